@@ -0,0 +1,154 @@
+#ifndef FILE_MAPPING
+#define FILE_MAPPING
+
+#include <cstddef>
+#ifdef _WIN32
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file, mapped straight from the page cache so callers can hand
+// the bytes (with their explicit length) to GL or the image decoder without copying.
+// On POSIX, truncating the file while it is mapped makes further access fault, so keep
+// mappings short-lived for files that may be edited.
+class FileMapping {
+	public:
+		FileMapping() = default;
+		explicit FileMapping(const char* path);
+		FileMapping(FileMapping&& other) noexcept;
+		FileMapping& operator=(FileMapping&& other) noexcept;
+		FileMapping(const FileMapping&) = delete;
+		FileMapping& operator=(const FileMapping&) = delete;
+		~FileMapping();
+
+		bool isOpen() const;
+		const char* data() const;
+		size_t size() const;
+		void prefault() const;
+
+	private:
+		const char* mappedData = nullptr;
+		size_t mappedSize = 0;
+		bool opened = false;
+
+		void release();
+};
+
+FileMapping::FileMapping(const char* path) {
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) return;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		CloseHandle(fileHandle);
+		return;
+	}
+	opened = true;
+	mappedSize = static_cast<size_t>(fileSize.QuadPart);
+	if (mappedSize > 0) {
+		HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mappingHandle != NULL) {
+			mappedData = static_cast<const char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mappingHandle);
+		}
+		if (mappedData == nullptr) {
+			opened = false;
+			mappedSize = 0;
+		}
+	}
+	CloseHandle(fileHandle);
+#else
+	int fileDescriptor = open(path, O_RDONLY | O_CLOEXEC);
+	if (fileDescriptor < 0) return;
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0) {
+		close(fileDescriptor);
+		return;
+	}
+	opened = true;
+	mappedSize = static_cast<size_t>(fileStatus.st_size);
+	if (mappedSize > 0) {
+		void* mapping = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		if (mapping == MAP_FAILED) {
+			opened = false;
+			mappedSize = 0;
+		} else {
+			mappedData = static_cast<const char*>(mapping);
+		}
+	}
+	close(fileDescriptor);
+#endif
+}
+
+FileMapping::FileMapping(FileMapping&& other) noexcept : mappedData(other.mappedData), mappedSize(other.mappedSize), opened(other.opened) {
+	other.mappedData = nullptr;
+	other.mappedSize = 0;
+	other.opened = false;
+}
+
+FileMapping& FileMapping::operator=(FileMapping&& other) noexcept {
+	if (this != &other) {
+		release();
+		mappedData = other.mappedData;
+		mappedSize = other.mappedSize;
+		opened = other.opened;
+		other.mappedData = nullptr;
+		other.mappedSize = 0;
+		other.opened = false;
+	}
+	return *this;
+}
+
+FileMapping::~FileMapping() {
+	release();
+}
+
+bool FileMapping::isOpen() const {
+	return opened;
+}
+
+const char* FileMapping::data() const {
+	// Empty files have no mapping; give callers a valid pointer anyway
+	return mappedData ? mappedData : "";
+}
+
+size_t FileMapping::size() const {
+	return mappedSize;
+}
+
+void FileMapping::prefault() const {
+	// Touch every page so the disk reads happen on the calling thread, not on first use
+#ifndef _WIN32
+	if (mappedData) madvise(const_cast<char*>(mappedData), mappedSize, MADV_WILLNEED);
+#endif
+	volatile char sink = 0;
+	for (size_t offset = 0; offset < mappedSize; offset += 4096) sink = sink + mappedData[offset];
+}
+
+void FileMapping::release() {
+	if (mappedData) {
+#ifdef _WIN32
+		UnmapViewOfFile(mappedData);
+#else
+		munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+	}
+	mappedData = nullptr;
+	mappedSize = 0;
+	opened = false;
+}
+
+#endif
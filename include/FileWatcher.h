@@ -0,0 +1,180 @@
+#ifndef FILE_WATCHER
+#define FILE_WATCHER
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// Watches individual files from a background thread and raises a per-file flag when one
+// is rewritten. watch() may be called before or after start(); a file registered while
+// the watcher runs is picked up within one poll interval. consumeChange() may be called
+// from any thread.
+class FileWatcher {
+	public:
+		FileWatcher() = default;
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+		~FileWatcher();
+
+		int watch(const char* path);
+		void start();
+		void stop();
+		bool consumeChange(int watchID);
+
+	private:
+		struct WatchedFile {
+			std::string directory;
+			std::string fileName;
+			std::atomic<bool> changed{ false };
+#ifdef _WIN32
+			__time64_t lastWriteTime = 0;
+#endif
+		};
+
+		std::vector<std::unique_ptr<WatchedFile>> files; // guarded by filesMutex once started
+		std::mutex filesMutex;
+		std::atomic<bool> stopping{ false };
+		std::thread watchThread;
+
+		void run();
+};
+
+FileWatcher::~FileWatcher() {
+	stop();
+}
+
+int FileWatcher::watch(const char* path) {
+	std::unique_ptr<WatchedFile> file(new WatchedFile());
+	std::string fullPath = path;
+	size_t separator = fullPath.find_last_of("/\\");
+	file->directory = separator == std::string::npos ? "." : fullPath.substr(0, separator);
+	file->fileName = separator == std::string::npos ? fullPath : fullPath.substr(separator + 1);
+#ifdef _WIN32
+	struct __stat64 fileStatus;
+	if (_stat64(path, &fileStatus) == 0) file->lastWriteTime = fileStatus.st_mtime;
+#endif
+	std::lock_guard<std::mutex> lock(filesMutex);
+	files.push_back(std::move(file));
+	return static_cast<int>(files.size()) - 1;
+}
+
+void FileWatcher::start() {
+	if (watchThread.joinable()) return;
+	stopping = false;
+	watchThread = std::thread(&FileWatcher::run, this);
+}
+
+void FileWatcher::stop() {
+	stopping = true;
+	if (watchThread.joinable()) watchThread.join();
+}
+
+bool FileWatcher::consumeChange(int watchID) {
+	std::lock_guard<std::mutex> lock(filesMutex);
+	return files[static_cast<size_t>(watchID)]->changed.exchange(false);
+}
+
+#ifdef _WIN32
+void FileWatcher::run() {
+	std::vector<std::string> directories;
+	std::vector<HANDLE> notifications;
+	size_t filesSeen = 0;
+	while (!stopping) {
+		{
+			std::lock_guard<std::mutex> lock(filesMutex);
+			for (; filesSeen < files.size(); ++filesSeen) {
+				const std::string& fileDirectory = files[filesSeen]->directory;
+				bool known = false;
+				for (const std::string& directory : directories) known = known || directory == fileDirectory;
+				if (known || notifications.size() == MAXIMUM_WAIT_OBJECTS) continue;
+
+				HANDLE notification = FindFirstChangeNotificationA(fileDirectory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+				if (notification == INVALID_HANDLE_VALUE) continue;
+				directories.push_back(fileDirectory);
+				notifications.push_back(notification);
+			}
+		}
+		if (notifications.empty()) {
+			Sleep(100);
+			continue;
+		}
+
+		DWORD signaled = WaitForMultipleObjects(static_cast<DWORD>(notifications.size()), notifications.data(), FALSE, 100);
+		if (signaled >= WAIT_OBJECT_0 + notifications.size()) continue;
+
+		// Directory notifications carry no file names, so compare write times instead
+		size_t index = signaled - WAIT_OBJECT_0;
+		std::lock_guard<std::mutex> lock(filesMutex);
+		for (const std::unique_ptr<WatchedFile>& file : files) {
+			if (file->directory != directories[index]) continue;
+			struct __stat64 fileStatus;
+			std::string path = file->directory + "/" + file->fileName;
+			if (_stat64(path.c_str(), &fileStatus) != 0 || fileStatus.st_mtime == file->lastWriteTime) continue;
+			file->lastWriteTime = fileStatus.st_mtime;
+			file->changed = true;
+		}
+		FindNextChangeNotification(notifications[index]);
+	}
+
+	for (HANDLE notification : notifications) FindCloseChangeNotification(notification);
+}
+#else
+void FileWatcher::run() {
+	int inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFD < 0) return;
+
+	// Editors either rewrite in place or write a temporary file and rename it over the original.
+	// IN_CREATE is left out: it fires before anything is written, so a reload would read an
+	// empty or half-written file.
+	std::vector<int> watchDescriptors;
+	alignas(inotify_event) char eventBuffer[4096];
+	while (!stopping) {
+		{
+			std::lock_guard<std::mutex> lock(filesMutex);
+			while (watchDescriptors.size() < files.size()) {
+				watchDescriptors.push_back(inotify_add_watch(inotifyFD, files[watchDescriptors.size()]->directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO));
+			}
+		}
+
+		pollfd pollDescriptor = { inotifyFD, POLLIN, 0 };
+		if (poll(&pollDescriptor, 1, 100) <= 0) continue;
+
+		std::lock_guard<std::mutex> lock(filesMutex);
+		ssize_t bytesRead;
+		while ((bytesRead = read(inotifyFD, eventBuffer, sizeof(eventBuffer))) > 0) {
+			for (char* cursor = eventBuffer; cursor < eventBuffer + bytesRead;) {
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+				for (size_t i = 0; i < files.size(); ++i) {
+					if (event->len > 0 && watchDescriptors[i] == event->wd && files[i]->fileName == event->name) files[i]->changed = true;
+				}
+				cursor += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+
+	close(inotifyFD);
+}
+#endif
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef GLEXTENSIONS
+#define GLEXTENSIONS
+
+#include <glad/glad.h>
+#include <cstring>
+
+// glad was generated for core 3.3 without extensions, so the few entry points we use
+// beyond that are declared and loaded here. Call loadGLExtensions() right after
+// gladLoadGLLoader(); every pointer stays NULL when the driver lacks the feature.
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+PFNGLGETPROGRAMBINARYPROC glextGetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glextProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glextProgramParameteri = NULL;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC glextMaxShaderCompilerThreads = NULL;
+PFNGLBUFFERSTORAGEPROC glextBufferStorage = NULL;
+
+bool GLEXT_program_binary = false;
+bool GLEXT_parallel_shader_compile = false;
+bool GLEXT_buffer_storage = false;
+
+bool hasGLExtension(const char* name) {
+	int extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (int i = 0; i < extensionCount; ++i) {
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<unsigned>(i)));
+		if (extension && std::strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+bool hasGLVersion(int major, int minor) {
+	int contextMajor = 0, contextMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+void loadGLExtensions(GLADloadproc loader) {
+	if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary")) {
+		glextGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(loader("glGetProgramBinary"));
+		glextProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(loader("glProgramBinary"));
+		glextProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(loader("glProgramParameteri"));
+
+		int binaryFormatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+		GLEXT_program_binary = glextGetProgramBinary && glextProgramBinary && glextProgramParameteri && binaryFormatCount > 0;
+	}
+
+	if (hasGLExtension("GL_KHR_parallel_shader_compile")) {
+		glextMaxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(loader("glMaxShaderCompilerThreadsKHR"));
+	} else if (hasGLExtension("GL_ARB_parallel_shader_compile")) {
+		glextMaxShaderCompilerThreads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(loader("glMaxShaderCompilerThreadsARB"));
+	}
+	if (glextMaxShaderCompilerThreads) {
+		// 0xFFFFFFFF lets the driver pick its own worker count
+		glextMaxShaderCompilerThreads(0xFFFFFFFFu);
+		GLEXT_parallel_shader_compile = true;
+	}
+
+	if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+		glextBufferStorage = reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(loader("glBufferStorage"));
+		GLEXT_buffer_storage = glextBufferStorage != NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef GL_OBJECTS
+#define GL_OBJECTS
+
+#include <glad/glad.h>
+#include <iostream>
+#include <vector>
+#include <atomic>
+
+// Debug builds count live objects per type so leaks show up at shutdown
+#if defined(_DEBUG) && !defined(GL_OBJECT_LEAK_TRACKING)
+#define GL_OBJECT_LEAK_TRACKING
+#endif
+
+struct VertexArrayTraits {
+	static const char* name() { return "VertexArray"; }
+	static void generate(int count, unsigned* ids) { glGenVertexArrays(count, ids); }
+	static void destroy(unsigned id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct BufferTraits {
+	static const char* name() { return "Buffer"; }
+	static void generate(int count, unsigned* ids) { glGenBuffers(count, ids); }
+	static void destroy(unsigned id) { glDeleteBuffers(1, &id); }
+};
+
+struct Texture2DTraits {
+	static const char* name() { return "Texture2D"; }
+	static void generate(int count, unsigned* ids) { glGenTextures(count, ids); }
+	static void destroy(unsigned id) { glDeleteTextures(1, &id); }
+};
+
+struct ProgramTraits {
+	static const char* name() { return "Program"; }
+	static void generate(int count, unsigned* ids) { for (int i = 0; i < count; ++i) ids[i] = glCreateProgram(); }
+	static void destroy(unsigned id) { glDeleteProgram(id); }
+};
+
+// Move-only owner of one GL object name; the same size as the raw unsigned handle.
+// A default-constructed object owns nothing (name 0).
+template <typename Traits>
+class GLObject {
+	public:
+		GLObject() = default;
+		explicit GLObject(unsigned adoptedID);
+		GLObject(GLObject&& other) noexcept;
+		GLObject& operator=(GLObject&& other) noexcept;
+		GLObject(const GLObject&) = delete;
+		GLObject& operator=(const GLObject&) = delete;
+		~GLObject();
+
+		static GLObject create();
+		static std::vector<GLObject> createMany(int count);
+		static int liveCount();
+
+		unsigned id() const;
+		unsigned release();
+		void reset();
+
+	private:
+		unsigned objectID = 0;
+
+#ifdef GL_OBJECT_LEAK_TRACKING
+		static std::atomic<int>& liveObjects();
+#endif
+};
+
+typedef GLObject<VertexArrayTraits> VertexArray;
+typedef GLObject<BufferTraits> Buffer;
+typedef GLObject<Texture2DTraits> Texture2D;
+typedef GLObject<ProgramTraits> Program;
+
+static_assert(sizeof(Buffer) == sizeof(unsigned), "GL object wrappers must stay as small as a raw handle");
+
+template <typename Traits>
+GLObject<Traits>::GLObject(unsigned adoptedID) : objectID(adoptedID) {
+#ifdef GL_OBJECT_LEAK_TRACKING
+	if (objectID != 0) ++liveObjects();
+#endif
+}
+
+template <typename Traits>
+GLObject<Traits>::GLObject(GLObject&& other) noexcept : objectID(other.objectID) {
+	other.objectID = 0;
+}
+
+template <typename Traits>
+GLObject<Traits>& GLObject<Traits>::operator=(GLObject&& other) noexcept {
+	if (this != &other) {
+		reset();
+		objectID = other.objectID;
+		other.objectID = 0;
+	}
+	return *this;
+}
+
+template <typename Traits>
+GLObject<Traits>::~GLObject() {
+	reset();
+}
+
+template <typename Traits>
+GLObject<Traits> GLObject<Traits>::create() {
+	unsigned newID = 0;
+	Traits::generate(1, &newID);
+	return GLObject(newID);
+}
+
+template <typename Traits>
+std::vector<GLObject<Traits>> GLObject<Traits>::createMany(int count) {
+	std::vector<unsigned> newIDs(static_cast<size_t>(count));
+	if (count > 0) Traits::generate(count, newIDs.data());
+
+	std::vector<GLObject> objects;
+	objects.reserve(newIDs.size());
+	for (unsigned newID : newIDs) objects.push_back(GLObject(newID));
+	return objects;
+}
+
+template <typename Traits>
+int GLObject<Traits>::liveCount() {
+#ifdef GL_OBJECT_LEAK_TRACKING
+	return liveObjects();
+#else
+	return 0;
+#endif
+}
+
+template <typename Traits>
+unsigned GLObject<Traits>::id() const {
+	return objectID;
+}
+
+template <typename Traits>
+unsigned GLObject<Traits>::release() {
+	unsigned releasedID = objectID;
+#ifdef GL_OBJECT_LEAK_TRACKING
+	if (objectID != 0) --liveObjects();
+#endif
+	objectID = 0;
+	return releasedID;
+}
+
+template <typename Traits>
+void GLObject<Traits>::reset() {
+	if (objectID == 0) return;
+	Traits::destroy(objectID);
+#ifdef GL_OBJECT_LEAK_TRACKING
+	--liveObjects();
+#endif
+	objectID = 0;
+}
+
+#ifdef GL_OBJECT_LEAK_TRACKING
+template <typename Traits>
+std::atomic<int>& GLObject<Traits>::liveObjects() {
+	static std::atomic<int> count(0);
+	return count;
+}
+#endif
+
+// Call after every owner has gone out of scope and before the context is destroyed.
+// Returns false (and names the types) if any wrapped object is still alive.
+bool reportGLObjectLeaks() {
+#ifdef GL_OBJECT_LEAK_TRACKING
+	const char* names[] = { VertexArrayTraits::name(), BufferTraits::name(), Texture2DTraits::name(), ProgramTraits::name() };
+	const int counts[] = { VertexArray::liveCount(), Buffer::liveCount(), Texture2D::liveCount(), Program::liveCount() };
+	bool clean = true;
+	for (int i = 0; i < 4; ++i) {
+		if (counts[i] == 0) continue;
+		std::cout << counts[i] << " " << names[i] << " object(s) still alive at shutdown" << std::endl;
+		clean = false;
+	}
+	return clean;
+#else
+	return true;
+#endif
+}
+
+#endif
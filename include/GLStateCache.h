@@ -0,0 +1,177 @@
+#ifndef GL_STATE_CACHE
+#define GL_STATE_CACHE
+
+#include <glad/glad.h>
+
+// Number of state-changing calls forwarded to the driver and dropped as no-ops.
+struct GLStateCounters {
+	unsigned long long issued;
+	unsigned long long filtered;
+};
+
+// Shadow copy of the bindings the render loop touches: current program, VAO, active
+// texture unit and per-unit texture bindings, non-indexed buffer bindings and polygon
+// mode. A call whose value matches the shadow is dropped before it reaches the driver.
+// Every shadow starts out unknown, so the first call always goes through. Code that
+// changes these bindings without going through the cache must call invalidate()
+// afterwards, and code that deletes a texture must call forgetTexture() first.
+class GLStateCache {
+	public:
+		static const unsigned MAX_TEXTURE_UNITS = 32;
+
+		GLStateCache();
+
+		void useProgram(unsigned programID);
+		void bindVertexArray(unsigned vertexArrayID);
+		void activeTexture(unsigned unit);
+		void bindTexture(unsigned unit, GLenum target, unsigned textureID);
+		void bindBuffer(GLenum target, unsigned bufferID);
+		void polygonMode(GLenum mode);
+		void forgetTexture(unsigned textureID);
+		void invalidate();
+
+		GLStateCounters counters() const;
+		GLStateCounters lastFrameCounters() const;
+		void endFrame();
+
+	private:
+		static const unsigned UNKNOWN = 0xFFFFFFFFu;
+		static const unsigned TEXTURE_TARGET_COUNT = 4;
+		static const unsigned BUFFER_TARGET_COUNT = 6;
+
+		unsigned currentProgram;
+		unsigned currentVertexArray;
+		unsigned currentTextureUnit;
+		unsigned textureBindings[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+		unsigned bufferBindings[BUFFER_TARGET_COUNT];
+		unsigned currentPolygonMode;
+
+		GLStateCounters totals;
+		GLStateCounters frameStart;
+		GLStateCounters lastFrame;
+
+		bool changed(unsigned& shadow, unsigned value);
+		static int textureTargetIndex(GLenum target);
+		static int bufferTargetIndex(GLenum target);
+};
+
+GLStateCache::GLStateCache() : totals{ 0, 0 }, frameStart{ 0, 0 }, lastFrame{ 0, 0 } {
+	invalidate();
+}
+
+void GLStateCache::useProgram(unsigned programID) {
+	if (changed(currentProgram, programID)) glUseProgram(programID);
+}
+
+void GLStateCache::bindVertexArray(unsigned vertexArrayID) {
+	if (!changed(currentVertexArray, vertexArrayID)) return;
+	glBindVertexArray(vertexArrayID);
+	// The element array binding is part of the VAO, so it changes along with it
+	bufferBindings[bufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+}
+
+void GLStateCache::activeTexture(unsigned unit) {
+	if (changed(currentTextureUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLStateCache::bindTexture(unsigned unit, GLenum target, unsigned textureID) {
+	int targetIndex = textureTargetIndex(target);
+	if (unit >= MAX_TEXTURE_UNITS || targetIndex < 0) {
+		activeTexture(unit);
+		glBindTexture(target, textureID);
+		++totals.issued;
+		return;
+	}
+	if (textureBindings[unit][targetIndex] == textureID) {
+		++totals.filtered;
+		return;
+	}
+	activeTexture(unit);
+	changed(textureBindings[unit][targetIndex], textureID);
+	glBindTexture(target, textureID);
+}
+
+void GLStateCache::bindBuffer(GLenum target, unsigned bufferID) {
+	int targetIndex = bufferTargetIndex(target);
+	if (targetIndex < 0) {
+		glBindBuffer(target, bufferID);
+		++totals.issued;
+		return;
+	}
+	if (changed(bufferBindings[targetIndex], bufferID)) glBindBuffer(target, bufferID);
+}
+
+void GLStateCache::polygonMode(GLenum mode) {
+	if (changed(currentPolygonMode, mode)) glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLStateCache::forgetTexture(unsigned textureID) {
+	// Deleting a bound texture reverts its bindings to 0. Keeping the old name would filter
+	// out the first bind of a new texture that the driver hands the same name.
+	if (textureID == 0) return;
+	for (unsigned unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+		for (unsigned target = 0; target < TEXTURE_TARGET_COUNT; ++target) {
+			if (textureBindings[unit][target] == textureID) textureBindings[unit][target] = 0;
+		}
+	}
+}
+
+void GLStateCache::invalidate() {
+	currentProgram = UNKNOWN;
+	currentVertexArray = UNKNOWN;
+	currentTextureUnit = UNKNOWN;
+	for (unsigned unit = 0; unit < MAX_TEXTURE_UNITS; ++unit) {
+		for (unsigned target = 0; target < TEXTURE_TARGET_COUNT; ++target) textureBindings[unit][target] = UNKNOWN;
+	}
+	for (unsigned target = 0; target < BUFFER_TARGET_COUNT; ++target) bufferBindings[target] = UNKNOWN;
+	currentPolygonMode = UNKNOWN;
+}
+
+GLStateCounters GLStateCache::counters() const {
+	return totals;
+}
+
+GLStateCounters GLStateCache::lastFrameCounters() const {
+	return lastFrame;
+}
+
+void GLStateCache::endFrame() {
+	lastFrame.issued = totals.issued - frameStart.issued;
+	lastFrame.filtered = totals.filtered - frameStart.filtered;
+	frameStart = totals;
+}
+
+bool GLStateCache::changed(unsigned& shadow, unsigned value) {
+	if (shadow == value) {
+		++totals.filtered;
+		return false;
+	}
+	shadow = value;
+	++totals.issued;
+	return true;
+}
+
+int GLStateCache::textureTargetIndex(GLenum target) {
+	switch (target) {
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_CUBE_MAP: return 1;
+		case GL_TEXTURE_2D_ARRAY: return 2;
+		case GL_TEXTURE_3D: return 3;
+		default: return -1;
+	}
+}
+
+int GLStateCache::bufferTargetIndex(GLenum target) {
+	// GL_UNIFORM_BUFFER is left out: glBindBufferRange also moves its generic binding
+	switch (target) {
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_ELEMENT_ARRAY_BUFFER: return 1;
+		case GL_PIXEL_UNPACK_BUFFER: return 2;
+		case GL_PIXEL_PACK_BUFFER: return 3;
+		case GL_COPY_READ_BUFFER: return 4;
+		case GL_COPY_WRITE_BUFFER: return 5;
+		default: return -1;
+	}
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef PROGRAM_BINARY_CACHE
+#define PROGRAM_BINARY_CACHE
+
+#include <glad/glad.h>
+#include "GLExtensions.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries. Entries are keyed by a hash of the shader
+// sources together with the driver's vendor/renderer/version strings, so a driver
+// update or an edited shader simply misses and falls back to compiling from source.
+class ProgramBinaryCache {
+	public:
+		static void setDirectory(const char* newDirectory);
+		static unsigned long long makeKey(const char* vShaderCode, size_t vShaderLength, const char* fShaderCode, size_t fShaderLength);
+		static unsigned load(unsigned long long key);
+		static void prepareForLink(unsigned programID);
+		static void store(unsigned programID, unsigned long long key);
+		static unsigned long long hashBytes(unsigned long long hash, const char* bytes, size_t length);
+
+	private:
+		struct EntryHeader {
+			char magic[4];
+			unsigned formatVersion;
+			unsigned long long key;
+			unsigned binaryFormat;
+			unsigned binaryLength;
+		};
+
+		static std::string directory;
+
+		static std::string entryPath(unsigned long long key);
+		static bool ensureDirectory();
+};
+
+std::string ProgramBinaryCache::directory = "shader_cache";
+
+void ProgramBinaryCache::setDirectory(const char* newDirectory) {
+	directory = newDirectory;
+}
+
+unsigned long long ProgramBinaryCache::makeKey(const char* vShaderCode, size_t vShaderLength, const char* fShaderCode, size_t fShaderLength) {
+	const char* driverStrings[] = {
+		reinterpret_cast<const char*>(glGetString(GL_VENDOR)),
+		reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+		reinterpret_cast<const char*>(glGetString(GL_VERSION)),
+	};
+
+	// FNV-1a 64; the separator keeps "ab"+"c" and "a"+"bc" from colliding
+	unsigned long long hash = 14695981039346656037ull;
+	hash = hashBytes(hash, vShaderCode, vShaderLength);
+	hash = hashBytes(hash, "\0", 1);
+	hash = hashBytes(hash, fShaderCode, fShaderLength);
+	for (const char* driverString : driverStrings) {
+		hash = hashBytes(hash, "\0", 1);
+		if (driverString) hash = hashBytes(hash, driverString, std::strlen(driverString));
+	}
+	return hash;
+}
+
+unsigned ProgramBinaryCache::load(unsigned long long key) {
+	if (!GLEXT_program_binary) return 0;
+
+	std::ifstream entryFile(entryPath(key), std::ios::binary);
+	if (!entryFile) return 0;
+
+	EntryHeader header;
+	if (!entryFile.read(reinterpret_cast<char*>(&header), sizeof(header))) return 0;
+	if (std::memcmp(header.magic, "LOPB", 4) != 0 || header.formatVersion != 1 || header.key != key) return 0;
+
+	// A corrupt length must not turn into a huge allocation; the binary has to fit in the file
+	std::streamoff binaryStart = entryFile.tellg();
+	entryFile.seekg(0, std::ios::end);
+	std::streamoff remaining = entryFile.tellg() - binaryStart;
+	if (binaryStart < 0 || header.binaryLength == 0 || static_cast<std::streamoff>(header.binaryLength) > remaining) return 0;
+	entryFile.seekg(binaryStart);
+
+	std::vector<char> binary(header.binaryLength);
+	if (!entryFile.read(binary.data(), static_cast<std::streamsize>(binary.size()))) return 0;
+
+	unsigned programID = glCreateProgram();
+	glextProgramBinary(programID, header.binaryFormat, binary.data(), static_cast<int>(binary.size()));
+
+	// The driver may reject a binary even when every key string matches
+	int success = 0;
+	glGetProgramiv(programID, GL_LINK_STATUS, &success);
+	if (!success) {
+		glDeleteProgram(programID);
+		return 0;
+	}
+	return programID;
+}
+
+void ProgramBinaryCache::prepareForLink(unsigned programID) {
+	if (GLEXT_program_binary) glextProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramBinaryCache::store(unsigned programID, unsigned long long key) {
+	if (!GLEXT_program_binary || !ensureDirectory()) return;
+
+	int binaryLength = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if (binaryLength <= 0) return;
+
+	std::vector<char> binary(static_cast<size_t>(binaryLength));
+	GLenum binaryFormat = 0;
+	glextGetProgramBinary(programID, binaryLength, &binaryLength, &binaryFormat, binary.data());
+
+	EntryHeader header;
+	std::memcpy(header.magic, "LOPB", 4);
+	header.formatVersion = 1;
+	header.key = key;
+	header.binaryFormat = binaryFormat;
+	header.binaryLength = static_cast<unsigned>(binaryLength);
+
+	// Write to a temporary file first so a crash never leaves a truncated entry behind
+	std::string path = entryPath(key);
+	std::string temporaryPath = path + ".tmp";
+	std::ofstream entryFile(temporaryPath, std::ios::binary | std::ios::trunc);
+	entryFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	entryFile.write(binary.data(), binaryLength);
+	entryFile.close();
+	if (!entryFile) {
+		std::cout << "Program binary cache write failed: " << temporaryPath << std::endl;
+		std::remove(temporaryPath.c_str());
+		return;
+	}
+	std::remove(path.c_str());
+	std::rename(temporaryPath.c_str(), path.c_str());
+}
+
+std::string ProgramBinaryCache::entryPath(unsigned long long key) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", key);
+	return directory + "/" + name;
+}
+
+unsigned long long ProgramBinaryCache::hashBytes(unsigned long long hash, const char* bytes, size_t length) {
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= static_cast<unsigned char>(bytes[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool ProgramBinaryCache::ensureDirectory() {
+#ifdef _WIN32
+	int result = _mkdir(directory.c_str());
+#else
+	int result = mkdir(directory.c_str(), 0755);
+#endif
+	return result == 0 || errno == EEXIST;
+}
+
+#endif
@@ -2,88 +2,226 @@
 #define SHADER
 
 #include <glad/glad.h>
+#include "ProgramBinaryCache.h"
+#include "ShaderPreprocessor.h"
+#include "GLObjects.h"
+#include "GLStateCache.h"
 #include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
+#include <cstring>
+
+struct UniformHandle {
+	int location;
+};
 
 class Shader {
 	public:
-		unsigned programID;
-
 		Shader(const char* vShader, const char* fShader);
-		void use() const;
-		void kill() const;
+		Shader(const ShaderSource& vShaderSource, const ShaderSource& fShaderSource);
+		explicit Shader(unsigned linkedProgramID);
+		unsigned programID() const;
+		void use(GLStateCache& glState) const;
+		void kill();
+		UniformHandle getUniformHandle(const char* name) const;
+		void bindUniformBlock(const char* blockName, unsigned bindingIndex) const;
 		void setUniform(const char* name, const bool newValue) const;
 		void setUniform(const char* name, const int newValue) const;
 		void setUniform(const char* name, const float newValue) const;
+		void setUniform(UniformHandle handle, const bool newValue) const;
+		void setUniform(UniformHandle handle, const int newValue) const;
+		void setUniform(UniformHandle handle, const float newValue) const;
 
 	private:
-		static bool checkShaderCompilationSuccess(unsigned shaderID, const char* shaderType, bool isShaderProgram);
+		friend class ShaderCompiler;
+
+		Program program;
+
+		struct UniformSlot {
+			unsigned hash;
+			int entry; // index into uniformNames/uniformLocations, -1 when empty
+		};
+
+		// Open-addressed by name hash and at most half full, so a lookup usually hashes the
+		// name and compares one slot, without the hard-to-predict branches of a binary search.
+		std::vector<UniformSlot> uniformSlots;
+		std::vector<int> uniformLocations;
+		std::vector<std::string> uniformNames;
+
+		void cacheActiveUniforms();
+		int findUniformLocation(const char* name) const;
+		static unsigned hashUniformName(const char* name);
+		static bool checkShaderCompilationSuccess(unsigned shaderID, const char* shaderType, bool isShaderProgram, const ShaderSource* source = NULL);
 };
 
-Shader::Shader(const char* vShader, const char* fShader) {
-	std::ifstream vShaderFile(vShader);
-	std::ifstream fShaderFile(fShader);
-	std::stringstream streamIn;
-	std::string vShaderCodeString;
-	std::string fShaderCodeString;
-	const char* vShaderCode;
-	const char* fShaderCode;
+Shader::Shader(const char* vShader, const char* fShader) : Shader(ShaderSource::load(vShader), ShaderSource::load(fShader)) {
+}
+
+Shader::Shader(const ShaderSource& vShaderSource, const ShaderSource& fShaderSource) {
+	const char* vShaderCode = vShaderSource.data();
+	const char* fShaderCode = fShaderSource.data();
+	const int vShaderLength = static_cast<int>(vShaderSource.size());
+	const int fShaderLength = static_cast<int>(fShaderSource.size());
+
+	unsigned long long binaryKey = ProgramBinaryCache::makeKey(vShaderCode, vShaderSource.size(), fShaderCode, fShaderSource.size());
+	program = Program(ProgramBinaryCache::load(binaryKey));
+	if (program.id() != 0) {
+		cacheActiveUniforms();
+		return;
+	}
 
 	unsigned vShaderID;
 	vShaderID = glCreateShader(GL_VERTEX_SHADER);
-	streamIn << vShaderFile.rdbuf();
-	vShaderCodeString = streamIn.str();
-	vShaderCode = vShaderCodeString.c_str();
-	glShaderSource(vShaderID, 1, &vShaderCode, NULL);
+	glShaderSource(vShaderID, 1, &vShaderCode, &vShaderLength);
 	glCompileShader(vShaderID);
-	checkShaderCompilationSuccess(vShaderID, "Vertex", false);
+	checkShaderCompilationSuccess(vShaderID, "Vertex", false, &vShaderSource);
 
 	unsigned fShaderID;
 	fShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-	streamIn.str("");
-	streamIn << fShaderFile.rdbuf();
-	fShaderCodeString = streamIn.str();
-	fShaderCode = fShaderCodeString.c_str();
-	glShaderSource(fShaderID, 1, &fShaderCode, NULL);
+	glShaderSource(fShaderID, 1, &fShaderCode, &fShaderLength);
 	glCompileShader(fShaderID);
-	checkShaderCompilationSuccess(fShaderID, "Fragment", false);
+	checkShaderCompilationSuccess(fShaderID, "Fragment", false, &fShaderSource);
 
-	vShaderFile.close();
-	fShaderFile.close();
-
-	programID = glCreateProgram();
-	glAttachShader(programID, vShaderID);
-	glAttachShader(programID, fShaderID);
-	glLinkProgram(programID);
-	checkShaderCompilationSuccess(programID, "Shader program", true);
+	program = Program::create();
+	glAttachShader(program.id(), vShaderID);
+	glAttachShader(program.id(), fShaderID);
+	ProgramBinaryCache::prepareForLink(program.id());
+	glLinkProgram(program.id());
+	if (checkShaderCompilationSuccess(program.id(), "Shader program", true)) ProgramBinaryCache::store(program.id(), binaryKey);
 
 	glDeleteShader(vShaderID);
 	glDeleteShader(fShaderID);
+
+	cacheActiveUniforms();
 }
 
-void Shader::use() const {
-	glUseProgram(programID);
+Shader::Shader(unsigned linkedProgramID) : program(linkedProgramID) {
+	cacheActiveUniforms();
 }
 
-void Shader::kill() const {
-	glDeleteProgram(programID);
+unsigned Shader::programID() const {
+	return program.id();
+}
+
+void Shader::use(GLStateCache& glState) const {
+	glState.useProgram(program.id());
+}
+
+void Shader::kill() {
+	program.reset();
+}
+
+UniformHandle Shader::getUniformHandle(const char* name) const {
+	return UniformHandle{ findUniformLocation(name) };
+}
+
+void Shader::bindUniformBlock(const char* blockName, unsigned bindingIndex) const {
+	unsigned blockIndex = glGetUniformBlockIndex(program.id(), blockName);
+	if (blockIndex != GL_INVALID_INDEX) glUniformBlockBinding(program.id(), blockIndex, bindingIndex);
 }
 
 void Shader::setUniform(const char* name, const bool newValue) const {
-	glUniform1i(glGetUniformLocation(programID, name), static_cast<int>(newValue));
+	glUniform1i(findUniformLocation(name), static_cast<int>(newValue));
 }
 
 void Shader::setUniform(const char* name, const int newValue) const {
-	glUniform1i(glGetUniformLocation(programID, name), newValue);
+	glUniform1i(findUniformLocation(name), newValue);
 }
 
 void Shader::setUniform(const char* name, const float newValue) const {
-	glUniform1f(glGetUniformLocation(programID, name), newValue);
+	glUniform1f(findUniformLocation(name), newValue);
+}
+
+void Shader::setUniform(UniformHandle handle, const bool newValue) const {
+	glUniform1i(handle.location, static_cast<int>(newValue));
+}
+
+void Shader::setUniform(UniformHandle handle, const int newValue) const {
+	glUniform1i(handle.location, newValue);
+}
+
+void Shader::setUniform(UniformHandle handle, const float newValue) const {
+	glUniform1f(handle.location, newValue);
+}
+
+void Shader::cacheActiveUniforms() {
+	uniformSlots.clear();
+	uniformLocations.clear();
+	uniformNames.clear();
+
+	int uniformCount = 0;
+	int maxNameLength = 0;
+	glGetProgramiv(program.id(), GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program.id(), GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	if (uniformCount <= 0) return;
+
+	// Every reported name is registered as is. An array whose last subscript is reported as
+	// "name[0]" is also registered under "name" and every other element; arrays of structs
+	// are reported per element and member ("lights[1].pos"), so they need no expansion.
+	std::vector<std::string> names;
+	std::vector<int> locations;
+	std::vector<char> nameBuffer(static_cast<size_t>(maxNameLength) + 1);
+	for (int i = 0; i < uniformCount; ++i) {
+		int nameLength = 0, arraySize = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program.id(), static_cast<unsigned>(i), maxNameLength, &nameLength, &arraySize, &type, nameBuffer.data());
+		std::string name(nameBuffer.data(), static_cast<size_t>(nameLength));
+
+		int location = glGetUniformLocation(program.id(), name.c_str());
+		if (location == -1) continue; // members of uniform blocks have no location
+
+		names.push_back(name);
+		locations.push_back(location);
+		const size_t suffixLength = 3; // "[0]"
+		if (name.size() <= suffixLength || name.compare(name.size() - suffixLength, suffixLength, "[0]") != 0) continue;
+
+		std::string baseName = name.substr(0, name.size() - suffixLength);
+		names.push_back(baseName);
+		locations.push_back(location);
+		for (int element = 1; element < arraySize; ++element) {
+			std::string elementName = baseName + "[" + std::to_string(element) + "]";
+			names.push_back(elementName);
+			locations.push_back(glGetUniformLocation(program.id(), elementName.c_str()));
+		}
+	}
+
+	size_t slotCount = 1;
+	while (slotCount < names.size() * 2) slotCount *= 2;
+	uniformSlots.assign(slotCount, UniformSlot{ 0, -1 });
+	for (size_t i = 0; i < names.size(); ++i) {
+		unsigned hash = hashUniformName(names[i].c_str());
+		size_t slot = hash & (slotCount - 1);
+		while (uniformSlots[slot].entry >= 0) slot = (slot + 1) & (slotCount - 1);
+		uniformSlots[slot] = UniformSlot{ hash, static_cast<int>(i) };
+	}
+	uniformLocations.swap(locations);
+	uniformNames.swap(names);
+}
+
+int Shader::findUniformLocation(const char* name) const {
+	if (!uniformSlots.empty()) {
+		unsigned hash = hashUniformName(name);
+		size_t mask = uniformSlots.size() - 1;
+		for (size_t slot = hash & mask; uniformSlots[slot].entry >= 0; slot = (slot + 1) & mask) {
+			const UniformSlot& candidate = uniformSlots[slot];
+			if (candidate.hash == hash && std::strcmp(uniformNames[candidate.entry].c_str(), name) == 0) return uniformLocations[candidate.entry];
+		}
+	}
+	// Any other spelling GL accepts (arrays of arrays, for one) is left to the driver
+	return glGetUniformLocation(program.id(), name);
+}
+
+unsigned Shader::hashUniformName(const char* name) {
+	// FNV-1a
+	unsigned hash = 2166136261u;
+	for (; *name; ++name) {
+		hash ^= static_cast<unsigned char>(*name);
+		hash *= 16777619u;
+	}
+	return hash;
 }
 
-bool Shader::checkShaderCompilationSuccess(unsigned shaderID, const char* shaderType, bool isShaderProgram) {
+bool Shader::checkShaderCompilationSuccess(unsigned shaderID, const char* shaderType, bool isShaderProgram, const ShaderSource* source) {
 	int success = 1;
 	char errorMessage[512];
 	if (isShaderProgram) glGetProgramiv(shaderID, GL_LINK_STATUS, &success);
@@ -92,7 +230,8 @@ bool Shader::checkShaderCompilationSuccess(unsigned shaderID, const char* shader
 	if (!success) {
 		if (isShaderProgram) glGetProgramInfoLog(shaderID, 512, NULL, errorMessage);
 		else glGetShaderInfoLog(shaderID, 512, NULL, errorMessage);
-		std::cout << shaderType << " shader compilation failed. Error:" << errorMessage << std::endl;
+		if (source) std::cout << shaderType << " shader compilation failed. Error:" << source->remapLog(errorMessage) << std::endl;
+		else std::cout << shaderType << " shader compilation failed. Error:" << errorMessage << std::endl;
 		return false;
 	}
 	return true;
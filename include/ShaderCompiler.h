@@ -0,0 +1,328 @@
+#ifndef SHADER_COMPILER
+#define SHADER_COMPILER
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "GLExtensions.h"
+#include "ProgramBinaryCache.h"
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+#include <string>
+#include <future>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class ShaderCompiler;
+
+struct ShaderJob {
+	std::string vShaderPath;
+	std::string fShaderPath;
+	std::future<ShaderSource> vShaderLoad;
+	std::future<ShaderSource> fShaderLoad;
+	ShaderSource vShaderSource;
+	ShaderSource fShaderSource;
+	unsigned vShaderID = 0;
+	unsigned fShaderID = 0;
+	unsigned programID = 0;
+	unsigned long long binaryKey = 0;
+	bool submitted = false;
+	bool fromBinaryCache = false;
+	bool sourcesMayChange = false;
+	bool background = false;
+	std::atomic<bool> compiled{ false }; // background jobs: linked and fenced on the compile thread
+	GLsync compiledFence = nullptr;
+	std::unique_ptr<Shader> result;
+	ShaderCompiler* owner = nullptr;
+};
+
+// Future-like view of a queued program. get() blocks until the program is linked,
+// isReady() never does when GL_KHR_parallel_shader_compile is available or the compiler
+// compiles in the background.
+class ShaderHandle {
+	public:
+		ShaderHandle() = default;
+		explicit ShaderHandle(std::shared_ptr<ShaderJob> job);
+		bool valid() const;
+		bool isReady() const;
+		Shader& get();
+
+	private:
+		std::shared_ptr<ShaderJob> job;
+};
+
+// Batches program creation: queue() starts reading the source files on worker threads
+// and submit() issues every glCompileShader and glLinkProgram before anything asks the
+// driver for a status, so the driver (and its compiler threads, if any) can work on all
+// of them while the application keeps going. Sources that may be edited while the job is
+// pending (hot reloads) should be queued with sourcesMayChange, which reads them into memory
+// instead of mapping them. The compiler must outlive its handles.
+//
+// Without that extension a status query waits for the compile, so there is no way to poll
+// one from the render thread. compileInBackground() moves every later job to a thread with
+// its own context sharing objects with the render context. That thread waits for the link
+// and then signals a fence, which isReady() polls.
+class ShaderCompiler {
+	public:
+		ShaderCompiler() = default;
+		ShaderCompiler(const ShaderCompiler&) = delete;
+		ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+		~ShaderCompiler();
+
+		bool compileInBackground(GLFWwindow* renderWindow);
+		ShaderHandle queue(const char* vShader, const char* fShader, bool sourcesMayChange = false);
+		bool sourcesLoaded() const;
+		void submit();
+		void finishAll();
+
+	private:
+		friend class ShaderHandle;
+
+		std::vector<std::shared_ptr<ShaderJob>> pendingJobs;
+		std::vector<std::shared_ptr<ShaderJob>> submittedJobs;
+
+		GLFWwindow* compileWindow = nullptr; // hidden; only its context is used
+		std::thread compileThread;
+		std::mutex compileMutex;
+		std::condition_variable compileRequested;
+		std::condition_variable compileFinished;
+		std::deque<std::shared_ptr<ShaderJob>> compileQueue;
+		bool stopping = false;
+
+		void runCompileThread();
+
+		static ShaderSource loadShaderSource(std::string path, bool copyToMemory);
+		static unsigned startCompile(GLenum shaderType, const ShaderSource& shaderCode);
+		static void finish(ShaderJob& job);
+		static void compileAndLink(ShaderJob& job);
+};
+
+ShaderHandle::ShaderHandle(std::shared_ptr<ShaderJob> job) : job(std::move(job)) {
+}
+
+bool ShaderHandle::valid() const {
+	return job != nullptr;
+}
+
+bool ShaderHandle::isReady() const {
+	if (job->result) return true;
+	if (job->background) {
+		if (!job->compiled.load(std::memory_order_acquire)) return false;
+		// The fence also makes the compile thread's changes to the program visible here
+		GLenum fenceStatus = glClientWaitSync(job->compiledFence, 0, 0);
+		return fenceStatus == GL_ALREADY_SIGNALED || fenceStatus == GL_CONDITION_SATISFIED;
+	}
+	if (!job->submitted) return false;
+	if (job->fromBinaryCache) return true;
+
+	// Without the extension the status query would block, so report ready and let get() wait
+	if (!GLEXT_parallel_shader_compile) return true;
+	int complete = 0;
+	glGetProgramiv(job->programID, GL_COMPLETION_STATUS_KHR, &complete);
+	return complete != 0;
+}
+
+Shader& ShaderHandle::get() {
+	if (job->background && !job->result) {
+		std::unique_lock<std::mutex> lock(job->owner->compileMutex);
+		job->owner->compileFinished.wait(lock, [this]() { return job->compiled.load(); });
+	}
+	if (!job->submitted) job->owner->submit();
+	if (!job->result) ShaderCompiler::finish(*job);
+	return *job->result;
+}
+
+ShaderCompiler::~ShaderCompiler() {
+	if (!compileThread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(compileMutex);
+		stopping = true;
+	}
+	compileRequested.notify_one();
+	compileThread.join();
+	glfwDestroyWindow(compileWindow);
+	for (const std::shared_ptr<ShaderJob>& job : submittedJobs) {
+		if (job->compiledFence) glDeleteSync(job->compiledFence);
+	}
+}
+
+bool ShaderCompiler::compileInBackground(GLFWwindow* renderWindow) {
+	// Called from the render thread, which GLFW requires for window creation; the hints
+	// given for the render window still apply, so the two contexts are compatible
+	if (compileThread.joinable()) return true;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	compileWindow = glfwCreateWindow(1, 1, "", NULL, renderWindow);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (compileWindow == NULL) {
+		std::cout << "Could not create a shared context for background shader compiles" << std::endl;
+		return false;
+	}
+	compileThread = std::thread(&ShaderCompiler::runCompileThread, this);
+	return true;
+}
+
+ShaderHandle ShaderCompiler::queue(const char* vShader, const char* fShader, bool sourcesMayChange) {
+	std::shared_ptr<ShaderJob> job = std::make_shared<ShaderJob>();
+	job->vShaderPath = vShader;
+	job->fShaderPath = fShader;
+	job->sourcesMayChange = sourcesMayChange;
+	job->owner = this;
+	if (compileThread.joinable()) {
+		// The compile thread reads the sources itself; to submit() the job is already done
+		job->background = true;
+		job->submitted = true;
+		{
+			std::lock_guard<std::mutex> lock(compileMutex);
+			compileQueue.push_back(job);
+		}
+		compileRequested.notify_one();
+		submittedJobs.push_back(job);
+		return ShaderHandle(job);
+	}
+	job->vShaderLoad = std::async(std::launch::async, loadShaderSource, job->vShaderPath, sourcesMayChange);
+	job->fShaderLoad = std::async(std::launch::async, loadShaderSource, job->fShaderPath, sourcesMayChange);
+	pendingJobs.push_back(job);
+	return ShaderHandle(job);
+}
+
+bool ShaderCompiler::sourcesLoaded() const {
+	for (const std::shared_ptr<ShaderJob>& job : pendingJobs) {
+		if (job->vShaderLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		if (job->fShaderLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+	}
+	return true;
+}
+
+void ShaderCompiler::submit() {
+	// Compile every stage first, then link; nothing here queries a status
+	for (const std::shared_ptr<ShaderJob>& job : pendingJobs) {
+		job->vShaderSource = job->vShaderLoad.get();
+		job->fShaderSource = job->fShaderLoad.get();
+
+		job->binaryKey = ProgramBinaryCache::makeKey(job->vShaderSource.data(), job->vShaderSource.size(), job->fShaderSource.data(), job->fShaderSource.size());
+		job->programID = ProgramBinaryCache::load(job->binaryKey);
+		if (job->programID != 0) {
+			job->fromBinaryCache = true;
+			job->vShaderSource = ShaderSource();
+			job->fShaderSource = ShaderSource();
+			continue;
+		}
+		job->vShaderID = startCompile(GL_VERTEX_SHADER, job->vShaderSource);
+		job->fShaderID = startCompile(GL_FRAGMENT_SHADER, job->fShaderSource);
+	}
+
+	for (const std::shared_ptr<ShaderJob>& job : pendingJobs) {
+		job->submitted = true;
+		if (job->fromBinaryCache) continue;
+		job->programID = glCreateProgram();
+		glAttachShader(job->programID, job->vShaderID);
+		glAttachShader(job->programID, job->fShaderID);
+		ProgramBinaryCache::prepareForLink(job->programID);
+		glLinkProgram(job->programID);
+	}
+
+	// Jobs already resolved through their handles are not needed for finishAll()
+	submittedJobs.erase(std::remove_if(submittedJobs.begin(), submittedJobs.end(),
+		[](const std::shared_ptr<ShaderJob>& job) { return job->result != nullptr; }), submittedJobs.end());
+	submittedJobs.insert(submittedJobs.end(), pendingJobs.begin(), pendingJobs.end());
+	pendingJobs.clear();
+}
+
+void ShaderCompiler::finishAll() {
+	submit();
+	for (const std::shared_ptr<ShaderJob>& job : submittedJobs) {
+		if (!job->result) ShaderHandle(job).get();
+	}
+	submittedJobs.clear();
+}
+
+void ShaderCompiler::runCompileThread() {
+	glfwMakeContextCurrent(compileWindow);
+	while (true) {
+		std::shared_ptr<ShaderJob> job;
+		{
+			std::unique_lock<std::mutex> lock(compileMutex);
+			compileRequested.wait(lock, [this]() { return stopping || !compileQueue.empty(); });
+			if (stopping) break;
+			job = std::move(compileQueue.front());
+			compileQueue.pop_front();
+		}
+
+		compileAndLink(*job);
+		job->compiledFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		{
+			std::lock_guard<std::mutex> lock(compileMutex);
+			job->compiled.store(true, std::memory_order_release);
+		}
+		compileFinished.notify_all();
+	}
+	glfwMakeContextCurrent(NULL);
+}
+
+void ShaderCompiler::compileAndLink(ShaderJob& job) {
+	// Everything here may wait on the driver; it runs on the compile thread only
+	job.vShaderSource = loadShaderSource(job.vShaderPath, job.sourcesMayChange);
+	job.fShaderSource = loadShaderSource(job.fShaderPath, job.sourcesMayChange);
+	job.binaryKey = ProgramBinaryCache::makeKey(job.vShaderSource.data(), job.vShaderSource.size(), job.fShaderSource.data(), job.fShaderSource.size());
+	job.programID = ProgramBinaryCache::load(job.binaryKey);
+	job.fromBinaryCache = job.programID != 0;
+	if (!job.fromBinaryCache) {
+		job.vShaderID = startCompile(GL_VERTEX_SHADER, job.vShaderSource);
+		job.fShaderID = startCompile(GL_FRAGMENT_SHADER, job.fShaderSource);
+		job.programID = glCreateProgram();
+		glAttachShader(job.programID, job.vShaderID);
+		glAttachShader(job.programID, job.fShaderID);
+		ProgramBinaryCache::prepareForLink(job.programID);
+		glLinkProgram(job.programID);
+		Shader::checkShaderCompilationSuccess(job.vShaderID, "Vertex", false, &job.vShaderSource);
+		Shader::checkShaderCompilationSuccess(job.fShaderID, "Fragment", false, &job.fShaderSource);
+		if (Shader::checkShaderCompilationSuccess(job.programID, "Shader program", true)) ProgramBinaryCache::store(job.programID, job.binaryKey);
+		glDeleteShader(job.vShaderID);
+		glDeleteShader(job.fShaderID);
+		job.vShaderID = 0;
+		job.fShaderID = 0;
+	}
+	job.vShaderSource = ShaderSource();
+	job.fShaderSource = ShaderSource();
+}
+
+ShaderSource ShaderCompiler::loadShaderSource(std::string path, bool copyToMemory) {
+	return copyToMemory ? ShaderSource::read(path.c_str()) : ShaderSource::load(path.c_str());
+}
+
+unsigned ShaderCompiler::startCompile(GLenum shaderType, const ShaderSource& shaderCode) {
+	const char* code = shaderCode.data();
+	const int length = static_cast<int>(shaderCode.size());
+	unsigned shaderID = glCreateShader(shaderType);
+	glShaderSource(shaderID, 1, &code, &length);
+	glCompileShader(shaderID);
+	return shaderID;
+}
+
+void ShaderCompiler::finish(ShaderJob& job) {
+	if (job.background) {
+		glWaitSync(job.compiledFence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(job.compiledFence);
+		job.compiledFence = nullptr;
+	} else if (!job.fromBinaryCache) {
+		Shader::checkShaderCompilationSuccess(job.vShaderID, "Vertex", false, &job.vShaderSource);
+		Shader::checkShaderCompilationSuccess(job.fShaderID, "Fragment", false, &job.fShaderSource);
+		if (Shader::checkShaderCompilationSuccess(job.programID, "Shader program", true)) ProgramBinaryCache::store(job.programID, job.binaryKey);
+		glDeleteShader(job.vShaderID);
+		glDeleteShader(job.fShaderID);
+		job.vShaderID = 0;
+		job.fShaderID = 0;
+		job.vShaderSource = ShaderSource();
+		job.fShaderSource = ShaderSource();
+	}
+	job.result.reset(new Shader(job.programID));
+}
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef SHADER_HOT_RELOADER
+#define SHADER_HOT_RELOADER
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "GLExtensions.h"
+#include "FileWatcher.h"
+#include "Shader.h"
+#include "ShaderCompiler.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Recompiles watched programs when their source files, or any file they #include, change.
+// The include set is resolved again after every reload, so a newly added #include is
+// watched from then on. The file watcher and the source reads run on background threads;
+// update() is called once per frame and never waits: it submits a reload once the sources are in memory and swaps the program in
+// only when the driver reports the link as complete. Drivers without
+// GL_KHR_parallel_shader_compile cannot report that without blocking, so on those the
+// reloads are compiled on a background context instead. A failed reload leaves the
+// previous program in place.
+class ShaderHotReloader {
+	public:
+		void watch(Shader& shader, const char* vShader, const char* fShader);
+		void start(GLFWwindow* renderWindow);
+		bool update();
+
+	private:
+		struct WatchedProgram {
+			Shader* shader;
+			std::string vShaderPath;
+			std::string fShaderPath;
+			std::vector<std::string> watchedPaths;
+			std::vector<int> watchIDs;
+			bool reloadRequested;
+			ShaderHandle reload;
+		};
+
+		FileWatcher fileWatcher;
+		ShaderCompiler compiler;
+		std::vector<WatchedProgram> programs;
+
+		void watchSourceFiles(WatchedProgram& program);
+};
+
+void ShaderHotReloader::watch(Shader& shader, const char* vShader, const char* fShader) {
+	WatchedProgram program;
+	program.shader = &shader;
+	program.vShaderPath = vShader;
+	program.fShaderPath = fShader;
+	program.reloadRequested = false;
+	watchSourceFiles(program);
+	programs.push_back(program);
+}
+
+void ShaderHotReloader::start(GLFWwindow* renderWindow) {
+	if (!GLEXT_parallel_shader_compile) compiler.compileInBackground(renderWindow);
+	fileWatcher.start();
+}
+
+bool ShaderHotReloader::update() {
+	for (WatchedProgram& program : programs) {
+		for (int watchID : program.watchIDs) {
+			if (fileWatcher.consumeChange(watchID)) program.reloadRequested = true;
+		}
+
+		// A change that lands while a reload is in flight is picked up once it finishes
+		if (program.reloadRequested && !program.reload.valid()) {
+			// The user may still be editing the files, so the sources are not left mapped
+			program.reload = compiler.queue(program.vShaderPath.c_str(), program.fShaderPath.c_str(), true);
+			program.reloadRequested = false;
+		}
+	}
+	if (compiler.sourcesLoaded()) compiler.submit();
+
+	bool swapped = false;
+	for (WatchedProgram& program : programs) {
+		if (!program.reload.valid() || !program.reload.isReady()) continue;
+
+		Shader& reloaded = program.reload.get();
+		int success = 0;
+		glGetProgramiv(reloaded.programID(), GL_LINK_STATUS, &success);
+		if (success) {
+			*program.shader = std::move(reloaded);
+			swapped = true;
+			std::cout << "Reloaded " << program.vShaderPath << " + " << program.fShaderPath << std::endl;
+		} else {
+			reloaded.kill();
+			std::cout << "Reload of " << program.vShaderPath << " + " << program.fShaderPath << " failed, keeping the previous program" << std::endl;
+		}
+		program.reload = ShaderHandle();
+		watchSourceFiles(program);
+	}
+	return swapped;
+}
+
+void ShaderHotReloader::watchSourceFiles(WatchedProgram& program) {
+	// Only the include lists are needed; the files are small and this runs once per reload
+	const std::string* shaderPaths[] = { &program.vShaderPath, &program.fShaderPath };
+	for (const std::string* shaderPath : shaderPaths) {
+		std::vector<std::string> paths(1, *shaderPath);
+		ShaderSource source = ShaderSource::read(shaderPath->c_str());
+		if (source.isOpen()) paths = source.files();
+		for (const std::string& path : paths) {
+			if (std::find(program.watchedPaths.begin(), program.watchedPaths.end(), path) != program.watchedPaths.end()) continue;
+			program.watchedPaths.push_back(path);
+			program.watchIDs.push_back(fileWatcher.watch(path.c_str()));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef SHADER_PREPROCESSOR
+#define SHADER_PREPROCESSOR
+
+#include "FileMapping.h"
+#include "ProgramBinaryCache.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+// Expanded lines [expandedFirstLine, next range) came from sourceFiles[fileIndex]
+// starting at originalFirstLine.
+struct ShaderLineRange {
+	int expandedFirstLine;
+	int fileIndex;
+	int originalFirstLine;
+};
+
+// Shader text ready for glShaderSource. Files without #include are passed through as the
+// raw mapping; otherwise the expanded text is kept together with a line map so driver
+// errors can be reported against the file and line they came from. read() copies the file
+// instead, for files an editor may rewrite while the source is alive.
+class ShaderSource {
+	public:
+		static ShaderSource load(const char* path);
+		static ShaderSource read(const char* path);
+		ShaderSource withDefines(const std::vector<std::string>& defines) const;
+		ShaderSource copyToMemory() const;
+
+		bool isOpen() const;
+		const char* data() const;
+		size_t size() const;
+		const std::vector<std::string>& files() const; // this file first, then everything it includes
+		std::string remapLog(const char* log) const;
+
+	private:
+		FileMapping mapping;
+		std::string expanded;
+		bool usesExpanded = false;
+		bool opened = false;
+		std::vector<std::string> sourceFiles;
+		std::vector<ShaderLineRange> lineMap;
+
+		int findRange(int expandedLine) const;
+};
+
+// Resolves #include "file" (paths relative to the including file). Each file is expanded
+// at most once per shader, which also breaks include cycles. The last parse of each file is
+// cached by path together with a hash of its contents, so shared headers are only scanned
+// again once they change, and an edited file replaces its old entry.
+class ShaderPreprocessor {
+	public:
+		static bool expand(const char* path, const char* code, size_t length, std::string& expanded, std::vector<std::string>& sourceFiles, std::vector<ShaderLineRange>& lineMap);
+		static bool hasInclude(const char* code, size_t length);
+
+	private:
+		struct Segment {
+			std::string text;        // lines copied verbatim, or empty for an include
+			std::string includeName; // relative to the including file
+			int firstLine;
+			int lineCount;
+		};
+		struct ParsedFile {
+			unsigned long long contentHash;
+			std::vector<Segment> segments;
+		};
+
+		static std::mutex cacheMutex;
+		static std::unordered_map<std::string, std::shared_ptr<const ParsedFile>> parsedFiles;
+
+		static std::shared_ptr<const ParsedFile> parse(const std::string& path, const char* code, size_t length);
+		static bool expandFile(const std::string& path, const char* code, size_t length, std::string& expanded, int& expandedLine, std::vector<std::string>& sourceFiles, std::vector<ShaderLineRange>& lineMap);
+		static bool parseIncludeDirective(const char* line, const char* lineEnd, std::string& includeName);
+};
+
+std::mutex ShaderPreprocessor::cacheMutex;
+std::unordered_map<std::string, std::shared_ptr<const ShaderPreprocessor::ParsedFile>> ShaderPreprocessor::parsedFiles;
+
+ShaderSource ShaderSource::load(const char* path) {
+	ShaderSource source;
+	source.mapping = FileMapping(path);
+	source.opened = source.mapping.isOpen();
+	if (!source.opened) {
+		std::cout << "Could not load " << path << std::endl;
+		return source;
+	}
+	source.mapping.prefault();
+
+	if (!ShaderPreprocessor::hasInclude(source.mapping.data(), source.mapping.size())) {
+		source.sourceFiles.push_back(path);
+		source.lineMap.push_back(ShaderLineRange{ 1, 0, 1 });
+		return source;
+	}
+
+	source.opened = ShaderPreprocessor::expand(path, source.mapping.data(), source.mapping.size(), source.expanded, source.sourceFiles, source.lineMap);
+	source.usesExpanded = true;
+	source.mapping = FileMapping();
+	return source;
+}
+
+ShaderSource ShaderSource::read(const char* path) {
+	// A copy cannot fault the way a mapping does when the file is truncated on save
+	ShaderSource source;
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "Could not load " << path << std::endl;
+		return source;
+	}
+	std::string code((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	source.usesExpanded = true;
+
+	if (!ShaderPreprocessor::hasInclude(code.data(), code.size())) {
+		source.opened = true;
+		source.expanded.swap(code);
+		source.sourceFiles.push_back(path);
+		source.lineMap.push_back(ShaderLineRange{ 1, 0, 1 });
+		return source;
+	}
+
+	source.opened = ShaderPreprocessor::expand(path, code.data(), code.size(), source.expanded, source.sourceFiles, source.lineMap);
+	return source;
+}
+
+ShaderSource ShaderSource::withDefines(const std::vector<std::string>& defines) const {
+	// The defines go right after #version, which has to stay the first directive, and a
+	// #line restores the numbering so the line map still applies
+	std::string code(data(), size());
+	size_t insertAt = 0;
+	int nextLine = 1;
+	size_t version = code.find("#version");
+	if (version != std::string::npos && code.find_first_not_of(" \t\r\n", 0) == version) {
+		size_t versionEnd = code.find('\n', version);
+		insertAt = versionEnd == std::string::npos ? code.size() : versionEnd + 1;
+		nextLine = static_cast<int>(std::count(code.begin(), code.begin() + static_cast<std::ptrdiff_t>(insertAt), '\n')) + 1;
+	}
+
+	std::string injected;
+	if (insertAt == code.size() && (code.empty() || code.back() != '\n')) injected += '\n';
+	for (const std::string& define : defines) injected += "#define " + define + "\n";
+	injected += "#line " + std::to_string(nextLine) + "\n";
+
+	ShaderSource source;
+	source.expanded = code.substr(0, insertAt) + injected + code.substr(insertAt);
+	source.usesExpanded = true;
+	source.opened = opened;
+	source.sourceFiles = sourceFiles;
+	source.lineMap = lineMap;
+	return source;
+}
+
+ShaderSource ShaderSource::copyToMemory() const {
+	// Same text and line map, but no longer backed by the file, so it stays valid however
+	// the file changes
+	ShaderSource source;
+	if (size() != 0) source.expanded.assign(data(), size());
+	source.usesExpanded = true;
+	source.opened = opened;
+	source.sourceFiles = sourceFiles;
+	source.lineMap = lineMap;
+	return source;
+}
+
+bool ShaderSource::isOpen() const {
+	return opened;
+}
+
+const char* ShaderSource::data() const {
+	return usesExpanded ? expanded.c_str() : mapping.data();
+}
+
+size_t ShaderSource::size() const {
+	return usesExpanded ? expanded.size() : mapping.size();
+}
+
+const std::vector<std::string>& ShaderSource::files() const {
+	return sourceFiles;
+}
+
+std::string ShaderSource::remapLog(const char* log) const {
+	// Driver logs prefix each message with the source string and line, e.g. "0:12(5): "
+	// (Mesa), "0(12) : " (NVIDIA) or "ERROR: 0:12: " (AMD, Intel on Windows)
+	std::string remapped;
+	const char* cursor = log;
+	while (*cursor) {
+		const char* lineEnd = std::strchr(cursor, '\n');
+		if (!lineEnd) lineEnd = cursor + std::strlen(cursor);
+
+		const char* location = cursor;
+		if (std::strncmp(location, "ERROR: ", 7) == 0) location += 7;
+		else if (std::strncmp(location, "WARNING: ", 9) == 0) location += 9;
+
+		const char* digits = location;
+		while (*digits >= '0' && *digits <= '9') ++digits;
+		bool parsed = false;
+		if (digits != location && (*digits == ':' || *digits == '(')) {
+			char separator = *digits;
+			const char* lineStart = digits + 1;
+			const char* lineDigits = lineStart;
+			int expandedLine = 0;
+			while (*lineDigits >= '0' && *lineDigits <= '9') expandedLine = expandedLine * 10 + (*lineDigits++ - '0');
+			if (lineDigits != lineStart && (separator == ':' || *lineDigits == ')')) {
+				int range = findRange(expandedLine);
+				if (range >= 0) {
+					const ShaderLineRange& lineRange = lineMap[static_cast<size_t>(range)];
+					remapped.append(cursor, location);
+					remapped += sourceFiles[static_cast<size_t>(lineRange.fileIndex)];
+					remapped += ":" + std::to_string(lineRange.originalFirstLine + expandedLine - lineRange.expandedFirstLine);
+					remapped.append(separator == '(' ? lineDigits + 1 : lineDigits, lineEnd);
+					parsed = true;
+				}
+			}
+		}
+		if (!parsed) remapped.append(cursor, lineEnd);
+
+		if (*lineEnd == '\0') break;
+		remapped += '\n';
+		cursor = lineEnd + 1;
+	}
+	return remapped;
+}
+
+int ShaderSource::findRange(int expandedLine) const {
+	std::vector<ShaderLineRange>::const_iterator it = std::upper_bound(lineMap.begin(), lineMap.end(), expandedLine,
+		[](int line, const ShaderLineRange& range) { return line < range.expandedFirstLine; });
+	if (it == lineMap.begin()) return -1;
+	return static_cast<int>(it - lineMap.begin()) - 1;
+}
+
+bool ShaderPreprocessor::expand(const char* path, const char* code, size_t length, std::string& expanded, std::vector<std::string>& sourceFiles, std::vector<ShaderLineRange>& lineMap) {
+	int expandedLine = 1;
+	expanded.clear();
+	sourceFiles.clear();
+	lineMap.clear();
+	return expandFile(path, code, length, expanded, expandedLine, sourceFiles, lineMap);
+}
+
+bool ShaderPreprocessor::hasInclude(const char* code, size_t length) {
+	static const char directive[] = "include";
+	const char* end = code + length;
+	for (const char* hash = std::find(code, end, '#'); hash != end; hash = std::find(hash + 1, end, '#')) {
+		const char* word = hash + 1;
+		while (word != end && (*word == ' ' || *word == '\t')) ++word;
+		if (static_cast<size_t>(end - word) >= sizeof(directive) - 1 && std::memcmp(word, directive, sizeof(directive) - 1) == 0) return true;
+	}
+	return false;
+}
+
+std::shared_ptr<const ShaderPreprocessor::ParsedFile> ShaderPreprocessor::parse(const std::string& path, const char* code, size_t length) {
+	unsigned long long contentHash = ProgramBinaryCache::hashBytes(14695981039346656037ull, code, length);
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		std::unordered_map<std::string, std::shared_ptr<const ParsedFile>>::const_iterator cached = parsedFiles.find(path);
+		if (cached != parsedFiles.end() && cached->second->contentHash == contentHash) return cached->second;
+	}
+
+	std::shared_ptr<ParsedFile> parsed = std::make_shared<ParsedFile>();
+	parsed->contentHash = contentHash;
+	Segment text = { std::string(), std::string(), 1, 0 };
+	int lineNumber = 1;
+	const char* end = code + length;
+	for (const char* line = code; line < end; ++lineNumber) {
+		const char* lineEnd = std::find(line, end, '\n');
+		std::string includeName;
+		if (parseIncludeDirective(line, lineEnd, includeName)) {
+			if (text.lineCount > 0) parsed->segments.push_back(text);
+			parsed->segments.push_back(Segment{ std::string(), includeName, lineNumber, 1 });
+			text = Segment{ std::string(), std::string(), lineNumber + 1, 0 };
+		} else {
+			text.text.append(line, lineEnd);
+			text.text += '\n';
+			++text.lineCount;
+		}
+		line = lineEnd + 1;
+	}
+	if (text.lineCount > 0) parsed->segments.push_back(text);
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	parsedFiles[path] = parsed;
+	return parsed;
+}
+
+bool ShaderPreprocessor::expandFile(const std::string& path, const char* code, size_t length, std::string& expanded, int& expandedLine, std::vector<std::string>& sourceFiles, std::vector<ShaderLineRange>& lineMap) {
+	if (std::find(sourceFiles.begin(), sourceFiles.end(), path) != sourceFiles.end()) return true;
+	int fileIndex = static_cast<int>(sourceFiles.size());
+	sourceFiles.push_back(path);
+
+	size_t separator = path.find_last_of("/\\");
+	std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+
+	bool success = true;
+	std::shared_ptr<const ParsedFile> parsed = parse(path, code, length);
+	for (const Segment& segment : parsed->segments) {
+		if (segment.includeName.empty()) {
+			lineMap.push_back(ShaderLineRange{ expandedLine, fileIndex, segment.firstLine });
+			expanded += segment.text;
+			expandedLine += segment.lineCount;
+			continue;
+		}
+
+		std::string includePath = directory + segment.includeName;
+		FileMapping includeFile(includePath.c_str());
+		if (!includeFile.isOpen()) {
+			std::cout << path << ":" << segment.firstLine << ": could not open include " << includePath << std::endl;
+			success = false;
+			continue;
+		}
+		success = expandFile(includePath, includeFile.data(), includeFile.size(), expanded, expandedLine, sourceFiles, lineMap) && success;
+	}
+	return success;
+}
+
+bool ShaderPreprocessor::parseIncludeDirective(const char* line, const char* lineEnd, std::string& includeName) {
+	while (line != lineEnd && (*line == ' ' || *line == '\t')) ++line;
+	if (line == lineEnd || *line != '#') return false;
+	++line;
+	while (line != lineEnd && (*line == ' ' || *line == '\t')) ++line;
+	if (lineEnd - line < 7 || std::strncmp(line, "include", 7) != 0) return false;
+	line += 7;
+	while (line != lineEnd && (*line == ' ' || *line == '\t')) ++line;
+	if (line == lineEnd || (*line != '"' && *line != '<')) return false;
+
+	char closing = *line == '"' ? '"' : '>';
+	const char* nameStart = line + 1;
+	const char* nameEnd = std::find(nameStart, lineEnd, closing);
+	if (nameEnd == lineEnd) return false;
+	includeName.assign(nameStart, nameEnd);
+	return true;
+}
+
+#endif
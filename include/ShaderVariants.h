@@ -0,0 +1,84 @@
+#ifndef SHADER_VARIANTS
+#define SHADER_VARIANTS
+
+#include "Shader.h"
+#include "ShaderPreprocessor.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cassert>
+
+// All permutations of one vertex/fragment pair over a list of feature defines. Bit i of a
+// variant key turns on features[i]; every permutation is compiled on first use and kept
+// in a table indexed directly by the key, so get() is an array lookup in the draw loop.
+// Uniform block bindings given to bindUniformBlock() apply to every variant, including the
+// ones compiled later. A key with bits beyond the declared features asserts in debug builds;
+// release builds report it once and use the variant with those bits cleared.
+class ShaderVariants {
+	public:
+		static const unsigned MAX_FEATURES = 8;
+
+		ShaderVariants(const char* vShader, const char* fShader, std::vector<std::string> featureDefines);
+		Shader& get(unsigned variantKey);
+		void bindUniformBlock(const char* blockName, unsigned bindingIndex);
+		void kill();
+
+	private:
+		ShaderSource vShaderSource;
+		ShaderSource fShaderSource;
+		std::vector<std::string> features;
+		std::vector<std::unique_ptr<Shader>> variants;
+		std::vector<std::pair<std::string, unsigned>> blockBindings;
+		bool reportedUndeclaredKey = false;
+
+		Shader& compile(unsigned variantKey);
+};
+
+ShaderVariants::ShaderVariants(const char* vShader, const char* fShader, std::vector<std::string> featureDefines)
+	: features(std::move(featureDefines)) {
+	// Keep owned copies rather than holding the file mappings open for the object's lifetime
+	vShaderSource = ShaderSource::load(vShader).copyToMemory();
+	fShaderSource = ShaderSource::load(fShader).copyToMemory();
+	if (features.size() > MAX_FEATURES) {
+		std::cout << "Shader variants support at most " << MAX_FEATURES << " features, ignoring the rest" << std::endl;
+		features.resize(MAX_FEATURES);
+	}
+	variants.resize(static_cast<size_t>(1) << features.size());
+}
+
+Shader& ShaderVariants::get(unsigned variantKey) {
+	unsigned declaredBits = static_cast<unsigned>(variants.size() - 1);
+	assert((variantKey & ~declaredBits) == 0 && "variant key sets an undeclared feature bit");
+	if ((variantKey & ~declaredBits) != 0 && !reportedUndeclaredKey) {
+		std::cout << "Shader variant key 0x" << std::hex << variantKey << std::dec << " sets features that were never declared (" << features.size() << " declared), ignoring those bits" << std::endl;
+		reportedUndeclaredKey = true;
+	}
+	variantKey &= declaredBits;
+	Shader* variant = variants[variantKey].get();
+	return variant ? *variant : compile(variantKey);
+}
+
+void ShaderVariants::bindUniformBlock(const char* blockName, unsigned bindingIndex) {
+	blockBindings.push_back(std::make_pair(std::string(blockName), bindingIndex));
+	for (const std::unique_ptr<Shader>& variant : variants) {
+		if (variant) variant->bindUniformBlock(blockName, bindingIndex);
+	}
+}
+
+void ShaderVariants::kill() {
+	for (std::unique_ptr<Shader>& variant : variants) variant.reset();
+}
+
+Shader& ShaderVariants::compile(unsigned variantKey) {
+	std::vector<std::string> defines;
+	for (size_t i = 0; i < features.size(); ++i) {
+		if (variantKey & (1u << i)) defines.push_back(features[i]);
+	}
+	variants[variantKey].reset(new Shader(vShaderSource.withDefines(defines), fShaderSource.withDefines(defines)));
+	for (const std::pair<std::string, unsigned>& binding : blockBindings) variants[variantKey]->bindUniformBlock(binding.first.c_str(), binding.second);
+	return *variants[variantKey];
+}
+
+#endif
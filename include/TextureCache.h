@@ -0,0 +1,144 @@
+#ifndef TEXTURE_CACHE
+#define TEXTURE_CACHE
+
+#include "TextureLoader.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <cstdlib>
+#ifndef _WIN32
+#include <climits>
+#endif
+
+struct TextureCacheStats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long evictions;
+	size_t residentBytes;
+	size_t entries;
+};
+
+// Hands out shared TextureHandles so every request for the same file and load options
+// reuses one decode and one GL texture. Textures stay cached after their last handle is
+// dropped; once the estimated GPU memory of the cache exceeds the budget, update() evicts
+// the least recently requested textures that nobody holds a handle to. Textures still in
+// use are never evicted, so the budget can be exceeded while they are alive.
+class TextureCache {
+	public:
+		TextureCache(TextureLoader& loader, size_t gpuBudgetBytes = 256 * 1024 * 1024);
+
+		TextureHandle get(const char* path, const TextureLoadOptions& options = TextureLoadOptions());
+		void update();
+		void setBudget(size_t gpuBudgetBytes);
+		TextureCacheStats stats() const;
+
+	private:
+		struct CachedTexture {
+			TextureHandle handle;
+			std::list<std::string>::iterator recentUse;
+			size_t countedBytes = 0; // the slot's gpuBytes as of the last update()
+		};
+
+		TextureLoader& loader;
+		size_t budget;
+		std::unordered_map<std::string, CachedTexture> textures;
+		std::list<std::string> recentUses; // most recently requested first
+		std::vector<CachedTexture*> loading; // entries whose gpuBytes can still change
+		size_t resident = 0; // sum of countedBytes
+		unsigned long long hits = 0;
+		unsigned long long misses = 0;
+		unsigned long long evictions = 0;
+
+		static std::string makeKey(const char* path, const TextureLoadOptions& options);
+		static std::string canonicalPath(const char* path);
+};
+
+TextureCache::TextureCache(TextureLoader& loader, size_t gpuBudgetBytes) : loader(loader), budget(gpuBudgetBytes) {
+}
+
+TextureHandle TextureCache::get(const char* path, const TextureLoadOptions& options) {
+	std::string key = makeKey(path, options);
+	std::unordered_map<std::string, CachedTexture>::iterator cached = textures.find(key);
+	if (cached != textures.end()) {
+		++hits;
+		recentUses.splice(recentUses.begin(), recentUses, cached->second.recentUse);
+		return cached->second.handle;
+	}
+
+	++misses;
+	recentUses.push_front(key);
+	CachedTexture& entry = textures[key];
+	entry.handle = loader.load(path, options);
+	entry.recentUse = recentUses.begin();
+	loading.push_back(&entry);
+	return entry.handle;
+}
+
+void TextureCache::update() {
+	// Only a texture that is still loading can change size, so the total is brought up to date
+	// from those alone. Map elements never move, so the pointers stay valid until eviction,
+	// and nothing the loader still holds is evicted.
+	size_t stillLoading = 0;
+	for (CachedTexture* entry : loading) {
+		const TextureSlot& slot = *entry->handle.slot;
+		resident = resident - entry->countedBytes + slot.gpuBytes;
+		entry->countedBytes = slot.gpuBytes;
+		if (!slot.finished) loading[stillLoading++] = entry;
+	}
+	loading.resize(stillLoading);
+
+	std::list<std::string>::iterator candidate = recentUses.end();
+	while (resident > budget && candidate != recentUses.begin()) {
+		--candidate;
+		std::unordered_map<std::string, CachedTexture>::iterator cached = textures.find(*candidate);
+		const std::shared_ptr<TextureSlot>& slot = cached->second.handle.slot;
+		// Still loading (the loader holds a reference) or held by a caller
+		if (slot.use_count() > 1) continue;
+
+		resident -= cached->second.countedBytes;
+		++evictions;
+		loader.destroyTexture(*slot);
+		textures.erase(cached);
+		candidate = recentUses.erase(candidate);
+	}
+}
+
+void TextureCache::setBudget(size_t gpuBudgetBytes) {
+	budget = gpuBudgetBytes;
+}
+
+TextureCacheStats TextureCache::stats() const {
+	return TextureCacheStats{ hits, misses, evictions, resident, textures.size() };
+}
+
+std::string TextureCache::makeKey(const char* path, const TextureLoadOptions& options) {
+	std::string key = canonicalPath(path);
+	key += '|';
+	key += static_cast<char>('0' + options.desiredChannels);
+	key += options.flipVertically ? 'f' : '-';
+	key += options.srgb ? 's' : '-';
+	key += static_cast<char>('0' + options.downscale);
+	key += options.progressivePreview ? 'p' : '-';
+	return key;
+}
+
+std::string TextureCache::canonicalPath(const char* path) {
+	// Different spellings of one file ("a/../b.png", "./b.png") must share an entry;
+	// a path that does not resolve is used as given so the loader reports the error
+#ifdef _WIN32
+	char resolved[_MAX_PATH];
+	if (_fullpath(resolved, path, _MAX_PATH) == NULL) return path;
+	for (char* c = resolved; *c; ++c) {
+		if (*c == '/') *c = '\\';
+		else if (*c >= 'A' && *c <= 'Z') *c = static_cast<char>(*c - 'A' + 'a');
+	}
+	return resolved;
+#else
+	char resolved[PATH_MAX];
+	if (realpath(path, resolved) == NULL) return path;
+	return resolved;
+#endif
+}
+
+#endif
@@ -0,0 +1,477 @@
+#ifndef TEXTURE_LOADER
+#define TEXTURE_LOADER
+
+#include <glad/glad.h>
+#include "GLObjects.h"
+#include "GLStateCache.h"
+#include "FileMapping.h"
+#include "std_image.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+// desiredChannels 0 keeps the file's channel count. sRGB applies to 3 and 4 channel images.
+// downscale 2, 4 or 8 decodes a reduced-size copy for previews; JPEGs never build the full image.
+// progressivePreview uploads a blurry version of a progressive JPEG as soon as its first scan is
+// decoded, which the full image replaces when the decode finishes (full-size loads only).
+struct TextureLoadOptions {
+	int desiredChannels = 0;
+	bool flipVertically = false;
+	bool srgb = false;
+	int downscale = 1;
+	bool progressivePreview = false;
+};
+
+struct TextureSlot {
+	Texture2D texture;
+	std::string path;
+	TextureLoadOptions options;
+	size_t gpuBytes = 0; // estimate including the mip chain, known once ready
+	bool ready = false;
+	bool failed = false;
+	bool finished = false; // the full image (not a preview) has been uploaded or has failed
+};
+
+// Totals over every decode so far. Allocation counts come from stb_image's per-thread
+// counters; heap allocations stay near zero once each worker's arena has grown to fit.
+struct TextureLoaderStats {
+	unsigned long long decoded;
+	double decodeSeconds;
+	unsigned long long heapAllocations;
+	unsigned long long arenaAllocations;
+};
+
+// Texture that may still be loading. id() names the loader's placeholder until the decoded
+// image has been uploaded, so it can be bound every frame from the moment load() returns.
+class TextureHandle {
+	public:
+		TextureHandle() = default;
+		TextureHandle(std::shared_ptr<TextureSlot> slot, unsigned placeholderID);
+		bool valid() const;
+		bool isReady() const;
+		bool failed() const;
+		unsigned id() const;
+
+	private:
+		friend class TextureCache;
+
+		std::shared_ptr<TextureSlot> slot;
+		unsigned placeholderID = 0;
+};
+
+// Decodes images on a pool of worker threads and uploads them from the GL thread through a
+// pixel unpack buffer. Workers push finished images onto a lock-free list that update()
+// drains once per frame, uploading at most uploadBytesPerUpdate bytes (but always at least
+// one image) so a burst of loads is spread over several frames. Each decode allocates from
+// an stb_image arena that is reset and reused once its image is uploaded, so steady loading
+// does not go through the global heap. Idle workers also help with the parallel parts of a
+// decode another thread has started, so a large JPEG never adds threads beyond the pool.
+// The loader must outlive its handles.
+class TextureLoader {
+	public:
+		TextureLoader(GLStateCache& glState, unsigned workerCount = 0, size_t uploadBytesPerUpdate = 8 * 1024 * 1024);
+		TextureLoader(const TextureLoader&) = delete;
+		TextureLoader& operator=(const TextureLoader&) = delete;
+		~TextureLoader();
+
+		TextureHandle load(const char* path, const TextureLoadOptions& options = TextureLoadOptions());
+		unsigned placeholderID() const;
+		void destroyTexture(TextureSlot& slot);
+		bool idle() const;
+		int update();
+		TextureLoaderStats stats();
+
+	private:
+		struct DecodedImage {
+			std::shared_ptr<TextureSlot> slot;
+			unsigned char* pixels;
+			int width;
+			int height;
+			int channels;
+			const char* failureReason; // stb_image's reason is per thread, so carry it over
+			stbi_arena* arena; // owns pixels
+			DecodedImage* next;
+			bool preview; // pixels are a new[] copy of a progressive pass; the full image follows
+		};
+
+		struct PreviewTarget {
+			TextureLoader* loader;
+			const std::shared_ptr<TextureSlot>* slot;
+		};
+
+		// One stb_image parallel-for call. The calling thread runs tasks too, so a job finishes
+		// even when every worker is busy decoding.
+		struct ParallelJob {
+			int count;
+			void (*task)(void* taskData, int index);
+			void* taskData;
+			std::atomic<int> nextIndex{ 0 };
+			int activeHelpers = 0; // guarded by requestMutex
+		};
+
+		GLStateCache& glState;
+		Texture2D placeholder;
+		Buffer uploadBuffer;
+		size_t uploadBudget;
+		int inFlight = 0;
+
+		std::vector<std::thread> workers;
+		std::mutex requestMutex;
+		std::condition_variable requestReady;
+		std::deque<std::shared_ptr<TextureSlot>> requests;
+		std::deque<ParallelJob*> parallelJobs; // taken before requests; a decode is waiting on them
+		std::condition_variable helpersDone;
+		bool stopping = false;
+
+		std::mutex arenaMutex;
+		std::vector<stbi_arena*> idleArenas; // at most one per worker
+		TextureLoaderStats decodeStats = {};
+
+		// Multi-producer list of decoded images; only update() takes from it, and it takes
+		// everything at once, so a plain compare-and-swap push is enough
+		std::atomic<DecodedImage*> decodedHead{ nullptr };
+		DecodedImage* uploadQueue = nullptr;
+
+		void runWorker();
+		void pushDecoded(DecodedImage* image);
+		void upload(DecodedImage& image);
+		stbi_arena* takeArena();
+		void recycleArena(DecodedImage& image);
+		static void freeImages(DecodedImage* image);
+		static int queuePreview(void* user, const stbi_uc* pixels, int width, int height, int channels, int scan);
+		static void parallelFor(void* user, int count, void (*task)(void* taskData, int index), void* taskData);
+		static void runTasks(ParallelJob& job);
+};
+
+TextureHandle::TextureHandle(std::shared_ptr<TextureSlot> slot, unsigned placeholderID) : slot(std::move(slot)), placeholderID(placeholderID) {
+}
+
+bool TextureHandle::valid() const {
+	return slot != nullptr;
+}
+
+bool TextureHandle::isReady() const {
+	return slot && slot->ready;
+}
+
+bool TextureHandle::failed() const {
+	return slot && slot->failed;
+}
+
+unsigned TextureHandle::id() const {
+	return isReady() ? slot->texture.id() : placeholderID;
+}
+
+TextureLoader::TextureLoader(GLStateCache& glState, unsigned workerCount, size_t uploadBytesPerUpdate) : glState(glState), uploadBudget(uploadBytesPerUpdate) {
+	// 2x2 magenta and black checker, easy to spot if a texture never arrives
+	const unsigned char checker[] = {
+		255, 0, 255, 255,    0, 0, 0, 255,
+		0, 0, 0, 255,        255, 0, 255, 255,
+	};
+	placeholder = Texture2D::create();
+	glState.bindTexture(0, GL_TEXTURE_2D, placeholder.id());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+
+	uploadBuffer = Buffer::create();
+
+	if (workerCount == 0) {
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	for (unsigned i = 0; i < workerCount; ++i) workers.push_back(std::thread(&TextureLoader::runWorker, this));
+
+	// Lets a single large JPEG spread its decode over more cores than its own worker
+	stbi_set_parallel_for(parallelFor, this);
+}
+
+TextureLoader::~TextureLoader() {
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		stopping = true;
+	}
+	requestReady.notify_all();
+	for (std::thread& worker : workers) worker.join();
+	stbi_set_parallel_for(NULL, NULL);
+	freeImages(decodedHead.exchange(nullptr));
+	freeImages(uploadQueue);
+	for (stbi_arena* arena : idleArenas) stbi_arena_destroy(arena);
+}
+
+TextureHandle TextureLoader::load(const char* path, const TextureLoadOptions& options) {
+	std::shared_ptr<TextureSlot> slot = std::make_shared<TextureSlot>();
+	slot->path = path;
+	slot->options = options;
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		requests.push_back(slot);
+	}
+	requestReady.notify_one();
+	++inFlight;
+	return TextureHandle(slot, placeholder.id());
+}
+
+unsigned TextureLoader::placeholderID() const {
+	return placeholder.id();
+}
+
+void TextureLoader::destroyTexture(TextureSlot& slot) {
+	// The state cache must drop its record before the name can be handed out again
+	glState.forgetTexture(slot.texture.id());
+	slot.texture.reset();
+	slot.gpuBytes = 0;
+	slot.ready = false;
+}
+
+bool TextureLoader::idle() const {
+	return inFlight == 0;
+}
+
+int TextureLoader::update() {
+	// The list comes off newest first; reverse it and append so uploads keep request order
+	DecodedImage* taken = decodedHead.exchange(nullptr, std::memory_order_acquire);
+	DecodedImage* reversed = nullptr;
+	while (taken) {
+		DecodedImage* next = taken->next;
+		taken->next = reversed;
+		reversed = taken;
+		taken = next;
+	}
+	DecodedImage** tail = &uploadQueue;
+	while (*tail) tail = &(*tail)->next;
+	*tail = reversed;
+
+	int uploaded = 0;
+	size_t uploadedBytes = 0;
+	while (uploadQueue && (uploaded == 0 || uploadedBytes < uploadBudget)) {
+		DecodedImage* image = uploadQueue;
+		uploadQueue = image->next;
+		upload(*image);
+		uploadedBytes += static_cast<size_t>(image->width) * image->height * image->channels;
+		if (image->preview) {
+			delete[] image->pixels;
+		} else {
+			recycleArena(*image);
+			--inFlight;
+		}
+		delete image;
+		++uploaded;
+	}
+	return uploaded;
+}
+
+TextureLoaderStats TextureLoader::stats() {
+	std::lock_guard<std::mutex> lock(arenaMutex);
+	return decodeStats;
+}
+
+void TextureLoader::runWorker() {
+	while (true) {
+		std::shared_ptr<TextureSlot> slot;
+		{
+			std::unique_lock<std::mutex> lock(requestMutex);
+			requestReady.wait(lock, [this]() { return stopping || !parallelJobs.empty() || !requests.empty(); });
+			if (stopping) return;
+			if (!parallelJobs.empty()) {
+				ParallelJob* job = parallelJobs.front();
+				++job->activeHelpers;
+				lock.unlock();
+				runTasks(*job);
+				lock.lock();
+				// Every index has been claimed, so nobody else needs to join
+				std::deque<ParallelJob*>::iterator queued = std::find(parallelJobs.begin(), parallelJobs.end(), job);
+				if (queued != parallelJobs.end()) parallelJobs.erase(queued);
+				if (--job->activeHelpers == 0) helpersDone.notify_all();
+				continue;
+			}
+			slot = std::move(requests.front());
+			requests.pop_front();
+		}
+
+		const TextureLoadOptions& options = slot->options;
+		DecodedImage* image = new DecodedImage{ slot, nullptr, 0, 0, 0, "could not open file", takeArena(), nullptr, false };
+		FileMapping imageFile(slot->path.c_str());
+		if (imageFile.isOpen()) {
+			imageFile.prefault();
+			int fileChannels = 0;
+			stbi_alloc_stats allocations;
+			std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+			stbi_reset_alloc_stats();
+			stbi_set_thread_arena(image->arena);
+			stbi_set_flip_vertically_on_load_thread(options.flipVertically);
+			if (options.progressivePreview && options.downscale == 1) {
+				PreviewTarget previewTarget{ this, &slot };
+				image->pixels = stbi_load_progressive_from_memory(reinterpret_cast<const stbi_uc*>(imageFile.data()), static_cast<int>(imageFile.size()),
+					&image->width, &image->height, &fileChannels, options.desiredChannels, queuePreview, &previewTarget);
+			} else {
+				image->pixels = stbi_load_scaled_from_memory(reinterpret_cast<const stbi_uc*>(imageFile.data()), static_cast<int>(imageFile.size()),
+					&image->width, &image->height, &fileChannels, options.desiredChannels, options.downscale);
+			}
+			stbi_set_thread_arena(NULL);
+			stbi_get_alloc_stats(&allocations);
+			std::chrono::duration<double> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+			image->channels = options.desiredChannels != 0 ? options.desiredChannels : fileChannels;
+			image->failureReason = image->pixels ? nullptr : stbi_failure_reason();
+
+			std::lock_guard<std::mutex> lock(arenaMutex);
+			++decodeStats.decoded;
+			decodeStats.decodeSeconds += decodeTime.count();
+			decodeStats.heapAllocations += allocations.heap_allocs;
+			decodeStats.arenaAllocations += allocations.arena_allocs;
+		}
+
+		pushDecoded(image);
+	}
+}
+
+void TextureLoader::pushDecoded(DecodedImage* image) {
+	image->next = decodedHead.load(std::memory_order_relaxed);
+	while (!decodedHead.compare_exchange_weak(image->next, image, std::memory_order_release, std::memory_order_relaxed)) {
+	}
+}
+
+int TextureLoader::queuePreview(void* user, const stbi_uc* pixels, int width, int height, int channels, int /*scan*/) {
+	// Only the first pass is uploaded; each later one would cost a full upload and mipmap
+	// build, and the finished image is not far behind
+	const PreviewTarget& target = *static_cast<PreviewTarget*>(user);
+	size_t size = static_cast<size_t>(width) * height * channels;
+	unsigned char* copy = new unsigned char[size];
+	std::memcpy(copy, pixels, size);
+	target.loader->pushDecoded(new DecodedImage{ *target.slot, copy, width, height, channels, nullptr, nullptr, nullptr, true });
+	return 0;
+}
+
+void TextureLoader::upload(DecodedImage& image) {
+	TextureSlot& slot = *image.slot;
+	if (image.pixels == nullptr) {
+		std::cout << "Could not load texture " << slot.path << ": " << image.failureReason << std::endl;
+		slot.failed = true;
+		slot.finished = true;
+		// A preview uploaded earlier goes too, so a failed load always shows the placeholder
+		destroyTexture(slot);
+		return;
+	}
+
+	static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	static const GLenum internalFormats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+	static const GLenum srgbInternalFormats[] = { GL_R8, GL_RG8, GL_SRGB8, GL_SRGB8_ALPHA8 };
+	GLenum format = formats[image.channels - 1];
+	GLenum internalFormat = slot.options.srgb ? srgbInternalFormats[image.channels - 1] : internalFormats[image.channels - 1];
+	GLsizeiptr size = static_cast<GLsizeiptr>(image.width) * image.height * image.channels;
+
+	// Orphaning the buffer lets the driver hand out fresh storage instead of waiting for the
+	// previous upload to be consumed
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer.id());
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == nullptr) {
+		glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		std::cout << "Could not map upload buffer for " << slot.path << std::endl;
+		slot.failed = true;
+		slot.finished = true;
+		destroyTexture(slot);
+		return;
+	}
+	std::memcpy(mapped, image.pixels, static_cast<size_t>(size));
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// Replacing a preview deletes it, which the render loop may have bound
+	glState.forgetTexture(slot.texture.id());
+	slot.texture = Texture2D::create();
+	glState.bindTexture(0, GL_TEXTURE_2D, slot.texture.id());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, static_cast<void*>(0));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	slot.gpuBytes = static_cast<size_t>(size) + static_cast<size_t>(size) / 3;
+	slot.ready = true;
+	slot.finished = !image.preview;
+}
+
+stbi_arena* TextureLoader::takeArena() {
+	{
+		std::lock_guard<std::mutex> lock(arenaMutex);
+		if (!idleArenas.empty()) {
+			stbi_arena* arena = idleArenas.back();
+			idleArenas.pop_back();
+			return arena;
+		}
+	}
+	return stbi_arena_create(0);
+}
+
+void TextureLoader::recycleArena(DecodedImage& image) {
+	// A reset arena keeps enough memory for everything its last image needed, so one that
+	// decoded an unusually large image is released instead of pinning that memory
+	const size_t maxPooledImageBytes = 64 * 1024 * 1024;
+	if (image.arena == nullptr) {
+		stbi_image_free(image.pixels);
+		return;
+	}
+	bool pooled;
+	{
+		std::lock_guard<std::mutex> lock(arenaMutex);
+		pooled = static_cast<size_t>(image.width) * image.height * image.channels <= maxPooledImageBytes && idleArenas.size() < workers.size();
+	}
+	if (!pooled) {
+		stbi_arena_destroy(image.arena);
+		return;
+	}
+	stbi_arena_reset(image.arena);
+	std::lock_guard<std::mutex> lock(arenaMutex);
+	idleArenas.push_back(image.arena);
+}
+
+void TextureLoader::parallelFor(void* user, int count, void (*task)(void* taskData, int index), void* taskData) {
+	TextureLoader& loader = *static_cast<TextureLoader*>(user);
+	ParallelJob job;
+	job.count = count;
+	job.task = task;
+	job.taskData = taskData;
+	{
+		std::lock_guard<std::mutex> lock(loader.requestMutex);
+		loader.parallelJobs.push_back(&job);
+	}
+	loader.requestReady.notify_all();
+	runTasks(job);
+
+	// Helpers that joined may still be running the last tasks they claimed
+	std::unique_lock<std::mutex> lock(loader.requestMutex);
+	std::deque<ParallelJob*>::iterator queued = std::find(loader.parallelJobs.begin(), loader.parallelJobs.end(), &job);
+	if (queued != loader.parallelJobs.end()) loader.parallelJobs.erase(queued);
+	loader.helpersDone.wait(lock, [&job]() { return job.activeHelpers == 0; });
+}
+
+void TextureLoader::runTasks(ParallelJob& job) {
+	for (int index = job.nextIndex++; index < job.count; index = job.nextIndex++) job.task(job.taskData, index);
+}
+
+void TextureLoader::freeImages(DecodedImage* image) {
+	while (image) {
+		DecodedImage* next = image->next;
+		if (image->preview) delete[] image->pixels;
+		else if (image->arena != nullptr) stbi_arena_destroy(image->arena);
+		else stbi_image_free(image->pixels);
+		delete image;
+		image = next;
+	}
+}
+
+#endif
@@ -0,0 +1,319 @@
+#ifndef TEXTURE_MANIFEST
+#define TEXTURE_MANIFEST
+
+#include "std_image.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#ifdef APIENTRY
+#undef APIENTRY
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+// Header facts for one image file, enough to budget GPU memory or pick load options
+// without decoding it
+struct TextureInfo {
+	std::string path; // relative to the scanned directory, '/' separated
+	long long modifiedTime = 0;
+	long long fileSize = 0;
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	bool is16Bit = false;
+	bool isHDR = false;
+	bool valid = false; // false when the file is named like an image but stb_image rejects it
+};
+
+struct TextureManifestStats {
+	size_t textures;
+	size_t headersRead; // files added or changed since the index was written
+	double scanSeconds;
+};
+
+// Every image under a directory with its dimensions and format. Results are kept in a binary
+// index file, so a later scan() only stats unchanged files and reads the headers of the ones
+// whose size or modification time differ. Headers are read with stbi_info_many, spread over
+// threads once a TextureLoader has installed stb_image's parallel-for.
+class TextureManifest {
+	public:
+		bool scan(const char* directory, const char* indexPath);
+		const TextureInfo* find(const char* path) const;
+		const std::vector<TextureInfo>& textures() const;
+		TextureManifestStats stats() const;
+
+	private:
+		struct IndexHeader {
+			char magic[4];
+			unsigned formatVersion;
+			unsigned recordCount;
+		};
+
+		// Followed by pathLength bytes of path
+		struct IndexRecord {
+			long long modifiedTime;
+			long long fileSize;
+			int width;
+			int height;
+			int channels;
+			unsigned flags;
+			unsigned pathLength;
+		};
+
+		enum IndexFlags { ValidFlag = 1, Is16BitFlag = 2, IsHDRFlag = 4 };
+
+		std::vector<TextureInfo> entries;
+		std::unordered_map<std::string, size_t> entryIndices;
+		size_t headersRead = 0;
+		double scanSeconds = 0.0;
+
+		bool writeIndex(const char* indexPath) const;
+		static bool readIndex(const char* indexPath, std::unordered_map<std::string, TextureInfo>& indexed);
+		static bool listImages(const std::string& directory, const std::string& relativePath, std::vector<TextureInfo>& images);
+		static bool isImageName(const char* name);
+};
+
+bool TextureManifest::scan(const char* directory, const char* indexPath) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<TextureInfo> found;
+	if (!listImages(directory, "", found)) {
+		std::cout << "Texture manifest could not read directory: " << directory << std::endl;
+		return false;
+	}
+
+	// A missing or unreadable index only means every header gets read again
+	std::unordered_map<std::string, TextureInfo> indexed;
+	readIndex(indexPath, indexed);
+
+	std::vector<std::string> stalePaths;
+	std::vector<size_t> staleEntries;
+	for (size_t i = 0; i < found.size(); ++i) {
+		std::unordered_map<std::string, TextureInfo>::iterator previous = indexed.find(found[i].path);
+		if (previous != indexed.end() && previous->second.modifiedTime == found[i].modifiedTime && previous->second.fileSize == found[i].fileSize) {
+			found[i] = previous->second;
+		} else {
+			stalePaths.push_back(std::string(directory) + "/" + found[i].path);
+			staleEntries.push_back(i);
+		}
+	}
+
+	if (!stalePaths.empty()) {
+		std::vector<const char*> fileNames;
+		for (const std::string& path : stalePaths) fileNames.push_back(path.c_str());
+		std::vector<stbi_info_result> results(stalePaths.size());
+		stbi_info_many(fileNames.data(), static_cast<int>(fileNames.size()), results.data());
+		for (size_t i = 0; i < results.size(); ++i) {
+			TextureInfo& info = found[staleEntries[i]];
+			info.valid = results[i].ok != 0;
+			info.width = info.valid ? results[i].x : 0;
+			info.height = info.valid ? results[i].y : 0;
+			info.channels = info.valid ? results[i].channels : 0;
+			info.is16Bit = info.valid && results[i].is_16_bit;
+			info.isHDR = info.valid && results[i].is_hdr;
+		}
+	}
+
+	// Every unchanged file matched an index entry, so equal counts also mean nothing was deleted
+	bool changed = !stalePaths.empty() || indexed.size() != found.size();
+	entries.swap(found);
+	entryIndices.clear();
+	entryIndices.reserve(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) entryIndices[entries[i].path] = i;
+	headersRead = stalePaths.size();
+
+	bool indexWritten = !changed || writeIndex(indexPath);
+	scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return indexWritten;
+}
+
+const TextureInfo* TextureManifest::find(const char* path) const {
+	std::unordered_map<std::string, size_t>::const_iterator entry = entryIndices.find(path);
+	return entry == entryIndices.end() ? nullptr : &entries[entry->second];
+}
+
+const std::vector<TextureInfo>& TextureManifest::textures() const {
+	return entries;
+}
+
+TextureManifestStats TextureManifest::stats() const {
+	return TextureManifestStats{ entries.size(), headersRead, scanSeconds };
+}
+
+bool TextureManifest::writeIndex(const char* indexPath) const {
+	IndexHeader header;
+	std::memcpy(header.magic, "LOTM", 4);
+	header.formatVersion = 1;
+	header.recordCount = static_cast<unsigned>(entries.size());
+
+	std::vector<char> contents(sizeof(header));
+	std::memcpy(contents.data(), &header, sizeof(header));
+	for (const TextureInfo& info : entries) {
+		IndexRecord record;
+		record.modifiedTime = info.modifiedTime;
+		record.fileSize = info.fileSize;
+		record.width = info.width;
+		record.height = info.height;
+		record.channels = info.channels;
+		record.flags = (info.valid ? ValidFlag : 0) | (info.is16Bit ? Is16BitFlag : 0) | (info.isHDR ? IsHDRFlag : 0);
+		record.pathLength = static_cast<unsigned>(info.path.size());
+		const char* recordBytes = reinterpret_cast<const char*>(&record);
+		contents.insert(contents.end(), recordBytes, recordBytes + sizeof(record));
+		contents.insert(contents.end(), info.path.begin(), info.path.end());
+	}
+
+	// Write to a temporary file first so a crash never leaves a truncated index behind
+	std::string temporaryPath = std::string(indexPath) + ".tmp";
+	std::ofstream indexFile(temporaryPath, std::ios::binary | std::ios::trunc);
+	indexFile.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+	indexFile.close();
+	if (!indexFile) {
+		std::cout << "Texture manifest index write failed: " << temporaryPath << std::endl;
+		std::remove(temporaryPath.c_str());
+		return false;
+	}
+	std::remove(indexPath);
+	std::rename(temporaryPath.c_str(), indexPath);
+	return true;
+}
+
+bool TextureManifest::readIndex(const char* indexPath, std::unordered_map<std::string, TextureInfo>& indexed) {
+	std::ifstream indexFile(indexPath, std::ios::binary);
+	if (!indexFile) return false;
+
+	IndexHeader header;
+	if (!indexFile.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+	if (std::memcmp(header.magic, "LOTM", 4) != 0 || header.formatVersion != 1) return false;
+
+	// One read for all records; parsing from memory is what keeps a warm scan fast
+	std::vector<char> contents((std::istreambuf_iterator<char>(indexFile)), std::istreambuf_iterator<char>());
+	const char* cursor = contents.data();
+	const char* end = cursor + contents.size();
+
+	indexed.reserve(header.recordCount);
+	for (unsigned i = 0; i < header.recordCount; ++i) {
+		IndexRecord record;
+		if (static_cast<size_t>(end - cursor) < sizeof(record)) break;
+		std::memcpy(&record, cursor, sizeof(record));
+		cursor += sizeof(record);
+		if (static_cast<size_t>(end - cursor) < record.pathLength) break;
+
+		std::string path(cursor, record.pathLength);
+		cursor += record.pathLength;
+		TextureInfo& info = indexed[path];
+		info.path = path;
+		info.modifiedTime = record.modifiedTime;
+		info.fileSize = record.fileSize;
+		info.width = record.width;
+		info.height = record.height;
+		info.channels = record.channels;
+		info.valid = (record.flags & ValidFlag) != 0;
+		info.is16Bit = (record.flags & Is16BitFlag) != 0;
+		info.isHDR = (record.flags & IsHDRFlag) != 0;
+	}
+
+	// A truncated index is not trusted at all
+	if (indexed.size() != header.recordCount) {
+		indexed.clear();
+		return false;
+	}
+	return true;
+}
+
+#ifdef _WIN32
+bool TextureManifest::listImages(const std::string& directory, const std::string& relativePath, std::vector<TextureInfo>& images) {
+	// The find data already carries size and write time, so no file is opened here
+	WIN32_FIND_DATAA findData;
+	std::string pattern = directory + "/" + relativePath + "*";
+	HANDLE find = FindFirstFileA(pattern.c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE) return false;
+	do {
+		const char* name = findData.cFileName;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+		std::string path = relativePath + name;
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			// Junctions and directory links can point back up the tree
+			if (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) continue;
+			listImages(directory, path + "/", images);
+		} else if (isImageName(name)) {
+			TextureInfo info;
+			info.path = path;
+			info.modifiedTime = static_cast<long long>((static_cast<unsigned long long>(findData.ftLastWriteTime.dwHighDateTime) << 32) | findData.ftLastWriteTime.dwLowDateTime);
+			info.fileSize = static_cast<long long>((static_cast<unsigned long long>(findData.nFileSizeHigh) << 32) | findData.nFileSizeLow);
+			images.push_back(info);
+		}
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+	return true;
+}
+#else
+bool TextureManifest::listImages(const std::string& directory, const std::string& relativePath, std::vector<TextureInfo>& images) {
+	std::string fullPath = directory + "/" + relativePath;
+	DIR* openedDirectory = opendir(fullPath.c_str());
+	if (openedDirectory == NULL) return false;
+	while (dirent* entry = readdir(openedDirectory)) {
+		const char* name = entry->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+		// Most file systems report the type, which saves a stat for every non-image file
+		if (entry->d_type == DT_REG && !isImageName(name)) continue;
+
+		// Links to image files are followed, links to directories are not: one pointing back up
+		// the tree would make the scan recurse forever
+		struct stat fileStatus;
+		if (fstatat(dirfd(openedDirectory), name, &fileStatus, AT_SYMLINK_NOFOLLOW) != 0) continue;
+		if (S_ISLNK(fileStatus.st_mode)) {
+			if (!isImageName(name) || fstatat(dirfd(openedDirectory), name, &fileStatus, 0) != 0 || !S_ISREG(fileStatus.st_mode)) continue;
+		}
+		std::string path = relativePath + name;
+		if (S_ISDIR(fileStatus.st_mode)) {
+			listImages(directory, path + "/", images);
+		} else if (S_ISREG(fileStatus.st_mode) && isImageName(name)) {
+			TextureInfo info;
+			info.path = path;
+			info.modifiedTime = static_cast<long long>(fileStatus.st_mtim.tv_sec) * 1000000000ll + fileStatus.st_mtim.tv_nsec;
+			info.fileSize = static_cast<long long>(fileStatus.st_size);
+			images.push_back(info);
+		}
+	}
+	closedir(openedDirectory);
+	return true;
+}
+#endif
+
+bool TextureManifest::isImageName(const char* name) {
+	const char* extension = std::strrchr(name, '.');
+	if (extension == NULL) return false;
+	char lowered[8];
+	size_t length = 0;
+	for (++extension; extension[length] != '\0'; ++length) {
+		if (length == sizeof(lowered) - 1) return false;
+		char c = extension[length];
+		lowered[length] = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+	lowered[length] = '\0';
+
+	static const char* const imageExtensions[] = { "png", "jpg", "jpeg", "bmp", "tga", "gif", "psd", "pic", "hdr", "pnm", "pgm", "ppm", "webp" };
+	for (const char* imageExtension : imageExtensions) {
+		if (std::strcmp(lowered, imageExtension) == 0) return true;
+	}
+	return false;
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef UNIFORM_RING_BUFFER
+#define UNIFORM_RING_BUFFER
+
+#include <glad/glad.h>
+#include "GLExtensions.h"
+#include "GLObjects.h"
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+
+// C++ mirrors of the std140 member types for declaring uniform blocks. Each starts at its
+// std140 offset, but a C++ type cannot be 12 bytes with 16-byte alignment, so Std140Vec3
+// takes 16 bytes where std140 lets a scalar use its last 4. Follow a vec3 only with
+// 16-byte aligned members (vec3, vec4, mat4) or end the block there. To mirror
+// "vec3 position; float intensity;", declare a Std140Vec4 and keep intensity in w.
+struct Std140Float { float value; };
+struct alignas(8) Std140Vec2 { float x, y; };
+struct alignas(16) Std140Vec3 { float x, y, z; };
+struct alignas(16) Std140Vec4 { float x, y, z, w; };
+struct alignas(16) Std140Mat4 { float columns[4][4]; };
+
+static_assert(sizeof(Std140Vec3) == 16 && sizeof(Std140Vec4) == 16, "std140 vec3/vec4 occupy 16 bytes");
+static_assert(sizeof(Std140Mat4) == 64, "std140 mat4 is four vec4 columns");
+
+// One block (or an array of equally sized blocks) carved out of the current frame's
+// region. data is only valid until finishWrites().
+struct UniformAllocation {
+	unsigned char* data;
+	unsigned offset;
+	unsigned blockSize;
+	unsigned stride;
+	unsigned count;
+};
+
+// Uniform buffer split into framesInFlight regions that are reused round robin. Each
+// frame writes all of its blocks into its own region, then binds them with
+// glBindBufferRange. A fence placed at endFrame() guards the region, so beginFrame()
+// only waits if the GPU is still reading the region about to be overwritten.
+// With GL_ARB_buffer_storage the buffer stays persistently mapped; otherwise the region
+// is mapped unsynchronized at beginFrame() and unmapped by finishWrites(), which must
+// happen before the frame's draws.
+class UniformRingBuffer {
+	public:
+		UniformRingBuffer(unsigned bytesPerFrame, unsigned framesInFlight = 3);
+		UniformRingBuffer(const UniformRingBuffer&) = delete;
+		UniformRingBuffer& operator=(const UniformRingBuffer&) = delete;
+		~UniformRingBuffer();
+
+		void beginFrame();
+		UniformAllocation allocate(unsigned blockSize, unsigned count = 1);
+		template <typename Block> UniformAllocation write(const Block& block);
+		void finishWrites();
+		void bind(unsigned bindingIndex, const UniformAllocation& allocation, unsigned element = 0) const;
+		void endFrame();
+
+	private:
+		Buffer buffer;
+		unsigned regionSize = 0;
+		unsigned regionCount = 0;
+		unsigned currentRegion = 0;
+		unsigned regionUsed = 0;
+		unsigned offsetAlignment = 256;
+		bool persistent = false;
+		unsigned char* persistentData = nullptr;
+		unsigned char* regionData = nullptr;
+		std::vector<GLsync> regionFences;
+
+		unsigned alignUp(unsigned value) const;
+};
+
+UniformRingBuffer::UniformRingBuffer(unsigned bytesPerFrame, unsigned framesInFlight) : regionCount(framesInFlight), regionFences(framesInFlight, nullptr) {
+	int alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if (alignment > 0) offsetAlignment = static_cast<unsigned>(alignment);
+	regionSize = alignUp(bytesPerFrame);
+
+	buffer = Buffer::create();
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+	GLsizeiptr totalSize = static_cast<GLsizeiptr>(regionSize) * regionCount;
+	persistent = GLEXT_buffer_storage;
+	if (persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glextBufferStorage(GL_UNIFORM_BUFFER, totalSize, NULL, flags);
+		persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, totalSize, flags));
+		persistent = persistentData != nullptr;
+	}
+	if (!persistent) glBufferData(GL_UNIFORM_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRingBuffer::~UniformRingBuffer() {
+	for (GLsync fence : regionFences) {
+		if (fence) glDeleteSync(fence);
+	}
+	if (persistent) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+}
+
+void UniformRingBuffer::beginFrame() {
+	GLsync& fence = regionFences[currentRegion];
+	if (fence) {
+		GLenum waitResult = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (waitResult == GL_TIMEOUT_EXPIRED) waitResult = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	regionUsed = 0;
+	GLintptr regionOffset = static_cast<GLintptr>(currentRegion) * regionSize;
+	if (persistent) {
+		regionData = persistentData + regionOffset;
+		return;
+	}
+	// The fence already guarantees the GPU is done with this region, so skip the driver's sync
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+	regionData = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, regionOffset, regionSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformAllocation UniformRingBuffer::allocate(unsigned blockSize, unsigned count) {
+	UniformAllocation allocation = { nullptr, 0, blockSize, alignUp(blockSize), count };
+	unsigned size = allocation.stride * count;
+	if (regionData == nullptr || regionUsed + size > regionSize) {
+		std::cout << "Uniform ring buffer region exhausted (" << regionUsed << " + " << size << " > " << regionSize << " bytes)" << std::endl;
+		allocation.count = 0;
+		return allocation;
+	}
+	allocation.data = regionData + regionUsed;
+	allocation.offset = currentRegion * regionSize + regionUsed;
+	regionUsed += size;
+	return allocation;
+}
+
+template <typename Block>
+UniformAllocation UniformRingBuffer::write(const Block& block) {
+	UniformAllocation allocation = allocate(static_cast<unsigned>(sizeof(Block)));
+	if (allocation.data) std::memcpy(allocation.data, &block, sizeof(Block));
+	return allocation;
+}
+
+void UniformRingBuffer::finishWrites() {
+	if (!persistent && regionData) {
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	regionData = nullptr;
+}
+
+void UniformRingBuffer::bind(unsigned bindingIndex, const UniformAllocation& allocation, unsigned element) const {
+	if (element >= allocation.count) return;
+	glBindBufferRange(GL_UNIFORM_BUFFER, bindingIndex, buffer.id(), allocation.offset + allocation.stride * element, allocation.blockSize);
+}
+
+void UniformRingBuffer::endFrame() {
+	if (regionData) finishWrites();
+	regionFences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	currentRegion = (currentRegion + 1) % regionCount;
+}
+
+unsigned UniformRingBuffer::alignUp(unsigned value) const {
+	return (value + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+}
+
+#endif
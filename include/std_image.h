@@ -31,6 +31,7 @@
       HDR (radiance rgbE format)
       PIC (Softimage PIC)
       PNM (PPM and PGM binary only)
+      WebP (lossy, lossless and lossy+alpha still images; no animation)
 
       Animated GIF still needs a proper API, but here's one way to do it:
           http://gist.github.com/urraka/685d9a6340b26b830d49
@@ -340,6 +341,7 @@ RECENT REVISION HISTORY:
 //        STBI_NO_HDR
 //        STBI_NO_PIC
 //        STBI_NO_PNM   (.ppm and .pgm)
+//        STBI_NO_WEBP
 //
 //  - You can request *only* certain decoders and suppress all other ones
 //    (this will be more forward-compatible, as addition of new decoders
@@ -354,6 +356,7 @@ RECENT REVISION HISTORY:
 //        STBI_ONLY_HDR
 //        STBI_ONLY_PIC
 //        STBI_ONLY_PNM   (.ppm and .pgm)
+//        STBI_ONLY_WEBP
 //
 //   - If you use STBI_NO_PNG (or _ONLY_ without PNG), and you still
 //     want the zlib decoder to be available, #define STBI_SUPPORT_ZLIB
@@ -433,6 +436,41 @@ extern "C" {
     STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp);
 #endif
 
+    // decode at 1/scale_denom of the size (scale_denom = 1, 2, 4 or 8), for thumbnails and
+    // low mip levels; x and y receive the reduced size, rounded up. JPEGs run reduced IDCTs
+    // and never build the full-size image; other formats are decoded and box filtered.
+    STBIDEF stbi_uc* stbi_load_scaled_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels, int scale_denom);
+#ifndef STBI_NO_STDIO
+    STBIDEF stbi_uc* stbi_load_scaled(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels, int scale_denom);
+#endif
+
+    // streaming decode for images too big to keep decoded in memory: instead of returning the
+    // image, hand it to rows(user, ...) in bands of whole rows while decoding. pixels holds
+    // num_rows rows of x * channels bytes starting at image row first_row, and is only valid
+    // during the call; return 0 from rows to stop decoding. Baseline JPEGs (a band per MCU row)
+    // and non-interlaced PNGs (bands of about 256KB) only ever hold a few bands; other files are
+    // decoded whole and handed over in one call. With flip-on-load set the bands arrive bottom
+    // up, each already flipped. Returns 1 on success, 0 on failure or when stopped.
+    typedef int (*stbi_rows_func)(void* user, stbi_uc const* pixels, int first_row, int num_rows, int x, int y, int channels);
+    STBIDEF int stbi_load_rows_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels, stbi_rows_func rows, void* user);
+    STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const* clbk, void* io_user, int* x, int* y, int* channels_in_file, int desired_channels, stbi_rows_func rows, void* user);
+#ifndef STBI_NO_STDIO
+    STBIDEF int stbi_load_rows(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels, stbi_rows_func rows, void* user);
+#endif
+
+    // early previews of progressive JPEGs: loads like stbi_load, and while a progressive JPEG
+    // is decoded hands preview(user, ...) the image as the scans so far make it, first once
+    // every component has its DC scan (about 1/8 of the detail, flat 8x8 blocks) and then
+    // after each later scan but the last. Previews have the final image's size, channels and
+    // orientation; pixels are only valid during the call, and scan counts the scans decoded
+    // so far. Return 0 from preview to skip the remaining previews; the load still finishes.
+    // Other files load without previews.
+    typedef int (*stbi_preview_func)(void* user, stbi_uc const* pixels, int x, int y, int channels, int scan);
+    STBIDEF stbi_uc* stbi_load_progressive_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels, stbi_preview_func preview, void* user);
+#ifndef STBI_NO_STDIO
+    STBIDEF stbi_uc* stbi_load_progressive(char const* filename, int* x, int* y, int* channels_in_file, int desired_channels, stbi_preview_func preview, void* user);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
     STBIDEF int stbi_convert_wchar_to_utf8(char* buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -501,6 +539,19 @@ extern "C" {
     STBIDEF int      stbi_info_from_file(FILE* f, int* x, int* y, int* comp);
     STBIDEF int      stbi_is_16_bit(char const* filename);
     STBIDEF int      stbi_is_16_bit_from_file(FILE* f);
+
+    // the above for many files at once, for building asset manifests. each file's first
+    // bytes pick the format's info routine instead of trying every format in turn, and the
+    // files are shared out over the stbi_set_parallel_for callback when one is set. files
+    // that can't be opened or aren't images get ok = 0. returns the number with ok = 1.
+    typedef struct
+    {
+        int x, y, channels;
+        int is_16_bit; // as stbi_is_16_bit
+        int is_hdr;    // as stbi_is_hdr
+        int ok;
+    } stbi_info_result;
+    STBIDEF int      stbi_info_many(char const* const* filenames, int count, stbi_info_result* results);
 #endif
 
 
@@ -524,6 +575,40 @@ extern "C" {
     STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
     STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+    // optional parallel-for used to split work inside a single image (currently JPEGs
+    // decoded from memory). parallel_for must call task(task_data, i) for every i in
+    // [0, count), in any order and on any threads, and return only once all calls are
+    // done. pass NULL to go back to single-threaded decoding.
+    typedef void (*stbi_parallel_for_func)(void* user, int count, void (*task)(void* task_data, int index), void* task_data);
+    STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func parallel_for, void* user);
+
+    // bump-allocation arena for batch loading. while an arena is set on a thread, everything
+    // stb_image allocates on that thread comes from the arena instead of STBI_MALLOC, the
+    // returned images (and GIF delays) included: don't stbi_image_free those, they stay valid
+    // until stbi_arena_reset or stbi_arena_destroy. reset makes the memory reusable for the
+    // next image, merged into one block big enough for the last one, so a batch of similar
+    // images stops calling STBI_MALLOC after the first. block_size 0 picks 1MB. an arena
+    // may only be set on one thread at a time; without thread-local support the setting is
+    // process-wide.
+    typedef struct stbi_arena stbi_arena;
+    STBIDEF stbi_arena* stbi_arena_create(size_t block_size);
+    STBIDEF void        stbi_arena_reset(stbi_arena* arena);
+    STBIDEF void        stbi_arena_destroy(stbi_arena* arena);
+    STBIDEF void        stbi_set_thread_arena(stbi_arena* arena_or_null);
+
+    // allocation counters for the calling thread (the whole process without thread-local
+    // support), to compare heap traffic with and without an arena
+    typedef struct
+    {
+        unsigned long long heap_allocs;  // STBI_MALLOC and STBI_REALLOC calls, arena blocks included
+        unsigned long long heap_frees;   // STBI_FREE calls and blocks moved by STBI_REALLOC
+        unsigned long long heap_bytes;   // bytes requested from STBI_MALLOC and STBI_REALLOC
+        unsigned long long arena_allocs; // allocations served from an arena
+        unsigned long long arena_bytes;
+    } stbi_alloc_stats;
+    STBIDEF void stbi_get_alloc_stats(stbi_alloc_stats* stats);
+    STBIDEF void stbi_reset_alloc_stats(void);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen);
@@ -549,7 +634,7 @@ extern "C" {
 #if defined(STBI_ONLY_JPEG) || defined(STBI_ONLY_PNG) || defined(STBI_ONLY_BMP) \
   || defined(STBI_ONLY_TGA) || defined(STBI_ONLY_GIF) || defined(STBI_ONLY_PSD) \
   || defined(STBI_ONLY_HDR) || defined(STBI_ONLY_PIC) || defined(STBI_ONLY_PNM) \
-  || defined(STBI_ONLY_ZLIB)
+  || defined(STBI_ONLY_WEBP) || defined(STBI_ONLY_ZLIB)
 #ifndef STBI_ONLY_JPEG
 #define STBI_NO_JPEG
 #endif
@@ -577,6 +662,9 @@ extern "C" {
 #ifndef STBI_ONLY_PNM
 #define STBI_NO_PNM
 #endif
+#ifndef STBI_ONLY_WEBP
+#define STBI_NO_WEBP
+#endif
 #endif
 
 #if defined(STBI_NO_PNG) && !defined(STBI_SUPPORT_ZLIB) && !defined(STBI_NO_ZLIB)
@@ -643,12 +731,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned long long stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -750,7 +840,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_WEBP) || !defined(STBI_NO_HDR)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     int info3 = stbi__cpuid3();
@@ -761,7 +851,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_WEBP) || !defined(STBI_NO_HDR)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     // If we're even attempting to compile this on GCC/Clang, that means
@@ -774,6 +864,63 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled with a per-function target attribute, so the rest of the
+// file keeps the baseline instruction set; they are only selected after CPUID and
+// XGETBV report AVX2 support with the YMM state enabled by the OS.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && ((defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+#else
+#include <cpuid.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_HDR)
+static int stbi__avx2_available(void)
+{
+    unsigned int ecx1, ebx7, xcr0;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    ecx1 = (unsigned int)info[2];
+    __cpuidex(info, 7, 0);
+    ebx7 = (unsigned int)info[1];
+    if (((ecx1 >> 27) & 1) == 0) return 0; // OSXSAVE
+    xcr0 = (unsigned int)_xgetbv(0);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7) return 0;
+    __cpuid(1, eax, ebx, ecx, edx);
+    ecx1 = ecx;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx7 = ebx;
+    if (((ecx1 >> 27) & 1) == 0) return 0; // OSXSAVE
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(edx) : "c"(0));
+#endif
+    return ((ecx1 >> 28) & 1) != 0 // AVX
+        && (xcr0 & 6) == 6         // XMM and YMM state saved by the OS
+        && ((ebx7 >> 5) & 1) != 0; // AVX2
+}
+#endif
+#endif
+
+// SSSE3 (pshufb) kernels follow the same scheme: a per-function target attribute and a
+// CPUID check before they are picked.
+#if defined(STBI_SSE2) && !defined(STBI_NO_SSSE3) && ((defined(_MSC_VER) && _MSC_VER >= 1900) || defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define STBI_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#define STBI__SSSE3_TARGET
+#else
+#include <cpuid.h>
+#define STBI__SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -800,6 +947,26 @@ static int stbi__sse2_available(void)
 //
 //  stbi__context struct and start_xxx functions
 
+// destination of a stbi_load_rows decode
+typedef struct
+{
+    stbi_rows_func func;
+    void* user;
+    int flip;
+    int streamed; // set by a loader that handed over every row itself
+} stbi__rows;
+
+// destination of stbi_load_progressive previews
+typedef struct
+{
+    stbi_preview_func func; // cleared once it asks for no more previews
+    void* user;
+    int req_comp;
+    int scans;
+    int dc_seen, ac_seen; // a bit per component with DC / AC coefficients decoded
+    stbi_uc* pixels; // the preview image, reused from one preview to the next
+} stbi__preview;
+
 // stbi__context structure is our basic context used by all images, so it
 // contains all the IO context, plus some basic image information
 typedef struct
@@ -817,6 +984,11 @@ typedef struct
 
     stbi_uc* img_buffer, * img_buffer_end;
     stbi_uc* img_buffer_original, * img_buffer_original_end;
+
+    int scale_shift; // log2 of the stbi_load_scaled divisor, 0 for a full-size load
+    stbi__rows* rows; // set by stbi_load_rows; loaders that can stream hand rows over as they go
+    int flip; // flip-on-load requested; loaders that honour it write the rows bottom-up themselves
+    stbi__preview* preview; // set by stbi_load_progressive
 } stbi__context;
 
 
@@ -830,6 +1002,10 @@ static void stbi__start_mem(stbi__context* s, stbi_uc const* buffer, int len)
     s->callback_already_read = 0;
     s->img_buffer = s->img_buffer_original = (stbi_uc*)buffer;
     s->img_buffer_end = s->img_buffer_original_end = (stbi_uc*)buffer + len;
+    s->scale_shift = 0;
+    s->rows = NULL;
+    s->flip = 0;
+    s->preview = NULL;
 }
 
 // initialize a callback-based context
@@ -843,7 +1019,20 @@ static void stbi__start_callbacks(stbi__context* s, stbi_io_callbacks* c, void*
     s->img_buffer = s->img_buffer_original = s->buffer_start;
     stbi__refill_buffer(s);
     s->img_buffer_original_end = s->img_buffer_end;
+    s->scale_shift = 0;
+    s->rows = NULL;
+    s->flip = 0;
+    s->preview = NULL;
+}
+
+#if !defined(STBI_NO_PNG) || !defined(STBI_NO_BMP) || !defined(STBI_NO_TGA)
+// whether a loader that leaves stbi_load_scaled to the postprocessing should write its rows
+// flipped; the box downscale groups rows from the top, so that only works at full size
+static int stbi__flip_full_size(stbi__context* s)
+{
+    return s->flip && s->scale_shift == 0;
 }
+#endif
 
 #ifndef STBI_NO_STDIO
 
@@ -903,6 +1092,8 @@ typedef struct
     int bits_per_channel;
     int num_channels;
     int channel_order;
+    int scale_shift; // set by loaders that already decoded at the stbi_load_scaled size
+    int flipped; // set by loaders that already wrote the rows in flipped order
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -963,6 +1154,12 @@ static int      stbi__pnm_info(stbi__context* s, int* x, int* y, int* comp);
 static int      stbi__pnm_is16(stbi__context* s);
 #endif
 
+#ifndef STBI_NO_WEBP
+static int      stbi__webp_test(stbi__context* s);
+static void* stbi__webp_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
+static int      stbi__webp_info(stbi__context* s, int* x, int* y, int* comp);
+#endif
+
 static
 #ifdef STBI_THREAD_LOCAL
 STBI_THREAD_LOCAL
@@ -982,11 +1179,199 @@ static int stbi__err(const char* str)
 }
 #endif
 
-static void* stbi__malloc(size_t size)
+// stbi_arena: blocks of STBI_MALLOC memory handed out front to back, 16-byte aligned for
+// the SIMD paths. Only the most recent allocation can be freed or grown in place, which
+// covers temporaries freed right after use and the growing IDAT and zlib output buffers;
+// anything else freed stays used until the reset.
+#define STBI__ARENA_ALIGN(n)       (((n) + 15) & ~(size_t)15)
+#define STBI__ARENA_DEFAULT_BLOCK  (1 << 20)
+
+typedef struct stbi__arena_block
+{
+    struct stbi__arena_block* next; // older blocks
+    char* data;
+    size_t size, used;
+} stbi__arena_block;
+
+struct stbi_arena
+{
+    stbi__arena_block* block; // the one being allocated from
+    size_t next_size;
+    size_t in_use, peak;      // bytes live since the reset, as if in a single block
+    char* last;               // most recent allocation
+    size_t last_size;
+};
+
+static
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL
+#endif
+stbi_arena* stbi__thread_arena;
+
+static
+#ifdef STBI_THREAD_LOCAL
+STBI_THREAD_LOCAL
+#endif
+stbi_alloc_stats stbi__alloc_stats;
+
+STBIDEF void stbi_get_alloc_stats(stbi_alloc_stats* stats)
+{
+    *stats = stbi__alloc_stats;
+}
+
+STBIDEF void stbi_reset_alloc_stats(void)
 {
+    memset(&stbi__alloc_stats, 0, sizeof(stbi__alloc_stats));
+}
+
+static void* stbi__heap_malloc(size_t size)
+{
+    ++stbi__alloc_stats.heap_allocs;
+    stbi__alloc_stats.heap_bytes += size;
     return STBI_MALLOC(size);
 }
 
+static void stbi__heap_free(void* p)
+{
+    if (p) ++stbi__alloc_stats.heap_frees;
+    STBI_FREE(p);
+}
+
+static stbi__arena_block* stbi__arena_new_block(size_t size)
+{
+    stbi__arena_block* b = (stbi__arena_block*)stbi__heap_malloc(sizeof(stbi__arena_block) + size + 15);
+    if (!b) return NULL;
+    b->next = NULL;
+    b->data = (char*)STBI__ARENA_ALIGN((size_t)(b + 1));
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+static void stbi__arena_free_blocks(stbi__arena_block* b)
+{
+    while (b) {
+        stbi__arena_block* next = b->next;
+        stbi__heap_free(b);
+        b = next;
+    }
+}
+
+static void* stbi__arena_alloc(stbi_arena* a, size_t size)
+{
+    stbi__arena_block* b = a->block;
+    char* p;
+    size = size ? STBI__ARENA_ALIGN(size) : 16;
+    if (!b || b->size - b->used < size) {
+        size_t block_size = a->next_size > size ? a->next_size : size;
+        b = stbi__arena_new_block(block_size);
+        if (!b) return NULL;
+        b->next = a->block;
+        a->block = b;
+        a->next_size = block_size * 2;
+    }
+    p = b->data + b->used;
+    b->used += size;
+    a->in_use += size;
+    if (a->in_use > a->peak) a->peak = a->in_use;
+    a->last = p;
+    a->last_size = size;
+    ++stbi__alloc_stats.arena_allocs;
+    stbi__alloc_stats.arena_bytes += size;
+    return p;
+}
+
+static int stbi__arena_owns(stbi_arena* a, void* p)
+{
+    stbi__arena_block* b;
+    for (b = a->block; b; b = b->next)
+        if ((size_t)p >= (size_t)b->data && (size_t)p < (size_t)b->data + b->size)
+            return 1;
+    return 0;
+}
+
+STBIDEF stbi_arena* stbi_arena_create(size_t block_size)
+{
+    stbi_arena* a = (stbi_arena*)stbi__heap_malloc(sizeof(stbi_arena));
+    if (!a) return NULL;
+    memset(a, 0, sizeof(*a));
+    a->next_size = block_size ? block_size : STBI__ARENA_DEFAULT_BLOCK;
+    return a;
+}
+
+STBIDEF void stbi_arena_reset(stbi_arena* a)
+{
+    if (a->block && a->block->next) {
+        // one block that fits everything the last image needed at once
+        stbi__arena_free_blocks(a->block);
+        a->block = stbi__arena_new_block(a->peak);
+    }
+    if (a->block) a->block->used = 0;
+    a->in_use = a->peak = 0;
+    a->last = NULL;
+}
+
+STBIDEF void stbi_arena_destroy(stbi_arena* a)
+{
+    if (!a) return;
+    if (stbi__thread_arena == a) stbi__thread_arena = NULL;
+    stbi__arena_free_blocks(a->block);
+    stbi__heap_free(a);
+}
+
+STBIDEF void stbi_set_thread_arena(stbi_arena* arena_or_null)
+{
+    stbi__thread_arena = arena_or_null;
+}
+
+static void* stbi__malloc(size_t size)
+{
+    if (stbi__thread_arena) return stbi__arena_alloc(stbi__thread_arena, size);
+    return stbi__heap_malloc(size);
+}
+
+static void stbi__free(void* p)
+{
+    stbi_arena* a = stbi__thread_arena;
+    if (a && p && stbi__arena_owns(a, p)) {
+        if ((char*)p == a->last) {
+            a->block->used -= a->last_size;
+            a->in_use -= a->last_size;
+            a->last = NULL;
+        }
+        return;
+    }
+    stbi__heap_free(p);
+}
+
+#if !defined(STBI_NO_ZLIB) || !(defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_WEBP))
+static void* stbi__realloc_sized(void* p, size_t old_size, size_t new_size)
+{
+    stbi_arena* a = stbi__thread_arena;
+    if (a && (!p || stbi__arena_owns(a, p))) {
+        void* q;
+        size_t size = new_size ? STBI__ARENA_ALIGN(new_size) : 16;
+        if (p && (char*)p == a->last && (size_t)(a->block->data + a->block->size - a->last) >= size) {
+            // the newest allocation grows (or shrinks) where it is
+            a->block->used += size - a->last_size;
+            a->in_use += size - a->last_size;
+            if (a->in_use > a->peak) a->peak = a->in_use;
+            a->last_size = size;
+            return p;
+        }
+        q = stbi__arena_alloc(a, new_size);
+        if (q && p) memcpy(q, p, old_size < new_size ? old_size : new_size);
+        return q;
+    }
+    // counted as a new block plus freeing the old one so allocs and frees still pair up
+    ++stbi__alloc_stats.heap_allocs;
+    if (p) ++stbi__alloc_stats.heap_frees;
+    stbi__alloc_stats.heap_bytes += new_size;
+    STBI_NOTUSED(old_size);
+    return STBI_REALLOC_SIZED(p, old_size, new_size);
+}
+#endif
+
 // stb_image uses ints pervasively, including for offset calculations.
 // therefore the largest decoded image size we can support with the
 // current code, even on 64-bit targets, is INT_MAX. this is not a
@@ -1019,7 +1404,7 @@ static int stbi__mul2sizes_valid(int a, int b)
     return a <= INT_MAX / b;
 }
 
-#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_TGA) || !defined(STBI_NO_HDR)
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_TGA) || !defined(STBI_NO_HDR) || !defined(STBI_NO_WEBP)
 // returns 1 if "a*b + add" has no negative terms/factors and doesn't overflow
 static int stbi__mad2sizes_valid(int a, int b, int add)
 {
@@ -1043,7 +1428,7 @@ static int stbi__mad4sizes_valid(int a, int b, int c, int d, int add)
 }
 #endif
 
-#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_TGA) || !defined(STBI_NO_HDR)
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG) || !defined(STBI_NO_TGA) || !defined(STBI_NO_HDR) || !defined(STBI_NO_WEBP)
 // mallocs with size overflow checking
 static void* stbi__malloc_mad2(int a, int b, int add)
 {
@@ -1100,7 +1485,7 @@ static int stbi__mul2shorts_valid(int a, int b)
 
 STBIDEF void stbi_image_free(void* retval_from_stbi_load)
 {
-    STBI_FREE(retval_from_stbi_load);
+    stbi__free(retval_from_stbi_load);
 }
 
 #ifndef STBI_NO_LINEAR
@@ -1134,6 +1519,15 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static stbi_parallel_for_func stbi__parallel_for = NULL;
+static void* stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for_func parallel_for, void* user)
+{
+    stbi__parallel_for = parallel_for;
+    stbi__parallel_for_user = user;
+}
+
 static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1160,6 +1554,9 @@ static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int re
 #ifndef STBI_NO_PIC
     if (stbi__pic_test(s))  return stbi__pic_load(s, x, y, comp, req_comp, ri);
 #endif
+#ifndef STBI_NO_WEBP
+    if (stbi__webp_test(s)) return stbi__webp_load(s, x, y, comp, req_comp, ri);
+#endif
 
     // then the formats that can end up attempting to load with just 1 or 2
     // bytes matching expectations; these are prone to false positives, so
@@ -1199,7 +1596,7 @@ static stbi_uc* stbi__convert_16_to_8(stbi__uint16* orig, int w, int h, int chan
     for (i = 0; i < img_len; ++i)
         reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
-    STBI_FREE(orig);
+    stbi__free(orig);
     return reduced;
 }
 
@@ -1215,10 +1612,39 @@ static stbi__uint16* stbi__convert_8_to_16(stbi_uc* orig, int w, int h, int chan
     for (i = 0; i < img_len; ++i)
         enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
 
-    STBI_FREE(orig);
+    stbi__free(orig);
     return enlarged;
 }
 
+// box filter an 8-bit image down by 1 << shift in place, for loaders that can't decode at
+// reduced size; boxes on the right and bottom edges average only the pixels that exist
+static void stbi__downscale_box(stbi_uc* image, int* w, int* h, int channels, int shift)
+{
+    int scale = 1 << shift;
+    int ow = (*w + scale - 1) >> shift, oh = (*h + scale - 1) >> shift;
+    int ox, oy, x, y, c;
+    stbi_uc* out = image;
+
+    // output pixel (ox,oy) never lies past the first input pixel of its box, so writing
+    // in order can't clobber input that is still needed
+    for (oy = 0; oy < oh; ++oy) {
+        int y0 = oy << shift, y1 = y0 + scale < *h ? y0 + scale : *h;
+        for (ox = 0; ox < ow; ++ox) {
+            int x0 = ox << shift, x1 = x0 + scale < *w ? x0 + scale : *w;
+            int count = (x1 - x0) * (y1 - y0);
+            for (c = 0; c < channels; ++c) {
+                int sum = count >> 1; // rounding
+                for (y = y0; y < y1; ++y)
+                    for (x = x0; x < x1; ++x)
+                        sum += image[((size_t)y * *w + x) * channels + c];
+                *out++ = (stbi_uc)(sum / count);
+            }
+        }
+    }
+    *w = ow;
+    *h = oh;
+}
+
 static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
 {
     int row;
@@ -1243,6 +1669,21 @@ static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
     }
 }
 
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)
+// hand rows [first_row, first_row + num_rows) of a w x h image to the stbi_load_rows callback;
+// with flip-on-load the band is flipped in place and lands at the mirrored rows
+static int stbi__emit_rows(stbi__rows* rows, stbi_uc* pixels, int first_row, int num_rows, int w, int h, int channels)
+{
+    if (rows->flip) {
+        stbi__vertical_flip(pixels, w, num_rows, channels);
+        first_row = h - first_row - num_rows;
+    }
+    if (!rows->func(rows->user, pixels, first_row, num_rows, w, h, channels))
+        return stbi__err("stopped", "Row callback stopped the load");
+    return 1;
+}
+#endif
+
 #ifndef STBI_NO_GIF
 static void stbi__vertical_flip_slices(void* image, int w, int h, int z, int bytes_per_pixel)
 {
@@ -1260,7 +1701,10 @@ static void stbi__vertical_flip_slices(void* image, int w, int h, int z, int byt
 static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x, int* y, int* comp, int req_comp)
 {
     stbi__result_info ri;
-    void* result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+    void* result;
+
+    s->flip = stbi__vertically_flip_on_load != 0;
+    result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
 
     if (result == NULL)
         return NULL;
@@ -1273,9 +1717,13 @@ static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x,
         ri.bits_per_channel = 8;
     }
 
+    // stbi_load_scaled with a loader that only decodes at full size
+    if (s->scale_shift > ri.scale_shift)
+        stbi__downscale_box((stbi_uc*)result, x, y, req_comp ? req_comp : *comp, s->scale_shift);
+
     // @TODO: move stbi__convert_format to here
 
-    if (stbi__vertically_flip_on_load) {
+    if (stbi__vertically_flip_on_load && !ri.flipped) {
         int channels = req_comp ? req_comp : *comp;
         stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
     }
@@ -1283,10 +1731,53 @@ static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x,
     return (unsigned char*)result;
 }
 
+// loaders that can stream hand the rows over themselves, then return NULL with
+// rows->streamed set; everything else is decoded whole and handed over in one call
+static int stbi__load_rows_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi_rows_func func, void* user)
+{
+    stbi__rows rows;
+    stbi_uc* result;
+    int ok = 1, file_comp;
+
+    rows.func = func;
+    rows.user = user;
+    rows.flip = stbi__vertically_flip_on_load;
+    rows.streamed = 0;
+    s->rows = &rows;
+    result = stbi__load_and_postprocess_8bit(s, x, y, &file_comp, req_comp);
+    if (comp && (result || rows.streamed)) *comp = file_comp;
+    if (result == NULL)
+        return rows.streamed;
+
+    // already flipped by the postprocessing if requested
+    if (!func(user, result, 0, *y, *x, *y, req_comp ? req_comp : file_comp))
+        ok = stbi__err("stopped", "Row callback stopped the load");
+    stbi_image_free(result);
+    return ok;
+}
+
+static stbi_uc* stbi__load_progressive_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi_preview_func func, void* user)
+{
+    stbi__preview preview;
+    stbi_uc* result;
+
+    memset(&preview, 0, sizeof(preview));
+    preview.func = func;
+    preview.user = user;
+    preview.req_comp = req_comp;
+    s->preview = &preview;
+    result = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+    stbi__free(preview.pixels);
+    return result;
+}
+
 static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x, int* y, int* comp, int req_comp)
 {
     stbi__result_info ri;
-    void* result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
+    void* result;
+
+    s->flip = stbi__vertically_flip_on_load != 0;
+    result = stbi__load_main(s, x, y, comp, req_comp, &ri, 16);
 
     if (result == NULL)
         return NULL;
@@ -1302,7 +1793,7 @@ static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x,
     // @TODO: move stbi__convert_format16 to here
     // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-    if (stbi__vertically_flip_on_load) {
+    if (stbi__vertically_flip_on_load && !ri.flipped) {
         int channels = req_comp ? req_comp : *comp;
         stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
     }
@@ -1310,6 +1801,17 @@ static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x,
     return (stbi__uint16*)result;
 }
 
+static int stbi__scale_shift(int scale_denom)
+{
+    switch (scale_denom) {
+    case 1: return 0;
+    case 2: return 1;
+    case 4: return 2;
+    case 8: return 3;
+    default: return -1;
+    }
+}
+
 #if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
 static void stbi__float_postprocess(float* result, int* x, int* y, int* comp, int req_comp)
 {
@@ -1363,6 +1865,46 @@ static FILE* stbi__fopen(char const* filename, char const* mode)
 }
 
 
+STBIDEF stbi_uc* stbi_load_scaled(char const* filename, int* x, int* y, int* comp, int req_comp, int scale_denom)
+{
+    FILE* f;
+    stbi__context s;
+    unsigned char* result;
+    int shift = stbi__scale_shift(scale_denom);
+    if (shift < 0) return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+    f = stbi__fopen(filename, "rb");
+    if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+    stbi__start_file(&s, f);
+    s.scale_shift = shift;
+    result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_load_rows(char const* filename, int* x, int* y, int* comp, int req_comp, stbi_rows_func rows, void* user)
+{
+    FILE* f = stbi__fopen(filename, "rb");
+    stbi__context s;
+    int result;
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    stbi__start_file(&s, f);
+    result = stbi__load_rows_main(&s, x, y, comp, req_comp, rows, user);
+    fclose(f);
+    return result;
+}
+
+STBIDEF stbi_uc* stbi_load_progressive(char const* filename, int* x, int* y, int* comp, int req_comp, stbi_preview_func preview, void* user)
+{
+    FILE* f = stbi__fopen(filename, "rb");
+    stbi__context s;
+    stbi_uc* result;
+    if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+    stbi__start_file(&s, f);
+    result = stbi__load_progressive_main(&s, x, y, comp, req_comp, preview, user);
+    fclose(f);
+    return result;
+}
+
 STBIDEF stbi_uc* stbi_load(char const* filename, int* x, int* y, int* comp, int req_comp)
 {
     FILE* f = stbi__fopen(filename, "rb");
@@ -1440,6 +1982,37 @@ STBIDEF stbi_uc* stbi_load_from_callbacks(stbi_io_callbacks const* clbk, void* u
     return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF stbi_uc* stbi_load_scaled_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp, int scale_denom)
+{
+    stbi__context s;
+    int shift = stbi__scale_shift(scale_denom);
+    if (shift < 0) return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+    stbi__start_mem(&s, buffer, len);
+    s.scale_shift = shift;
+    return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp, stbi_rows_func rows, void* user)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_rows_main(&s, x, y, comp, req_comp, rows, user);
+}
+
+STBIDEF int stbi_load_rows_from_callbacks(stbi_io_callbacks const* clbk, void* io_user, int* x, int* y, int* comp, int req_comp, stbi_rows_func rows, void* user)
+{
+    stbi__context s;
+    stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, io_user);
+    return stbi__load_rows_main(&s, x, y, comp, req_comp, rows, user);
+}
+
+STBIDEF stbi_uc* stbi_load_progressive_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp, stbi_preview_func preview, void* user)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_progressive_main(&s, x, y, comp, req_comp, preview, user);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
 {
@@ -1623,7 +2196,7 @@ stbi_inline static stbi_uc stbi__get8(stbi__context* s)
     return 0;
 }
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_HDR) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_WEBP)
 // nothing
 #else
 stbi_inline static int stbi__at_eof(stbi__context* s)
@@ -1639,7 +2212,7 @@ stbi_inline static int stbi__at_eof(stbi__context* s)
 }
 #endif
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_WEBP)
 // nothing
 #else
 static void stbi__skip(stbi__context* s, int n)
@@ -1661,7 +2234,7 @@ static void stbi__skip(stbi__context* s, int n)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_TGA) && defined(STBI_NO_HDR) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_TGA) && defined(STBI_NO_HDR) && defined(STBI_NO_PNM) && defined(STBI_NO_WEBP)
 // nothing
 #else
 static int stbi__getn(stbi__context* s, stbi_uc* buffer, int n)
@@ -1690,7 +2263,7 @@ static int stbi__getn(stbi__context* s, stbi_uc* buffer, int n)
 }
 #endif
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC) && defined(STBI_NO_WEBP)
 // nothing
 #else
 static int stbi__get16be(stbi__context* s)
@@ -1700,7 +2273,7 @@ static int stbi__get16be(stbi__context* s)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD) && defined(STBI_NO_PIC) && defined(STBI_NO_WEBP)
 // nothing
 #else
 static stbi__uint32 stbi__get32be(stbi__context* s)
@@ -1710,7 +2283,7 @@ static stbi__uint32 stbi__get32be(stbi__context* s)
 }
 #endif
 
-#if defined(STBI_NO_BMP) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF)
+#if defined(STBI_NO_BMP) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_WEBP)
 // nothing
 #else
 static int stbi__get16le(stbi__context* s)
@@ -1720,7 +2293,9 @@ static int stbi__get16le(stbi__context* s)
 }
 #endif
 
-#ifndef STBI_NO_BMP
+#if defined(STBI_NO_BMP) && defined(STBI_NO_WEBP)
+// nothing
+#else
 static stbi__uint32 stbi__get32le(stbi__context* s)
 {
     stbi__uint32 z = stbi__get16le(s);
@@ -1731,7 +2306,7 @@ static stbi__uint32 stbi__get32le(stbi__context* s)
 
 #define STBI__BYTECAST(x)  ((stbi_uc) ((x) & 255))  // truncate int to byte without warnings
 
-#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_WEBP)
 // nothing
 #else
 //////////////////////////////////////////////////////////////////////////////
@@ -1742,7 +2317,8 @@ static stbi__uint32 stbi__get32le(stbi__context* s)
 //    and it never has alpha, so very few cases ). png can automatically
 //    interleave an alpha=255 channel, but falls back to this for other cases
 //
-//  assume data buffer is malloced, so malloc a new one and free that one
+//  assume data buffer is malloced: it is converted in place when the result fits,
+//  or grown and expanded in place by the SIMD kernels, else replaced by a new one
 //  only failure mode is malloc failing
 
 static stbi_uc stbi__compute_y(int r, int g, int b)
@@ -1751,86 +2327,409 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM)
+#if defined(STBI_NO_PNG) && defined(STBI_NO_BMP) && defined(STBI_NO_PSD) && defined(STBI_NO_TGA) && defined(STBI_NO_GIF) && defined(STBI_NO_PIC) && defined(STBI_NO_PNM) && defined(STBI_NO_WEBP)
 // nothing
 #else
-static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
-{
-    int i, j;
-    unsigned char* good;
-
-    if (req_comp == img_n) return data;
-    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+#if defined(STBI_SSSE3) || defined(STBI_NEON)
+#define STBI__CONVERT_SIMD
 
-    good = (unsigned char*)stbi__malloc_mad3(req_comp, x, y, 0);
-    if (good == NULL) {
-        STBI_FREE(data);
-        return stbi__errpuc("outofmem", "Out of memory");
+// SIMD channel conversion. Without luminance every combination is a byte shuffle, which
+// SSSE3 does with one pshufb per 16 bytes and NEON by de- and re-interleaving 16 (8 for
+// 16-bit) pixels with vld/vst. Luminance uses the integer weights of stbi__compute_y, so
+// the results match the scalar code exactly; 16-bit luminance is left to it.
+typedef struct
+{
+    int img_n, req_comp, bytes;
+    int step;  // pixels per kernel step, 0 when there is no kernel for the combination
+    int exact; // steps store only their own pixels, so they can run back to front
+    int luma;
+    int map[4];
+#ifdef STBI_SSSE3
+    stbi_uc shuffle[16], fill[16];
+#endif
+} stbi__convert_kernel;
+
+// input channel copied to each output channel, -1 for an opaque alpha channel; returns 0
+// for the combinations that compute luminance instead
+static int stbi__convert_channel_map(int img_n, int req_comp, int map[4])
+{
+    int c;
+    if (img_n >= 3 && req_comp <= 2) return 0;
+    for (c = 0; c < req_comp; ++c) {
+        if ((req_comp == 2 || req_comp == 4) && c == req_comp - 1)
+            map[c] = (img_n == 2 || img_n == 4) ? img_n - 1 : -1;
+        else
+            map[c] = img_n <= 2 ? 0 : c;
     }
+    return 1;
+}
 
-    for (j = 0; j < (int)y; ++j) {
-        unsigned char* src = data + j * x * img_n;
-        unsigned char* dest = good + j * x * req_comp;
-
-#define STBI__COMBO(a,b)  ((a)*8+(b))
-#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-        // convert source image with img_n components to one with req_comp components;
-        // avoid switch per pixel, so use switch per scanline and massive macros
-        switch (STBI__COMBO(img_n, req_comp)) {
-            STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
-            STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-            STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
-            STBI__CASE(2, 1) { dest[0] = src[0]; } break;
-            STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-            STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
-            STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 255; } break;
-            STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-            STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
-            STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-            STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
-            STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
-        default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return stbi__errpuc("unsupported", "Unsupported format conversion");
+#ifdef STBI_SSSE3
+static int stbi__ssse3_available(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] >> 9) & 1;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+    return (ecx >> 9) & 1;
+#endif
+}
+
+STBI__SSSE3_TARGET
+static void stbi__convert_shuffle_ssse3(const stbi__convert_kernel* k, const stbi_uc* src, stbi_uc* dest, int pixels, int backward)
+{
+    __m128i shuffle = _mm_loadu_si128((const __m128i*)k->shuffle);
+    __m128i fill = _mm_loadu_si128((const __m128i*)k->fill);
+    size_t in_step = (size_t)k->step * k->img_n * k->bytes;
+    size_t out_step = (size_t)k->step * k->req_comp * k->bytes;
+    int steps = pixels / k->step, i;
+    // two steps per iteration, both loaded before either is stored; a forward step may store
+    // past its own pixels, which the next step overwrites
+    for (i = 0; i + 2 <= steps; i += 2) {
+        size_t s0 = (size_t)(backward ? steps - 1 - i : i);
+        size_t s1 = backward ? s0 - 1 : s0 + 1;
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(src + s0 * in_step));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(src + s1 * in_step));
+        _mm_storeu_si128((__m128i*)(dest + s0 * out_step), _mm_or_si128(_mm_shuffle_epi8(v0, shuffle), fill));
+        _mm_storeu_si128((__m128i*)(dest + s1 * out_step), _mm_or_si128(_mm_shuffle_epi8(v1, shuffle), fill));
+    }
+    if (i < steps) {
+        size_t s0 = (size_t)(backward ? 0 : i);
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(src + s0 * in_step));
+        _mm_storeu_si128((__m128i*)(dest + s0 * out_step), _mm_or_si128(_mm_shuffle_epi8(v0, shuffle), fill));
+    }
+}
+
+STBI__SSSE3_TARGET
+static void stbi__convert_luma_ssse3(const stbi__convert_kernel* k, const stbi_uc* src, stbi_uc* dest, int pixels)
+{
+    // rgb pixels are spread to rgb0 first; then the even bytes (r, b) and odd bytes (g, a)
+    // of every pixel each make one multiply-add
+    const __m128i rgb_to_rgb0 = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i low_bytes = _mm_set1_epi16(0xff);
+    const __m128i rb_weights = _mm_set1_epi32((29 << 16) | 77);
+    const __m128i g_weight = _mm_set1_epi32(150);
+    const __m128i opaque = _mm_set1_epi16(255);
+    int i;
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        __m128i p0, p1, y0, y1, y;
+        if (k->img_n == 4) {
+            p0 = _mm_loadu_si128((const __m128i*)(src + i * 4));
+            p1 = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+        }
+        else {
+            p0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 3)), rgb_to_rgb0);
+            p1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i * 3 + 12)), rgb_to_rgb0);
+        }
+        y0 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p0, low_bytes), rb_weights), _mm_madd_epi16(_mm_srli_epi16(p0, 8), g_weight));
+        y1 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p1, low_bytes), rb_weights), _mm_madd_epi16(_mm_srli_epi16(p1, 8), g_weight));
+        y = _mm_packs_epi32(_mm_srli_epi32(y0, 8), _mm_srli_epi32(y1, 8));
+        if (k->req_comp == 1) {
+            _mm_storel_epi64((__m128i*)(dest + i), _mm_packus_epi16(y, y));
+        }
+        else {
+            __m128i a = k->img_n == 4 ? _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24)) : opaque;
+            _mm_storeu_si128((__m128i*)(dest + i * 2), _mm_or_si128(y, _mm_slli_epi16(a, 8)));
         }
-#undef STBI__CASE
     }
-
-    STBI_FREE(data);
-    return good;
 }
 #endif
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
-// nothing
-#else
-static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
+#ifdef STBI_NEON
+static void stbi__convert_neon(const stbi__convert_kernel* k, const stbi_uc* src, stbi_uc* dest, int pixels, int backward)
+{
+    int steps = pixels / k->step, i, c;
+    for (i = 0; i < steps; ++i) {
+        size_t s = (size_t)(backward ? steps - 1 - i : i) * k->step;
+        if (k->bytes == 1) {
+            const stbi_uc* in = src + s * k->img_n;
+            stbi_uc* out = dest + s * k->req_comp;
+            uint8x16_t ch[4], res[4];
+            uint8x16x2_t v2;
+            uint8x16x3_t v3;
+            uint8x16x4_t v4;
+            switch (k->img_n) {
+            case 1: ch[0] = vld1q_u8(in); break;
+            case 2: v2 = vld2q_u8(in); ch[0] = v2.val[0]; ch[1] = v2.val[1]; break;
+            case 3: v3 = vld3q_u8(in); ch[0] = v3.val[0]; ch[1] = v3.val[1]; ch[2] = v3.val[2]; break;
+            default: v4 = vld4q_u8(in); ch[0] = v4.val[0]; ch[1] = v4.val[1]; ch[2] = v4.val[2]; ch[3] = v4.val[3]; break;
+            }
+            if (k->luma) {
+                uint16x8_t lo = vmull_u8(vget_low_u8(ch[0]), vdup_n_u8(77));
+                uint16x8_t hi = vmull_u8(vget_high_u8(ch[0]), vdup_n_u8(77));
+                lo = vmlal_u8(lo, vget_low_u8(ch[1]), vdup_n_u8(150));
+                hi = vmlal_u8(hi, vget_high_u8(ch[1]), vdup_n_u8(150));
+                lo = vmlal_u8(lo, vget_low_u8(ch[2]), vdup_n_u8(29));
+                hi = vmlal_u8(hi, vget_high_u8(ch[2]), vdup_n_u8(29));
+                res[0] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+                res[1] = k->img_n == 4 ? ch[3] : vdupq_n_u8(255);
+            }
+            else {
+                for (c = 0; c < k->req_comp; ++c)
+                    res[c] = k->map[c] < 0 ? vdupq_n_u8(255) : ch[k->map[c]];
+            }
+            switch (k->req_comp) {
+            case 1: vst1q_u8(out, res[0]); break;
+            case 2: v2.val[0] = res[0]; v2.val[1] = res[1]; vst2q_u8(out, v2); break;
+            case 3: v3.val[0] = res[0]; v3.val[1] = res[1]; v3.val[2] = res[2]; vst3q_u8(out, v3); break;
+            default: v4.val[0] = res[0]; v4.val[1] = res[1]; v4.val[2] = res[2]; v4.val[3] = res[3]; vst4q_u8(out, v4); break;
+            }
+        }
+        else {
+            const stbi__uint16* in = (const stbi__uint16*)src + s * k->img_n;
+            stbi__uint16* out = (stbi__uint16*)dest + s * k->req_comp;
+            uint16x8_t ch[4], res[4];
+            uint16x8x2_t v2;
+            uint16x8x3_t v3;
+            uint16x8x4_t v4;
+            switch (k->img_n) {
+            case 1: ch[0] = vld1q_u16(in); break;
+            case 2: v2 = vld2q_u16(in); ch[0] = v2.val[0]; ch[1] = v2.val[1]; break;
+            case 3: v3 = vld3q_u16(in); ch[0] = v3.val[0]; ch[1] = v3.val[1]; ch[2] = v3.val[2]; break;
+            default: v4 = vld4q_u16(in); ch[0] = v4.val[0]; ch[1] = v4.val[1]; ch[2] = v4.val[2]; ch[3] = v4.val[3]; break;
+            }
+            for (c = 0; c < k->req_comp; ++c)
+                res[c] = k->map[c] < 0 ? vdupq_n_u16(0xffff) : ch[k->map[c]];
+            switch (k->req_comp) {
+            case 1: vst1q_u16(out, res[0]); break;
+            case 2: v2.val[0] = res[0]; v2.val[1] = res[1]; vst2q_u16(out, v2); break;
+            case 3: v3.val[0] = res[0]; v3.val[1] = res[1]; v3.val[2] = res[2]; vst3q_u16(out, v3); break;
+            default: v4.val[0] = res[0]; v4.val[1] = res[1]; v4.val[2] = res[2]; v4.val[3] = res[3]; vst4q_u16(out, v4); break;
+            }
+        }
+    }
+}
+#endif
+
+// bytes is 1 or 2 per channel
+static void stbi__convert_kernel_setup(stbi__convert_kernel* k, int img_n, int req_comp, int bytes)
 {
-    return (stbi__uint16)(((r * 77) + (g * 150) + (29 * b)) >> 8);
+    k->img_n = img_n;
+    k->req_comp = req_comp;
+    k->bytes = bytes;
+    k->step = 0;
+    k->exact = 0;
+    k->luma = !stbi__convert_channel_map(img_n, req_comp, k->map);
+    if (k->luma && bytes == 2) return;
+#ifdef STBI_SSSE3
+    if (!stbi__ssse3_available()) return;
+    if (k->luma) {
+        k->step = 8;
+        k->exact = 1;
+    }
+    else {
+        int p, c, b;
+        // as many whole pixels as fit in 16 bytes on both sides
+        k->step = 16 / ((img_n > req_comp ? img_n : req_comp) * bytes);
+        k->exact = k->step * req_comp * bytes == 16;
+        memset(k->shuffle, 0x80, sizeof(k->shuffle));
+        memset(k->fill, 0, sizeof(k->fill));
+        for (p = 0; p < k->step; ++p) {
+            for (c = 0; c < req_comp; ++c) {
+                for (b = 0; b < bytes; ++b) {
+                    int o = (p * req_comp + c) * bytes + b;
+                    if (k->map[c] < 0)
+                        k->fill[o] = 255;
+                    else
+                        k->shuffle[o] = (stbi_uc)((p * img_n + k->map[c]) * bytes + b);
+                }
+            }
+        }
+    }
+#else
+    k->step = 16 / bytes;
+    k->exact = 1;
+#endif
 }
+
+// number of leading pixels of a row the kernel converts, keeping its loads and stores
+// inside the row
+static int stbi__convert_kernel_count(const stbi__convert_kernel* k, int pixels)
+{
+    int n;
+    if (k->step == 0) return 0;
+    n = pixels - pixels % k->step;
+#ifdef STBI_SSSE3
+    {
+        // the 16-byte loads and stores of a step can reach past its own pixels
+        int in_bytes = k->img_n * k->bytes, out_bytes = k->req_comp * k->bytes;
+        int in_reach = k->luma ? (k->img_n == 3 ? 28 : 32) : 16;
+        int out_reach = k->luma ? 8 * k->req_comp : 16;
+        while (n > 0 && ((n - k->step) * in_bytes + in_reach > pixels * in_bytes || (n - k->step) * out_bytes + out_reach > pixels * out_bytes))
+            n -= k->step;
+    }
 #endif
+    return n;
+}
 
-#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
-// nothing
+// pixels is a multiple of the kernel's step; backward runs the steps last to first
+static void stbi__convert_kernel_run(const stbi__convert_kernel* k, const stbi_uc* src, stbi_uc* dest, int pixels, int backward)
+{
+#ifdef STBI_SSSE3
+    if (k->luma)
+        stbi__convert_luma_ssse3(k, src, dest, pixels);
+    else
+        stbi__convert_shuffle_ssse3(k, src, dest, pixels, backward);
 #else
-static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+    stbi__convert_neon(k, src, dest, pixels, backward);
+#endif
+}
+
+// expand pixels in a buffer already grown to hold the result, last pixel first so no input
+// is overwritten before it is read. only for kernels with exact steps
+static void stbi__convert_grow_in_place(const stbi__convert_kernel* k, stbi_uc* data, int pixels)
 {
-    int i, j;
-    stbi__uint16* good;
+    int in_bytes = k->img_n * k->bytes, out_bytes = k->req_comp * k->bytes;
+    int n = stbi__convert_kernel_count(k, pixels), i, c, b;
+    for (i = pixels - 1; i >= n; --i) {
+        stbi_uc px[8];
+        stbi_uc* out = data + (size_t)i * out_bytes;
+        memcpy(px, data + (size_t)i * in_bytes, in_bytes);
+        for (c = 0; c < k->req_comp; ++c)
+            for (b = 0; b < k->bytes; ++b)
+                out[c * k->bytes + b] = k->map[c] < 0 ? 255 : px[k->map[c] * k->bytes + b];
+    }
+    stbi__convert_kernel_run(k, data, data, n, 1);
+}
+#endif // STBI_SSSE3 || STBI_NEON
+
+// convert y rows of x pixels from img_n to req_comp components, from data into good.
+// data and good may be the same buffer when req_comp < img_n
+static int stbi__convert_format_rows(const unsigned char* data, unsigned char* good, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+    int i, j, done = 0;
+#ifdef STBI__CONVERT_SIMD
+    stbi__convert_kernel k;
+    stbi__convert_kernel_setup(&k, img_n, req_comp, 1);
+    done = stbi__convert_kernel_count(&k, x);
+#endif
+
+    for (j = 0; j < (int)y; ++j) {
+        const unsigned char* src = data + j * x * img_n;
+        unsigned char* dest = good + j * x * req_comp;
+
+#ifdef STBI__CONVERT_SIMD
+        if (done) {
+            stbi__convert_kernel_run(&k, src, dest, done, 0);
+            src += done * img_n;
+            dest += done * req_comp;
+        }
+#endif
+
+#define STBI__COMBO(a,b)  ((a)*8+(b))
+#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-done-1; i >= 0; --i, src += a, dest += b)
+        // convert source image with img_n components to one with req_comp components;
+        // avoid switch per pixel, so use switch per scanline and massive macros
+        switch (STBI__COMBO(img_n, req_comp)) {
+            STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
+            STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+            STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
+            STBI__CASE(2, 1) { dest[0] = src[0]; } break;
+            STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+            STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
+            STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 255; } break;
+            STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+            STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
+            STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+            STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
+            STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
+        default: STBI_ASSERT(0); return stbi__err("unsupported", "Unsupported format conversion");
+        }
+#undef STBI__CASE
+    }
+    return 1;
+}
+
+static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+    unsigned char* good;
 
     if (req_comp == img_n) return data;
     STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
 
-    good = (stbi__uint16*)stbi__malloc(req_comp * x * y * 2);
+    if (req_comp < img_n) {
+        // the result fits where the input was; convert in place and give back the rest
+        if (!stbi__convert_format_rows(data, data, img_n, req_comp, x, y)) {
+            stbi__free(data);
+            return NULL;
+        }
+        good = (unsigned char*)stbi__realloc_sized(data, (size_t)img_n * x * y, (size_t)req_comp * x * y);
+        return good ? good : data;
+    }
+
+#ifdef STBI__CONVERT_SIMD
+    {
+        stbi__convert_kernel k;
+        stbi__convert_kernel_setup(&k, img_n, req_comp, 1);
+        if (k.exact && stbi__mad3sizes_valid(req_comp, x, y, 0)) {
+            // grow the buffer (often without moving it) and expand in place
+            good = (unsigned char*)stbi__realloc_sized(data, (size_t)img_n * x * y, (size_t)req_comp * x * y);
+            if (good == NULL) {
+                stbi__free(data);
+                return stbi__errpuc("outofmem", "Out of memory");
+            }
+            stbi__convert_grow_in_place(&k, good, x * y);
+            return good;
+        }
+    }
+#endif
+
+    good = (unsigned char*)stbi__malloc_mad3(req_comp, x, y, 0);
     if (good == NULL) {
-        STBI_FREE(data);
-        return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
+        stbi__free(data);
+        return stbi__errpuc("outofmem", "Out of memory");
+    }
+
+    if (!stbi__convert_format_rows(data, good, img_n, req_comp, x, y)) {
+        stbi__free(data);
+        stbi__free(good);
+        return NULL;
     }
 
+    stbi__free(data);
+    return good;
+}
+#endif
+
+#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
+// nothing
+#else
+static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
+{
+    return (stbi__uint16)(((r * 77) + (g * 150) + (29 * b)) >> 8);
+}
+#endif
+
+#if defined(STBI_NO_PNG) && defined(STBI_NO_PSD)
+// nothing
+#else
+// convert y rows of x pixels from img_n to req_comp components, from data into good
+static int stbi__convert_format16_rows(const stbi__uint16* data, stbi__uint16* good, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+    int i, j, done = 0;
+#ifdef STBI__CONVERT_SIMD
+    stbi__convert_kernel k;
+    stbi__convert_kernel_setup(&k, img_n, req_comp, 2);
+    done = stbi__convert_kernel_count(&k, x);
+#endif
+
     for (j = 0; j < (int)y; ++j) {
-        stbi__uint16* src = data + j * x * img_n;
+        const stbi__uint16* src = data + j * x * img_n;
         stbi__uint16* dest = good + j * x * req_comp;
 
+#ifdef STBI__CONVERT_SIMD
+        if (done) {
+            stbi__convert_kernel_run(&k, (const stbi_uc*)src, (stbi_uc*)dest, done, 0);
+            src += done * img_n;
+            dest += done * req_comp;
+        }
+#endif
+
 #define STBI__COMBO(a,b)  ((a)*8+(b))
-#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-done-1; i >= 0; --i, src += a, dest += b)
         // convert source image with img_n components to one with req_comp components;
         // avoid switch per pixel, so use switch per scanline and massive macros
         switch (STBI__COMBO(img_n, req_comp)) {
@@ -1846,12 +2745,58 @@ static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int r
             STBI__CASE(4, 1) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); } break;
             STBI__CASE(4, 2) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); dest[1] = src[3]; } break;
             STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
-        default: STBI_ASSERT(0); STBI_FREE(data); STBI_FREE(good); return (stbi__uint16*)stbi__errpuc("unsupported", "Unsupported format conversion");
+        default: STBI_ASSERT(0); return stbi__err("unsupported", "Unsupported format conversion");
         }
 #undef STBI__CASE
     }
+    return 1;
+}
+
+static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+    stbi__uint16* good;
+
+    if (req_comp == img_n) return data;
+    STBI_ASSERT(req_comp >= 1 && req_comp <= 4);
+
+    if (req_comp < img_n) {
+        if (!stbi__convert_format16_rows(data, data, img_n, req_comp, x, y)) {
+            stbi__free(data);
+            return NULL;
+        }
+        good = (stbi__uint16*)stbi__realloc_sized(data, (size_t)img_n * x * y * 2, (size_t)req_comp * x * y * 2);
+        return good ? good : data;
+    }
+
+#ifdef STBI__CONVERT_SIMD
+    {
+        stbi__convert_kernel k;
+        stbi__convert_kernel_setup(&k, img_n, req_comp, 2);
+        if (k.exact) {
+            good = (stbi__uint16*)stbi__realloc_sized(data, (size_t)img_n * x * y * 2, (size_t)req_comp * x * y * 2);
+            if (good == NULL) {
+                stbi__free(data);
+                return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
+            }
+            stbi__convert_grow_in_place(&k, (stbi_uc*)good, x * y);
+            return good;
+        }
+    }
+#endif
+
+    good = (stbi__uint16*)stbi__malloc(req_comp * x * y * 2);
+    if (good == NULL) {
+        stbi__free(data);
+        return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
+    }
+
+    if (!stbi__convert_format16_rows(data, good, img_n, req_comp, x, y)) {
+        stbi__free(data);
+        stbi__free(good);
+        return NULL;
+    }
 
-    STBI_FREE(data);
+    stbi__free(data);
     return good;
 }
 #endif
@@ -1863,7 +2808,7 @@ static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
     float* output;
     if (!data) return NULL;
     output = (float*)stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-    if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+    if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
     // compute number of non-alpha components
     if (comp & 1) n = comp; else n = comp - 1;
     for (i = 0; i < x * y; ++i) {
@@ -1876,37 +2821,178 @@ static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
             output[i * comp + n] = data[i * comp + n] / 255.0f;
         }
     }
-    STBI_FREE(data);
+    stbi__free(data);
     return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
+
+static stbi_uc stbi__hdr_to_ldr_value(float v, float scale, float gamma)
+{
+    float z = (float)pow(v * scale, gamma) * 255 + 0.5f;
+    if (z < 0) z = 0;
+    if (z > 255) z = 255;
+    return (stbi_uc)stbi__float2int(z);
+}
+
+// a pow per channel dominates converting a large image, but the result is a byte that never
+// falls as the input grows, so it's fully described by the smallest input reaching each of
+// 1..255. non-negative floats (all the HDR loader produces; negative ones come out 0) order
+// like their bits, so the bits those thresholds span are cut into power-of-two buckets no
+// wider than the closest pair: each bucket then holds at most one threshold, and a channel
+// is a bucket lookup and one compare, exactly as pow would have rounded it
+typedef struct
+{
+    stbi__int32 low, high; // bits of the thresholds for 1 and 255
+    int shift, count;
+    stbi__int32* split;    // per bucket, the bits of the threshold inside it or INT_MAX
+    stbi__int32* base;     // per bucket, the output at its first value
+} stbi__hdr_ldr_table;
+
+// below this many color channels the table costs more than it saves
+#define STBI__HDR_LDR_TABLE_MIN  65536
+#define STBI__HDR_LDR_TABLE_MAX_BUCKETS  65536
+
+static float stbi__bits_to_float(stbi__int32 bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static int stbi__hdr_ldr_table_build(stbi__hdr_ldr_table* t, float scale, float gamma)
+{
+    stbi__int32 threshold[256];
+    stbi__int32 gap, start;
+    int k, b;
+    // only a positive gamma and scale give an increasing curve (NaN fails the tests too)
+    if (!(gamma > 0) || !(scale > 0)) return 0;
+    if (stbi__hdr_to_ldr_value(stbi__bits_to_float(0x7f800000), scale, gamma) != 255) return 0;
+    threshold[0] = 0;
+    for (k = 1; k < 256; ++k) {
+        stbi__int32 lo = threshold[k - 1], hi = 0x7f800000;
+        while (lo < hi) {
+            stbi__int32 mid = lo + (hi - lo) / 2;
+            if (stbi__hdr_to_ldr_value(stbi__bits_to_float(mid), scale, gamma) >= k) hi = mid;
+            else lo = mid + 1;
+        }
+        threshold[k] = lo;
+    }
+    gap = INT_MAX;
+    for (k = 1; k < 255; ++k)
+        if (threshold[k + 1] - threshold[k] < gap) gap = threshold[k + 1] - threshold[k];
+    if (gap < 1) return 0;
+
+    t->low = threshold[1];
+    t->high = threshold[255];
+    for (t->shift = 0; t->shift < 30 && (2 << t->shift) <= gap; ++t->shift);
+    t->count = ((t->high - t->low) >> t->shift) + 1;
+    if (t->count > STBI__HDR_LDR_TABLE_MAX_BUCKETS) return 0;
+    t->split = (stbi__int32*)stbi__malloc_mad2(t->count, 2 * sizeof(stbi__int32), 0);
+    if (!t->split) return 0;
+    t->base = t->split + t->count;
+
+    k = 1;
+    for (b = 0; b < t->count; ++b) {
+        start = t->low + (b << t->shift);
+        while (k < 256 && threshold[k] <= start) ++k;
+        t->base[b] = k - 1;
+        t->split[b] = k < 256 && threshold[k] - start < (1 << t->shift) ? threshold[k] : INT_MAX;
+    }
+    return 1;
+}
+
+static stbi_uc stbi__hdr_ldr_lookup(const stbi__hdr_ldr_table* t, float v)
+{
+    stbi__int32 bits;
+    int b;
+    memcpy(&bits, &v, sizeof(bits));
+    if (bits < t->low) return 0; // negative values too
+    if (bits >= t->high) return 255;
+    b = (bits - t->low) >> t->shift;
+    return (stbi_uc)(t->base[b] + (bits >= t->split[b]));
+}
+
+static stbi_uc stbi__hdr_to_ldr_alpha(float v)
+{
+    float z = v * 255 + 0.5f;
+    if (z < 0) z = 0;
+    if (z > 255) z = 255;
+    return (stbi_uc)stbi__float2int(z);
+}
+
+#ifdef STBI_AVX2
+// 8 pixels per step: comp vectors of 8 channels, with alpha in the same lanes of each
+// because comp is 1, 2 or 4 whenever there is one. returns the pixels converted
+STBI__AVX2_TARGET
+static int stbi__hdr_to_ldr_avx2(const stbi__hdr_ldr_table* t, const float* data, stbi_uc* output, int pixels, int comp, int n)
+{
+    const __m256i low = _mm256_set1_epi32(t->low);
+    const __m256i high_m1 = _mm256_set1_epi32(t->high - 1);
+    const __m256i top = _mm256_set1_epi32(255);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m128i shift = _mm_cvtsi32_si128(t->shift);
+    const __m256 alpha_scale = _mm256_set1_ps(255.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 max = _mm256_set1_ps(255.0f);
+    __m256i alpha_lanes = _mm256_setzero_si256();
+    int i, v;
+    if (n < comp)
+        alpha_lanes = comp == 2 ? _mm256_setr_epi32(0, -1, 0, -1, 0, -1, 0, -1) : _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+    for (i = 0; i + 8 <= pixels; i += 8) {
+        for (v = 0; v < comp; ++v) {
+            __m256 f = _mm256_loadu_ps(data + (size_t)i * comp + v * 8);
+            __m256i bits = _mm256_castps_si256(f);
+            __m256i clamped = _mm256_max_epi32(_mm256_min_epi32(bits, high_m1), low);
+            __m256i bucket = _mm256_srl_epi32(_mm256_sub_epi32(clamped, low), shift);
+            __m256i split = _mm256_i32gather_epi32((const int*)t->split, bucket, 4);
+            __m256i base = _mm256_i32gather_epi32((const int*)t->base, bucket, 4);
+            __m256i reached = _mm256_cmpgt_epi32(bits, _mm256_sub_epi32(split, one));
+            __m256i color = _mm256_sub_epi32(base, reached);
+            __m256i res, alpha;
+            __m128i packed;
+            color = _mm256_andnot_si256(_mm256_cmpgt_epi32(low, bits), color);
+            color = _mm256_blendv_epi8(color, top, _mm256_cmpgt_epi32(bits, high_m1));
+            alpha = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(f, alpha_scale), half), zero), max));
+            res = _mm256_blendv_epi8(color, alpha, alpha_lanes);
+            packed = _mm_packs_epi32(_mm256_castsi256_si128(res), _mm256_extracti128_si256(res, 1));
+            _mm_storel_epi64((__m128i*)(output + (size_t)i * comp + v * 8), _mm_packus_epi16(packed, packed));
+        }
+    }
+    return i;
+}
+#endif
+
 static stbi_uc* stbi__hdr_to_ldr(float* data, int x, int y, int comp)
 {
-    int i, k, n;
+    int i, k, n, use_table;
     stbi_uc* output;
+    stbi__hdr_ldr_table table;
+    float scale = stbi__h2l_scale_i, gamma = stbi__h2l_gamma_i;
     if (!data) return NULL;
     output = (stbi_uc*)stbi__malloc_mad3(x, y, comp, 0);
-    if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+    if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
     // compute number of non-alpha components
     if (comp & 1) n = comp; else n = comp - 1;
-    for (i = 0; i < x * y; ++i) {
+    use_table = (double)x * y * n >= STBI__HDR_LDR_TABLE_MIN && stbi__hdr_ldr_table_build(&table, scale, gamma);
+    i = 0;
+#ifdef STBI_AVX2
+    if (use_table && stbi__avx2_available())
+        i = stbi__hdr_to_ldr_avx2(&table, data, output, x * y, comp, n);
+#endif
+    for (; i < x * y; ++i) {
         for (k = 0; k < n; ++k) {
-            float z = (float)pow(data[i * comp + k] * stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-            if (z < 0) z = 0;
-            if (z > 255) z = 255;
-            output[i * comp + k] = (stbi_uc)stbi__float2int(z);
-        }
-        if (k < comp) {
-            float z = data[i * comp + k] * 255 + 0.5f;
-            if (z < 0) z = 0;
-            if (z > 255) z = 255;
-            output[i * comp + k] = (stbi_uc)stbi__float2int(z);
+            float v = data[i * comp + k];
+            output[i * comp + k] = use_table ? stbi__hdr_ldr_lookup(&table, v) : stbi__hdr_to_ldr_value(v, scale, gamma);
         }
+        if (k < comp)
+            output[i * comp + k] = stbi__hdr_to_ldr_alpha(data[i * comp + k]);
     }
-    STBI_FREE(data);
+    if (use_table) stbi__free(table.split);
+    stbi__free(data);
     return output;
 }
 #endif
@@ -1995,9 +3081,15 @@ typedef struct
 
     int scan_n, order[4];
     int restart_interval, todo;
+    int idct_size; // 8, or 4/2/1 for a reduced-size decode
+
+    stbi__rows* rows; // stbi_load_rows sink, or NULL
+    int rows_scan;    // stopped at a scan that load_jpeg_image decodes a window at a time
+    stbi__preview* preview; // stbi_load_progressive sink, or NULL
 
     // kernels
     void (*idct_block_kernel)(stbi_uc* out, int out_stride, short data[64]);
+    void (*idct_block_pair_kernel)(stbi_uc* out0, int out_stride0, short data0[64], stbi_uc* out1, int out_stride1, short data1[64]);
     void (*YCbCr_to_RGB_kernel)(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step);
     stbi_uc* (*resample_row_hv_2_kernel)(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs);
 } stbi__jpeg;
@@ -2536,6 +3628,57 @@ static void stbi__idct_block(stbi_uc* out, int out_stride, short data[64])
     }
 }
 
+// Reduced IDCTs for scaled decoding. An N-point IDCT over the top-left NxN
+// coefficients, normalized like the 8-point one, produces the block directly at
+// N/8 of its size; the DC term still maps to the block average.
+static void stbi__idct_block_4x4(stbi_uc* out, int out_stride, short data[64])
+{
+    int i, val[16], * v = val;
+    stbi_uc* o;
+    short* d = data;
+
+    // columns; results keep 2 extra bits of precision
+    for (i = 0; i < 4; ++i, ++d, ++v) {
+        int e0 = (d[0] + d[16]) * stbi__f2f(0.707106781f);
+        int e1 = (d[0] - d[16]) * stbi__f2f(0.707106781f);
+        int o0 = d[8] * stbi__f2f(0.923879533f) + d[24] * stbi__f2f(0.382683432f);
+        int o1 = d[8] * stbi__f2f(0.382683432f) - d[24] * stbi__f2f(0.923879533f);
+        v[0] = (e0 + o0 + 1024) >> 11;
+        v[12] = (e0 - o0 + 1024) >> 11;
+        v[4] = (e1 + o1 + 1024) >> 11;
+        v[8] = (e1 - o1 + 1024) >> 11;
+    }
+
+    // rows; the total scale is 1 << 15, with rounding and the +128 level shift folded into e0/e1
+    for (i = 0, v = val, o = out; i < 4; ++i, v += 4, o += out_stride) {
+        int e0 = (v[0] + v[2]) * stbi__f2f(0.707106781f) + (1 << 14) + (128 << 15);
+        int e1 = (v[0] - v[2]) * stbi__f2f(0.707106781f) + (1 << 14) + (128 << 15);
+        int o0 = v[1] * stbi__f2f(0.923879533f) + v[3] * stbi__f2f(0.382683432f);
+        int o1 = v[1] * stbi__f2f(0.382683432f) - v[3] * stbi__f2f(0.923879533f);
+        o[0] = stbi__clamp((e0 + o0) >> 15);
+        o[3] = stbi__clamp((e0 - o0) >> 15);
+        o[1] = stbi__clamp((e1 + o1) >> 15);
+        o[2] = stbi__clamp((e1 - o1) >> 15);
+    }
+}
+
+static void stbi__idct_block_2x2(stbi_uc* out, int out_stride, short data[64])
+{
+    // the 2-point basis is +-cos(pi/4), so the 2x2 transform is sums and differences over 8
+    int s0 = data[0] + data[8], d0 = data[0] - data[8];
+    int s1 = data[1] + data[9], d1 = data[1] - data[9];
+    out[0] = stbi__clamp(((s0 + s1 + 4) >> 3) + 128);
+    out[1] = stbi__clamp(((s0 - s1 + 4) >> 3) + 128);
+    out[out_stride] = stbi__clamp(((d0 + d1 + 4) >> 3) + 128);
+    out[out_stride + 1] = stbi__clamp(((d0 - d1 + 4) >> 3) + 128);
+}
+
+static void stbi__idct_block_1x1(stbi_uc* out, int out_stride, short data[64])
+{
+    STBI_NOTUSED(out_stride);
+    out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2717,79 +3860,271 @@ static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
-#ifdef STBI_NEON
-
-// NEON integer IDCT. should produce bit-identical
-// results to the generic C version.
-static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
+#ifdef STBI_AVX2
+// AVX2 IDCT of two blocks at once: block 0 lives in the low 128-bit lane of every
+// register and block 1 in the high lane. All the arithmetic and the unpack-based
+// transposes work within lanes, so this is the SSE2 IDCT step for step and produces
+// the same bytes.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2_pair(stbi_uc* out0, int out_stride0, short data0[64], stbi_uc* out1, int out_stride1, short data1[64])
 {
-    int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+    __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+    __m256i tmp;
 
-    int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
-    int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
-    int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
-    int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
-    int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
-    int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
-    int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
-    int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
-    int16x4_t rot3_0 = vdup_n_s16(stbi__f2f(0.298631336f));
-    int16x4_t rot3_1 = vdup_n_s16(stbi__f2f(2.053119869f));
-    int16x4_t rot3_2 = vdup_n_s16(stbi__f2f(3.072711026f));
-    int16x4_t rot3_3 = vdup_n_s16(stbi__f2f(1.501321110f));
-
-#define dct_long_mul(out, inq, coeff) \
-   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+#define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
 
-#define dct_long_mac(out, acc, inq, coeff) \
-   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
 
-#define dct_widen(out, inq) \
-   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
-   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+#define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
 
-    // wide add
 #define dct_wadd(out, a, b) \
-   int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
-   int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
 
-// wide sub
 #define dct_wsub(out, a, b) \
-   int32x4_t out##_l = vsubq_s32(a##_l, b##_l); \
-   int32x4_t out##_h = vsubq_s32(a##_h, b##_h)
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
 
-// butterfly a/b, then shift using "shiftop" by "s" and pack
-#define dct_bfly32o(out0,out1, a,b,shiftop,s) \
-   { \
-      dct_wadd(sum, a, b); \
-      dct_wsub(dif, a, b); \
-      out0 = vcombine_s16(shiftop(sum_l, s), shiftop(sum_h, s)); \
-      out1 = vcombine_s16(shiftop(dif_l, s), shiftop(dif_h, s)); \
-   }
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
 
-#define dct_pass(shiftop, shift) \
-   { \
-      /* even part */ \
-      int16x8_t sum26 = vaddq_s16(row2, row6); \
-      dct_long_mul(p1e, sum26, rot0_0); \
-      dct_long_mac(t2e, p1e, row6, rot0_1); \
-      dct_long_mac(t3e, p1e, row2, rot0_2); \
-      int16x8_t sum04 = vaddq_s16(row0, row4); \
-      int16x8_t dif04 = vsubq_s16(row0, row4); \
-      dct_widen(t0e, sum04); \
-      dct_widen(t1e, dif04); \
-      dct_wadd(x0, t0e, t3e); \
-      dct_wsub(x3, t0e, t3e); \
-      dct_wadd(x1, t1e, t2e); \
-      dct_wsub(x2, t1e, t2e); \
-      /* odd part */ \
-      int16x8_t sum15 = vaddq_s16(row1, row5); \
-      int16x8_t sum17 = vaddq_s16(row1, row7); \
-      int16x8_t sum35 = vaddq_s16(row3, row5); \
-      int16x8_t sum37 = vaddq_s16(row3, row7); \
-      int16x8_t sumodd = vaddq_s16(sum17, sum35); \
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+#define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i*) (data0 + (r) * 8))), \
+                              _mm_load_si128((const __m128i*) (data1 + (r) * 8)), 1)
+
+    __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+    __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f), stbi__f2f(0.5411961f));
+    __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+    __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+    __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f), stbi__f2f(-1.961570560f));
+    __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+    __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f), stbi__f2f(-0.390180644f));
+    __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+    // rounding biases in column/row passes, see stbi__idct_block for explanation.
+    __m256i bias_0 = _mm256_set1_epi32(512);
+    __m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+    // load
+    row0 = dct_load(0);
+    row1 = dct_load(1);
+    row2 = dct_load(2);
+    row3 = dct_load(3);
+    row4 = dct_load(4);
+    row5 = dct_load(5);
+    row6 = dct_load(6);
+    row7 = dct_load(7);
+
+    // column pass
+    dct_pass(bias_0, 10);
+
+    {
+        // 16bit 8x8 transpose, within each lane
+        dct_interleave16(row0, row4);
+        dct_interleave16(row1, row5);
+        dct_interleave16(row2, row6);
+        dct_interleave16(row3, row7);
+
+        dct_interleave16(row0, row2);
+        dct_interleave16(row1, row3);
+        dct_interleave16(row4, row6);
+        dct_interleave16(row5, row7);
+
+        dct_interleave16(row0, row1);
+        dct_interleave16(row2, row3);
+        dct_interleave16(row4, row5);
+        dct_interleave16(row6, row7);
+    }
+
+    // row pass
+    dct_pass(bias_1, 17);
+
+    {
+        // pack
+        __m256i p0 = _mm256_packus_epi16(row0, row1);
+        __m256i p1 = _mm256_packus_epi16(row2, row3);
+        __m256i p2 = _mm256_packus_epi16(row4, row5);
+        __m256i p3 = _mm256_packus_epi16(row6, row7);
+        __m128i q0, q1, q2, q3;
+
+        // 8bit 8x8 transpose, within each lane
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        dct_interleave8(p0, p1);
+        dct_interleave8(p2, p3);
+
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        // store block 0 from the low lanes, block 1 from the high lanes
+        q0 = _mm256_castsi256_si128(p0);
+        q1 = _mm256_castsi256_si128(p1);
+        q2 = _mm256_castsi256_si128(p2);
+        q3 = _mm256_castsi256_si128(p3);
+        _mm_storel_epi64((__m128i*) out0, q0); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, _mm_shuffle_epi32(q0, 0x4e)); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, q2); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, _mm_shuffle_epi32(q2, 0x4e)); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, q1); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, _mm_shuffle_epi32(q1, 0x4e)); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, q3); out0 += out_stride0;
+        _mm_storel_epi64((__m128i*) out0, _mm_shuffle_epi32(q3, 0x4e));
+
+        q0 = _mm256_extracti128_si256(p0, 1);
+        q1 = _mm256_extracti128_si256(p1, 1);
+        q2 = _mm256_extracti128_si256(p2, 1);
+        q3 = _mm256_extracti128_si256(p3, 1);
+        _mm_storel_epi64((__m128i*) out1, q0); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, _mm_shuffle_epi32(q0, 0x4e)); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, q2); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, _mm_shuffle_epi32(q2, 0x4e)); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, q1); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, _mm_shuffle_epi32(q1, 0x4e)); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, q3); out1 += out_stride1;
+        _mm_storel_epi64((__m128i*) out1, _mm_shuffle_epi32(q3, 0x4e));
+    }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+}
+
+#endif // STBI_AVX2
+
+#ifdef STBI_NEON
+
+// NEON integer IDCT. should produce bit-identical
+// results to the generic C version.
+static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
+{
+    int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+    int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
+    int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
+    int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
+    int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
+    int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
+    int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
+    int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
+    int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
+    int16x4_t rot3_0 = vdup_n_s16(stbi__f2f(0.298631336f));
+    int16x4_t rot3_1 = vdup_n_s16(stbi__f2f(2.053119869f));
+    int16x4_t rot3_2 = vdup_n_s16(stbi__f2f(3.072711026f));
+    int16x4_t rot3_3 = vdup_n_s16(stbi__f2f(1.501321110f));
+
+#define dct_long_mul(out, inq, coeff) \
+   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+
+#define dct_long_mac(out, acc, inq, coeff) \
+   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+
+#define dct_widen(out, inq) \
+   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
+   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+
+    // wide add
+#define dct_wadd(out, a, b) \
+   int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
+
+// wide sub
+#define dct_wsub(out, a, b) \
+   int32x4_t out##_l = vsubq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vsubq_s32(a##_h, b##_h)
+
+// butterfly a/b, then shift using "shiftop" by "s" and pack
+#define dct_bfly32o(out0,out1, a,b,shiftop,s) \
+   { \
+      dct_wadd(sum, a, b); \
+      dct_wsub(dif, a, b); \
+      out0 = vcombine_s16(shiftop(sum_l, s), shiftop(sum_h, s)); \
+      out1 = vcombine_s16(shiftop(dif_l, s), shiftop(dif_h, s)); \
+   }
+
+#define dct_pass(shiftop, shift) \
+   { \
+      /* even part */ \
+      int16x8_t sum26 = vaddq_s16(row2, row6); \
+      dct_long_mul(p1e, sum26, rot0_0); \
+      dct_long_mac(t2e, p1e, row6, rot0_1); \
+      dct_long_mac(t3e, p1e, row2, rot0_2); \
+      int16x8_t sum04 = vaddq_s16(row0, row4); \
+      int16x8_t dif04 = vsubq_s16(row0, row4); \
+      dct_widen(t0e, sum04); \
+      dct_widen(t1e, dif04); \
+      dct_wadd(x0, t0e, t3e); \
+      dct_wsub(x3, t0e, t3e); \
+      dct_wadd(x1, t1e, t2e); \
+      dct_wsub(x2, t1e, t2e); \
+      /* odd part */ \
+      int16x8_t sum15 = vaddq_s16(row1, row5); \
+      int16x8_t sum17 = vaddq_s16(row1, row7); \
+      int16x8_t sum35 = vaddq_s16(row3, row5); \
+      int16x8_t sum37 = vaddq_s16(row3, row7); \
+      int16x8_t sumodd = vaddq_s16(sum17, sum35); \
       dct_long_mul(p5o, sumodd, rot1_0); \
       dct_long_mac(p1o, p5o, sum17, rot1_1); \
       dct_long_mac(p2o, p5o, sum35, rot1_2); \
@@ -2959,68 +4294,136 @@ static void stbi__jpeg_reset(stbi__jpeg* j)
     // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+// Blocks waiting for the IDCT. With a pair kernel every two decoded blocks are
+// transformed together; without one each block is transformed as soon as it is pushed.
+typedef struct
 {
-    stbi__jpeg_reset(z);
-    if (!z->progressive) {
-        if (z->scan_n == 1) {
-            int i, j;
-            STBI_SIMD_ALIGN(short, data[64]);
-            int n = z->order[0];
-            // non-interleaved data, we just need to process one block at a time,
-            // in trivial scanline order
-            // number of blocks to do just depends on how many actual "pixels" this
-            // component has, independent of interleaved MCU blocking and such
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    int ha = z->img_comp[n].ha;
-                    if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
-                    // every data block is an MCU, so countdown the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        // if it's NOT a restart, then just bail, so we get corrupt data
-                        // rather than no data
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
+    STBI_SIMD_ALIGN(short, storage[2][64]);
+    short* data;
+    stbi_uc* out;
+    int out_stride;
+    int pending;
+} stbi__idct_batch;
+
+static void stbi__idct_batch_init(stbi__idct_batch* b)
+{
+    b->pending = 0;
+}
+
+// coefficient buffer for the next block to decode
+static short* stbi__idct_batch_slot(stbi__idct_batch* b)
+{
+    return b->storage[b->pending];
+}
+
+static void stbi__idct_batch_push(stbi__jpeg* z, stbi__idct_batch* b, stbi_uc* out, int out_stride, short* data)
+{
+    if (!z->idct_block_pair_kernel) {
+        z->idct_block_kernel(out, out_stride, data);
+    }
+    else if (!b->pending) {
+        b->data = data;
+        b->out = out;
+        b->out_stride = out_stride;
+        b->pending = 1;
+    }
+    else {
+        z->idct_block_pair_kernel(b->out, b->out_stride, b->data, out, out_stride, data);
+        b->pending = 0;
+    }
+}
+
+static void stbi__idct_batch_flush(stbi__jpeg* z, stbi__idct_batch* b)
+{
+    if (b->pending) z->idct_block_kernel(b->out, b->out_stride, b->data);
+    b->pending = 0;
+}
+
+// decode rows [first, last) of a baseline scan, writing row first at the top of the
+// component planes; a row is an MCU row, or an 8-pixel block row for a scan of one
+// component. *stopped is set if the scan ends early on a marker other than RSTn
+static int stbi__jpeg_decode_baseline_rows(stbi__jpeg* z, int first, int last, int* stopped)
+{
+    if (z->scan_n == 1) {
+        int i, j;
+        stbi__idct_batch batch;
+        int n = z->order[0];
+        // non-interleaved data, we just need to process one block at a time,
+        // in trivial scanline order
+        // number of blocks to do just depends on how many actual "pixels" this
+        // component has, independent of interleaved MCU blocking and such
+        int w = (z->img_comp[n].x + 7) >> 3;
+        stbi__idct_batch_init(&batch);
+        for (j = first; j < last; ++j) {
+            for (i = 0; i < w; ++i) {
+                int ha = z->img_comp[n].ha;
+                short* data = stbi__idct_batch_slot(&batch);
+                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                stbi__idct_batch_push(z, &batch, z->img_comp[n].data + (z->img_comp[n].w2 * (j - first) + i) * z->idct_size, z->img_comp[n].w2, data);
+                // every data block is an MCU, so countdown the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    // if it's NOT a restart, then just bail, so we get corrupt data
+                    // rather than no data
+                    if (!STBI__RESTART(z->marker)) {
+                        stbi__idct_batch_flush(z, &batch);
+                        *stopped = 1;
+                        return 1;
                     }
+                    stbi__jpeg_reset(z);
                 }
             }
-            return 1;
         }
-        else { // interleaved
-            int i, j, k, x, y;
-            STBI_SIMD_ALIGN(short, data[64]);
-            for (j = 0; j < z->img_mcu_y; ++j) {
-                for (i = 0; i < z->img_mcu_x; ++i) {
-                    // scan an interleaved mcu... process scan_n components in order
-                    for (k = 0; k < z->scan_n; ++k) {
-                        int n = z->order[k];
-                        // scan out an mcu's worth of this component; that's just determined
-                        // by the basic H and V specified for the component
-                        for (y = 0; y < z->img_comp[n].v; ++y) {
-                            for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i * z->img_comp[n].h + x) * 8;
-                                int y2 = (j * z->img_comp[n].v + y) * 8;
-                                int ha = z->img_comp[n].ha;
-                                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                                z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
-                            }
+        stbi__idct_batch_flush(z, &batch);
+        return 1;
+    }
+    else { // interleaved
+        int i, j, k, x, y;
+        stbi__idct_batch batch;
+        stbi__idct_batch_init(&batch);
+        for (j = first; j < last; ++j) {
+            for (i = 0; i < z->img_mcu_x; ++i) {
+                // scan an interleaved mcu... process scan_n components in order
+                for (k = 0; k < z->scan_n; ++k) {
+                    int n = z->order[k];
+                    // scan out an mcu's worth of this component; that's just determined
+                    // by the basic H and V specified for the component
+                    for (y = 0; y < z->img_comp[n].v; ++y) {
+                        for (x = 0; x < z->img_comp[n].h; ++x) {
+                            int x2 = (i * z->img_comp[n].h + x) * z->idct_size;
+                            int y2 = ((j - first) * z->img_comp[n].v + y) * z->idct_size;
+                            int ha = z->img_comp[n].ha;
+                            short* data = stbi__idct_batch_slot(&batch);
+                            if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                            stbi__idct_batch_push(z, &batch, z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
                         }
                     }
-                    // after all interleaved components, that's an interleaved MCU,
-                    // so now count down the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
+                }
+                // after all interleaved components, that's an interleaved MCU,
+                // so now count down the restart interval
+                if (--z->todo <= 0) {
+                    if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                    if (!STBI__RESTART(z->marker)) {
+                        stbi__idct_batch_flush(z, &batch);
+                        *stopped = 1;
+                        return 1;
                     }
+                    stbi__jpeg_reset(z);
                 }
             }
-            return 1;
         }
+        stbi__idct_batch_flush(z, &batch);
+        return 1;
+    }
+}
+
+static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+{
+    stbi__jpeg_reset(z);
+    if (!z->progressive) {
+        int stopped = 0;
+        int rows = z->scan_n == 1 ? (z->img_comp[z->order[0]].y + 7) >> 3 : z->img_mcu_y;
+        return stbi__jpeg_decode_baseline_rows(z, 0, rows, &stopped);
     }
     else {
         if (z->scan_n == 1) {
@@ -3087,6 +4490,160 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
     }
 }
 
+// Baseline scans with restart markers can be split at the RSTn markers: every restart
+// interval starts with a fresh bit buffer and zeroed DC predictions, so intervals decode
+// independently. Only used for memory-backed contexts, where the whole scan can be
+// located up front.
+#define STBI__JPEG_MAX_PARALLEL_TASKS 64
+#define STBI__JPEG_STRIPE_ROWS 32
+
+typedef struct
+{
+    stbi__jpeg* z;
+    stbi_uc** interval_begin;
+    stbi_uc** interval_end;
+    int interval_count;
+    int intervals_per_task;
+    int mcu_count;
+    int* task_ok;
+} stbi__jpeg_parallel_scan;
+
+static int stbi__jpeg_decode_mcus(stbi__jpeg* z, int first, int last)
+{
+    stbi__idct_batch batch;
+    int m, k, x, y;
+    stbi__idct_batch_init(&batch);
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        int w = (z->img_comp[n].x + 7) >> 3;
+        int ha = z->img_comp[n].ha;
+        for (m = first; m < last; ++m) {
+            int i = m % w, j = m / w;
+            short* data = stbi__idct_batch_slot(&batch);
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            stbi__idct_batch_push(z, &batch, z->img_comp[n].data + (z->img_comp[n].w2 * j + i) * z->idct_size, z->img_comp[n].w2, data);
+        }
+        stbi__idct_batch_flush(z, &batch);
+        return 1;
+    }
+    for (m = first; m < last; ++m) {
+        int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+        for (k = 0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y = 0; y < z->img_comp[n].v; ++y) {
+                for (x = 0; x < z->img_comp[n].h; ++x) {
+                    int x2 = (i * z->img_comp[n].h + x) * z->idct_size;
+                    int y2 = (j * z->img_comp[n].v + y) * z->idct_size;
+                    int ha = z->img_comp[n].ha;
+                    short* data = stbi__idct_batch_slot(&batch);
+                    if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                    stbi__idct_batch_push(z, &batch, z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
+                }
+            }
+        }
+    }
+    stbi__idct_batch_flush(z, &batch);
+    return 1;
+}
+
+static void stbi__jpeg_decode_intervals_task(void* task_data, int index)
+{
+    stbi__jpeg_parallel_scan* scan = (stbi__jpeg_parallel_scan*)task_data;
+    stbi__jpeg local;
+    stbi__context context;
+    int interval = index * scan->intervals_per_task;
+    int last_interval = interval + scan->intervals_per_task;
+
+    // the tables are shared read-only; the bit buffer and DC predictions are per task
+    local = *scan->z;
+    memset(&context, 0, sizeof(context));
+    local.s = &context;
+    if (last_interval > scan->interval_count) last_interval = scan->interval_count;
+    scan->task_ok[index] = 1;
+    for (; interval < last_interval; ++interval) {
+        int first_mcu = interval * scan->z->restart_interval;
+        int last_mcu = first_mcu + scan->z->restart_interval;
+        if (last_mcu > scan->mcu_count) last_mcu = scan->mcu_count;
+        stbi__start_mem(&context, scan->interval_begin[interval], (int)(scan->interval_end[interval] - scan->interval_begin[interval]));
+        stbi__jpeg_reset(&local);
+        if (!stbi__jpeg_decode_mcus(&local, first_mcu, last_mcu)) {
+            scan->task_ok[index] = 0;
+            return;
+        }
+    }
+}
+
+// returns -1 if the scan can't be split (the caller then decodes it serially), else
+// the usual 0/1 result of stbi__parse_entropy_coded_data
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg* z)
+{
+    stbi__jpeg_parallel_scan scan;
+    stbi_uc* p = z->s->img_buffer;
+    stbi_uc* end = z->s->img_buffer_end;
+    stbi_uc* scan_end;
+    int task_count, i, result = 1;
+
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        scan.mcu_count = ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3);
+    }
+    else {
+        scan.mcu_count = z->img_mcu_x * z->img_mcu_y;
+    }
+    scan.interval_count = (scan.mcu_count + z->restart_interval - 1) / z->restart_interval;
+    if (scan.interval_count < 2) return -1;
+
+    scan.interval_begin = (stbi_uc**)stbi__malloc_mad2(scan.interval_count, (int)(2 * sizeof(stbi_uc*)), 0);
+    scan.task_ok = (int*)stbi__malloc(STBI__JPEG_MAX_PARALLEL_TASKS * sizeof(int));
+    if (!scan.interval_begin || !scan.task_ok) {
+        stbi__free(scan.interval_begin);
+        stbi__free(scan.task_ok);
+        return -1;
+    }
+    scan.interval_end = scan.interval_begin + scan.interval_count;
+
+    // find the RSTn markers; anything other than a stuffed zero, fill byte or RSTn ends the scan
+    i = 0;
+    scan.interval_begin[0] = p;
+    while (p < end) {
+        stbi_uc* q;
+        p = (stbi_uc*)memchr(p, 0xff, (size_t)(end - p));
+        if (!p) { p = end; break; }
+        q = p + 1;
+        while (q < end && *q == 0xff) ++q;
+        if (q == end) { p = end; break; }
+        if (*q == 0) { p = q + 1; continue; }
+        if (!STBI__RESTART(*q)) break;
+        scan.interval_end[i] = p;
+        if (++i == scan.interval_count) break; // more markers than intervals
+        scan.interval_begin[i] = q + 1;
+        p = q + 1;
+    }
+    scan_end = p < end ? p : end;
+    if (i == scan.interval_count || i + 1 != scan.interval_count) {
+        stbi__free(scan.interval_begin);
+        stbi__free(scan.task_ok);
+        return -1;
+    }
+    scan.interval_end[i] = scan_end;
+
+    scan.z = z;
+    task_count = scan.interval_count < STBI__JPEG_MAX_PARALLEL_TASKS ? scan.interval_count : STBI__JPEG_MAX_PARALLEL_TASKS;
+    scan.intervals_per_task = (scan.interval_count + task_count - 1) / task_count;
+    task_count = (scan.interval_count + scan.intervals_per_task - 1) / scan.intervals_per_task;
+    stbi__parallel_for(stbi__parallel_for_user, task_count, stbi__jpeg_decode_intervals_task, &scan);
+    for (i = 0; i < task_count; ++i)
+        if (!scan.task_ok[i]) result = stbi__err("bad huffman code", "Corrupt JPEG");
+
+    stbi__free(scan.interval_begin);
+    stbi__free(scan.task_ok);
+
+    // leave the stream on the marker that ended the scan, as the serial decoder does
+    z->s->img_buffer = scan_end;
+    z->marker = STBI__MARKER_none;
+    return result;
+}
+
 static void stbi__jpeg_dequantize(short* data, stbi__uint16* dequant)
 {
     int i;
@@ -3099,6 +4656,8 @@ static void stbi__jpeg_finish(stbi__jpeg* z)
     if (z->progressive) {
         // dequantize and idct the data
         int i, j, n;
+        stbi__idct_batch batch;
+        stbi__idct_batch_init(&batch);
         for (n = 0; n < z->s->img_n; ++n) {
             int w = (z->img_comp[n].x + 7) >> 3;
             int h = (z->img_comp[n].y + 7) >> 3;
@@ -3106,10 +4665,11 @@ static void stbi__jpeg_finish(stbi__jpeg* z)
                 for (i = 0; i < w; ++i) {
                     short* data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                     stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+                    stbi__idct_batch_push(z, &batch, z->img_comp[n].data + (z->img_comp[n].w2 * j + i) * z->idct_size, z->img_comp[n].w2, data);
                 }
             }
         }
+        stbi__idct_batch_flush(z, &batch);
     }
 }
 
@@ -3264,32 +4824,59 @@ static int stbi__free_jpeg_components(stbi__jpeg* z, int ncomp, int why)
     int i;
     for (i = 0; i < ncomp; ++i) {
         if (z->img_comp[i].raw_data) {
-            STBI_FREE(z->img_comp[i].raw_data);
+            stbi__free(z->img_comp[i].raw_data);
             z->img_comp[i].raw_data = NULL;
             z->img_comp[i].data = NULL;
         }
         if (z->img_comp[i].raw_coeff) {
-            STBI_FREE(z->img_comp[i].raw_coeff);
+            stbi__free(z->img_comp[i].raw_coeff);
             z->img_comp[i].raw_coeff = 0;
             z->img_comp[i].coeff = 0;
         }
         if (z->img_comp[i].linebuf) {
-            STBI_FREE(z->img_comp[i].linebuf);
+            stbi__free(z->img_comp[i].linebuf);
             z->img_comp[i].linebuf = NULL;
         }
     }
     return why;
 }
 
-static int stbi__process_frame_header(stbi__jpeg* z, int scan)
+// allocate the full component planes, and the coefficients of a progressive image
+static int stbi__jpeg_alloc_components(stbi__jpeg* z)
 {
-    stbi__context* s = z->s;
-    int Lf, p, i, q, h_max = 1, v_max = 1, c;
-    Lf = stbi__get16be(s);         if (Lf < 11) return stbi__err("bad SOF len", "Corrupt JPEG"); // JPEG
-    p = stbi__get8(s);            if (p != 8) return stbi__err("only 8-bit", "JPEG format not supported: 8-bit only"); // JPEG baseline
-    s->img_y = stbi__get16be(s);   if (s->img_y == 0) return stbi__err("no header height", "JPEG format not supported: delayed height"); // Legal, but we don't handle it--but neither does IJG
-    s->img_x = stbi__get16be(s);   if (s->img_x == 0) return stbi__err("0 width", "Corrupt JPEG"); // JPEG requires
-    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
+    int i;
+    for (i = 0; i < z->s->img_n; ++i) {
+        z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+        if (z->img_comp[i].raw_data == NULL)
+            return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
+        // blocks a corrupt or truncated stream never reaches are left as allocated; recycled
+        // arena memory would show the previous image there, so clear it
+        if (stbi__thread_arena) memset(z->img_comp[i].raw_data, 0, (size_t)z->img_comp[i].w2 * z->img_comp[i].h2 + 15);
+        // align blocks for idct using mmx/sse
+        z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
+        if (z->progressive) {
+            // coefficients are kept for every block, even when decoding at reduced size
+            z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+            z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
+            if (z->img_comp[i].raw_coeff == NULL)
+                return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
+            if (stbi__thread_arena) memset(z->img_comp[i].raw_coeff, 0, (size_t)z->img_comp[i].coeff_w * 8 * z->img_comp[i].coeff_h * 8 * sizeof(short) + 15);
+            z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
+        }
+    }
+    return 1;
+}
+
+static int stbi__process_frame_header(stbi__jpeg* z, int scan)
+{
+    stbi__context* s = z->s;
+    int Lf, p, i, q, h_max = 1, v_max = 1, c;
+    Lf = stbi__get16be(s);         if (Lf < 11) return stbi__err("bad SOF len", "Corrupt JPEG"); // JPEG
+    p = stbi__get8(s);            if (p != 8) return stbi__err("only 8-bit", "JPEG format not supported: 8-bit only"); // JPEG baseline
+    s->img_y = stbi__get16be(s);   if (s->img_y == 0) return stbi__err("no header height", "JPEG format not supported: delayed height"); // Legal, but we don't handle it--but neither does IJG
+    s->img_x = stbi__get16be(s);   if (s->img_x == 0) return stbi__err("0 width", "Corrupt JPEG"); // JPEG requires
+    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
     if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
     c = stbi__get8(s);
     if (c != 3 && c != 1 && c != 4) return stbi__err("bad component count", "Corrupt JPEG");
@@ -3349,28 +4936,16 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         //
         // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
         // so these muls can't overflow with 32-bit ints (which we require)
-        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+        z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->idct_size;
+        z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * z->idct_size;
         z->img_comp[i].coeff = 0;
         z->img_comp[i].raw_coeff = 0;
         z->img_comp[i].linebuf = NULL;
-        z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
-        if (z->img_comp[i].raw_data == NULL)
-            return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
-        // align blocks for idct using mmx/sse
-        z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
-        if (z->progressive) {
-            // w2, h2 are multiples of 8 (see above)
-            z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-            z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-            z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
-            if (z->img_comp[i].raw_coeff == NULL)
-                return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
-            z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
-        }
     }
 
-    return 1;
+    // stbi_load_rows decides at the first scan whether a window of MCU rows will do
+    if (z->rows && !z->progressive) return 1;
+    return stbi__jpeg_alloc_components(z);
 }
 
 // use comparisons since in some cases we handle more than one case (e.g. SOF)
@@ -3429,6 +5004,8 @@ static stbi_uc stbi__skip_jpeg_junk_at_end(stbi__jpeg* j)
 }
 
 // decode image to YCbCr format
+static int stbi__jpeg_preview_scan(stbi__jpeg* z, int last);
+
 static int stbi__decode_jpeg_image(stbi__jpeg* j)
 {
     int m;
@@ -3441,8 +5018,22 @@ static int stbi__decode_jpeg_image(stbi__jpeg* j)
     m = stbi__get_marker(j);
     while (!stbi__EOI(m)) {
         if (stbi__SOS(m)) {
+            int parsed = -1;
             if (!stbi__process_scan_header(j)) return 0;
-            if (!stbi__parse_entropy_coded_data(j)) return 0;
+            if (j->rows && !j->progressive && !j->img_comp[0].raw_data) {
+                // stbi_load_rows: a scan of every component can be color-converted as it
+                // is decoded; separate component scans need the whole planes
+                if (j->scan_n == j->s->img_n && j->idct_size == 8) {
+                    j->rows_scan = 1;
+                    return 1;
+                }
+                if (!stbi__jpeg_alloc_components(j)) return 0;
+            }
+            if (stbi__parallel_for && !j->progressive && j->restart_interval && !j->s->read_from_callbacks)
+                parsed = stbi__parse_entropy_coded_data_parallel(j);
+            if (parsed == -1)
+                parsed = stbi__parse_entropy_coded_data(j);
+            if (!parsed) return 0;
             if (j->marker == STBI__MARKER_none) {
                 j->marker = stbi__skip_jpeg_junk_at_end(j);
                 // if we reach eof without hitting a marker, stbi__get_marker() below will fail and we'll eventually return 0
@@ -3450,6 +5041,7 @@ static int stbi__decode_jpeg_image(stbi__jpeg* j)
             m = stbi__get_marker(j);
             if (STBI__RESTART(m))
                 m = stbi__get_marker(j);
+            if (j->preview && j->progressive && !stbi__jpeg_preview_scan(j, stbi__EOI(m))) return 0;
         }
         else if (stbi__DNL(m)) {
             int Ld = stbi__get16be(j->s);
@@ -3665,6 +5257,64 @@ static stbi_uc* stbi__resample_row_hv_2_simd(stbi_uc* out, stbi_uc* in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// Same filter as stbi__resample_row_hv_2_simd, 16 input pixels per iteration. The
+// neighbour rows are built across the two 128-bit lanes with a lane permute plus alignr.
+STBI__AVX2_TARGET
+static stbi_uc* stbi__resample_row_hv_2_avx2(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
+{
+    int i = 0, t0, t1;
+
+    if (w == 1) {
+        out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+        return out;
+    }
+
+    t1 = 3 * in_near[0] + in_far[0];
+    for (; i < ((w - 1) & ~15); i += 16) {
+        // vertical pass: 3*near + far = 4*near + (far - near)
+        __m256i farw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (in_far + i)));
+        __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (in_near + i)));
+        __m256i curr = _mm256_add_epi16(_mm256_slli_epi16(nearw, 2), _mm256_sub_epi16(farw, nearw));
+
+        // "prev" is curr shifted up one pixel with t1 in front, "next" is curr shifted
+        // down one pixel with the first pixel of the next group at the end
+        __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+        __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+        __m256i prev = _mm256_insert_epi16(prv0, (short)t1, 0);
+        __m256i next = _mm256_insert_epi16(nxt0, (short)(3 * in_near[i + 16] + in_far[i + 16]), 15);
+
+        // horizontal pass, even = 4*cur + (prev - cur), odd = 4*cur + (next - cur)
+        __m256i curb = _mm256_add_epi16(_mm256_slli_epi16(curr, 2), _mm256_set1_epi16(8));
+        __m256i even = _mm256_add_epi16(_mm256_sub_epi16(prev, curr), curb);
+        __m256i odd = _mm256_add_epi16(_mm256_sub_epi16(next, curr), curb);
+
+        // interleave, undo scaling; unpack and pack stay within lanes so the bytes come out in order
+        __m256i de0 = _mm256_srli_epi16(_mm256_unpacklo_epi16(even, odd), 4);
+        __m256i de1 = _mm256_srli_epi16(_mm256_unpackhi_epi16(even, odd), 4);
+        _mm256_storeu_si256((__m256i*) (out + i * 2), _mm256_packus_epi16(de0, de1));
+
+        t1 = 3 * in_near[i + 15] + in_far[i + 15];
+    }
+
+    t0 = t1;
+    t1 = 3 * in_near[i] + in_far[i];
+    out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+    for (++i; i < w; ++i) {
+        t0 = t1;
+        t1 = 3 * in_near[i] + in_far[i];
+        out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+        out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+    }
+    out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+    STBI_NOTUSED(hs);
+
+    return out;
+}
+#endif
+
 static stbi_uc* stbi__resample_row_generic(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
 {
     // resample with nearest-neighbor
@@ -3839,10 +5489,109 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc* out, stbi_uc const* y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// 16 pixels per iteration with the same 16-bit arithmetic as the SSE2 path, so the
+// results match stbi__YCbCr_to_RGB_row exactly. Handles step 3 as well as step 4;
+// step 3 compacts each lane with a byte shuffle and writes exactly 48 bytes.
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc* out, stbi_uc const* y, stbi_uc const* pcb, stbi_uc const* pcr, int count, int step)
+{
+    int i = 0;
+
+    if (step == 3 || step == 4) {
+        __m128i signflip = _mm_set1_epi8(-0x80);
+        __m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f * 4096.0f + 0.5f));
+        __m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f * 4096.0f + 0.5f));
+        __m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f * 4096.0f + 0.5f));
+        __m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f * 4096.0f + 0.5f));
+        __m256i y_bias = _mm256_set1_epi16(128);
+        __m256i xw = _mm256_set1_epi16(255); // alpha channel
+        __m256i rgb_only = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        __m256i pack_lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+        for (; i + 15 < count; i += 16) {
+            // load, and widen to the words the SSE2 path builds with unpacklo:
+            // y becomes (y << 8) | 128, cr and cb become (c - 128) << 8
+            __m128i y_bytes = _mm_loadu_si128((__m128i*) (y + i));
+            __m128i cr_biased = _mm_xor_si128(_mm_loadu_si128((__m128i*) (pcr + i)), signflip);
+            __m128i cb_biased = _mm_xor_si128(_mm_loadu_si128((__m128i*) (pcb + i)), signflip);
+            __m256i yw = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+            __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cr_biased), 8);
+            __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(cb_biased), 8);
+
+            // color transform
+            __m256i yws = _mm256_srli_epi16(yw, 4);
+            __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+            __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+            __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+            __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+            __m256i rws = _mm256_add_epi16(cr0, yws);
+            __m256i gwt = _mm256_add_epi16(cb0, yws);
+            __m256i bws = _mm256_add_epi16(yws, cb1);
+            __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+            // descale
+            __m256i rw = _mm256_srai_epi16(rws, 4);
+            __m256i bw = _mm256_srai_epi16(bws, 4);
+            __m256i gw = _mm256_srai_epi16(gws, 4);
+
+            // back to byte and interleave within each lane: o0 holds pixels 0-3 and 8-11,
+            // o1 holds pixels 4-7 and 12-15
+            __m256i brb = _mm256_packus_epi16(rw, bw);
+            __m256i gxb = _mm256_packus_epi16(gw, xw);
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+            __m256i lo = _mm256_permute2x128_si256(o0, o1, 0x20); // pixels 0-7
+            __m256i hi = _mm256_permute2x128_si256(o0, o1, 0x31); // pixels 8-15
+
+            if (step == 4) {
+                _mm256_storeu_si256((__m256i*) (out + 0), lo);
+                _mm256_storeu_si256((__m256i*) (out + 32), hi);
+                out += 64;
+            }
+            else {
+                // drop the alpha bytes, leaving 24 bytes at the bottom of each register
+                __m256i lo3 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lo, rgb_only), pack_lanes);
+                __m256i hi3 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(hi, rgb_only), pack_lanes);
+                _mm256_storeu_si256((__m256i*) (out + 0), lo3); // bytes 24-31 are rewritten below
+                _mm_storeu_si128((__m128i*) (out + 24), _mm256_castsi256_si128(hi3));
+                _mm_storel_epi64((__m128i*) (out + 40), _mm256_extracti128_si256(hi3, 1));
+                out += 48;
+            }
+        }
+    }
+
+    for (; i < count; ++i) {
+        int y_fixed = (y[i] << 20) + (1 << 19); // rounding
+        int r, g, b;
+        int cr = pcr[i] - 128;
+        int cb = pcb[i] - 128;
+        r = y_fixed + cr * stbi__float2fixed(1.40200f);
+        g = y_fixed + cr * -stbi__float2fixed(0.71414f) + ((cb * -stbi__float2fixed(0.34414f)) & 0xffff0000);
+        b = y_fixed + cb * stbi__float2fixed(1.77200f);
+        r >>= 20;
+        g >>= 20;
+        b >>= 20;
+        if ((unsigned)r > 255) { if (r < 0) r = 0; else r = 255; }
+        if ((unsigned)g > 255) { if (g < 0) g = 0; else g = 255; }
+        if ((unsigned)b > 255) { if (b < 0) b = 0; else b = 255; }
+        out[0] = (stbi_uc)r;
+        out[1] = (stbi_uc)g;
+        out[2] = (stbi_uc)b;
+        out[3] = 255;
+        out += step;
+    }
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg* j)
 {
     j->idct_block_kernel = stbi__idct_block;
+    j->idct_block_pair_kernel = NULL;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3854,11 +5603,26 @@ static void stbi__setup_jpeg(stbi__jpeg* j)
     }
 #endif
 
+#ifdef STBI_AVX2
+    if (stbi__avx2_available()) {
+        j->idct_block_pair_kernel = stbi__idct_avx2_pair;
+        j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+        j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+    }
+#endif
+
 #ifdef STBI_NEON
     j->idct_block_kernel = stbi__idct_simd;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+    // reduced-size decode requested through stbi_load_scaled
+    j->idct_size = 8 >> j->s->scale_shift;
+    if (j->idct_size != 8) {
+        j->idct_block_kernel = j->idct_size == 4 ? stbi__idct_block_4x4 : j->idct_size == 2 ? stbi__idct_block_2x2 : stbi__idct_block_1x1;
+        j->idct_block_pair_kernel = NULL;
+    }
 }
 
 // clean up the temporary component buffers
@@ -3884,257 +5648,535 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
     return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
-static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp, int req_comp)
+// resample and color-convert rows [first_row, last_row) into output, which points at
+// first_row's pixels, with stride bytes from one row to the next (negative to write the
+// rows bottom-up); res_comp must hold the resampler state for first_row and is advanced
+// past last_row
+static void stbi__jpeg_convert_rows(stbi__jpeg* z, stbi__resample* res_comp, stbi_uc** linebuf, stbi_uc* output, int stride, int n, int decode_n, int is_rgb, unsigned int first_row, unsigned int last_row)
 {
-    int n, decode_n, is_rgb;
-    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
-
-    // validate req_comp
-    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-
-    // load a jpeg image from whichever source, but leave in YCbCr format
-    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
-
-    // determine actual number of components to generate
-    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
-
-    is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
-
-    if (z->s->img_n == 3 && n < 3 && !is_rgb)
-        decode_n = 1;
-    else
-        decode_n = z->s->img_n;
-
-    // nothing to do if no components requested; check this now to avoid
-    // accessing uninitialized coutput[0] later
-    if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
-
-    // resample and color-convert
-    {
-        int k;
-        unsigned int i, j;
-        stbi_uc* output;
-        stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
-
-        stbi__resample res_comp[4];
-
+    int k;
+    unsigned int i, j;
+    stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
+    for (j = first_row; j < last_row; ++j) {
+        stbi_uc* row = output + stride * (int)(j - first_row);
+        stbi_uc* out = row;
+        // 3-channel writers store a fourth byte past each pixel; bottom-up, the byte past
+        // the row is the first of the row written just before, so it is put back after
+        int keep = stride < 0 && j > first_row;
+        stbi_uc kept = keep ? row[-stride] : 0;
         for (k = 0; k < decode_n; ++k) {
             stbi__resample* r = &res_comp[k];
-
-            // allocate line buffer big enough for upsampling off the edges
-            // with upsample factor of 4
-            z->img_comp[k].linebuf = (stbi_uc*)stbi__malloc(z->s->img_x + 3);
-            if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-            r->hs = z->img_h_max / z->img_comp[k].h;
-            r->vs = z->img_v_max / z->img_comp[k].v;
-            r->ystep = r->vs >> 1;
-            r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
-            r->ypos = 0;
-            r->line0 = r->line1 = z->img_comp[k].data;
-
-            if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-            else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-            else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-            else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-            else                               r->resample = stbi__resample_row_generic;
-        }
-
-        // can't error after this so, this is safe
-        output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-        if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-        // now go ahead and resample
-        for (j = 0; j < z->s->img_y; ++j) {
-            stbi_uc* out = output + n * z->s->img_x * j;
-            for (k = 0; k < decode_n; ++k) {
-                stbi__resample* r = &res_comp[k];
-                int y_bot = r->ystep >= (r->vs >> 1);
-                coutput[k] = r->resample(z->img_comp[k].linebuf,
-                    y_bot ? r->line1 : r->line0,
-                    y_bot ? r->line0 : r->line1,
-                    r->w_lores, r->hs);
-                if (++r->ystep >= r->vs) {
-                    r->ystep = 0;
-                    r->line0 = r->line1;
-                    if (++r->ypos < z->img_comp[k].y)
-                        r->line1 += z->img_comp[k].w2;
-                }
+            int y_bot = r->ystep >= (r->vs >> 1);
+            coutput[k] = r->resample(linebuf[k],
+                y_bot ? r->line1 : r->line0,
+                y_bot ? r->line0 : r->line1,
+                r->w_lores, r->hs);
+            if (++r->ystep >= r->vs) {
+                r->ystep = 0;
+                r->line0 = r->line1;
+                if (++r->ypos < z->img_comp[k].y)
+                    r->line1 += z->img_comp[k].w2;
             }
-            if (n >= 3) {
-                stbi_uc* y = coutput[0];
-                if (z->s->img_n == 3) {
-                    if (is_rgb) {
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            out[0] = y[i];
-                            out[1] = coutput[1][i];
-                            out[2] = coutput[2][i];
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else {
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+        }
+        if (n >= 3) {
+            stbi_uc* y = coutput[0];
+            if (z->s->img_n == 3) {
+                if (is_rgb) {
+                    for (i = 0; i < z->s->img_x; ++i) {
+                        out[0] = y[i];
+                        out[1] = coutput[1][i];
+                        out[2] = coutput[2][i];
+                        out[3] = 255;
+                        out += n;
                     }
                 }
-                else if (z->s->img_n == 4) {
-                    if (z->app14_color_transform == 0) { // CMYK
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                            out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                            out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else if (z->app14_color_transform == 2) { // YCCK
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(255 - out[0], m);
-                            out[1] = stbi__blinn_8x8(255 - out[1], m);
-                            out[2] = stbi__blinn_8x8(255 - out[2], m);
-                            out += n;
-                        }
-                    }
-                    else { // YCbCr + alpha?  Ignore the fourth channel for now
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
+                else {
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
                 }
-                else
+            }
+            else if (z->s->img_n == 4) {
+                if (z->app14_color_transform == 0) { // CMYK
                     for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = out[1] = out[2] = y[i];
-                        out[3] = 255; // not used if n==3
+                        stbi_uc m = coutput[3][i];
+                        out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                        out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                        out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                        out[3] = 255;
                         out += n;
                     }
-            }
-            else {
-                if (is_rgb) {
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i)
-                            *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                    else {
-                        for (i = 0; i < z->s->img_x; ++i, out += 2) {
-                            out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                            out[1] = 255;
-                        }
-                    }
                 }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+                else if (z->app14_color_transform == 2) { // YCCK
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
                     for (i = 0; i < z->s->img_x; ++i) {
                         stbi_uc m = coutput[3][i];
-                        stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                        stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                        stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                        out[0] = stbi__compute_y(r, g, b);
-                        out[1] = 255;
+                        out[0] = stbi__blinn_8x8(255 - out[0], m);
+                        out[1] = stbi__blinn_8x8(255 - out[1], m);
+                        out[2] = stbi__blinn_8x8(255 - out[2], m);
                         out += n;
                     }
                 }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                else { // YCbCr + alpha?  Ignore the fourth channel for now
+                    z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                }
+            }
+            else
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = out[1] = out[2] = y[i];
+                    out[3] = 255; // not used if n==3
+                    out += n;
+                }
+        }
+        else {
+            if (is_rgb) {
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i)
+                        *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                else {
+                    for (i = 0; i < z->s->img_x; ++i, out += 2) {
+                        out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
                         out[1] = 255;
-                        out += n;
                     }
                 }
-                else {
-                    stbi_uc* y = coutput[0];
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-                    else
-                        for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+                for (i = 0; i < z->s->img_x; ++i) {
+                    stbi_uc m = coutput[3][i];
+                    stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+                    stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+                    stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+                    out[0] = stbi__compute_y(r, g, b);
+                    out[1] = 255;
+                    out += n;
+                }
+            }
+            else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                    out[1] = 255;
+                    out += n;
                 }
             }
+            else {
+                stbi_uc* y = coutput[0];
+                if (n == 1)
+                    for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+                else
+                    for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+            }
         }
-        stbi__cleanup_jpeg(z);
-        *out_x = z->s->img_x;
-        *out_y = z->s->img_y;
-        if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-        return output;
+        if (keep) row[-stride] = kept;
     }
 }
 
-static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+// move a resampler's state forward by rows output rows without producing them
+static void stbi__resample_skip_rows(stbi__resample* r, int comp_y, int w2, unsigned int rows)
 {
-    unsigned char* result;
-    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-    if (!j) return stbi__errpuc("outofmem", "Out of memory");
-    memset(j, 0, sizeof(stbi__jpeg));
-    STBI_NOTUSED(ri);
-    j->s = s;
-    stbi__setup_jpeg(j);
-    result = load_jpeg_image(j, x, y, comp, req_comp);
-    STBI_FREE(j);
-    return result;
+    for (; rows > 0; --rows) {
+        if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < comp_y)
+                r->line1 += w2;
+        }
+    }
 }
 
-static int stbi__jpeg_test(stbi__context* s)
+typedef struct
 {
-    int r;
-    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-    if (!j) return stbi__err("outofmem", "Out of memory");
-    memset(j, 0, sizeof(stbi__jpeg));
-    j->s = s;
-    stbi__setup_jpeg(j);
-    r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
-    stbi__rewind(s);
-    STBI_FREE(j);
-    return r;
+    stbi__jpeg* z;
+    stbi__resample* res_comp;
+    stbi_uc* scratch; // per stripe: decode_n line buffers, then one output row
+    size_t scratch_stride;
+    stbi_uc* output;
+    int n, decode_n, is_rgb, flip;
+    unsigned int rows_per_stripe;
+} stbi__jpeg_convert_stripes;
+
+static void stbi__jpeg_convert_stripe_task(void* task_data, int index)
+{
+    stbi__jpeg_convert_stripes* stripes = (stbi__jpeg_convert_stripes*)task_data;
+    stbi__jpeg* z = stripes->z;
+    stbi__resample res_comp[4];
+    stbi_uc* linebuf[4];
+    stbi_uc* scratch = stripes->scratch + stripes->scratch_stride * index;
+    stbi_uc* edge_out;
+    size_t row_bytes = (size_t)stripes->n * z->s->img_x;
+    unsigned int img_y = z->s->img_y;
+    unsigned int first_row = (unsigned int)index * stripes->rows_per_stripe;
+    unsigned int last_row = first_row + stripes->rows_per_stripe;
+    int k;
+    if (last_row > z->s->img_y) last_row = z->s->img_y;
+    for (k = 0; k < stripes->decode_n; ++k) {
+        res_comp[k] = stripes->res_comp[k];
+        stbi__resample_skip_rows(&res_comp[k], z->img_comp[k].y, z->img_comp[k].w2, first_row);
+        linebuf[k] = scratch + (size_t)k * (z->s->img_x + 3);
+    }
+    // 3-channel writers store a fourth byte past each pixel, which for the stripe's last
+    // row (its first when writing bottom-up) would land in the neighbouring stripe; that
+    // row goes through the scratch row instead
+    edge_out = scratch + (size_t)stripes->decode_n * (z->s->img_x + 3);
+    if (stripes->flip) {
+        // copied in last, as the next row's stray byte lands on it too
+        stbi__jpeg_convert_rows(z, res_comp, linebuf, edge_out, 0, stripes->n, stripes->decode_n, stripes->is_rgb, first_row, first_row + 1);
+        if (first_row + 1 < last_row)
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, stripes->output + row_bytes * (img_y - 2 - first_row), -(int)row_bytes, stripes->n, stripes->decode_n, stripes->is_rgb, first_row + 1, last_row);
+        memcpy(stripes->output + row_bytes * (img_y - 1 - first_row), edge_out, row_bytes);
+    }
+    else {
+        stbi__jpeg_convert_rows(z, res_comp, linebuf, stripes->output + row_bytes * first_row, (int)row_bytes, stripes->n, stripes->decode_n, stripes->is_rgb, first_row, last_row - 1);
+        stbi__jpeg_convert_rows(z, res_comp, linebuf, edge_out, 0, stripes->n, stripes->decode_n, stripes->is_rgb, last_row - 1, last_row);
+        memcpy(stripes->output + row_bytes * (last_row - 1), edge_out, row_bytes);
+    }
 }
 
-static int stbi__jpeg_info_raw(stbi__jpeg* j, int* x, int* y, int* comp)
+// channels to generate (n) and planes to resample (decode_n) for req_comp
+static void stbi__jpeg_output_layout(stbi__jpeg* z, int req_comp, int* n, int* decode_n, int* is_rgb)
 {
-    if (!stbi__decode_jpeg_header(j, STBI__SCAN_header)) {
-        stbi__rewind(j->s);
-        return 0;
+    *n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+    *is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+    if (z->s->img_n == 3 && *n < 3 && !*is_rgb)
+        *decode_n = 1;
+    else
+        *decode_n = z->s->img_n;
+}
+
+// start the resamplers at the top of the planes
+static int stbi__jpeg_init_resamplers(stbi__jpeg* z, stbi__resample* res_comp, int decode_n)
+{
+    int k;
+    for (k = 0; k < decode_n; ++k) {
+        stbi__resample* r = &res_comp[k];
+
+        // allocate line buffer big enough for upsampling off the edges
+        // with upsample factor of 4; progressive previews already did
+        if (!z->img_comp[k].linebuf) z->img_comp[k].linebuf = (stbi_uc*)stbi__malloc(z->s->img_x + 3);
+        if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+        r->hs = z->img_h_max / z->img_comp[k].h;
+        r->vs = z->img_v_max / z->img_comp[k].v;
+        r->ystep = r->vs >> 1;
+        r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+        r->ypos = 0;
+        r->line0 = r->line1 = z->img_comp[k].data;
+
+        if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+        else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+        else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+        else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+        else                               r->resample = stbi__resample_row_generic;
     }
-    if (x) *x = j->s->img_x;
-    if (y) *y = j->s->img_y;
-    if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
     return 1;
 }
 
-static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
-{
-    int result;
-    stbi__jpeg* j = (stbi__jpeg*)(stbi__malloc(sizeof(stbi__jpeg)));
-    if (!j) return stbi__err("outofmem", "Out of memory");
-    memset(j, 0, sizeof(stbi__jpeg));
-    j->s = s;
-    result = stbi__jpeg_info_raw(j, x, y, comp);
-    STBI_FREE(j);
-    return result;
+// resample and color-convert the whole image into output, n * img_x * img_y bytes plus one;
+// res_comp must be fresh from stbi__jpeg_init_resamplers
+static void stbi__jpeg_convert_image(stbi__jpeg* z, stbi__resample* res_comp, stbi_uc* output, int n, int decode_n, int is_rgb)
+{
+    int k, stripe_count;
+    stbi_uc* linebuf[4] = { NULL, NULL, NULL, NULL };
+    stbi__jpeg_convert_stripes stripes;
+
+    // in horizontal stripes when a parallel-for is set
+    stripe_count = 0;
+    if (stbi__parallel_for && z->s->img_y >= 2 * STBI__JPEG_STRIPE_ROWS) {
+        stripe_count = (int)((z->s->img_y + STBI__JPEG_STRIPE_ROWS - 1) / STBI__JPEG_STRIPE_ROWS);
+        if (stripe_count > STBI__JPEG_MAX_PARALLEL_TASKS) stripe_count = STBI__JPEG_MAX_PARALLEL_TASKS;
+        stripes.scratch_stride = (size_t)decode_n * (z->s->img_x + 3) + (size_t)n * z->s->img_x + 1;
+        stripes.scratch = (stbi_uc*)stbi__malloc_mad2(stripe_count, (int)stripes.scratch_stride, 0);
+        if (!stripes.scratch) stripe_count = 0;
+    }
+    if (stripe_count) {
+        stripes.z = z;
+        stripes.res_comp = res_comp;
+        stripes.output = output;
+        stripes.n = n;
+        stripes.decode_n = decode_n;
+        stripes.is_rgb = is_rgb;
+        stripes.flip = z->s->flip;
+        stripes.rows_per_stripe = (z->s->img_y + stripe_count - 1) / stripe_count;
+        stripe_count = (int)((z->s->img_y + stripes.rows_per_stripe - 1) / stripes.rows_per_stripe);
+        stbi__parallel_for(stbi__parallel_for_user, stripe_count, stbi__jpeg_convert_stripe_task, &stripes);
+        stbi__free(stripes.scratch);
+    }
+    else {
+        int row_bytes = n * z->s->img_x;
+        for (k = 0; k < decode_n; ++k) linebuf[k] = z->img_comp[k].linebuf;
+        // with flip-on-load the rows go straight to their mirrored place
+        if (z->s->flip)
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, output + (size_t)row_bytes * (z->s->img_y - 1), -row_bytes, n, decode_n, is_rgb, 0, z->s->img_y);
+        else
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, output, row_bytes, n, decode_n, is_rgb, 0, z->s->img_y);
+    }
 }
-#endif
 
-// public domain zlib decode    v0.2  Sean Barrett 2006-11-18
-//    simple implementation
-//      - all input must be provided in an upfront buffer
-//      - all output is written to a single output buffer (can malloc/realloc)
-//    performance
-//      - fast huffman
+// a stbi_load_progressive preview of the scans so far. The planes are rebuilt from copies of
+// the coefficients, which stbi__jpeg_finish still needs as they are; a component without AC
+// coefficients yet has flat blocks, filled with the value its IDCT would give
+static int stbi__jpeg_preview(stbi__jpeg* z)
+{
+    stbi__preview* p = z->preview;
+    stbi__resample res_comp[4];
+    stbi__idct_batch batch;
+    int n, decode_n, is_rgb, c, i, j, k;
 
-#ifndef STBI_NO_ZLIB
+    stbi__jpeg_output_layout(z, p->req_comp, &n, &decode_n, &is_rgb);
+    if (decode_n <= 0) return 1;
+    if (!p->pixels) {
+        p->pixels = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+        if (!p->pixels) return stbi__err("outofmem", "Out of memory");
+    }
 
-// fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
-#define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
-#define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+    stbi__idct_batch_init(&batch);
+    for (c = 0; c < decode_n; ++c) {
+        int w = (z->img_comp[c].x + 7) >> 3;
+        int h = (z->img_comp[c].y + 7) >> 3;
+        int w2 = z->img_comp[c].w2;
+        stbi__uint16* dequant = z->dequant[z->img_comp[c].tq];
+        for (j = 0; j < h; ++j) {
+            short* coeff = z->img_comp[c].coeff + 64 * j * z->img_comp[c].coeff_w;
+            stbi_uc* out = z->img_comp[c].data + w2 * j * 8;
+            if (p->ac_seen & (1 << c)) {
+                for (i = 0; i < w; ++i) {
+                    short* data = stbi__idct_batch_slot(&batch);
+                    memcpy(data, coeff + 64 * i, 64 * sizeof(short));
+                    stbi__jpeg_dequantize(data, dequant);
+                    stbi__idct_batch_push(z, &batch, out + 8 * i, w2, data);
+                }
+            }
+            else {
+                // one row of the block row, copied to the other seven
+                for (i = 0; i < w; ++i)
+                    memset(out + 8 * i, stbi__clamp((((short)(coeff[64 * i] * dequant[0]) + 4) >> 3) + 128), 8);
+                for (k = 1; k < 8; ++k)
+                    memcpy(out + w2 * k, out, (size_t)w * 8);
+            }
+        }
+    }
+    stbi__idct_batch_flush(z, &batch);
 
-// zlib-style huffman encoding
-// (jpegs packs from left, zlib from right, so can't share code)
-typedef struct
+    if (!stbi__jpeg_init_resamplers(z, res_comp, decode_n)) return 0;
+    stbi__jpeg_convert_image(z, res_comp, p->pixels, n, decode_n, is_rgb);
+    if (!p->func(p->user, p->pixels, z->s->img_x, z->s->img_y, n, p->scans))
+        p->func = NULL;
+    return 1;
+}
+
+// called after each scan of a progressive JPEG decoded for stbi_load_progressive; last is
+// set when the scan completes the image, which then needs no preview
+static int stbi__jpeg_preview_scan(stbi__jpeg* z, int last)
 {
-    stbi__uint16 fast[1 << STBI__ZFAST_BITS];
-    stbi__uint16 firstcode[16];
-    int maxcode[17];
-    stbi__uint16 firstsymbol[16];
-    stbi_uc  size[STBI__ZNSYMS];
-    stbi__uint16 value[STBI__ZNSYMS];
-} stbi__zhuffman;
+    stbi__preview* p = z->preview;
+    int i, all = (1 << z->s->img_n) - 1;
+    ++p->scans;
+    for (i = 0; i < z->scan_n; ++i) {
+        if (z->spec_start == 0) p->dc_seen |= 1 << z->order[i];
+        else p->ac_seen |= 1 << z->order[i];
+    }
+    if (!p->func || last || p->dc_seen != all || z->idct_size != 8)
+        return 1;
+    return stbi__jpeg_preview(z);
+}
+
+// stbi_load_rows for a baseline scan of every component: each plane keeps a window of the
+// last row of MCU row m-2, MCU row m-1 and MCU row m. Once row m is decoded, the output rows
+// of m-1 are converted (the vertical upsamplers look one plane row above and below) and
+// handed over, and the window slides up by one MCU row.
+static int stbi__jpeg_stream_scan(stbi__jpeg* z, int req_comp)
+{
+    stbi__context* s = z->s;
+    stbi__resample res_comp[4];
+    stbi_uc* linebuf[4] = { NULL, NULL, NULL, NULL };
+    stbi_uc* band;
+    int n, decode_n, is_rgb, k, m, stopped = 0, ok = 1;
+
+    stbi__jpeg_output_layout(z, req_comp, &n, &decode_n, &is_rgb);
+    for (k = 0; k < s->img_n; ++k) {
+        int cmh = z->img_comp[k].v * 8;
+        z->img_comp[k].raw_data = stbi__malloc_mad2(z->img_comp[k].w2, 2 * cmh + 1, 15);
+        if (z->img_comp[k].raw_data == NULL) return stbi__err("outofmem", "Out of memory");
+        z->img_comp[k].data = (stbi_uc*)(((size_t)z->img_comp[k].raw_data + 15) & ~15) + (size_t)z->img_comp[k].w2 * (cmh + 1);
+    }
+    if (!stbi__jpeg_init_resamplers(z, res_comp, decode_n)) return 0;
+    for (k = 0; k < decode_n; ++k) linebuf[k] = z->img_comp[k].linebuf;
+    band = (stbi_uc*)stbi__malloc_mad3(n, s->img_x, z->img_mcu_h, 1);
+    if (!band) return stbi__err("outofmem", "Out of memory");
+
+    stbi__jpeg_reset(z);
+    for (m = 0; m <= z->img_mcu_y && ok; ++m) {
+        if (m < z->img_mcu_y && stopped) {
+            // rows after a scan that ended early were never decoded
+            for (k = 0; k < s->img_n; ++k)
+                memset(z->img_comp[k].data, 0, (size_t)z->img_comp[k].w2 * z->img_comp[k].v * 8);
+        }
+        else if (m < z->img_mcu_y) {
+            if (z->scan_n == 1) {
+                int v = z->img_comp[z->order[0]].v, block_rows = (z->img_comp[z->order[0]].y + 7) >> 3;
+                ok = stbi__jpeg_decode_baseline_rows(z, m * v, m * v + v < block_rows ? m * v + v : block_rows, &stopped);
+            }
+            else {
+                ok = stbi__jpeg_decode_baseline_rows(z, m, m + 1, &stopped);
+            }
+        }
+        if (ok && m > 0) {
+            unsigned int first_row = (m - 1) * z->img_mcu_h;
+            unsigned int last_row = first_row + z->img_mcu_h;
+            if (last_row > s->img_y) last_row = s->img_y;
+            stbi__jpeg_convert_rows(z, res_comp, linebuf, band, n * z->s->img_x, n, decode_n, is_rgb, first_row, last_row);
+            ok = stbi__emit_rows(s->rows, band, first_row, last_row - first_row, s->img_x, s->img_y, n);
+        }
+        if (ok && m < z->img_mcu_y) {
+            for (k = 0; k < s->img_n; ++k) {
+                size_t shift = (size_t)z->img_comp[k].w2 * z->img_comp[k].v * 8;
+                stbi_uc* top = z->img_comp[k].data - shift - z->img_comp[k].w2;
+                memmove(top, top + shift, shift + z->img_comp[k].w2);
+                if (k < decode_n) {
+                    res_comp[k].line0 -= shift;
+                    res_comp[k].line1 -= shift;
+                }
+            }
+        }
+    }
+    stbi__free(band);
+    if (ok) s->rows->streamed = 1;
+    return ok;
+}
+
+static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp, int req_comp)
+{
+    int n, decode_n, is_rgb;
+    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+    // validate req_comp
+    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+    // load a jpeg image from whichever source, but leave in YCbCr format
+    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+    if (z->rows_scan) {
+        // stbi_load_rows: the rows are handed over as they are decoded
+        int ok = stbi__jpeg_stream_scan(z, req_comp);
+        stbi__cleanup_jpeg(z);
+        if (ok) {
+            *out_x = z->s->img_x;
+            *out_y = z->s->img_y;
+            if (comp) *comp = z->s->img_n >= 3 ? 3 : 1;
+        }
+        return NULL;
+    }
+    // stbi_load_rows leaves the planes to the first scan, and this file has none
+    if (!z->img_comp[0].raw_data && !stbi__jpeg_alloc_components(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+    // a reduced-size decode left smaller component planes; the image is that size from here on
+    if (z->idct_size != 8) {
+        int k, scale = 8 / z->idct_size;
+        z->s->img_x = (z->s->img_x + scale - 1) / scale;
+        z->s->img_y = (z->s->img_y + scale - 1) / scale;
+        for (k = 0; k < z->s->img_n; ++k) {
+            z->img_comp[k].x = (z->img_comp[k].x + scale - 1) / scale;
+            z->img_comp[k].y = (z->img_comp[k].y + scale - 1) / scale;
+        }
+    }
+
+    // determine actual number of components to generate
+    stbi__jpeg_output_layout(z, req_comp, &n, &decode_n, &is_rgb);
+
+    // nothing to do if no components requested; check this now to avoid
+    // accessing uninitialized coutput[0] later
+    if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
+
+    // resample and color-convert
+    {
+        stbi_uc* output;
+        stbi__resample res_comp[4];
+
+        if (!stbi__jpeg_init_resamplers(z, res_comp, decode_n)) { stbi__cleanup_jpeg(z); return NULL; }
+
+        // can't error after this so, this is safe; a progressive preview's image is the
+        // same size, and already paged in
+        if (z->preview && z->preview->pixels) {
+            output = z->preview->pixels;
+            z->preview->pixels = NULL;
+        }
+        else
+            output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+        if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
+        stbi__jpeg_convert_image(z, res_comp, output, n, decode_n, is_rgb);
+        stbi__cleanup_jpeg(z);
+        *out_x = z->s->img_x;
+        *out_y = z->s->img_y;
+        if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+        return output;
+    }
+}
+
+static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+{
+    unsigned char* result;
+    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+    if (!j) return stbi__errpuc("outofmem", "Out of memory");
+    memset(j, 0, sizeof(stbi__jpeg));
+    j->s = s;
+    j->rows = s->rows;
+    j->preview = s->preview;
+    stbi__setup_jpeg(j);
+    result = load_jpeg_image(j, x, y, comp, req_comp);
+    ri->scale_shift = s->scale_shift;
+    ri->flipped = s->flip;
+    stbi__free(j);
+    return result;
+}
+
+static int stbi__jpeg_test(stbi__context* s)
+{
+    int r;
+    stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+    if (!j) return stbi__err("outofmem", "Out of memory");
+    memset(j, 0, sizeof(stbi__jpeg));
+    j->s = s;
+    stbi__setup_jpeg(j);
+    r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
+    stbi__rewind(s);
+    stbi__free(j);
+    return r;
+}
+
+static int stbi__jpeg_info_raw(stbi__jpeg* j, int* x, int* y, int* comp)
+{
+    if (!stbi__decode_jpeg_header(j, STBI__SCAN_header)) {
+        stbi__rewind(j->s);
+        return 0;
+    }
+    if (x) *x = j->s->img_x;
+    if (y) *y = j->s->img_y;
+    if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
+    return 1;
+}
+
+static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
+{
+    int result;
+    stbi__jpeg* j = (stbi__jpeg*)(stbi__malloc(sizeof(stbi__jpeg)));
+    if (!j) return stbi__err("outofmem", "Out of memory");
+    memset(j, 0, sizeof(stbi__jpeg));
+    j->s = s;
+    result = stbi__jpeg_info_raw(j, x, y, comp);
+    stbi__free(j);
+    return result;
+}
+#endif
+
+// public domain zlib decode    v0.2  Sean Barrett 2006-11-18
+//    simple implementation
+//      - all input must be provided in an upfront buffer
+//      - all output is written to a single output buffer (can malloc/realloc)
+//    performance
+//      - fast huffman
 
+#if !defined(STBI_NO_ZLIB) || !defined(STBI_NO_WEBP)
+// shared by the deflate and VP8L prefix code decoders, which both pack codes from the LSB
 stbi_inline static int stbi__bitreverse16(int n)
 {
     n = ((n & 0xAAAA) >> 1) | ((n & 0x5555) << 1);
@@ -4152,7 +6194,33 @@ stbi_inline static int stbi__bit_reverse(int v, int bits)
     return stbi__bitreverse16(v) >> (16 - bits);
 }
 
-static int stbi__zbuild_huffman(stbi__zhuffman* z, const stbi_uc* sizelist, int num)
+#endif
+
+#ifndef STBI_NO_ZLIB
+
+// fast-way is faster to check than jpeg huffman, but slow way is slower
+#define STBI__ZFAST_BITS  11 // resolves nearly every code of typical dynamic tables in one lookup
+#define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
+#define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+
+// fast table entries: bits 0-3 hold the length of all codes in the entry, bits 4-7 the length of
+// the first code, bits 8-9 the number of literals packed in bits 16-23 and 24-31 (0 means bits
+// 16-31 hold a plain symbol instead); an all-zero entry means "use the slow path"
+#define STBI__ZFAST_LITERALS(e)  (((e) >> 8) & 3)
+
+// zlib-style huffman encoding
+// (jpegs packs from left, zlib from right, so can't share code)
+typedef struct
+{
+    stbi__uint32 fast[1 << STBI__ZFAST_BITS];
+    stbi__uint16 firstcode[16];
+    int maxcode[17];
+    stbi__uint16 firstsymbol[16];
+    stbi_uc  size[STBI__ZNSYMS];
+    stbi__uint16 value[STBI__ZNSYMS];
+} stbi__zhuffman;
+
+static int stbi__zbuild_huffman(stbi__zhuffman* z, const stbi_uc* sizelist, int num, int pair_literals)
 {
     int i, k = 0;
     int code, next_code[16], sizes[17];
@@ -4183,7 +6251,7 @@ static int stbi__zbuild_huffman(stbi__zhuffman* z, const stbi_uc* sizelist, int
         int s = sizelist[i];
         if (s) {
             int c = next_code[s] - z->firstcode[s] + z->firstsymbol[s];
-            stbi__uint16 fastv = (stbi__uint16)((s << 9) | i);
+            stbi__uint32 fastv = (stbi__uint32)((i << 16) | ((pair_literals && i < 256) << 8) | (s << 4) | s);
             z->size[c] = (stbi_uc)s;
             z->value[c] = (stbi__uint16)i;
             if (s <= STBI__ZFAST_BITS) {
@@ -4196,6 +6264,18 @@ static int stbi__zbuild_huffman(stbi__zhuffman* z, const stbi_uc* sizelist, int
             ++next_code[s];
         }
     }
+    if (pair_literals) {
+        // a literal whose code leaves room for the whole code of another literal decodes both;
+        // the entry at i >> s describes the bits that follow, and may already hold a pair itself
+        for (i = 0; i < (1 << STBI__ZFAST_BITS); ++i) {
+            stbi__uint32 e = z->fast[i], next;
+            int s = e & 15;
+            if (STBI__ZFAST_LITERALS(e) != 1) continue;
+            next = z->fast[i >> s];
+            if (STBI__ZFAST_LITERALS(next) && s + ((next >> 4) & 15) <= STBI__ZFAST_BITS)
+                z->fast[i] = e + ((next >> 4) & 15) + (1 << 8) + (((next >> 16) & 255) << 24);
+        }
+    }
     return 1;
 }
 
@@ -4205,23 +6285,33 @@ static int stbi__zbuild_huffman(stbi__zhuffman* z, const stbi_uc* sizelist, int
 //    we require PNG read all the IDATs and combine them into a single
 //    memory buffer
 
-typedef struct
+typedef struct stbi__zbuf_s
 {
     stbi_uc* zbuffer, * zbuffer_end;
     int num_bits;
     int hit_zeof_once;
-    stbi__uint32 code_buffer;
+    int num_pad_bits; // zero bits appended past the end of the input; consuming any is an error
+    stbi__uint64 code_buffer; // bits above num_bits may hold lookahead copied from zbuffer
 
     char* zout;
     char* zout_start;
     char* zout_end;
     int   z_expandable;
 
+    // streaming (PNG rows): refill moves the unread input to the front of its buffer and
+    // appends more, returning how much; drain takes finished output from the front of the
+    // buffer so it can slide instead of grow, returning how much it took or -1 to stop
+    int (*refill)(struct stbi__zbuf_s* z);
+    int (*drain)(struct stbi__zbuf_s* z, stbi_uc* data, int len);
+    void* stream;
+    int zout_drained; // offset of the first output byte drain has not taken
+
     stbi__zhuffman z_length, z_distance;
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf* z)
 {
+    if (z->zbuffer >= z->zbuffer_end && z->refill) z->refill(z);
     return (z->zbuffer >= z->zbuffer_end);
 }
 
@@ -4230,34 +6320,54 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf* z)
     return stbi__zeof(z) ? 0 : *z->zbuffer++;
 }
 
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc* p)
+{
+#if defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM64) || defined(__i386__) || defined(__x86_64__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    stbi__uint64 v;
+    memcpy(&v, p, 8);
+    return v;
+#else
+    return (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) | ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24) |
+        ((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) | ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+#endif
+}
+
 static void stbi__fill_bits(stbi__zbuf* z)
 {
+    if (z->zbuffer_end - z->zbuffer < 8 && z->refill) z->refill(z);
+    if (z->zbuffer_end - z->zbuffer >= 8) {
+        // one unaligned load tops the buffer up to 56-63 bits; whatever lands above the new
+        // num_bits is the start of the following bytes, so loading it again later is harmless
+        z->code_buffer |= stbi__zload64(z->zbuffer) << z->num_bits;
+        z->zbuffer += (63 - z->num_bits) >> 3;
+        z->num_bits |= 56;
+        return;
+    }
+    z->code_buffer &= ((stbi__uint64)1 << z->num_bits) - 1; // drop lookahead, it is read again below
     do {
-        if (z->code_buffer >= (1U << z->num_bits)) {
-            z->zbuffer = z->zbuffer_end;  /* treat this as EOF so we fail. */
-            return;
-        }
-        z->code_buffer |= (unsigned int)stbi__zget8(z) << z->num_bits;
+        if (stbi__zeof(z)) z->num_pad_bits += 8;
+        z->code_buffer |= (stbi__uint64)stbi__zget8(z) << z->num_bits;
         z->num_bits += 8;
-    } while (z->num_bits <= 24);
+    } while (z->num_bits <= 56);
 }
 
 stbi_inline static unsigned int stbi__zreceive(stbi__zbuf* z, int n)
 {
     unsigned int k;
     if (z->num_bits < n) stbi__fill_bits(z);
-    k = z->code_buffer & ((1 << n) - 1);
+    k = (unsigned int)(z->code_buffer & ((1 << n) - 1));
     z->code_buffer >>= n;
     z->num_bits -= n;
     return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
+// returns the symbol for a code too long for the fast table and its length in *size, or -1
+static int stbi__zhuffman_decode_slowpath(stbi__zhuffman* z, unsigned int bits, int* size)
 {
     int b, s, k;
     // not resolved by fast table, so compute it the slow way
     // use jpeg approach, which requires MSbits at top
-    k = stbi__bit_reverse(a->code_buffer, 16);
+    k = stbi__bit_reverse(bits & 0xffff, 16);
     for (s = STBI__ZFAST_BITS + 1; ; ++s)
         if (k < z->maxcode[s])
             break;
@@ -4266,14 +6376,14 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
     b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
     if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
     if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
-    a->code_buffer >>= s;
-    a->num_bits -= s;
+    *size = s;
     return z->value[b];
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf* a, stbi__zhuffman* z)
 {
-    int b, s;
+    stbi__uint32 b;
+    int s, v;
     if (a->num_bits < 16) {
         if (stbi__zeof(a)) {
             if (!a->hit_zeof_once) {
@@ -4282,6 +6392,7 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf* a, stbi__zhuffman* z)
                 // though, that is invalid data. This is caught later.
                 a->hit_zeof_once = 1;
                 a->num_bits += 16; // add 16 implicit zero bits
+                a->num_pad_bits += 16;
             }
             else {
                 // We already inserted our extra 16 padding bits and are again
@@ -4295,12 +6406,17 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf* a, stbi__zhuffman* z)
     }
     b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
     if (b) {
-        s = b >> 9;
-        a->code_buffer >>= s;
-        a->num_bits -= s;
-        return b & 511;
+        // only the first literal of a pair is taken here
+        s = (b >> 4) & 15;
+        v = (int)(b >> 16) & (STBI__ZFAST_LITERALS(b) ? 255 : 0xffff);
+    }
+    else {
+        v = stbi__zhuffman_decode_slowpath(z, (unsigned int)a->code_buffer, &s);
+        if (v < 0) return -1;
     }
-    return stbi__zhuffman_decode_slowpath(a, z);
+    a->code_buffer >>= s;
+    a->num_bits -= s;
+    return v;
 }
 
 static int stbi__zexpand(stbi__zbuf* z, char* zout, int n)  // need to make room for n bytes
@@ -4308,6 +6424,21 @@ static int stbi__zexpand(stbi__zbuf* z, char* zout, int n)  // need to make room
     char* q;
     unsigned int cur, limit, old_limit;
     z->zout = zout;
+    if (z->drain) {
+        // hand finished output over, then slide what wasn't taken to the front; matches can
+        // reach 32K back, so that much stays even if it was taken
+        int used = (int)(zout - z->zout_start), keep_from;
+        int taken = z->drain(z, (stbi_uc*)z->zout_start + z->zout_drained, used - z->zout_drained);
+        if (taken < 0) return 0;
+        z->zout_drained += taken;
+        keep_from = z->zout_drained < used - 32768 ? z->zout_drained : used - 32768;
+        if (keep_from > 0) {
+            memmove(z->zout_start, z->zout_start + keep_from, used - keep_from);
+            z->zout -= keep_from;
+            z->zout_drained -= keep_from;
+        }
+        if (z->zout_end - z->zout >= n) return 1;
+    }
     if (!z->z_expandable) return stbi__err("output buffer limit", "Corrupt PNG");
     cur = (unsigned int)(z->zout - z->zout_start);
     limit = old_limit = (unsigned)(z->zout_end - z->zout_start);
@@ -4316,7 +6447,7 @@ static int stbi__zexpand(stbi__zbuf* z, char* zout, int n)  // need to make room
         if (limit > UINT_MAX / 2) return stbi__err("outofmem", "Out of memory");
         limit *= 2;
     }
-    q = (char*)STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+    q = (char*)stbi__realloc_sized(z->zout_start, old_limit, limit);
     STBI_NOTUSED(old_limit);
     if (q == NULL) return stbi__err("outofmem", "Out of memory");
     z->zout_start = q;
@@ -4339,11 +6470,145 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+#define STBI__ZCOPY_OVERRUN  15 // stbi__zcopy_match may write this far past the end of a match
+
+// copies a match in 16-byte steps; short distances repeat with period dist, so they are
+// copied bytewise until a multiple of dist of at least 8 bytes exists to copy from
+stbi_inline static void stbi__zcopy_match(stbi_uc* zout, int len, int dist)
+{
+    stbi_uc* end = zout + len;
+    stbi_uc* p = zout - dist;
+    if (dist == 1) { // run of one byte; common in images.
+        memset(zout, *p, len);
+        return;
+    }
+    if (dist < 8) {
+        int period = dist, i;
+        while (period < 8) period += dist;
+        if (len <= period) {
+            do *zout++ = *p++; while (--len);
+            return;
+        }
+        for (i = 0; i < period; ++i)
+            zout[i] = p[i];
+        zout += period;
+        p = zout - period;
+    }
+    do {
+        memcpy(zout, p, 8);
+        memcpy(zout + 8, p + 8, 8);
+        zout += 16;
+        p += 16;
+    } while (zout < end);
+}
+
+// Decodes the bulk of a block while at least 8 input bytes remain for a whole-word refill and
+// the output has room for the longest match plus copy overrun. One refill covers any literal
+// pair or any match (15 + 5 + 15 + 13 bits). Stops without consuming anything at end-of-block
+// or at a code or distance that is invalid, so stbi__parse_huffman_block can handle those.
+static char* stbi__parse_huffman_fast(stbi__zbuf* a, char* zout)
+{
+    stbi_uc* in = a->zbuffer;
+    stbi__uint64 bits = a->code_buffer;
+    int num_bits = a->num_bits;
+    const stbi__uint32* lfast = a->z_length.fast;
+    const stbi__uint32* dfast = a->z_distance.fast;
+
+    while (a->zbuffer_end - in >= 8 && a->zout_end - zout >= 258 + STBI__ZCOPY_OVERRUN) {
+        stbi__uint64 match_bits;
+        stbi__uint32 e;
+        int z, s, len, dist, match_num_bits;
+        bits |= stbi__zload64(in) << num_bits;
+        in += (63 - num_bits) >> 3;
+        num_bits |= 56;
+
+        e = lfast[bits & STBI__ZFAST_MASK];
+        if (STBI__ZFAST_LITERALS(e)) {
+            // the second lookup still has at least 45 bits to work with
+            s = e & 15;
+            bits >>= s;
+            num_bits -= s;
+            zout[0] = (char)(e >> 16);
+            zout[1] = (char)(e >> 24);
+            zout += STBI__ZFAST_LITERALS(e);
+            e = lfast[bits & STBI__ZFAST_MASK];
+            if (STBI__ZFAST_LITERALS(e)) {
+                s = e & 15;
+                bits >>= s;
+                num_bits -= s;
+                zout[0] = (char)(e >> 16);
+                zout[1] = (char)(e >> 24);
+                zout += STBI__ZFAST_LITERALS(e);
+            }
+            continue;
+        }
+        if (e) {
+            s = e & 15;
+            z = (int)(e >> 16);
+        }
+        else {
+            z = stbi__zhuffman_decode_slowpath(&a->z_length, (unsigned int)bits, &s);
+            if (z < 0) break;
+        }
+        if (z < 256) {
+            bits >>= s;
+            num_bits -= s;
+            *zout++ = (char)z;
+            continue;
+        }
+        if (z == 256 || z >= 286) break;
+
+        match_bits = bits;
+        match_num_bits = num_bits;
+        bits >>= s;
+        num_bits -= s;
+        z -= 257;
+        len = stbi__zlength_base[z];
+        s = stbi__zlength_extra[z];
+        len += (int)(bits & ((1 << s) - 1));
+        bits >>= s;
+        num_bits -= s;
+        e = dfast[bits & STBI__ZFAST_MASK];
+        if (e) {
+            s = e & 15;
+            z = (int)(e >> 16);
+        }
+        else {
+            z = stbi__zhuffman_decode_slowpath(&a->z_distance, (unsigned int)bits, &s);
+        }
+        if (z < 0 || z >= 30) {
+            bits = match_bits;
+            num_bits = match_num_bits;
+            break;
+        }
+        bits >>= s;
+        num_bits -= s;
+        dist = stbi__zdist_base[z];
+        s = stbi__zdist_extra[z];
+        dist += (int)(bits & ((1 << s) - 1));
+        bits >>= s;
+        num_bits -= s;
+        if (zout - a->zout_start < dist) {
+            bits = match_bits;
+            num_bits = match_num_bits;
+            break;
+        }
+        stbi__zcopy_match((stbi_uc*)zout, len, dist);
+        zout += len;
+    }
+    a->zbuffer = in;
+    a->code_buffer = bits;
+    a->num_bits = num_bits;
+    return zout;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf* a)
 {
     char* zout = a->zout;
     for (;;) {
-        int z = stbi__zhuffman_decode(a, &a->z_length);
+        int z;
+        zout = stbi__parse_huffman_fast(a, zout);
+        z = stbi__zhuffman_decode(a, &a->z_length);
         if (z < 256) {
             if (z < 0) return stbi__err("bad huffman code", "Corrupt PNG"); // error in huffman codes
             if (zout >= a->zout_end) {
@@ -4357,11 +6622,11 @@ static int stbi__parse_huffman_block(stbi__zbuf* a)
             int len, dist;
             if (z == 256) {
                 a->zout = zout;
-                if (a->hit_zeof_once && a->num_bits < 16) {
-                    // The first time we hit zeof, we inserted 16 extra zero bits into our bit
-                    // buffer so the decoder can just do its speculative decoding. But if we
-                    // actually consumed any of those bits (which is the case when num_bits < 16),
-                    // the stream actually read past the end so it is malformed.
+                if (a->num_bits < a->num_pad_bits) {
+                    // At the end of the input we inserted extra zero bits into our bit buffer
+                    // so the decoder can just do its speculative decoding. But if we actually
+                    // consumed any of those bits (which is the case when fewer bits than were
+                    // padded remain), the stream actually read past the end so it is malformed.
                     return stbi__err("unexpected end", "Corrupt PNG");
                 }
                 return 1;
@@ -4409,7 +6674,7 @@ static int stbi__compute_huffman_codes(stbi__zbuf* a)
         int s = stbi__zreceive(a, 3);
         codelength_sizes[length_dezigzag[i]] = (stbi_uc)s;
     }
-    if (!stbi__zbuild_huffman(&z_codelength, codelength_sizes, 19)) return 0;
+    if (!stbi__zbuild_huffman(&z_codelength, codelength_sizes, 19, 0)) return 0;
 
     n = 0;
     while (n < ntot) {
@@ -4439,34 +6704,55 @@ static int stbi__compute_huffman_codes(stbi__zbuf* a)
         }
     }
     if (n != ntot) return stbi__err("bad codelengths", "Corrupt PNG");
-    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit)) return 0;
-    if (!stbi__zbuild_huffman(&a->z_distance, lencodes + hlit, hdist)) return 0;
+    if (!stbi__zbuild_huffman(&a->z_length, lencodes, hlit, 1)) return 0;
+    if (!stbi__zbuild_huffman(&a->z_distance, lencodes + hlit, hdist, 0)) return 0;
     return 1;
 }
 
 static int stbi__parse_uncompressed_block(stbi__zbuf* a)
 {
     stbi_uc header[4];
-    int len, nlen, k;
+    int len, nlen, k, buffered;
     if (a->num_bits & 7)
         stbi__zreceive(a, a->num_bits & 7); // discard
     // drain the bit-packed data into header
     k = 0;
-    while (a->num_bits > 0) {
+    while (a->num_bits > 0 && k < 4) {
         header[k++] = (stbi_uc)(a->code_buffer & 255); // suppress MSVC run-time check
         a->code_buffer >>= 8;
         a->num_bits -= 8;
     }
     if (a->num_bits < 0) return stbi__err("zlib corrupt", "Corrupt PNG");
+    // input is read directly from here on, so lookahead in the bit buffer would go stale
+    a->code_buffer &= ((stbi__uint64)1 << a->num_bits) - 1;
     // now fill header the normal way
     while (k < 4)
         header[k++] = stbi__zget8(a);
     len = header[1] * 256 + header[0];
     nlen = header[3] * 256 + header[2];
     if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt", "Corrupt PNG");
-    if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer", "Corrupt PNG");
+    // the 64-bit buffer can still hold the first few bytes of the block
+    buffered = a->num_bits >> 3;
+    if (buffered > len) buffered = len;
+    if (!a->refill && a->zbuffer + (len - buffered) > a->zbuffer_end) return stbi__err("read past buffer", "Corrupt PNG");
     if (a->zout + len > a->zout_end)
         if (!stbi__zexpand(a, a->zout, len)) return 0;
+    for (k = 0; k < buffered; ++k) {
+        *a->zout++ = (char)(a->code_buffer & 255);
+        a->code_buffer >>= 8;
+        a->num_bits -= 8;
+    }
+    if (a->num_bits < a->num_pad_bits) return stbi__err("read past buffer", "Corrupt PNG");
+    len -= buffered;
+    // streaming input may hold only part of the block
+    while (a->zbuffer_end - a->zbuffer < len) {
+        k = (int)(a->zbuffer_end - a->zbuffer);
+        memcpy(a->zout, a->zbuffer, k);
+        a->zbuffer += k;
+        a->zout += k;
+        len -= k;
+        if (!a->refill || !a->refill(a)) return stbi__err("read past buffer", "Corrupt PNG");
+    }
     memcpy(a->zout, a->zbuffer, len);
     a->zbuffer += len;
     a->zout += len;
@@ -4524,6 +6810,7 @@ static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
     a->num_bits = 0;
     a->code_buffer = 0;
     a->hit_zeof_once = 0;
+    a->num_pad_bits = 0;
     do {
         final = stbi__zreceive(a, 1);
         type = stbi__zreceive(a, 2);
@@ -4536,8 +6823,8 @@ static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
         else {
             if (type == 1) {
                 // use fixed code lengths
-                if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, STBI__ZNSYMS)) return 0;
-                if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance, 32)) return 0;
+                if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, STBI__ZNSYMS, 1)) return 0;
+                if (!stbi__zbuild_huffman(&a->z_distance, stbi__zdefault_distance, 32, 0)) return 0;
             }
             else {
                 if (!stbi__compute_huffman_codes(a)) return 0;
@@ -4554,6 +6841,8 @@ static int stbi__do_zlib(stbi__zbuf* a, char* obuf, int olen, int exp, int parse
     a->zout = obuf;
     a->zout_end = obuf + olen;
     a->z_expandable = exp;
+    a->refill = NULL;
+    a->drain = NULL;
 
     return stbi__parse_zlib(a, parse_header);
 }
@@ -4570,7 +6859,7 @@ STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int
         return a.zout_start;
     }
     else {
-        STBI_FREE(a.zout_start);
+        stbi__free(a.zout_start);
         return NULL;
     }
 }
@@ -4592,7 +6881,7 @@ STBIDEF char* stbi_zlib_decode_malloc_guesssize_headerflag(const char* buffer, i
         return a.zout_start;
     }
     else {
-        STBI_FREE(a.zout_start);
+        stbi__free(a.zout_start);
         return NULL;
     }
 }
@@ -4620,7 +6909,7 @@ STBIDEF char* stbi_zlib_decode_noheader_malloc(char const* buffer, int len, int*
         return a.zout_start;
     }
     else {
-        STBI_FREE(a.zout_start);
+        stbi__free(a.zout_start);
         return NULL;
     }
 }
@@ -4737,89 +7026,238 @@ static void stbi__create_png_alpha_expand8(stbi_uc* dest, stbi_uc* src, stbi__ui
     }
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+// SIMD unfiltering of scanlines with 3- or 4-byte pixels (8-bit RGB/RGBA, 16-bit gray+alpha).
+// Sub, Avg and Paeth depend on the pixel just decoded: Sub turns a whole register into a
+// prefix sum, while Avg and Paeth keep the previous pixel in a register and step one pixel
+// at a time, using the same arithmetic as the scalar loops so results are identical.
+// Returns how many bytes were unfiltered, a whole number of pixels; the scalar loops in
+// stbi__create_png_image_raw finish the row from there.
+static int stbi__png_unfilter_simd(stbi_uc* cur, const stbi_uc* prior, const stbi_uc* raw, int nk, int filter, int filter_bytes)
+{
+    int k = 0;
+#ifdef STBI_SSE2
+    __m128i zero = _mm_setzero_si128();
+    switch (filter) {
+    case STBI__F_up:
+        for (; k + 16 <= nk; k += 16) {
+            __m128i r = _mm_loadu_si128((const __m128i*)(raw + k));
+            __m128i b = _mm_loadu_si128((const __m128i*)(prior + k));
+            _mm_storeu_si128((__m128i*)(cur + k), _mm_add_epi8(r, b));
+        }
+        break;
+    case STBI__F_sub:
+        if (filter_bytes == 4) {
+            __m128i last = zero;
+            for (; k + 16 <= nk; k += 16) {
+                __m128i d = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(raw + k)), last);
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+                _mm_storeu_si128((__m128i*)(cur + k), d);
+                last = _mm_srli_si128(d, 12);
+            }
+        }
+        else {
+            // five pixels per step; the 16th byte stored belongs to the next step, which
+            // overwrites it
+            __m128i mask = _mm_setr_epi32(0xffffff, 0, 0, 0);
+            __m128i last = zero;
+            for (; k + 16 <= nk; k += 15) {
+                __m128i d = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(raw + k)), last);
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 3));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 6));
+                d = _mm_add_epi8(d, _mm_slli_si128(d, 12));
+                _mm_storeu_si128((__m128i*)(cur + k), d);
+                last = _mm_and_si128(_mm_srli_si128(d, 12), mask);
+            }
+        }
+        break;
+    case STBI__F_avg: {
+        // _mm_avg_epu8 rounds up, the filter rounds down
+        __m128i a = zero, one = _mm_set1_epi8(1);
+        for (; k + 4 <= nk; k += filter_bytes) {
+            stbi__uint32 rv, bv;
+            __m128i b, avg;
+            memcpy(&rv, raw + k, 4);
+            memcpy(&bv, prior + k, 4);
+            b = _mm_cvtsi32_si128((int)bv);
+            avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(_mm_cvtsi32_si128((int)rv), avg);
+            rv = (stbi__uint32)_mm_cvtsi128_si32(a);
+            memcpy(cur + k, &rv, 4);
+        }
+        break;
+    }
+    case STBI__F_paeth: {
+        // stbi__paeth on 16-bit lanes; a is the pixel to the left, c the one above it
+        __m128i a = zero, c = zero, lowbyte = _mm_set1_epi16(0xff);
+        for (; k + 4 <= nk; k += filter_bytes) {
+            stbi__uint32 rv, bv;
+            __m128i b, thresh, lo, hi, t0, t1, m;
+            memcpy(&rv, raw + k, 4);
+            memcpy(&bv, prior + k, 4);
+            b = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)bv), zero);
+            thresh = _mm_sub_epi16(_mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), b), a); // a last: it is the only serial input
+            lo = _mm_min_epi16(a, b);
+            hi = _mm_max_epi16(a, b);
+            m = _mm_cmpgt_epi16(hi, thresh);
+            t0 = _mm_or_si128(_mm_and_si128(m, c), _mm_andnot_si128(m, lo));
+            m = _mm_cmpgt_epi16(thresh, lo);
+            t1 = _mm_or_si128(_mm_and_si128(m, t0), _mm_andnot_si128(m, hi));
+            a = _mm_and_si128(_mm_add_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)rv), zero), t1), lowbyte);
+            c = b;
+            rv = (stbi__uint32)_mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+            memcpy(cur + k, &rv, 4);
+        }
+        break;
+    }
+    }
+#else
+    uint8x16_t zero = vdupq_n_u8(0);
+    switch (filter) {
+    case STBI__F_up:
+        for (; k + 16 <= nk; k += 16)
+            vst1q_u8(cur + k, vaddq_u8(vld1q_u8(raw + k), vld1q_u8(prior + k)));
+        break;
+    case STBI__F_sub:
+        if (filter_bytes == 4) {
+            uint8x16_t last = zero;
+            for (; k + 16 <= nk; k += 16) {
+                uint8x16_t d = vaddq_u8(vld1q_u8(raw + k), last);
+                d = vaddq_u8(d, vextq_u8(zero, d, 12));
+                d = vaddq_u8(d, vextq_u8(zero, d, 8));
+                vst1q_u8(cur + k, d);
+                last = vextq_u8(d, zero, 12);
+            }
+        }
+        else {
+            // five pixels per step; the 16th byte stored belongs to the next step, which
+            // overwrites it
+            static const stbi_uc first_pixel[16] = { 255,255,255,0, 0,0,0,0, 0,0,0,0, 0,0,0,0 };
+            uint8x16_t mask = vld1q_u8(first_pixel);
+            uint8x16_t last = zero;
+            for (; k + 16 <= nk; k += 15) {
+                uint8x16_t d = vaddq_u8(vld1q_u8(raw + k), last);
+                d = vaddq_u8(d, vextq_u8(zero, d, 13));
+                d = vaddq_u8(d, vextq_u8(zero, d, 10));
+                d = vaddq_u8(d, vextq_u8(zero, d, 4));
+                vst1q_u8(cur + k, d);
+                last = vandq_u8(vextq_u8(d, zero, 12), mask);
+            }
+        }
+        break;
+    case STBI__F_avg: {
+        uint8x8_t a = vdup_n_u8(0);
+        for (; k + 4 <= nk; k += filter_bytes) {
+            stbi__uint32 rv, bv;
+            memcpy(&rv, raw + k, 4);
+            memcpy(&bv, prior + k, 4);
+            a = vadd_u8(vreinterpret_u8_u32(vdup_n_u32(rv)), vhadd_u8(a, vreinterpret_u8_u32(vdup_n_u32(bv))));
+            rv = vget_lane_u32(vreinterpret_u32_u8(a), 0);
+            memcpy(cur + k, &rv, 4);
+        }
+        break;
+    }
+    case STBI__F_paeth: {
+        // stbi__paeth on 16-bit lanes; a is the pixel to the left, c the one above it
+        int16x8_t a = vdupq_n_s16(0), c = vdupq_n_s16(0), lowbyte = vdupq_n_s16(0xff);
+        for (; k + 4 <= nk; k += filter_bytes) {
+            stbi__uint32 rv, bv;
+            int16x8_t b, thresh, lo, hi, t0, t1;
+            memcpy(&rv, raw + k, 4);
+            memcpy(&bv, prior + k, 4);
+            b = vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bv))));
+            thresh = vsubq_s16(vsubq_s16(vaddq_s16(c, vaddq_s16(c, c)), b), a); // a last: it is the only serial input
+            lo = vminq_s16(a, b);
+            hi = vmaxq_s16(a, b);
+            t0 = vbslq_s16(vcgtq_s16(hi, thresh), c, lo);
+            t1 = vbslq_s16(vcgtq_s16(thresh, lo), t0, hi);
+            a = vandq_s16(vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(rv)))), t1), lowbyte);
+            c = b;
+            rv = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vreinterpretq_u16_s16(a))), 0);
+            memcpy(cur + k, &rv, 4);
+        }
+        break;
+    }
+    }
+#endif
+    return k;
+}
+#endif
+
+// unfilter rows [first_row, last_row) of a pass x pixels wide from raw, a filter byte plus
+// packed samples per row, into out at out_n channels per pixel. filter_buf holds the current
+// and previous row, picked by row parity, so a call can continue where the last one stopped.
+// Row j lands at out + stride * (j - first_row); a negative stride writes the rows bottom-up
+static int stbi__png_unfilter_rows(stbi_uc* out, int stride, stbi_uc* filter_buf, stbi_uc* raw, int img_n, int out_n, stbi__uint32 x, stbi__uint32 first_row, stbi__uint32 last_row, int depth, int color)
 {
     int bytes = (depth == 16 ? 2 : 1);
-    stbi__context* s = a->s;
-    stbi__uint32 i, j, stride = x * out_n * bytes;
-    stbi__uint32 img_len, img_width_bytes;
-    stbi_uc* filter_buf;
-    int all_ok = 1;
+    stbi__uint32 i, j;
+    stbi__uint32 img_width_bytes = (((img_n * x * depth) + 7) >> 3);
     int k;
-    int img_n = s->img_n; // copy it into a local for later
-
-    int output_bytes = out_n * bytes;
     int filter_bytes = img_n * bytes;
     int width = x;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+    int simd;
+#endif
 
-    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
-    a->out = (stbi_uc*)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-    if (!a->out) return stbi__err("outofmem", "Out of memory");
+    // Filtering for low-bit-depth images
+    if (depth < 8) {
+        filter_bytes = 1;
+        width = img_width_bytes;
+    }
 
-    // note: error exits here don't need to clean up a->out individually,
-    // stbi__do_png always does on error.
-    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
-    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
-    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
-    img_len = (img_width_bytes + 1) * y;
-
-    // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
-    // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
-    // so just check for raw_len < img_len always.
-    if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
-
-    // Allocate two scan lines worth of filter workspace buffer.
-    filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
-    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
-
-    // Filtering for low-bit-depth images
-    if (depth < 8) {
-        filter_bytes = 1;
-        width = img_width_bytes;
-    }
+#ifdef STBI_SSE2
+    simd = (filter_bytes == 3 || filter_bytes == 4) && stbi__sse2_available();
+#elif defined(STBI_NEON)
+    simd = (filter_bytes == 3 || filter_bytes == 4);
+#endif
 
-    for (j = 0; j < y; ++j) {
+    for (j = first_row; j < last_row; ++j) {
         // cur/prior filter buffers alternate
         stbi_uc* cur = filter_buf + (j & 1) * img_width_bytes;
         stbi_uc* prior = filter_buf + (~j & 1) * img_width_bytes;
-        stbi_uc* dest = a->out + stride * j;
+        stbi_uc* dest = out + stride * (int)(j - first_row);
         int nk = width * filter_bytes;
         int filter = *raw++;
+        int done = 0; // bytes of cur already unfiltered by stbi__png_unfilter_simd
 
         // check filter type
-        if (filter > 4) {
-            all_ok = stbi__err("invalid filter", "Corrupt PNG");
-            break;
-        }
+        if (filter > 4) return stbi__err("invalid filter", "Corrupt PNG");
 
         // if first row, use special filter that doesn't sample previous row
         if (j == 0) filter = first_row_filter[filter];
 
-        // perform actual filtering
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+        if (simd)
+            done = stbi__png_unfilter_simd(cur, prior, raw, nk, filter, filter_bytes);
+#endif
+
+        // perform actual filtering, or finish the row after the SIMD kernel
         switch (filter) {
         case STBI__F_none:
             memcpy(cur, raw, nk);
             break;
         case STBI__F_sub:
-            memcpy(cur, raw, filter_bytes);
-            for (k = filter_bytes; k < nk; ++k)
+            for (k = done; k < filter_bytes; ++k)
+                cur[k] = raw[k];
+            for (; k < nk; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + cur[k - filter_bytes]);
             break;
         case STBI__F_up:
-            for (k = 0; k < nk; ++k)
+            for (k = done; k < nk; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
             break;
         case STBI__F_avg:
-            for (k = 0; k < filter_bytes; ++k)
+            for (k = done; k < filter_bytes; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + (prior[k] >> 1));
-            for (k = filter_bytes; k < nk; ++k)
+            for (; k < nk; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k - filter_bytes]) >> 1));
             break;
         case STBI__F_paeth:
-            for (k = 0; k < filter_bytes; ++k)
+            for (k = done; k < filter_bytes; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
-            for (k = filter_bytes; k < nk; ++k)
+            for (; k < nk; ++k)
                 cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k - filter_bytes], prior[k], prior[k - filter_bytes]));
             break;
         case STBI__F_avg_first:
@@ -4903,20 +7341,60 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
         }
     }
 
-    STBI_FREE(filter_buf);
-    if (!all_ok) return 0;
-
     return 1;
 }
 
+// create the png data from post-deflated data
+static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
+{
+    int bytes = (depth == 16 ? 2 : 1);
+    stbi__context* s = a->s;
+    stbi__uint32 img_len, img_width_bytes;
+    stbi_uc* filter_buf;
+    int ok, stride;
+    int img_n = s->img_n; // copy it into a local for later
+
+    int output_bytes = out_n * bytes;
+
+    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
+    a->out = (stbi_uc*)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+    if (!a->out) return stbi__err("outofmem", "Out of memory");
+
+    // note: error exits here don't need to clean up a->out individually,
+    // stbi__do_png always does on error.
+    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
+    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
+    img_len = (img_width_bytes + 1) * y;
+
+    // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
+    // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
+    // so just check for raw_len < img_len always.
+    if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
+
+    // Allocate two scan lines worth of filter workspace buffer.
+    filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
+    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+
+    // with flip-on-load the rows go straight to their mirrored place
+    stride = x * output_bytes;
+    if (flip)
+        ok = stbi__png_unfilter_rows(a->out + (size_t)stride * (y - 1), -stride, filter_buf, raw, img_n, out_n, x, 0, y, depth, color);
+    else
+        ok = stbi__png_unfilter_rows(a->out, stride, filter_buf, raw, img_n, out_n, x, 0, y, depth, color);
+    stbi__free(filter_buf);
+    return ok;
+}
+
 static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint32 image_data_len, int out_n, int depth, int color, int interlaced)
 {
     int bytes = (depth == 16 ? 2 : 1);
     int out_bytes = out_n * bytes;
+    int flip = stbi__flip_full_size(a->s);
     stbi_uc* final;
     int p;
     if (!interlaced)
-        return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+        return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, flip);
 
     // de-interlacing
     final = (stbi_uc*)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
@@ -4932,19 +7410,20 @@ static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint3
         y = (a->s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
         if (x && y) {
             stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-            if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-                STBI_FREE(final);
+            if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
+                stbi__free(final);
                 return 0;
             }
             for (j = 0; j < y; ++j) {
                 for (i = 0; i < x; ++i) {
                     int out_y = j * yspc[p] + yorig[p];
                     int out_x = i * xspc[p] + xorig[p];
+                    if (flip) out_y = a->s->img_y - 1 - out_y;
                     memcpy(final + out_y * a->s->img_x * out_bytes + out_x * out_bytes,
                         a->out + (j * x + i) * out_bytes, out_bytes);
                 }
             }
-            STBI_FREE(a->out);
+            stbi__free(a->out);
             image_data += img_len;
             image_data_len -= img_len;
         }
@@ -4954,11 +7433,30 @@ static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint3
     return 1;
 }
 
-static int stbi__compute_transparency(stbi__png* z, stbi_uc tc[3], int out_n)
+// exact size of the filtered image data, a filter byte plus packed samples per row of every
+// interlace pass, so zlib decodes into a buffer that never has to grow for well-formed files
+static stbi__uint32 stbi__png_raw_len(stbi__context* s, int depth, int interlaced)
 {
-    stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-    stbi_uc* p = z->out;
+    static const int xorig[] = { 0,4,0,2,0,1,0 };
+    static const int yorig[] = { 0,0,4,0,2,0,1 };
+    static const int xspc[] = { 8,8,4,4,2,2,1 };
+    static const int yspc[] = { 8,8,8,4,4,2,2 };
+    stbi__uint32 raw_len = 0;
+    int p;
+    if (!interlaced)
+        return (((s->img_n * s->img_x * depth) + 7) >> 3) * s->img_y + s->img_y;
+    for (p = 0; p < 7; ++p) {
+        stbi__uint32 x = (s->img_x - xorig[p] + xspc[p] - 1) / xspc[p];
+        stbi__uint32 y = (s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
+        if (x && y)
+            raw_len += ((((s->img_n * x * depth) + 7) >> 3) + 1) * y;
+    }
+    return raw_len;
+}
+
+static int stbi__compute_transparency(stbi_uc* p, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
+{
+    stbi__uint32 i;
 
     // compute color-based transparency, assuming we've
     // already got 255 as the alpha value in the output
@@ -4980,11 +7478,9 @@ static int stbi__compute_transparency(stbi__png* z, stbi_uc tc[3], int out_n)
     return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png* z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__uint16* p, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-    stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-    stbi__uint16* p = (stbi__uint16*)z->out;
+    stbi__uint32 i;
 
     // compute color-based transparency, assuming we've
     // already got 65535 as the alpha value in the output
@@ -5006,17 +7502,9 @@ static int stbi__compute_transparency16(stbi__png* z, stbi__uint16 tc[3], int ou
     return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int pal_img_n)
+static void stbi__png_palette_lookup(stbi_uc* p, const stbi_uc* orig, stbi__uint32 pixel_count, const stbi_uc* palette, int pal_img_n)
 {
-    stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
-    stbi_uc* p, * temp_out, * orig = a->out;
-
-    p = (stbi_uc*)stbi__malloc_mad2(pixel_count, pal_img_n, 0);
-    if (p == NULL) return stbi__err("outofmem", "Out of memory");
-
-    // between here and free(out) below, exitting would leak
-    temp_out = p;
-
+    stbi__uint32 i;
     if (pal_img_n == 3) {
         for (i = 0; i < pixel_count; ++i) {
             int n = orig[i] * 4;
@@ -5036,7 +7524,18 @@ static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int
             p += 4;
         }
     }
-    STBI_FREE(a->out);
+}
+
+static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int pal_img_n)
+{
+    stbi__uint32 pixel_count = a->s->img_x * a->s->img_y;
+    stbi_uc* temp_out;
+
+    temp_out = (stbi_uc*)stbi__malloc_mad2(pixel_count, pal_img_n, 0);
+    if (temp_out == NULL) return stbi__err("outofmem", "Out of memory");
+
+    stbi__png_palette_lookup(temp_out, a->out, pixel_count, palette, pal_img_n);
+    stbi__free(a->out);
     a->out = temp_out;
 
     STBI_NOTUSED(len);
@@ -5084,13 +7583,11 @@ STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_conve
                                 : stbi__de_iphone_flag_global)
 #endif // STBI_THREAD_LOCAL
 
-static void stbi__de_iphone(stbi__png* z)
+static void stbi__de_iphone(stbi_uc* p, stbi__uint32 pixel_count, int out_n)
 {
-    stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
-    stbi_uc* p = z->out;
+    stbi__uint32 i;
 
-    if (s->img_out_n == 3) {  // convert bgr to rgb
+    if (out_n == 3) {  // convert bgr to rgb
         for (i = 0; i < pixel_count; ++i) {
             stbi_uc t = p[0];
             p[0] = p[2];
@@ -5099,7 +7596,7 @@ static void stbi__de_iphone(stbi__png* z)
         }
     }
     else {
-        STBI_ASSERT(s->img_out_n == 4);
+        STBI_ASSERT(out_n == 4);
         if (stbi__unpremultiply_on_load) {
             // convert bgr to rgb and unpremultiply
             for (i = 0; i < pixel_count; ++i) {
@@ -5132,6 +7629,197 @@ static void stbi__de_iphone(stbi__png* z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+// stbi_load_rows for non-interlaced PNGs: the IDAT data is read and inflated a window at a
+// time, and rows are unfiltered, post-processed and handed over a band at a time as soon as
+// they are complete, so memory stays at the two zlib windows and two bands
+#define STBI__PNG_STREAM_INPUT  65536
+#define STBI__PNG_STREAM_BAND   (1 << 18) // bytes of output per band, at least one row
+
+typedef struct
+{
+    stbi__png* p;
+    stbi_uc* in; // compressed input window
+    stbi__uint32 idat_left; // bytes of the current IDAT chunk not read yet
+    int idat_done; // reached a chunk other than IDAT, or the end of the file
+    stbi_uc* filter_buf, * band, * scratch;
+    stbi__uint32 row, band_rows, row_bytes; // row_bytes counts the filter byte
+    int img_n, out_n, pal_out_n, req_comp, color, pal_img_n, has_trans, is_iphone;
+    stbi_uc* palette, * tc;
+    stbi__uint16* tc16;
+} stbi__png_rows;
+
+static int stbi__png_stream_refill(stbi__zbuf* a)
+{
+    stbi__png_rows* st = (stbi__png_rows*)a->stream;
+    stbi__context* s = st->p->s;
+    int kept = (int)(a->zbuffer_end - a->zbuffer), n = kept;
+    memmove(st->in, a->zbuffer, kept);
+    while (n < STBI__PNG_STREAM_INPUT && !st->idat_done) {
+        if (st->idat_left == 0) {
+            stbi__pngchunk c;
+            stbi__get32be(s); // CRC of the IDAT just finished
+            c = stbi__get_chunk_header(s);
+            if (c.type != STBI__PNG_TYPE('I', 'D', 'A', 'T') || c.length > (1u << 30))
+                st->idat_done = 1;
+            st->idat_left = c.length;
+        }
+        else {
+            stbi__uint32 take = STBI__PNG_STREAM_INPUT - n;
+            if (take > st->idat_left) take = st->idat_left;
+            // a short read leaves zlib to report the truncated stream
+            if (!stbi__getn(s, st->in + n, (int)take)) {
+                st->idat_done = 1;
+                break;
+            }
+            n += take;
+            st->idat_left -= take;
+        }
+    }
+    a->zbuffer = st->in;
+    a->zbuffer_end = st->in + n;
+    return n - kept;
+}
+
+// the same steps stbi__parse_png_file and stbi__do_png apply to the whole image, on one band
+static int stbi__png_stream_band(stbi__png_rows* st, stbi_uc* raw, stbi__uint32 rows)
+{
+    stbi__context* s = st->p->s;
+    int depth = st->p->depth, n = st->out_n;
+    stbi__uint32 i, count = s->img_x * rows;
+    stbi_uc* cur = st->band, * other = st->scratch, * t;
+
+    if (!stbi__png_unfilter_rows(cur, s->img_x * n * (depth == 16 ? 2 : 1), st->filter_buf, raw, st->img_n, n, s->img_x, st->row, st->row + rows, depth, st->color)) return 0;
+    if (st->has_trans) {
+        if (depth == 16)
+            stbi__compute_transparency16((stbi__uint16*)cur, count, st->tc16, n);
+        else
+            stbi__compute_transparency(cur, count, st->tc, n);
+    }
+    if (st->is_iphone && stbi__de_iphone_flag && n > 2)
+        stbi__de_iphone(cur, count, n);
+    if (st->pal_img_n) {
+        stbi__png_palette_lookup(other, cur, count, st->palette, st->pal_out_n);
+        t = cur; cur = other; other = t;
+        n = st->pal_out_n;
+    }
+    if (st->req_comp && st->req_comp != n) {
+        if (depth == 16) {
+            if (!stbi__convert_format16_rows((stbi__uint16*)cur, (stbi__uint16*)other, n, st->req_comp, s->img_x, rows)) return 0;
+        }
+        else {
+            if (!stbi__convert_format_rows(cur, other, n, st->req_comp, s->img_x, rows)) return 0;
+        }
+        t = cur; cur = other; other = t;
+        n = st->req_comp;
+    }
+    if (depth == 16) {
+        // as stbi__convert_16_to_8, in place: byte i is written after sample i is read
+        stbi__uint16* wide = (stbi__uint16*)cur;
+        for (i = 0; i < count * n; ++i)
+            cur[i] = (stbi_uc)((wide[i] >> 8) & 0xFF);
+    }
+    if (!stbi__emit_rows(s->rows, cur, st->row, rows, s->img_x, s->img_y, n)) return 0;
+    st->row += rows;
+    return 1;
+}
+
+// takes whole bands only, apart from the last rows of the image; bytes after the last row
+// are ignored, as stbi__create_png_image_raw does
+static int stbi__png_stream_drain(stbi__zbuf* a, stbi_uc* data, int len)
+{
+    stbi__png_rows* st = (stbi__png_rows*)a->stream;
+    stbi__uint32 left = st->p->s->img_y - st->row;
+    stbi__uint32 rows = (stbi__uint32)len / st->row_bytes, taken;
+    if (rows >= left)
+        rows = left;
+    else
+        rows -= rows % st->band_rows;
+    taken = rows * st->row_bytes;
+    while (rows) {
+        stbi__uint32 band = rows < st->band_rows ? rows : st->band_rows;
+        if (!stbi__png_stream_band(st, data, band)) return -1;
+        data += band * st->row_bytes;
+        rows -= band;
+    }
+    return st->row == st->p->s->img_y ? len : (int)taken;
+}
+
+// called at the first IDAT chunk, with its header read
+static int stbi__png_stream(stbi__png* z, stbi__uint32 idat_len, int req_comp, int color, int pal_img_n, stbi_uc* palette, int has_trans, stbi_uc* tc, stbi__uint16* tc16, int is_iphone)
+{
+    stbi__context* s = z->s;
+    stbi__png_rows st;
+    stbi__zbuf a;
+    stbi__uint32 img_width_bytes;
+    int bytes = (z->depth == 16 ? 2 : 1), channels, window, ok;
+
+    // same output layout as the IEND path of stbi__parse_png_file
+    st.p = z;
+    st.img_n = s->img_n;
+    if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
+        st.out_n = s->img_n + 1;
+    else
+        st.out_n = s->img_n;
+    st.pal_out_n = req_comp >= 3 ? req_comp : pal_img_n;
+    st.req_comp = req_comp;
+    st.color = color;
+    st.pal_img_n = pal_img_n;
+    st.palette = palette;
+    st.has_trans = has_trans;
+    st.tc = tc;
+    st.tc16 = tc16;
+    st.is_iphone = is_iphone;
+    if (pal_img_n)
+        s->img_n = pal_img_n;
+    else if (has_trans)
+        ++s->img_n;
+    channels = req_comp ? req_comp : s->img_n;
+    s->img_out_n = channels;
+
+    if (!stbi__mad3sizes_valid(st.img_n, s->img_x, z->depth, 7)) return stbi__err("too large", "Corrupt PNG");
+    img_width_bytes = (((st.img_n * s->img_x * z->depth) + 7) >> 3);
+    st.row_bytes = img_width_bytes + 1;
+    st.band_rows = STBI__PNG_STREAM_BAND / (s->img_x * channels);
+    if (st.band_rows < 1) st.band_rows = 1;
+    if (st.band_rows > s->img_y) st.band_rows = s->img_y;
+    if (!stbi__mad2sizes_valid(st.band_rows * 2, st.row_bytes, 32768 * 3)) return stbi__err("too large", "Corrupt PNG");
+    // room for a band behind the window matches read from and a band being written
+    window = (int)(st.band_rows * 2 * st.row_bytes) + 32768 * 3;
+
+    st.in = (stbi_uc*)stbi__malloc(STBI__PNG_STREAM_INPUT);
+    st.filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
+    st.band = (stbi_uc*)stbi__malloc_mad3(st.band_rows, s->img_x, 4 * bytes, 0);
+    st.scratch = (stbi_uc*)stbi__malloc_mad3(st.band_rows, s->img_x, 4 * bytes, 0);
+    a.zout_start = (char*)stbi__malloc(window);
+    if (!st.in || !st.filter_buf || !st.band || !st.scratch || !a.zout_start) {
+        ok = stbi__err("outofmem", "Out of memory");
+    }
+    else {
+        st.idat_left = idat_len;
+        st.idat_done = 0;
+        st.row = 0;
+        a.zbuffer = a.zbuffer_end = st.in;
+        a.zout = a.zout_start;
+        a.zout_end = a.zout_start + window;
+        a.z_expandable = 1;
+        a.refill = stbi__png_stream_refill;
+        a.drain = stbi__png_stream_drain;
+        a.stream = &st;
+        a.zout_drained = 0;
+        ok = stbi__parse_zlib(&a, !is_iphone);
+        // the rows still in the window
+        if (ok) ok = stbi__png_stream_drain(&a, (stbi_uc*)a.zout_start + a.zout_drained, (int)(a.zout - a.zout_start) - a.zout_drained) >= 0;
+        if (ok && st.row != s->img_y) ok = stbi__err("not enough pixels", "Corrupt PNG");
+    }
+    stbi__free(st.in);
+    stbi__free(st.filter_buf);
+    stbi__free(st.band);
+    stbi__free(st.scratch);
+    stbi__free(a.zout_start);
+    if (ok) s->rows->streamed = 1;
+    return ok;
+}
+
 static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 {
     stbi_uc palette[1024], pal_img_n = 0;
@@ -5240,6 +7928,8 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
                 return 1;
             }
             if (c.length > (1u << 30)) return stbi__err("IDAT size limit", "IDAT section larger than 2^30 bytes");
+            if (s->rows && !interlace)
+                return stbi__png_stream(z, c.length, req_comp, color, pal_img_n, palette, has_trans, tc, tc16, is_iphone);
             if ((int)(ioff + c.length) < (int)ioff) return 0;
             if (ioff + c.length > idata_limit) {
                 stbi__uint32 idata_limit_old = idata_limit;
@@ -5248,7 +7938,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
                 while (ioff + c.length > idata_limit)
                     idata_limit *= 2;
                 STBI_NOTUSED(idata_limit_old);
-                p = (stbi_uc*)STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+                p = (stbi_uc*)stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
                 z->idata = p;
             }
             if (!stbi__getn(s, z->idata + ioff, c.length)) return stbi__err("outofdata", "Corrupt PNG");
@@ -5257,16 +7947,14 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
         }
 
         case STBI__PNG_TYPE('I', 'E', 'N', 'D'): {
-            stbi__uint32 raw_len, bpl;
+            stbi__uint32 raw_len;
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT", "Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+            raw_len = stbi__png_raw_len(s, z->depth, interlace);
             z->expanded = (stbi_uc*)stbi_zlib_decode_malloc_guesssize_headerflag((char*)z->idata, ioff, raw_len, (int*)&raw_len, !is_iphone);
             if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
+            stbi__free(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
                 s->img_out_n = s->img_n + 1;
             else
@@ -5274,14 +7962,14 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
             if (has_trans) {
                 if (z->depth == 16) {
-                    if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+                    if (!stbi__compute_transparency16((stbi__uint16*)z->out, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                 }
                 else {
-                    if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                    if (!stbi__compute_transparency(z->out, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                 }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-                stbi__de_iphone(z);
+                stbi__de_iphone(z->out, s->img_x * s->img_y, s->img_out_n);
             if (pal_img_n) {
                 // pal_img_n == 3 or 4
                 s->img_n = pal_img_n; // record the actual colors we had
@@ -5294,7 +7982,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
                 // non-paletted image with tRNS -> source image has (constant) alpha
                 ++s->img_n;
             }
-            STBI_FREE(z->expanded); z->expanded = NULL;
+            stbi__free(z->expanded); z->expanded = NULL;
             // end of PNG chunk, read and skip CRC
             stbi__get32be(s);
             return 1;
@@ -5325,8 +8013,16 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, stbi__result_info* ri)
 {
     void* result = NULL;
+    int ok;
     if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-    if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
+    ok = stbi__parse_png_file(p, STBI__SCAN_load, req_comp);
+    if (ok && p->s->rows && p->s->rows->streamed) {
+        // stbi_load_rows: the rows were handed over as they were decoded
+        *x = p->s->img_x;
+        *y = p->s->img_y;
+        if (n) *n = p->s->img_n;
+    }
+    else if (ok) {
         if (p->depth <= 8)
             ri->bits_per_channel = 8;
         else if (p->depth == 16)
@@ -5335,6 +8031,7 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
             return stbi__errpuc("bad bits_per_channel", "PNG not supported: unsupported color depth");
         result = p->out;
         p->out = NULL;
+        ri->flipped = stbi__flip_full_size(p->s);
         if (req_comp && req_comp != p->s->img_out_n) {
             if (ri->bits_per_channel == 8)
                 result = stbi__convert_format((unsigned char*)result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -5347,9 +8044,9 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
         *y = p->s->img_y;
         if (n) *n = p->s->img_n;
     }
-    STBI_FREE(p->out);      p->out = NULL;
-    STBI_FREE(p->expanded); p->expanded = NULL;
-    STBI_FREE(p->idata);    p->idata = NULL;
+    stbi__free(p->out);      p->out = NULL;
+    stbi__free(p->expanded); p->expanded = NULL;
+    stbi__free(p->idata);    p->idata = NULL;
 
     return result;
 }
@@ -5602,15 +8299,16 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
     unsigned int mr = 0, mg = 0, mb = 0, ma = 0, all_a;
     stbi_uc pal[256][4];
     int psize = 0, i, j, width;
-    int flip_vertically, pad, target;
+    int flip_vertically, pad, target, row_bytes;
     stbi__bmp_data info;
-    STBI_NOTUSED(ri);
 
     info.all_a = 255;
     if (stbi__bmp_parse_header(s, &info) == NULL)
         return NULL; // error code already set
 
-    flip_vertically = ((int)s->img_y) > 0;
+    // bottom-up files are flipped as they are read, and with flip-on-load top-down ones are
+    ri->flipped = stbi__flip_full_size(s);
+    flip_vertically = (((int)s->img_y) > 0) ^ ri->flipped;
     s->img_y = abs((int)s->img_y);
 
     if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large", "Very large image (corrupt?)");
@@ -5666,9 +8364,10 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 
     out = (stbi_uc*)stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
     if (!out) return stbi__errpuc("outofmem", "Out of memory");
+    row_bytes = target * s->img_x;
     if (info.bpp < 16) {
-        int z = 0;
-        if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+        int z;
+        if (psize == 0 || psize > 256) { stbi__free(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
         for (i = 0; i < psize; ++i) {
             pal[i][2] = stbi__get8(s);
             pal[i][1] = stbi__get8(s);
@@ -5680,11 +8379,12 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
         if (info.bpp == 1) width = (s->img_x + 7) >> 3;
         else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
         else if (info.bpp == 8) width = s->img_x;
-        else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+        else { stbi__free(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
         pad = (-width) & 3;
         if (info.bpp == 1) {
             for (j = 0; j < (int)s->img_y; ++j) {
                 int bit_offset = 7, v = stbi__get8(s);
+                z = (flip_vertically ? (int)s->img_y - 1 - j : j) * row_bytes;
                 for (i = 0; i < (int)s->img_x; ++i) {
                     int color = (v >> bit_offset) & 0x1;
                     out[z++] = pal[color][0];
@@ -5702,6 +8402,7 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
         }
         else {
             for (j = 0; j < (int)s->img_y; ++j) {
+                z = (flip_vertically ? (int)s->img_y - 1 - j : j) * row_bytes;
                 for (i = 0; i < (int)s->img_x; i += 2) {
                     int v = stbi__get8(s), v2 = 0;
                     if (info.bpp == 4) {
@@ -5725,7 +8426,7 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
     }
     else {
         int rshift = 0, gshift = 0, bshift = 0, ashift = 0, rcount = 0, gcount = 0, bcount = 0, acount = 0;
-        int z = 0;
+        int z;
         int easy = 0;
         stbi__skip(s, info.offset - info.extra_read - info.hsz);
         if (info.bpp == 24) width = 3 * s->img_x;
@@ -5740,15 +8441,16 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
                 easy = 2;
         }
         if (!easy) {
-            if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+            if (!mr || !mg || !mb) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
             // right shift amt to put high bit in position #7
             rshift = stbi__high_bit(mr) - 7; rcount = stbi__bitcount(mr);
             gshift = stbi__high_bit(mg) - 7; gcount = stbi__bitcount(mg);
             bshift = stbi__high_bit(mb) - 7; bcount = stbi__bitcount(mb);
             ashift = stbi__high_bit(ma) - 7; acount = stbi__bitcount(ma);
-            if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+            if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { stbi__free(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
         }
         for (j = 0; j < (int)s->img_y; ++j) {
+            z = (flip_vertically ? (int)s->img_y - 1 - j : j) * row_bytes;
             if (easy) {
                 for (i = 0; i < (int)s->img_x; ++i) {
                     unsigned char a;
@@ -5783,17 +8485,6 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
         for (i = 4 * s->img_x * s->img_y - 1; i >= 0; i -= 4)
             out[i] = 255;
 
-    if (flip_vertically) {
-        stbi_uc t;
-        for (j = 0; j < (int)s->img_y >> 1; ++j) {
-            stbi_uc* p1 = out + j * s->img_x * target;
-            stbi_uc* p2 = out + (s->img_y - 1 - j) * s->img_x * target;
-            for (i = 0; i < (int)s->img_x * target; ++i) {
-                t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-            }
-        }
-    }
-
     if (req_comp && req_comp != target) {
         out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
         if (out == NULL) return out; // stbi__convert_format frees input on failure
@@ -5971,7 +8662,7 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
     int RLE_count = 0;
     int RLE_repeating = 0;
     int read_next_pixel = 1;
-    STBI_NOTUSED(ri);
+    int tga_row_bytes, tga_out, tga_col = 0;
     STBI_NOTUSED(tga_x_origin); // @TODO
     STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5985,6 +8676,9 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
         tga_is_RLE = 1;
     }
     tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+    // bottom-up files are flipped as they are read, and with flip-on-load top-down ones are
+    ri->flipped = stbi__flip_full_size(s);
+    tga_inverted ^= ri->flipped;
 
     //   If I'm paletted, then I'll use the number of bits from the palette
     if (tga_indexed) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -6007,11 +8701,12 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
     // skip to the data's starting position (offset usually = 0)
     stbi__skip(s, tga_offset);
 
+    tga_row_bytes = tga_width * tga_comp;
     if (!tga_indexed && !tga_is_RLE && !tga_rgb16) {
         for (i = 0; i < tga_height; ++i) {
             int row = tga_inverted ? tga_height - i - 1 : i;
-            stbi_uc* tga_row = tga_data + row * tga_width * tga_comp;
-            stbi__getn(s, tga_row, tga_width * tga_comp);
+            stbi_uc* tga_row = tga_data + row * tga_row_bytes;
+            stbi__getn(s, tga_row, tga_row_bytes);
         }
     }
     else {
@@ -6019,7 +8714,7 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
         if (tga_indexed)
         {
             if (tga_palette_len == 0) {  /* you have to have at least one entry! */
-                STBI_FREE(tga_data);
+                stbi__free(tga_data);
                 return stbi__errpuc("bad palette", "Corrupt TGA");
             }
 
@@ -6028,7 +8723,7 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
             //   load the palette
             tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
             if (!tga_palette) {
-                STBI_FREE(tga_data);
+                stbi__free(tga_data);
                 return stbi__errpuc("outofmem", "Out of memory");
             }
             if (tga_rgb16) {
@@ -6040,12 +8735,13 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
                 }
             }
             else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-                STBI_FREE(tga_data);
-                STBI_FREE(tga_palette);
+                stbi__free(tga_data);
+                stbi__free(tga_palette);
                 return stbi__errpuc("bad palette", "Corrupt TGA");
             }
         }
-        //   load the data
+        //   load the data, each row straight to its final place
+        tga_out = tga_inverted ? (tga_height - 1) * tga_row_bytes : 0;
         for (i = 0; i < tga_width * tga_height; ++i)
         {
             //   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
@@ -6101,32 +8797,20 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 
             // copy data
             for (j = 0; j < tga_comp; ++j)
-                tga_data[i * tga_comp + j] = raw_data[j];
+                tga_data[tga_out + j] = raw_data[j];
+            tga_out += tga_comp;
+            if (++tga_col == tga_width) {
+                tga_col = 0;
+                if (tga_inverted) tga_out -= 2 * tga_row_bytes;
+            }
 
             //   in case we're in RLE mode, keep counting down
             --RLE_count;
         }
-        //   do I need to invert the image?
-        if (tga_inverted)
-        {
-            for (j = 0; j * 2 < tga_height; ++j)
-            {
-                int index1 = j * tga_width * tga_comp;
-                int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-                for (i = tga_width * tga_comp; i > 0; --i)
-                {
-                    unsigned char temp = tga_data[index1];
-                    tga_data[index1] = tga_data[index2];
-                    tga_data[index2] = temp;
-                    ++index1;
-                    ++index2;
-                }
-            }
-        }
         //   clear my palette, if I had one
         if (tga_palette != NULL)
         {
-            STBI_FREE(tga_palette);
+            stbi__free(tga_palette);
         }
     }
 
@@ -6322,7 +9006,7 @@ static void* stbi__psd_load(stbi__context* s, int* x, int* y, int* comp, int req
             else {
                 // Read the RLE data.
                 if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-                    STBI_FREE(out);
+                    stbi__free(out);
                     return stbi__errpuc("corrupt", "bad RLE data");
                 }
             }
@@ -6621,7 +9305,7 @@ static void* stbi__pic_load(stbi__context* s, int* px, int* py, int* comp, int r
     memset(result, 0xff, x * y * 4);
 
     if (!stbi__pic_load_core(s, x, y, comp, result)) {
-        STBI_FREE(result);
+        stbi__free(result);
         result = 0;
     }
     *px = x;
@@ -6735,13 +9419,13 @@ static int stbi__gif_info_raw(stbi__context* s, int* x, int* y, int* comp)
     stbi__gif* g = (stbi__gif*)stbi__malloc(sizeof(stbi__gif));
     if (!g) return stbi__err("outofmem", "Out of memory");
     if (!stbi__gif_header(s, g, comp, 1)) {
-        STBI_FREE(g);
+        stbi__free(g);
         stbi__rewind(s);
         return 0;
     }
     if (x) *x = g->w;
     if (y) *y = g->h;
-    STBI_FREE(g);
+    stbi__free(g);
     return 1;
 }
 
@@ -7020,175 +9704,2809 @@ static stbi_uc* stbi__gif_load_next(stbi__context* s, stbi__gif* g, int* comp, i
                     g->eflags = stbi__get8(s);
                     g->delay = 10 * stbi__get16le(s); // delay - 1/100th of a second, saving as 1/1000ths.
 
-                    // unset old transparent
-                    if (g->transparent >= 0) {
-                        g->pal[g->transparent][3] = 255;
-                    }
-                    if (g->eflags & 0x01) {
-                        g->transparent = stbi__get8(s);
-                        if (g->transparent >= 0) {
-                            g->pal[g->transparent][3] = 0;
-                        }
-                    }
-                    else {
-                        // don't need transparent
-                        stbi__skip(s, 1);
-                        g->transparent = -1;
-                    }
+                    // unset old transparent
+                    if (g->transparent >= 0) {
+                        g->pal[g->transparent][3] = 255;
+                    }
+                    if (g->eflags & 0x01) {
+                        g->transparent = stbi__get8(s);
+                        if (g->transparent >= 0) {
+                            g->pal[g->transparent][3] = 0;
+                        }
+                    }
+                    else {
+                        // don't need transparent
+                        stbi__skip(s, 1);
+                        g->transparent = -1;
+                    }
+                }
+                else {
+                    stbi__skip(s, len);
+                    break;
+                }
+            }
+            while ((len = stbi__get8(s)) != 0) {
+                stbi__skip(s, len);
+            }
+            break;
+        }
+
+        case 0x3B: // gif stream termination code
+            return (stbi_uc*)s; // using '1' causes warning on some compilers
+
+        default:
+            return stbi__errpuc("unknown code", "Corrupt GIF");
+        }
+    }
+}
+
+static void* stbi__load_gif_main_outofmem(stbi__gif* g, stbi_uc* out, int** delays)
+{
+    stbi__free(g->out);
+    stbi__free(g->history);
+    stbi__free(g->background);
+
+    if (out) stbi__free(out);
+    if (delays && *delays) stbi__free(*delays);
+    return stbi__errpuc("outofmem", "Out of memory");
+}
+
+static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
+{
+    if (stbi__gif_test(s)) {
+        int layers = 0;
+        stbi_uc* u = 0;
+        stbi_uc* out = 0;
+        stbi_uc* two_back = 0;
+        stbi__gif g;
+        int stride;
+        int out_size = 0;
+        int delays_size = 0;
+
+        STBI_NOTUSED(out_size);
+        STBI_NOTUSED(delays_size);
+
+        memset(&g, 0, sizeof(g));
+        if (delays) {
+            *delays = 0;
+        }
+
+        do {
+            u = stbi__gif_load_next(s, &g, comp, req_comp, two_back);
+            if (u == (stbi_uc*)s) u = 0;  // end of animated gif marker
+
+            if (u) {
+                *x = g.w;
+                *y = g.h;
+                ++layers;
+                stride = g.w * g.h * 4;
+
+                if (out) {
+                    void* tmp = (stbi_uc*)stbi__realloc_sized(out, out_size, layers * stride);
+                    if (!tmp)
+                        return stbi__load_gif_main_outofmem(&g, out, delays);
+                    else {
+                        out = (stbi_uc*)tmp;
+                        out_size = layers * stride;
+                    }
+
+                    if (delays) {
+                        int* new_delays = (int*)stbi__realloc_sized(*delays, delays_size, sizeof(int) * layers);
+                        if (!new_delays)
+                            return stbi__load_gif_main_outofmem(&g, out, delays);
+                        *delays = new_delays;
+                        delays_size = layers * sizeof(int);
+                    }
+                }
+                else {
+                    out = (stbi_uc*)stbi__malloc(layers * stride);
+                    if (!out)
+                        return stbi__load_gif_main_outofmem(&g, out, delays);
+                    out_size = layers * stride;
+                    if (delays) {
+                        *delays = (int*)stbi__malloc(layers * sizeof(int));
+                        if (!*delays)
+                            return stbi__load_gif_main_outofmem(&g, out, delays);
+                        delays_size = layers * sizeof(int);
+                    }
+                }
+                memcpy(out + ((layers - 1) * stride), u, stride);
+                if (layers >= 2) {
+                    two_back = out - 2 * stride;
+                }
+
+                if (delays) {
+                    (*delays)[layers - 1U] = g.delay;
+                }
+            }
+        } while (u != 0);
+
+        // free temp buffer;
+        stbi__free(g.out);
+        stbi__free(g.history);
+        stbi__free(g.background);
+
+        // do the final conversion after loading everything;
+        if (req_comp && req_comp != 4)
+            out = stbi__convert_format(out, 4, req_comp, layers * g.w, g.h);
+
+        *z = layers;
+        return out;
+    }
+    else {
+        return stbi__errpuc("not GIF", "Image was not as a gif type.");
+    }
+}
+
+static void* stbi__gif_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+{
+    stbi_uc* u = 0;
+    stbi__gif g;
+    memset(&g, 0, sizeof(g));
+    STBI_NOTUSED(ri);
+
+    u = stbi__gif_load_next(s, &g, comp, req_comp, 0);
+    if (u == (stbi_uc*)s) u = 0;  // end of animated gif marker
+    if (u) {
+        *x = g.w;
+        *y = g.h;
+
+        // moved conversion to after successful load so that the same
+        // can be done for multiple frames.
+        if (req_comp && req_comp != 4)
+            u = stbi__convert_format(u, 4, req_comp, g.w, g.h);
+    }
+    else if (g.out) {
+        // if there was an error and we allocated an image buffer, free it!
+        stbi__free(g.out);
+    }
+
+    // free buffers needed for multiple frame loading;
+    stbi__free(g.history);
+    stbi__free(g.background);
+
+    return u;
+}
+
+static int stbi__gif_info(stbi__context* s, int* x, int* y, int* comp)
+{
+    return stbi__gif_info_raw(s, x, y, comp);
+}
+#endif
+
+// *************************************************************************************************
+// WebP loader
+//
+// Still images in the simple and extended (VP8X) RIFF layouts: lossy key frames (RFC 6386),
+// lossless images, and lossy images with an ALPH alpha plane. ICC profiles and metadata
+// are skipped; animations are rejected. The lossy path reproduces libwebp's default
+// output, fancy chroma upsampling included.
+
+#ifndef STBI_NO_WEBP
+
+typedef struct
+{
+    stbi_uc* data;       // "VP8 " or "VP8L" chunk payload
+    int len;
+    int lossless;
+    stbi_uc* alpha;      // ALPH chunk payload, lossy images only
+    int alpha_len;
+    int w, h;
+    int has_alpha;
+} stbi__webp;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  VP8 (lossy) decoding
+//
+
+#define STBI__VP8_BPS 32 // stride of the per-macroblock work buffer
+
+enum
+{
+    STBI__VP8_DC_PRED = 0, STBI__VP8_TM_PRED, STBI__VP8_V_PRED, STBI__VP8_H_PRED,
+    STBI__VP8_RD_PRED, STBI__VP8_VR_PRED, STBI__VP8_LD_PRED, STBI__VP8_VL_PRED, STBI__VP8_HD_PRED, STBI__VP8_HU_PRED,
+    // DC prediction at the picture edges
+    STBI__VP8_DC_PRED_NOTOP, STBI__VP8_DC_PRED_NOLEFT, STBI__VP8_DC_PRED_NOTOPLEFT
+};
+
+static const stbi_uc stbi__vp8_coeff_update_probs[4][8][3][11] =
+{
+    {
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 176, 246, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 223, 241, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 249, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 244, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 234, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 253, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 246, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 239, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 248, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 251, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 251, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 253, 255, 254, 255, 255, 255, 255, 255, 255 },
+          { 250, 255, 254, 255, 254, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } }
+    },
+    {
+        { { 217, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 225, 252, 241, 253, 255, 255, 254, 255, 255, 255, 255 },
+          { 234, 250, 241, 250, 253, 255, 253, 254, 255, 255, 255 } },
+        { { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 223, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 238, 253, 254, 254, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 248, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 249, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 253, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 247, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 252, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 253, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 250, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } }
+    },
+    {
+        { { 186, 251, 250, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 234, 251, 244, 254, 255, 255, 255, 255, 255, 255, 255 },
+          { 251, 251, 243, 253, 254, 255, 254, 255, 255, 255, 255 } },
+        { { 255, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 236, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 251, 253, 253, 254, 254, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 254, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } }
+    },
+    {
+        { { 248, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 250, 254, 252, 254, 255, 255, 255, 255, 255, 255, 255 },
+          { 248, 254, 249, 253, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 246, 253, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 252, 254, 251, 254, 254, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 254, 252, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 248, 254, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 253, 255, 254, 254, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 251, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 245, 251, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 253, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 251, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 252, 253, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 254, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 252, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 249, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 254, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 253, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 250, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } },
+        { { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 254, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 },
+          { 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255 } }
+    }
+};
+
+static const stbi_uc stbi__vp8_coeff_default_probs[4][8][3][11] =
+{
+    {
+        { { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 } },
+        { { 253, 136, 254, 255, 228, 219, 128, 128, 128, 128, 128 },
+          { 189, 129, 242, 255, 227, 213, 255, 219, 128, 128, 128 },
+          { 106, 126, 227, 252, 214, 209, 255, 255, 128, 128, 128 } },
+        { {   1,  98, 248, 255, 236, 226, 255, 255, 128, 128, 128 },
+          { 181, 133, 238, 254, 221, 234, 255, 154, 128, 128, 128 },
+          {  78, 134, 202, 247, 198, 180, 255, 219, 128, 128, 128 } },
+        { {   1, 185, 249, 255, 243, 255, 128, 128, 128, 128, 128 },
+          { 184, 150, 247, 255, 236, 224, 128, 128, 128, 128, 128 },
+          {  77, 110, 216, 255, 236, 230, 128, 128, 128, 128, 128 } },
+        { {   1, 101, 251, 255, 241, 255, 128, 128, 128, 128, 128 },
+          { 170, 139, 241, 252, 236, 209, 255, 255, 128, 128, 128 },
+          {  37, 116, 196, 243, 228, 255, 255, 255, 128, 128, 128 } },
+        { {   1, 204, 254, 255, 245, 255, 128, 128, 128, 128, 128 },
+          { 207, 160, 250, 255, 238, 128, 128, 128, 128, 128, 128 },
+          { 102, 103, 231, 255, 211, 171, 128, 128, 128, 128, 128 } },
+        { {   1, 152, 252, 255, 240, 255, 128, 128, 128, 128, 128 },
+          { 177, 135, 243, 255, 234, 225, 128, 128, 128, 128, 128 },
+          {  80, 129, 211, 255, 194, 224, 128, 128, 128, 128, 128 } },
+        { {   1,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 246,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 255, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 } }
+    },
+    {
+        { { 198,  35, 237, 223, 193, 187, 162, 160, 145, 155,  62 },
+          { 131,  45, 198, 221, 172, 176, 220, 157, 252, 221,   1 },
+          {  68,  47, 146, 208, 149, 167, 221, 162, 255, 223, 128 } },
+        { {   1, 149, 241, 255, 221, 224, 255, 255, 128, 128, 128 },
+          { 184, 141, 234, 253, 222, 220, 255, 199, 128, 128, 128 },
+          {  81,  99, 181, 242, 176, 190, 249, 202, 255, 255, 128 } },
+        { {   1, 129, 232, 253, 214, 197, 242, 196, 255, 255, 128 },
+          {  99, 121, 210, 250, 201, 198, 255, 202, 128, 128, 128 },
+          {  23,  91, 163, 242, 170, 187, 247, 210, 255, 255, 128 } },
+        { {   1, 200, 246, 255, 234, 255, 128, 128, 128, 128, 128 },
+          { 109, 178, 241, 255, 231, 245, 255, 255, 128, 128, 128 },
+          {  44, 130, 201, 253, 205, 192, 255, 255, 128, 128, 128 } },
+        { {   1, 132, 239, 251, 219, 209, 255, 165, 128, 128, 128 },
+          {  94, 136, 225, 251, 218, 190, 255, 255, 128, 128, 128 },
+          {  22, 100, 174, 245, 186, 161, 255, 199, 128, 128, 128 } },
+        { {   1, 182, 249, 255, 232, 235, 128, 128, 128, 128, 128 },
+          { 124, 143, 241, 255, 227, 234, 128, 128, 128, 128, 128 },
+          {  35,  77, 181, 251, 193, 211, 255, 205, 128, 128, 128 } },
+        { {   1, 157, 247, 255, 236, 231, 255, 255, 128, 128, 128 },
+          { 121, 141, 235, 255, 225, 227, 255, 255, 128, 128, 128 },
+          {  45,  99, 188, 251, 195, 217, 255, 224, 128, 128, 128 } },
+        { {   1,   1, 251, 255, 213, 255, 128, 128, 128, 128, 128 },
+          { 203,   1, 248, 255, 255, 128, 128, 128, 128, 128, 128 },
+          { 137,   1, 177, 255, 224, 255, 128, 128, 128, 128, 128 } }
+    },
+    {
+        { { 253,   9, 248, 251, 207, 208, 255, 192, 128, 128, 128 },
+          { 175,  13, 224, 243, 193, 185, 249, 198, 255, 255, 128 },
+          {  73,  17, 171, 221, 161, 179, 236, 167, 255, 234, 128 } },
+        { {   1,  95, 247, 253, 212, 183, 255, 255, 128, 128, 128 },
+          { 239,  90, 244, 250, 211, 209, 255, 255, 128, 128, 128 },
+          { 155,  77, 195, 248, 188, 195, 255, 255, 128, 128, 128 } },
+        { {   1,  24, 239, 251, 218, 219, 255, 205, 128, 128, 128 },
+          { 201,  51, 219, 255, 196, 186, 128, 128, 128, 128, 128 },
+          {  69,  46, 190, 239, 201, 218, 255, 228, 128, 128, 128 } },
+        { {   1, 191, 251, 255, 255, 128, 128, 128, 128, 128, 128 },
+          { 223, 165, 249, 255, 213, 255, 128, 128, 128, 128, 128 },
+          { 141, 124, 248, 255, 255, 128, 128, 128, 128, 128, 128 } },
+        { {   1,  16, 248, 255, 255, 128, 128, 128, 128, 128, 128 },
+          { 190,  36, 230, 255, 236, 255, 128, 128, 128, 128, 128 },
+          { 149,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 } },
+        { {   1, 226, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 247, 192, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 240, 128, 255, 128, 128, 128, 128, 128, 128, 128, 128 } },
+        { {   1, 134, 252, 255, 255, 128, 128, 128, 128, 128, 128 },
+          { 213,  62, 250, 255, 255, 128, 128, 128, 128, 128, 128 },
+          {  55,  93, 255, 128, 128, 128, 128, 128, 128, 128, 128 } },
+        { { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128 } }
+    },
+    {
+        { { 202,  24, 213, 235, 186, 191, 220, 160, 240, 175, 255 },
+          { 126,  38, 182, 232, 169, 184, 228, 174, 255, 187, 128 },
+          {  61,  46, 138, 219, 151, 178, 240, 170, 255, 216, 128 } },
+        { {   1, 112, 230, 250, 199, 191, 247, 159, 255, 255, 128 },
+          { 166, 109, 228, 252, 211, 215, 255, 174, 128, 128, 128 },
+          {  39,  77, 162, 232, 172, 180, 245, 178, 255, 255, 128 } },
+        { {   1,  52, 220, 246, 198, 199, 249, 220, 255, 255, 128 },
+          { 124,  74, 191, 243, 183, 193, 250, 221, 255, 255, 128 },
+          {  24,  71, 130, 219, 154, 170, 243, 182, 255, 255, 128 } },
+        { {   1, 182, 225, 249, 219, 240, 255, 224, 128, 128, 128 },
+          { 149, 150, 226, 252, 216, 205, 255, 171, 128, 128, 128 },
+          {  28, 108, 170, 242, 183, 194, 254, 223, 255, 255, 128 } },
+        { {   1,  81, 230, 252, 204, 203, 255, 192, 128, 128, 128 },
+          { 123, 102, 209, 247, 188, 196, 255, 233, 128, 128, 128 },
+          {  20,  95, 153, 243, 164, 173, 255, 203, 128, 128, 128 } },
+        { {   1, 222, 248, 255, 216, 213, 128, 128, 128, 128, 128 },
+          { 168, 175, 246, 252, 235, 205, 255, 255, 128, 128, 128 },
+          {  47, 116, 215, 255, 211, 212, 255, 255, 128, 128, 128 } },
+        { {   1, 121, 236, 253, 212, 214, 255, 255, 128, 128, 128 },
+          { 141,  84, 213, 252, 201, 202, 255, 219, 128, 128, 128 },
+          {  42,  80, 160, 240, 162, 185, 255, 205, 128, 128, 128 } },
+        { {   1,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 244,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 },
+          { 238,   1, 255, 128, 128, 128, 128, 128, 128, 128, 128 } }
+    }
+};
+
+static const stbi_uc stbi__vp8_bmode_probs[10][10][9] =
+{
+    { { 231, 120,  48,  89, 115, 113, 120, 152, 112 },
+      { 152, 179,  64, 126, 170, 118,  46,  70,  95 },
+      { 175,  69, 143,  80,  85,  82,  72, 155, 103 },
+      {  56,  58,  10, 171, 218, 189,  17,  13, 152 },
+      { 114,  26,  17, 163,  44, 195,  21,  10, 173 },
+      { 121,  24,  80, 195,  26,  62,  44,  64,  85 },
+      { 144,  71,  10,  38, 171, 213, 144,  34,  26 },
+      { 170,  46,  55,  19, 136, 160,  33, 206,  71 },
+      {  63,  20,   8, 114, 114, 208,  12,   9, 226 },
+      {  81,  40,  11,  96, 182,  84,  29,  16,  36 } },
+    { { 134, 183,  89, 137,  98, 101, 106, 165, 148 },
+      {  72, 187, 100, 130, 157, 111,  32,  75,  80 },
+      {  66, 102, 167,  99,  74,  62,  40, 234, 128 },
+      {  41,  53,   9, 178, 241, 141,  26,   8, 107 },
+      {  74,  43,  26, 146,  73, 166,  49,  23, 157 },
+      {  65,  38, 105, 160,  51,  52,  31, 115, 128 },
+      { 104,  79,  12,  27, 217, 255,  87,  17,   7 },
+      {  87,  68,  71,  44, 114,  51,  15, 186,  23 },
+      {  47,  41,  14, 110, 182, 183,  21,  17, 194 },
+      {  66,  45,  25, 102, 197, 189,  23,  18,  22 } },
+    { {  88,  88, 147, 150,  42,  46,  45, 196, 205 },
+      {  43,  97, 183, 117,  85,  38,  35, 179,  61 },
+      {  39,  53, 200,  87,  26,  21,  43, 232, 171 },
+      {  56,  34,  51, 104, 114, 102,  29,  93,  77 },
+      {  39,  28,  85, 171,  58, 165,  90,  98,  64 },
+      {  34,  22, 116, 206,  23,  34,  43, 166,  73 },
+      { 107,  54,  32,  26,  51,   1,  81,  43,  31 },
+      {  68,  25, 106,  22,  64, 171,  36, 225, 114 },
+      {  34,  19,  21, 102, 132, 188,  16,  76, 124 },
+      {  62,  18,  78,  95,  85,  57,  50,  48,  51 } },
+    { { 193, 101,  35, 159, 215, 111,  89,  46, 111 },
+      {  60, 148,  31, 172, 219, 228,  21,  18, 111 },
+      { 112, 113,  77,  85, 179, 255,  38, 120, 114 },
+      {  40,  42,   1, 196, 245, 209,  10,  25, 109 },
+      {  88,  43,  29, 140, 166, 213,  37,  43, 154 },
+      {  61,  63,  30, 155,  67,  45,  68,   1, 209 },
+      { 100,  80,   8,  43, 154,   1,  51,  26,  71 },
+      { 142,  78,  78,  16, 255, 128,  34, 197, 171 },
+      {  41,  40,   5, 102, 211, 183,   4,   1, 221 },
+      {  51,  50,  17, 168, 209, 192,  23,  25,  82 } },
+    { { 138,  31,  36, 171,  27, 166,  38,  44, 229 },
+      {  67,  87,  58, 169,  82, 115,  26,  59, 179 },
+      {  63,  59,  90, 180,  59, 166,  93,  73, 154 },
+      {  40,  40,  21, 116, 143, 209,  34,  39, 175 },
+      {  47,  15,  16, 183,  34, 223,  49,  45, 183 },
+      {  46,  17,  33, 183,   6,  98,  15,  32, 183 },
+      {  57,  46,  22,  24, 128,   1,  54,  17,  37 },
+      {  65,  32,  73, 115,  28, 128,  23, 128, 205 },
+      {  40,   3,   9, 115,  51, 192,  18,   6, 223 },
+      {  87,  37,   9, 115,  59,  77,  64,  21,  47 } },
+    { { 104,  55,  44, 218,   9,  54,  53, 130, 226 },
+      {  64,  90,  70, 205,  40,  41,  23,  26,  57 },
+      {  54,  57, 112, 184,   5,  41,  38, 166, 213 },
+      {  30,  34,  26, 133, 152, 116,  10,  32, 134 },
+      {  39,  19,  53, 221,  26, 114,  32,  73, 255 },
+      {  31,   9,  65, 234,   2,  15,   1, 118,  73 },
+      {  75,  32,  12,  51, 192, 255, 160,  43,  51 },
+      {  88,  31,  35,  67, 102,  85,  55, 186,  85 },
+      {  56,  21,  23, 111,  59, 205,  45,  37, 192 },
+      {  55,  38,  70, 124,  73, 102,   1,  34,  98 } },
+    { { 125,  98,  42,  88, 104,  85, 117, 175,  82 },
+      {  95,  84,  53,  89, 128, 100, 113, 101,  45 },
+      {  75,  79, 123,  47,  51, 128,  81, 171,   1 },
+      {  57,  17,   5,  71, 102,  57,  53,  41,  49 },
+      {  38,  33,  13, 121,  57,  73,  26,   1,  85 },
+      {  41,  10,  67, 138,  77, 110,  90,  47, 114 },
+      { 115,  21,   2,  10, 102, 255, 166,  23,   6 },
+      { 101,  29,  16,  10,  85, 128, 101, 196,  26 },
+      {  57,  18,  10, 102, 102, 213,  34,  20,  43 },
+      { 117,  20,  15,  36, 163, 128,  68,   1,  26 } },
+    { { 102,  61,  71,  37,  34,  53,  31, 243, 192 },
+      {  69,  60,  71,  38,  73, 119,  28, 222,  37 },
+      {  68,  45, 128,  34,   1,  47,  11, 245, 171 },
+      {  62,  17,  19,  70, 146,  85,  55,  62,  70 },
+      {  37,  43,  37, 154, 100, 163,  85, 160,   1 },
+      {  63,   9,  92, 136,  28,  64,  32, 201,  85 },
+      {  75,  15,   9,   9,  64, 255, 184, 119,  16 },
+      {  86,   6,  28,   5,  64, 255,  25, 248,   1 },
+      {  56,   8,  17, 132, 137, 255,  55, 116, 128 },
+      {  58,  15,  20,  82, 135,  57,  26, 121,  40 } },
+    { { 164,  50,  31, 137, 154, 133,  25,  35, 218 },
+      {  51, 103,  44, 131, 131, 123,  31,   6, 158 },
+      {  86,  40,  64, 135, 148, 224,  45, 183, 128 },
+      {  22,  26,  17, 131, 240, 154,  14,   1, 209 },
+      {  45,  16,  21,  91,  64, 222,   7,   1, 197 },
+      {  56,  21,  39, 155,  60, 138,  23, 102, 213 },
+      {  83,  12,  13,  54, 192, 255,  68,  47,  28 },
+      {  85,  26,  85,  85, 128, 128,  32, 146, 171 },
+      {  18,  11,   7,  63, 144, 171,   4,   4, 246 },
+      {  35,  27,  10, 146, 174, 171,  12,  26, 128 } },
+    { { 190,  80,  35,  99, 180,  80, 126,  54,  45 },
+      {  85, 126,  47,  87, 176,  51,  41,  20,  32 },
+      { 101,  75, 128, 139, 118, 146, 116, 128,  85 },
+      {  56,  41,  15, 176, 236,  85,  37,   9,  62 },
+      {  71,  30,  17, 119, 118, 255,  17,  18, 138 },
+      { 101,  38,  60, 138,  55,  70,  43,  26, 142 },
+      { 146,  36,  19,  30, 171, 255,  97,  27,  20 },
+      { 138,  45,  61,  62, 219,   1,  81, 188,  64 },
+      {  32,  41,  20, 117, 151, 142,  20,  21, 163 },
+      { 112,  19,  12,  61, 195, 128,  48,   4,  24 } }
+};
+
+static const stbi_uc stbi__vp8_dc_table[128] =
+{
+    4, 5, 6, 7, 8, 9, 10, 10, 11, 12, 13, 14, 15, 16, 17, 17,
+    18, 19, 20, 20, 21, 21, 22, 22, 23, 23, 24, 25, 25, 26, 27, 28,
+    29, 30, 31, 32, 33, 34, 35, 36, 37, 37, 38, 39, 40, 41, 42, 43,
+    44, 45, 46, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58,
+    59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74,
+    75, 76, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 88, 89,
+    91, 93, 95, 96, 98, 100, 101, 102, 104, 106, 108, 110, 112, 114, 116, 118,
+    122, 124, 126, 128, 130, 132, 134, 136, 138, 140, 143, 145, 148, 151, 154, 157
+};
+
+static const stbi__uint16 stbi__vp8_ac_table[128] =
+{
+    4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19,
+    20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35,
+    36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,
+    52, 53, 54, 55, 56, 57, 58, 60, 62, 64, 66, 68, 70, 72, 74, 76,
+    78, 80, 82, 84, 86, 88, 90, 92, 94, 96, 98, 100, 102, 104, 106, 108,
+    110, 112, 114, 116, 119, 122, 125, 128, 131, 134, 137, 140, 143, 146, 149, 152,
+    155, 158, 161, 164, 167, 170, 173, 177, 181, 185, 189, 193, 197, 201, 205, 209,
+    213, 217, 221, 225, 229, 234, 239, 245, 249, 254, 259, 264, 269, 274, 279, 284
+};
+
+static const stbi_uc stbi__vp8_zigzag[16] = { 0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15 };
+
+// coefficient position -> probability band; the extra entry serves the lookahead past the last coefficient
+static const stbi_uc stbi__vp8_bands[17] = { 0, 1, 2, 3, 6, 4, 5, 6, 6, 6, 6, 6, 6, 6, 6, 7, 0 };
+
+// 4x4 intra mode tree: positive entries index the next node pair, others are negated modes
+static const signed char stbi__vp8_bmode_tree[18] =
+{
+    -STBI__VP8_DC_PRED, 1, -STBI__VP8_TM_PRED, 2, -STBI__VP8_V_PRED, 3, 4, 6,
+    -STBI__VP8_H_PRED, 5, -STBI__VP8_RD_PRED, -STBI__VP8_VR_PRED, -STBI__VP8_LD_PRED, 7,
+    -STBI__VP8_VL_PRED, 8, -STBI__VP8_HD_PRED, -STBI__VP8_HU_PRED
+};
+
+static const stbi_uc stbi__vp8_cat3[] = { 173, 148, 140, 0 };
+static const stbi_uc stbi__vp8_cat4[] = { 176, 155, 140, 135, 0 };
+static const stbi_uc stbi__vp8_cat5[] = { 180, 157, 141, 134, 130, 0 };
+static const stbi_uc stbi__vp8_cat6[] = { 254, 254, 243, 230, 196, 177, 153, 140, 133, 130, 129, 0 };
+static const stbi_uc* const stbi__vp8_cat_probs[4] = { stbi__vp8_cat3, stbi__vp8_cat4, stbi__vp8_cat5, stbi__vp8_cat6 };
+
+// boolean entropy decoder; range holds range - 1 and value keeps 'bits' unread bits
+// below the 8-bit window compared against the split
+typedef struct
+{
+    const stbi_uc* buf;
+    const stbi_uc* buf_end;
+    stbi__uint32 value;
+    int range;
+    int bits;
+    int eof;
+} stbi__vp8_bool;
+
+static void stbi__vp8_bool_init(stbi__vp8_bool* br, const stbi_uc* buf, int len)
+{
+    br->buf = buf;
+    br->buf_end = buf + len;
+    br->value = 0;
+    br->range = 255 - 1;
+    br->bits = -8;
+    br->eof = 0;
+}
+
+static void stbi__vp8_bool_fill(stbi__vp8_bool* br)
+{
+    if (br->buf_end - br->buf >= 3) {
+        br->value = (br->value << 24) | ((stbi__uint32)br->buf[0] << 16) | ((stbi__uint32)br->buf[1] << 8) | br->buf[2];
+        br->buf += 3;
+        br->bits += 24;
+    } else {
+        // past the end of the partition the decoder reads zeros; the caller checks eof
+        while (br->bits < 0) {
+            br->value <<= 8;
+            if (br->buf < br->buf_end)
+                br->value |= *br->buf++;
+            else
+                br->eof = 1;
+            br->bits += 8;
+        }
+    }
+}
+
+stbi_inline static int stbi__vp8_get_bit(stbi__vp8_bool* br, int prob)
+{
+    unsigned int range = (unsigned int)br->range;
+    unsigned int split, value;
+    int bit;
+    if (br->bits < 0) stbi__vp8_bool_fill(br);
+    split = (range * prob) >> 8;
+    value = br->value >> br->bits;
+    if (value > split) {
+        range -= split;
+        br->value -= (stbi__uint32)(split + 1) << br->bits;
+        bit = 1;
+    } else {
+        range = split + 1;
+        bit = 0;
+    }
+    while (range < 0x80) {
+        range <<= 1;
+        --br->bits;
+    }
+    br->range = (int)range - 1;
+    return bit;
+}
+
+static int stbi__vp8_get_value(stbi__vp8_bool* br, int n)
+{
+    int v = 0;
+    while (n-- > 0)
+        v |= stbi__vp8_get_bit(br, 0x80) << n;
+    return v;
+}
+
+static int stbi__vp8_get_signed_value(stbi__vp8_bool* br, int n)
+{
+    int v = stbi__vp8_get_value(br, n);
+    return stbi__vp8_get_bit(br, 0x80) ? -v : v;
+}
+
+typedef struct
+{
+    int limit;      // 0 disables filtering of the macroblock
+    int ilevel;
+    int hev_thresh;
+    int inner;
+} stbi__vp8_finfo;
+
+typedef struct
+{
+    int segment;
+    int skip;
+    int is_i4x4;
+    stbi_uc imodes[16]; // 4x4 modes, or the 16x16 mode in imodes[0]
+    stbi_uc uvmode;
+} stbi__vp8_mb;
+
+typedef struct
+{
+    stbi__vp8_bool br;          // first partition: per-macroblock modes
+    stbi__vp8_bool parts[8];    // coefficient partitions, used round robin by macroblock row
+    int num_parts;
+    int width, height, mb_w, mb_h;
+
+    int use_segment, update_map;
+    stbi_uc segment_probs[3];
+    int use_skip_prob, skip_prob;
+    int filter_type; // 0 off, 1 simple, 2 normal
+    stbi__vp8_finfo fstrengths[4][2]; // [segment][is_i4x4]
+    int dq[4][3][2];                  // [segment][y1, y2, uv][dc, ac]
+    stbi_uc coeff_probs[4][8][3][11];
+
+    stbi_uc* intra_t;   // 4 sub-block modes per macroblock column, from the row above
+    stbi_uc intra_l[4];
+    stbi_uc* nz_t;      // 9 non-zero flags per macroblock column: 4 y, 2 u, 2 v, y2
+    stbi_uc nz_l[9];
+    stbi_uc* top;       // unfiltered bottom rows of the macroblock row above: 16 y, 8 u, 8 v each
+    stbi__vp8_finfo* finfo;
+
+    // one macroblock with its left and top context, see stbi__vp8_reconstruct
+    STBI_SIMD_ALIGN(stbi_uc, work[STBI__VP8_BPS * 26]);
+    STBI_SIMD_ALIGN(short, coeffs[384]);
+    stbi_uc nz_code[24]; // per 4x4 block: 0 no coefficients, 1 DC only, 2 full transform
+
+    stbi_uc* y, * u, * v;
+    int y_stride, uv_stride;
+    int use_sse2;
+} stbi__vp8;
+
+#define STBI__VP8_Y_OFF  (STBI__VP8_BPS * 1 + 8)
+#define STBI__VP8_U_OFF  (STBI__VP8_Y_OFF + STBI__VP8_BPS * 16 + STBI__VP8_BPS)
+#define STBI__VP8_V_OFF  (STBI__VP8_U_OFF + 16)
+
+static int stbi__vp8_clip(int v, int m)
+{
+    return v < 0 ? 0 : v > m ? m : v;
+}
+
+static int stbi__vp8_parse_header(stbi__vp8* d, const stbi_uc* data, int len)
+{
+    stbi__vp8_bool* br = &d->br;
+    stbi__uint32 tag;
+    int first_len, i, t, b, c, p, base_q, left, last;
+    int dq_delta[5], seg_quant[4], seg_filter[4], absolute_delta = 1;
+    int simple, level, sharpness, use_lf_delta, ref_lf_delta[4], mode_lf_delta[4];
+    const stbi_uc* part;
+
+    if (len < 10) return stbi__err("truncated", "Corrupt WebP");
+    tag = data[0] | (data[1] << 8) | (data[2] << 16);
+    if (tag & 1) return stbi__err("not a key frame", "Corrupt WebP");
+    if (((tag >> 1) & 7) > 3) return stbi__err("bad profile", "Corrupt WebP");
+    if (!((tag >> 4) & 1)) return stbi__err("frame not shown", "Corrupt WebP");
+    first_len = (int)(tag >> 5);
+    if (data[3] != 0x9d || data[4] != 0x01 || data[5] != 0x2a) return stbi__err("bad start code", "Corrupt WebP");
+    d->width = (data[6] | (data[7] << 8)) & 0x3fff;
+    d->height = (data[8] | (data[9] << 8)) & 0x3fff;
+    if (d->width == 0 || d->height == 0) return stbi__err("0-pixel image", "Corrupt WebP");
+    d->mb_w = (d->width + 15) >> 4;
+    d->mb_h = (d->height + 15) >> 4;
+    data += 10;
+    len -= 10;
+    if (first_len > len) return stbi__err("truncated", "Corrupt WebP");
+    stbi__vp8_bool_init(br, data, first_len);
+
+    stbi__vp8_get_value(br, 1); // color space, always YCbCr
+    stbi__vp8_get_value(br, 1); // clamping type; pixels are always clamped here
+
+    // segment header
+    memset(seg_quant, 0, sizeof(seg_quant));
+    memset(seg_filter, 0, sizeof(seg_filter));
+    d->use_segment = stbi__vp8_get_value(br, 1);
+    d->update_map = 0;
+    if (d->use_segment) {
+        d->update_map = stbi__vp8_get_value(br, 1);
+        if (stbi__vp8_get_value(br, 1)) {
+            absolute_delta = stbi__vp8_get_value(br, 1);
+            for (i = 0; i < 4; ++i) seg_quant[i] = stbi__vp8_get_value(br, 1) ? stbi__vp8_get_signed_value(br, 7) : 0;
+            for (i = 0; i < 4; ++i) seg_filter[i] = stbi__vp8_get_value(br, 1) ? stbi__vp8_get_signed_value(br, 6) : 0;
+        }
+        if (d->update_map)
+            for (i = 0; i < 3; ++i) d->segment_probs[i] = (stbi_uc)(stbi__vp8_get_value(br, 1) ? stbi__vp8_get_value(br, 8) : 255);
+    }
+
+    // loop filter header
+    memset(ref_lf_delta, 0, sizeof(ref_lf_delta));
+    memset(mode_lf_delta, 0, sizeof(mode_lf_delta));
+    simple = stbi__vp8_get_value(br, 1);
+    level = stbi__vp8_get_value(br, 6);
+    sharpness = stbi__vp8_get_value(br, 3);
+    use_lf_delta = stbi__vp8_get_value(br, 1);
+    if (use_lf_delta && stbi__vp8_get_value(br, 1)) {
+        for (i = 0; i < 4; ++i) if (stbi__vp8_get_value(br, 1)) ref_lf_delta[i] = stbi__vp8_get_signed_value(br, 6);
+        for (i = 0; i < 4; ++i) if (stbi__vp8_get_value(br, 1)) mode_lf_delta[i] = stbi__vp8_get_signed_value(br, 6);
+    }
+    d->filter_type = level == 0 ? 0 : simple ? 1 : 2;
+
+    // coefficient partitions follow the first one, preceded by 3-byte sizes for all but the last
+    d->num_parts = 1 << stbi__vp8_get_value(br, 2);
+    last = d->num_parts - 1;
+    part = data + first_len;
+    left = len - first_len;
+    if (left < 3 * last) return stbi__err("truncated", "Corrupt WebP");
+    {
+        const stbi_uc* sizes = part;
+        part += 3 * last;
+        left -= 3 * last;
+        for (i = 0; i < last; ++i) {
+            int psize = sizes[0] | (sizes[1] << 8) | (sizes[2] << 16);
+            if (psize > left) psize = left;
+            stbi__vp8_bool_init(&d->parts[i], part, psize);
+            part += psize;
+            left -= psize;
+            sizes += 3;
+        }
+    }
+    if (left <= 0) return stbi__err("truncated", "Corrupt WebP");
+    stbi__vp8_bool_init(&d->parts[last], part, left);
+
+    // dequantization factors
+    base_q = stbi__vp8_get_value(br, 7);
+    for (i = 0; i < 5; ++i) dq_delta[i] = stbi__vp8_get_value(br, 1) ? stbi__vp8_get_signed_value(br, 4) : 0;
+    for (i = 0; i < 4; ++i) {
+        int q, y2_ac;
+        if (d->use_segment) {
+            q = seg_quant[i] + (absolute_delta ? 0 : base_q);
+        } else if (i > 0) {
+            memcpy(d->dq[i], d->dq[0], sizeof(d->dq[0]));
+            continue;
+        } else {
+            q = base_q;
+        }
+        d->dq[i][0][0] = stbi__vp8_dc_table[stbi__vp8_clip(q + dq_delta[0], 127)];
+        d->dq[i][0][1] = stbi__vp8_ac_table[stbi__vp8_clip(q, 127)];
+        d->dq[i][1][0] = stbi__vp8_dc_table[stbi__vp8_clip(q + dq_delta[1], 127)] * 2;
+        // y2 AC is scaled by 155/100, with a floor of 8
+        y2_ac = (stbi__vp8_ac_table[stbi__vp8_clip(q + dq_delta[2], 127)] * 101581) >> 16;
+        d->dq[i][1][1] = y2_ac < 8 ? 8 : y2_ac;
+        d->dq[i][2][0] = stbi__vp8_dc_table[stbi__vp8_clip(q + dq_delta[3], 117)];
+        d->dq[i][2][1] = stbi__vp8_ac_table[stbi__vp8_clip(q + dq_delta[4], 127)];
+    }
+
+    stbi__vp8_get_value(br, 1); // refresh_entropy_probs, meaningless for a single frame
+
+    for (t = 0; t < 4; ++t)
+        for (b = 0; b < 8; ++b)
+            for (c = 0; c < 3; ++c)
+                for (p = 0; p < 11; ++p)
+                    d->coeff_probs[t][b][c][p] = stbi__vp8_get_bit(br, stbi__vp8_coeff_update_probs[t][b][c][p])
+                        ? (stbi_uc)stbi__vp8_get_value(br, 8) : stbi__vp8_coeff_default_probs[t][b][c][p];
+    d->use_skip_prob = stbi__vp8_get_value(br, 1);
+    d->skip_prob = d->use_skip_prob ? stbi__vp8_get_value(br, 8) : 0;
+
+    // loop filter strength per segment and macroblock type
+    for (i = 0; i < 4; ++i) {
+        int i4x4, base_level = level;
+        if (d->use_segment) base_level = seg_filter[i] + (absolute_delta ? 0 : level);
+        for (i4x4 = 0; i4x4 <= 1; ++i4x4) {
+            stbi__vp8_finfo* info = &d->fstrengths[i][i4x4];
+            int lvl = base_level;
+            if (use_lf_delta) {
+                lvl += ref_lf_delta[0];
+                if (i4x4) lvl += mode_lf_delta[0];
+            }
+            lvl = stbi__vp8_clip(lvl, 63);
+            info->limit = 0;
+            if (lvl > 0) {
+                int ilevel = lvl;
+                if (sharpness > 0) {
+                    ilevel >>= sharpness > 4 ? 2 : 1;
+                    if (ilevel > 9 - sharpness) ilevel = 9 - sharpness;
+                }
+                if (ilevel < 1) ilevel = 1;
+                info->ilevel = ilevel;
+                info->limit = 2 * lvl + ilevel;
+                info->hev_thresh = lvl >= 40 ? 2 : lvl >= 15 ? 1 : 0;
+            }
+            info->inner = i4x4;
+        }
+    }
+    return 1;
+}
+
+static void stbi__vp8_parse_modes(stbi__vp8* d, int mb_x, stbi__vp8_mb* mb)
+{
+    stbi__vp8_bool* br = &d->br;
+    stbi_uc* top = d->intra_t + 4 * mb_x;
+    stbi_uc* left = d->intra_l;
+
+    mb->segment = 0;
+    if (d->update_map)
+        mb->segment = !stbi__vp8_get_bit(br, d->segment_probs[0]) ? stbi__vp8_get_bit(br, d->segment_probs[1])
+            : stbi__vp8_get_bit(br, d->segment_probs[2]) + 2;
+    mb->skip = d->use_skip_prob ? stbi__vp8_get_bit(br, d->skip_prob) : 0;
+    mb->is_i4x4 = !stbi__vp8_get_bit(br, 145);
+    if (!mb->is_i4x4) {
+        int ymode = stbi__vp8_get_bit(br, 156)
+            ? (stbi__vp8_get_bit(br, 128) ? STBI__VP8_TM_PRED : STBI__VP8_H_PRED)
+            : (stbi__vp8_get_bit(br, 163) ? STBI__VP8_V_PRED : STBI__VP8_DC_PRED);
+        mb->imodes[0] = (stbi_uc)ymode;
+        // neighbouring 4x4 blocks see the 16x16 mode as their context
+        memset(top, ymode, 4);
+        memset(left, ymode, 4);
+    } else {
+        int x, y;
+        for (y = 0; y < 4; ++y) {
+            int ymode = left[y];
+            for (x = 0; x < 4; ++x) {
+                const stbi_uc* prob = stbi__vp8_bmode_probs[top[x]][ymode];
+                int i = stbi__vp8_bmode_tree[stbi__vp8_get_bit(br, prob[0])];
+                while (i > 0)
+                    i = stbi__vp8_bmode_tree[2 * i + stbi__vp8_get_bit(br, prob[i])];
+                ymode = -i;
+                top[x] = (stbi_uc)ymode;
+                mb->imodes[y * 4 + x] = (stbi_uc)ymode;
+            }
+            left[y] = (stbi_uc)ymode;
+        }
+    }
+    mb->uvmode = (stbi_uc)(!stbi__vp8_get_bit(br, 142) ? STBI__VP8_DC_PRED
+        : !stbi__vp8_get_bit(br, 114) ? STBI__VP8_V_PRED
+        : stbi__vp8_get_bit(br, 183) ? STBI__VP8_TM_PRED : STBI__VP8_H_PRED);
+}
+
+static int stbi__vp8_large_value(stbi__vp8_bool* br, const stbi_uc* p)
+{
+    int v;
+    if (!stbi__vp8_get_bit(br, p[3])) {
+        if (!stbi__vp8_get_bit(br, p[4]))
+            v = 2;
+        else
+            v = 3 + stbi__vp8_get_bit(br, p[5]);
+    } else if (!stbi__vp8_get_bit(br, p[6])) {
+        if (!stbi__vp8_get_bit(br, p[7])) {
+            v = 5 + stbi__vp8_get_bit(br, 159);
+        } else {
+            v = 7 + 2 * stbi__vp8_get_bit(br, 165);
+            v += stbi__vp8_get_bit(br, 145);
+        }
+    } else {
+        const stbi_uc* tab;
+        int bit1 = stbi__vp8_get_bit(br, p[8]);
+        int bit0 = stbi__vp8_get_bit(br, p[9 + bit1]);
+        int cat = 2 * bit1 + bit0;
+        v = 0;
+        for (tab = stbi__vp8_cat_probs[cat]; *tab; ++tab)
+            v += v + stbi__vp8_get_bit(br, *tab);
+        v += 3 + (8 << cat);
+    }
+    return v;
+}
+
+// Decodes the tokens of one 4x4 block starting at coefficient n and returns the
+// position after the last non-zero coefficient (n when the block is empty).
+static int stbi__vp8_get_coeffs(stbi__vp8_bool* br, stbi_uc (*probs)[3][11], int ctx, const int* dq, int n, short* out)
+{
+    const stbi_uc* p = probs[stbi__vp8_bands[n]][ctx];
+    for (; n < 16; ++n) {
+        if (!stbi__vp8_get_bit(br, p[0]))
+            return n; // end of block
+        while (!stbi__vp8_get_bit(br, p[1])) {
+            p = probs[stbi__vp8_bands[++n]][0];
+            if (n == 16) return 16;
+        }
+        {
+            stbi_uc (*next)[11] = probs[stbi__vp8_bands[n + 1]];
+            int v;
+            if (!stbi__vp8_get_bit(br, p[2])) {
+                v = 1;
+                p = next[1];
+            } else {
+                v = stbi__vp8_large_value(br, p);
+                p = next[2];
+            }
+            out[stbi__vp8_zigzag[n]] = (short)((stbi__vp8_get_bit(br, 0x80) ? -v : v) * dq[n > 0]);
+        }
+    }
+    return 16;
+}
+
+static void stbi__vp8_iwht(const short* in, short* out)
+{
+    int tmp[16], i;
+    for (i = 0; i < 4; ++i) {
+        int a0 = in[0 + i] + in[12 + i];
+        int a1 = in[4 + i] + in[8 + i];
+        int a2 = in[4 + i] - in[8 + i];
+        int a3 = in[0 + i] - in[12 + i];
+        tmp[0 + i] = a0 + a1;
+        tmp[8 + i] = a0 - a1;
+        tmp[4 + i] = a3 + a2;
+        tmp[12 + i] = a3 - a2;
+    }
+    for (i = 0; i < 4; ++i) {
+        int dc = tmp[0 + i * 4] + 3;
+        int a0 = dc + tmp[3 + i * 4];
+        int a1 = tmp[1 + i * 4] + tmp[2 + i * 4];
+        int a2 = tmp[1 + i * 4] - tmp[2 + i * 4];
+        int a3 = dc - tmp[3 + i * 4];
+        out[0] = (short)((a0 + a1) >> 3);
+        out[16] = (short)((a3 + a2) >> 3);
+        out[32] = (short)((a0 - a1) >> 3);
+        out[48] = (short)((a3 - a2) >> 3);
+        out += 64;
+    }
+}
+
+static int stbi__vp8_nz_code(int nz, int dc)
+{
+    return nz > 1 ? 2 : dc != 0;
+}
+
+// Returns non-zero if the macroblock has any coefficient left after dequantization.
+static int stbi__vp8_parse_residuals(stbi__vp8* d, int mb_x, const stbi__vp8_mb* mb, stbi__vp8_bool* br)
+{
+    stbi_uc* tnz = d->nz_t + 9 * mb_x;
+    stbi_uc* lnz = d->nz_l;
+    const int (*dq)[2] = d->dq[mb->segment];
+    short* dst = d->coeffs;
+    int x, y, ch, first, type, any = 0;
+
+    memset(dst, 0, 384 * sizeof(*dst));
+    if (!mb->is_i4x4) {
+        // the DC of all 16 luma blocks is coded as a separate block and Walsh-Hadamard transformed
+        short dc[16];
+        int nz;
+        memset(dc, 0, sizeof(dc));
+        nz = stbi__vp8_get_coeffs(br, d->coeff_probs[1], tnz[8] + lnz[8], dq[1], 0, dc);
+        tnz[8] = lnz[8] = (stbi_uc)(nz > 0);
+        if (nz > 1) {
+            stbi__vp8_iwht(dc, dst);
+        } else {
+            int i, dc0 = (dc[0] + 3) >> 3;
+            for (i = 0; i < 16 * 16; i += 16) dst[i] = (short)dc0;
+        }
+        first = 1;
+        type = 0;
+    } else {
+        first = 0;
+        type = 3;
+    }
+
+    for (y = 0; y < 4; ++y) {
+        for (x = 0; x < 4; ++x) {
+            int nz = stbi__vp8_get_coeffs(br, d->coeff_probs[type], tnz[x] + lnz[y], dq[0], first, dst);
+            tnz[x] = lnz[y] = (stbi_uc)(nz > first);
+            d->nz_code[y * 4 + x] = (stbi_uc)stbi__vp8_nz_code(nz, dst[0]);
+            any |= d->nz_code[y * 4 + x];
+            dst += 16;
+        }
+    }
+    for (ch = 4; ch < 8; ch += 2) {
+        for (y = 0; y < 2; ++y) {
+            for (x = 0; x < 2; ++x) {
+                int nz = stbi__vp8_get_coeffs(br, d->coeff_probs[2], tnz[ch + x] + lnz[ch + y], dq[2], 0, dst);
+                tnz[ch + x] = lnz[ch + y] = (stbi_uc)(nz > 0);
+                d->nz_code[16 + (ch - 4) * 2 + y * 2 + x] = (stbi_uc)stbi__vp8_nz_code(nz, dst[0]);
+                any |= d->nz_code[16 + (ch - 4) * 2 + y * 2 + x];
+                dst += 16;
+            }
+        }
+    }
+    return any;
+}
+
+//
+//  inverse transforms
+//
+
+#define STBI__VP8_MUL1(a) ((((a) * 20091) >> 16) + (a))
+#define STBI__VP8_MUL2(a) (((a) * 35468) >> 16)
+
+static stbi_uc stbi__vp8_clip_pixel(int v)
+{
+    return (stbi_uc)((v & ~255) == 0 ? v : v < 0 ? 0 : 255);
+}
+
+static void stbi__vp8_idct_add(const short* in, stbi_uc* dst)
+{
+    int tmp[16], i;
+    int* t = tmp;
+    for (i = 0; i < 4; ++i) { // vertical pass
+        int a = in[0] + in[8];
+        int b = in[0] - in[8];
+        int c = STBI__VP8_MUL2(in[4]) - STBI__VP8_MUL1(in[12]);
+        int d = STBI__VP8_MUL1(in[4]) + STBI__VP8_MUL2(in[12]);
+        t[0] = a + d;
+        t[1] = b + c;
+        t[2] = b - c;
+        t[3] = a - d;
+        t += 4;
+        ++in;
+    }
+    t = tmp;
+    for (i = 0; i < 4; ++i) { // horizontal pass
+        int dc = t[0] + 4;
+        int a = dc + t[8];
+        int b = dc - t[8];
+        int c = STBI__VP8_MUL2(t[4]) - STBI__VP8_MUL1(t[12]);
+        int d = STBI__VP8_MUL1(t[4]) + STBI__VP8_MUL2(t[12]);
+        dst[0] = stbi__vp8_clip_pixel(dst[0] + ((a + d) >> 3));
+        dst[1] = stbi__vp8_clip_pixel(dst[1] + ((b + c) >> 3));
+        dst[2] = stbi__vp8_clip_pixel(dst[2] + ((b - c) >> 3));
+        dst[3] = stbi__vp8_clip_pixel(dst[3] + ((a - d) >> 3));
+        ++t;
+        dst += STBI__VP8_BPS;
+    }
+}
+
+static void stbi__vp8_idct_dc_add(const short* in, stbi_uc* dst)
+{
+    int dc = (in[0] + 4) >> 3, i, j;
+    for (j = 0; j < 4; ++j, dst += STBI__VP8_BPS)
+        for (i = 0; i < 4; ++i)
+            dst[i] = stbi__vp8_clip_pixel(dst[i] + dc);
+}
+
+#ifdef STBI_SSE2
+// Inverse transform of one block, or of two horizontally adjacent blocks (one per 64-bit
+// half) when 'two' is set. Bit-exact with stbi__vp8_idct_add: the 35468 multiply becomes a
+// signed high multiply by 35468 - 65536 plus the input, and 20091 (the fractional part of
+// sqrt(2) cos(pi/8)) the same.
+static void stbi__vp8_idct_add_sse2(const short* in, stbi_uc* dst, int two)
+{
+    const __m128i k1 = _mm_set1_epi16(20091);
+    const __m128i k2 = _mm_set1_epi16(-30068);
+    const __m128i four = _mm_set1_epi16(4);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i r0, r1, r2, r3, a, b, c, d, t0, t1, t2, t3;
+    int i;
+
+#define STBI__VP8_MUL1_SSE2(x) _mm_add_epi16(_mm_mulhi_epi16(x, k1), x)
+#define STBI__VP8_MUL2_SSE2(x) _mm_add_epi16(_mm_mulhi_epi16(x, k2), x)
+    // transpose both 4x4 blocks at once, rows of the left block in the low halves
+#define STBI__VP8_TRANSPOSE2(x0, x1, x2, x3) \
+    do { \
+        __m128i u0 = _mm_unpacklo_epi16(x0, x1), u1 = _mm_unpacklo_epi16(x2, x3); \
+        __m128i u2 = _mm_unpackhi_epi16(x0, x1), u3 = _mm_unpackhi_epi16(x2, x3); \
+        __m128i v0 = _mm_unpacklo_epi32(u0, u1), v1 = _mm_unpackhi_epi32(u0, u1); \
+        __m128i v2 = _mm_unpacklo_epi32(u2, u3), v3 = _mm_unpackhi_epi32(u2, u3); \
+        x0 = _mm_unpacklo_epi64(v0, v2); x1 = _mm_unpackhi_epi64(v0, v2); \
+        x2 = _mm_unpacklo_epi64(v1, v3); x3 = _mm_unpackhi_epi64(v1, v3); \
+    } while (0)
+
+    r0 = _mm_loadl_epi64((const __m128i*)(in + 0));
+    r1 = _mm_loadl_epi64((const __m128i*)(in + 4));
+    r2 = _mm_loadl_epi64((const __m128i*)(in + 8));
+    r3 = _mm_loadl_epi64((const __m128i*)(in + 12));
+    if (two) {
+        r0 = _mm_unpacklo_epi64(r0, _mm_loadl_epi64((const __m128i*)(in + 16)));
+        r1 = _mm_unpacklo_epi64(r1, _mm_loadl_epi64((const __m128i*)(in + 20)));
+        r2 = _mm_unpacklo_epi64(r2, _mm_loadl_epi64((const __m128i*)(in + 24)));
+        r3 = _mm_unpacklo_epi64(r3, _mm_loadl_epi64((const __m128i*)(in + 28)));
+    }
+
+    // vertical pass
+    a = _mm_add_epi16(r0, r2);
+    b = _mm_sub_epi16(r0, r2);
+    c = _mm_sub_epi16(STBI__VP8_MUL2_SSE2(r1), STBI__VP8_MUL1_SSE2(r3));
+    d = _mm_add_epi16(STBI__VP8_MUL1_SSE2(r1), STBI__VP8_MUL2_SSE2(r3));
+    t0 = _mm_add_epi16(a, d);
+    t1 = _mm_add_epi16(b, c);
+    t2 = _mm_sub_epi16(b, c);
+    t3 = _mm_sub_epi16(a, d);
+    STBI__VP8_TRANSPOSE2(t0, t1, t2, t3);
+
+    // horizontal pass
+    t0 = _mm_add_epi16(t0, four);
+    a = _mm_add_epi16(t0, t2);
+    b = _mm_sub_epi16(t0, t2);
+    c = _mm_sub_epi16(STBI__VP8_MUL2_SSE2(t1), STBI__VP8_MUL1_SSE2(t3));
+    d = _mm_add_epi16(STBI__VP8_MUL1_SSE2(t1), STBI__VP8_MUL2_SSE2(t3));
+    r0 = _mm_srai_epi16(_mm_add_epi16(a, d), 3);
+    r1 = _mm_srai_epi16(_mm_add_epi16(b, c), 3);
+    r2 = _mm_srai_epi16(_mm_sub_epi16(b, c), 3);
+    r3 = _mm_srai_epi16(_mm_sub_epi16(a, d), 3);
+    STBI__VP8_TRANSPOSE2(r0, r1, r2, r3);
+
+    for (i = 0; i < 4; ++i) {
+        stbi_uc* out = dst + i * STBI__VP8_BPS;
+        __m128i row = i == 0 ? r0 : i == 1 ? r1 : i == 2 ? r2 : r3;
+        __m128i p;
+        if (two) {
+            p = _mm_add_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)out), zero), row);
+            _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(p, p));
+        } else {
+            int pixels;
+            memcpy(&pixels, out, 4);
+            p = _mm_add_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(pixels), zero), row);
+            pixels = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+            memcpy(out, &pixels, 4);
+        }
+    }
+#undef STBI__VP8_MUL1_SSE2
+#undef STBI__VP8_MUL2_SSE2
+#undef STBI__VP8_TRANSPOSE2
+}
+#endif // STBI_SSE2
+
+static void stbi__vp8_transform(const stbi__vp8* d, int code, const short* in, stbi_uc* dst)
+{
+    STBI_NOTUSED(d); // only read by the SSE2 path
+    if (code == 2) {
+#ifdef STBI_SSE2
+        if (d->use_sse2) {
+            stbi__vp8_idct_add_sse2(in, dst, 0);
+            return;
+        }
+#endif
+        stbi__vp8_idct_add(in, dst);
+    } else if (code == 1) {
+        stbi__vp8_idct_dc_add(in, dst);
+    }
+}
+
+// Adds the residuals of the two adjacent blocks at in and in + 16.
+static void stbi__vp8_transform2(const stbi__vp8* d, const stbi_uc* code, const short* in, stbi_uc* dst)
+{
+#ifdef STBI_SSE2
+    if (d->use_sse2 && code[0] == 2 && code[1] == 2) {
+        stbi__vp8_idct_add_sse2(in, dst, 1);
+        return;
+    }
+#endif
+    stbi__vp8_transform(d, code[0], in, dst);
+    stbi__vp8_transform(d, code[1], in + 16, dst + 4);
+}
+
+//
+//  intra prediction; dst has the top row at dst - BPS and the left column at dst[-1]
+//
+
+#define STBI__VP8_AVG3(a, b, c) ((stbi_uc)(((a) + 2 * (b) + (c) + 2) >> 2))
+#define STBI__VP8_AVG2(a, b)    ((stbi_uc)(((a) + (b) + 1) >> 1))
+#define STBI__VP8_DST(x, y)     dst[(x) + (y) * STBI__VP8_BPS]
+
+static void stbi__vp8_pred_fill(stbi_uc* dst, int value, int size)
+{
+    int j;
+    for (j = 0; j < size; ++j) memset(dst + j * STBI__VP8_BPS, value, size);
+}
+
+static void stbi__vp8_pred_tm(stbi_uc* dst, int size)
+{
+    const stbi_uc* top = dst - STBI__VP8_BPS;
+    int i, j;
+    for (j = 0; j < size; ++j, dst += STBI__VP8_BPS) {
+        int d = dst[-1] - top[-1];
+        for (i = 0; i < size; ++i) dst[i] = stbi__vp8_clip_pixel(top[i] + d);
+    }
+}
+
+static void stbi__vp8_pred_ve(stbi_uc* dst, int size)
+{
+    int j;
+    for (j = 0; j < size; ++j) memcpy(dst + j * STBI__VP8_BPS, dst - STBI__VP8_BPS, size);
+}
+
+static void stbi__vp8_pred_he(stbi_uc* dst, int size)
+{
+    int j;
+    for (j = 0; j < size; ++j, dst += STBI__VP8_BPS) memset(dst, dst[-1], size);
+}
+
+// 16x16 luma (size 16, shift 4) and 8x8 chroma (size 8, shift 3) prediction
+static void stbi__vp8_pred_block(int mode, stbi_uc* dst, int size, int shift)
+{
+    int dc = 0, j;
+    switch (mode) {
+        case STBI__VP8_TM_PRED: stbi__vp8_pred_tm(dst, size); return;
+        case STBI__VP8_V_PRED:  stbi__vp8_pred_ve(dst, size); return;
+        case STBI__VP8_H_PRED:  stbi__vp8_pred_he(dst, size); return;
+        case STBI__VP8_DC_PRED:
+            for (j = 0; j < size; ++j) dc += dst[j - STBI__VP8_BPS] + dst[j * STBI__VP8_BPS - 1];
+            dc = (dc + size) >> (shift + 1);
+            break;
+        case STBI__VP8_DC_PRED_NOTOP:
+            for (j = 0; j < size; ++j) dc += dst[j * STBI__VP8_BPS - 1];
+            dc = (dc + (size >> 1)) >> shift;
+            break;
+        case STBI__VP8_DC_PRED_NOLEFT:
+            for (j = 0; j < size; ++j) dc += dst[j - STBI__VP8_BPS];
+            dc = (dc + (size >> 1)) >> shift;
+            break;
+        default:
+            dc = 0x80;
+            break;
+    }
+    stbi__vp8_pred_fill(dst, dc, size);
+}
+
+static void stbi__vp8_pred4(int mode, stbi_uc* dst)
+{
+    const stbi_uc* top = dst - STBI__VP8_BPS;
+    const int X = top[-1], A = top[0], B = top[1], C = top[2], D = top[3];
+    const int E = top[4], F = top[5], G = top[6], H = top[7];
+    const int I = dst[-1], J = dst[-1 + STBI__VP8_BPS], K = dst[-1 + 2 * STBI__VP8_BPS], L = dst[-1 + 3 * STBI__VP8_BPS];
+    int i, j, dc;
+    switch (mode) {
+        case STBI__VP8_DC_PRED:
+            dc = 4;
+            for (i = 0; i < 4; ++i) dc += top[i] + dst[-1 + i * STBI__VP8_BPS];
+            stbi__vp8_pred_fill(dst, dc >> 3, 4);
+            break;
+        case STBI__VP8_TM_PRED:
+            stbi__vp8_pred_tm(dst, 4);
+            break;
+        case STBI__VP8_V_PRED: {
+            stbi_uc vals[4];
+            vals[0] = STBI__VP8_AVG3(X, A, B);
+            vals[1] = STBI__VP8_AVG3(A, B, C);
+            vals[2] = STBI__VP8_AVG3(B, C, D);
+            vals[3] = STBI__VP8_AVG3(C, D, E);
+            for (j = 0; j < 4; ++j) memcpy(dst + j * STBI__VP8_BPS, vals, 4);
+            break;
+        }
+        case STBI__VP8_H_PRED:
+            memset(dst + 0 * STBI__VP8_BPS, STBI__VP8_AVG3(X, I, J), 4);
+            memset(dst + 1 * STBI__VP8_BPS, STBI__VP8_AVG3(I, J, K), 4);
+            memset(dst + 2 * STBI__VP8_BPS, STBI__VP8_AVG3(J, K, L), 4);
+            memset(dst + 3 * STBI__VP8_BPS, STBI__VP8_AVG3(K, L, L), 4);
+            break;
+        case STBI__VP8_RD_PRED:
+            STBI__VP8_DST(0, 3) = STBI__VP8_AVG3(J, K, L);
+            STBI__VP8_DST(1, 3) = STBI__VP8_DST(0, 2) = STBI__VP8_AVG3(I, J, K);
+            STBI__VP8_DST(2, 3) = STBI__VP8_DST(1, 2) = STBI__VP8_DST(0, 1) = STBI__VP8_AVG3(X, I, J);
+            STBI__VP8_DST(3, 3) = STBI__VP8_DST(2, 2) = STBI__VP8_DST(1, 1) = STBI__VP8_DST(0, 0) = STBI__VP8_AVG3(A, X, I);
+            STBI__VP8_DST(3, 2) = STBI__VP8_DST(2, 1) = STBI__VP8_DST(1, 0) = STBI__VP8_AVG3(B, A, X);
+            STBI__VP8_DST(3, 1) = STBI__VP8_DST(2, 0) = STBI__VP8_AVG3(C, B, A);
+            STBI__VP8_DST(3, 0) = STBI__VP8_AVG3(D, C, B);
+            break;
+        case STBI__VP8_VR_PRED:
+            STBI__VP8_DST(0, 0) = STBI__VP8_DST(1, 2) = STBI__VP8_AVG2(X, A);
+            STBI__VP8_DST(1, 0) = STBI__VP8_DST(2, 2) = STBI__VP8_AVG2(A, B);
+            STBI__VP8_DST(2, 0) = STBI__VP8_DST(3, 2) = STBI__VP8_AVG2(B, C);
+            STBI__VP8_DST(3, 0) = STBI__VP8_AVG2(C, D);
+            STBI__VP8_DST(0, 3) = STBI__VP8_AVG3(K, J, I);
+            STBI__VP8_DST(0, 2) = STBI__VP8_AVG3(J, I, X);
+            STBI__VP8_DST(0, 1) = STBI__VP8_DST(1, 3) = STBI__VP8_AVG3(I, X, A);
+            STBI__VP8_DST(1, 1) = STBI__VP8_DST(2, 3) = STBI__VP8_AVG3(X, A, B);
+            STBI__VP8_DST(2, 1) = STBI__VP8_DST(3, 3) = STBI__VP8_AVG3(A, B, C);
+            STBI__VP8_DST(3, 1) = STBI__VP8_AVG3(B, C, D);
+            break;
+        case STBI__VP8_LD_PRED:
+            STBI__VP8_DST(0, 0) = STBI__VP8_AVG3(A, B, C);
+            STBI__VP8_DST(1, 0) = STBI__VP8_DST(0, 1) = STBI__VP8_AVG3(B, C, D);
+            STBI__VP8_DST(2, 0) = STBI__VP8_DST(1, 1) = STBI__VP8_DST(0, 2) = STBI__VP8_AVG3(C, D, E);
+            STBI__VP8_DST(3, 0) = STBI__VP8_DST(2, 1) = STBI__VP8_DST(1, 2) = STBI__VP8_DST(0, 3) = STBI__VP8_AVG3(D, E, F);
+            STBI__VP8_DST(3, 1) = STBI__VP8_DST(2, 2) = STBI__VP8_DST(1, 3) = STBI__VP8_AVG3(E, F, G);
+            STBI__VP8_DST(3, 2) = STBI__VP8_DST(2, 3) = STBI__VP8_AVG3(F, G, H);
+            STBI__VP8_DST(3, 3) = STBI__VP8_AVG3(G, H, H);
+            break;
+        case STBI__VP8_VL_PRED:
+            STBI__VP8_DST(0, 0) = STBI__VP8_AVG2(A, B);
+            STBI__VP8_DST(1, 0) = STBI__VP8_DST(0, 2) = STBI__VP8_AVG2(B, C);
+            STBI__VP8_DST(2, 0) = STBI__VP8_DST(1, 2) = STBI__VP8_AVG2(C, D);
+            STBI__VP8_DST(3, 0) = STBI__VP8_DST(2, 2) = STBI__VP8_AVG2(D, E);
+            STBI__VP8_DST(0, 1) = STBI__VP8_AVG3(A, B, C);
+            STBI__VP8_DST(1, 1) = STBI__VP8_DST(0, 3) = STBI__VP8_AVG3(B, C, D);
+            STBI__VP8_DST(2, 1) = STBI__VP8_DST(1, 3) = STBI__VP8_AVG3(C, D, E);
+            STBI__VP8_DST(3, 1) = STBI__VP8_DST(2, 3) = STBI__VP8_AVG3(D, E, F);
+            STBI__VP8_DST(3, 2) = STBI__VP8_AVG3(E, F, G);
+            STBI__VP8_DST(3, 3) = STBI__VP8_AVG3(F, G, H);
+            break;
+        case STBI__VP8_HD_PRED:
+            STBI__VP8_DST(0, 0) = STBI__VP8_DST(2, 1) = STBI__VP8_AVG2(I, X);
+            STBI__VP8_DST(0, 1) = STBI__VP8_DST(2, 2) = STBI__VP8_AVG2(J, I);
+            STBI__VP8_DST(0, 2) = STBI__VP8_DST(2, 3) = STBI__VP8_AVG2(K, J);
+            STBI__VP8_DST(0, 3) = STBI__VP8_AVG2(L, K);
+            STBI__VP8_DST(3, 0) = STBI__VP8_AVG3(A, B, C);
+            STBI__VP8_DST(2, 0) = STBI__VP8_AVG3(X, A, B);
+            STBI__VP8_DST(1, 0) = STBI__VP8_DST(3, 1) = STBI__VP8_AVG3(I, X, A);
+            STBI__VP8_DST(1, 1) = STBI__VP8_DST(3, 2) = STBI__VP8_AVG3(J, I, X);
+            STBI__VP8_DST(1, 2) = STBI__VP8_DST(3, 3) = STBI__VP8_AVG3(K, J, I);
+            STBI__VP8_DST(1, 3) = STBI__VP8_AVG3(L, K, J);
+            break;
+        default: // STBI__VP8_HU_PRED
+            STBI__VP8_DST(0, 0) = STBI__VP8_AVG2(I, J);
+            STBI__VP8_DST(2, 0) = STBI__VP8_DST(0, 1) = STBI__VP8_AVG2(J, K);
+            STBI__VP8_DST(2, 1) = STBI__VP8_DST(0, 2) = STBI__VP8_AVG2(K, L);
+            STBI__VP8_DST(1, 0) = STBI__VP8_AVG3(I, J, K);
+            STBI__VP8_DST(3, 0) = STBI__VP8_DST(1, 1) = STBI__VP8_AVG3(J, K, L);
+            STBI__VP8_DST(3, 1) = STBI__VP8_DST(1, 2) = STBI__VP8_AVG3(K, L, L);
+            STBI__VP8_DST(3, 2) = STBI__VP8_DST(2, 2) = STBI__VP8_DST(0, 3) = STBI__VP8_DST(1, 3) = STBI__VP8_DST(2, 3) = STBI__VP8_DST(3, 3) = (stbi_uc)L;
+            break;
+    }
+}
+
+static int stbi__vp8_edge_mode(int mb_x, int mb_y, int mode)
+{
+    if (mode != STBI__VP8_DC_PRED) return mode;
+    if (mb_x == 0) return mb_y == 0 ? STBI__VP8_DC_PRED_NOTOPLEFT : STBI__VP8_DC_PRED_NOLEFT;
+    return mb_y == 0 ? STBI__VP8_DC_PRED_NOTOP : STBI__VP8_DC_PRED;
+}
+
+// Predicts and reconstructs one macroblock in the work buffer, which keeps the left
+// neighbour's last columns and the unfiltered top row around it, then copies it out.
+//
+//  work:  row 0        top context of y (16 + 4 top-right pixels)
+//         rows 1..16   y, at column 8
+//         row 17       top context of u and v
+//         rows 18..25  u at column 8, v at column 24
+static void stbi__vp8_reconstruct(stbi__vp8* d, int mb_x, int mb_y, const stbi__vp8_mb* mb)
+{
+    stbi_uc* y_dst = d->work + STBI__VP8_Y_OFF;
+    stbi_uc* u_dst = d->work + STBI__VP8_U_OFF;
+    stbi_uc* v_dst = d->work + STBI__VP8_V_OFF;
+    stbi_uc* top = d->top + 32 * mb_x;
+    const short* coeffs = d->coeffs;
+    int j, n;
+
+    if (mb_x == 0) {
+        for (j = 0; j < 16; ++j) y_dst[j * STBI__VP8_BPS - 1] = 129;
+        for (j = 0; j < 8; ++j) u_dst[j * STBI__VP8_BPS - 1] = v_dst[j * STBI__VP8_BPS - 1] = 129;
+        if (mb_y > 0) {
+            y_dst[-1 - STBI__VP8_BPS] = u_dst[-1 - STBI__VP8_BPS] = v_dst[-1 - STBI__VP8_BPS] = 129;
+        } else {
+            // the whole top row of the picture predicts from 127; set once here, it stays valid
+            memset(y_dst - STBI__VP8_BPS - 1, 127, 16 + 4 + 1);
+            memset(u_dst - STBI__VP8_BPS - 1, 127, 8 + 1);
+            memset(v_dst - STBI__VP8_BPS - 1, 127, 8 + 1);
+        }
+    } else {
+        // the left neighbour's rightmost columns (and top-left corner) become the left context
+        for (j = -1; j < 16; ++j) memcpy(y_dst + j * STBI__VP8_BPS - 4, y_dst + j * STBI__VP8_BPS + 12, 4);
+        for (j = -1; j < 8; ++j) {
+            memcpy(u_dst + j * STBI__VP8_BPS - 4, u_dst + j * STBI__VP8_BPS + 4, 4);
+            memcpy(v_dst + j * STBI__VP8_BPS - 4, v_dst + j * STBI__VP8_BPS + 4, 4);
+        }
+    }
+    if (mb_y > 0) {
+        memcpy(y_dst - STBI__VP8_BPS, top, 16);
+        memcpy(u_dst - STBI__VP8_BPS, top + 16, 8);
+        memcpy(v_dst - STBI__VP8_BPS, top + 24, 8);
+    }
+
+    if (mb->is_i4x4) {
+        stbi_uc* top_right = y_dst - STBI__VP8_BPS + 16;
+        if (mb_y > 0) {
+            if (mb_x >= d->mb_w - 1)
+                memset(top_right, top[15], 4);
+            else
+                memcpy(top_right, top + 32, 4);
+        }
+        // blocks in the right column use the macroblock's top-right pixels as well
+        memcpy(top_right + 4 * STBI__VP8_BPS, top_right, 4);
+        memcpy(top_right + 8 * STBI__VP8_BPS, top_right, 4);
+        memcpy(top_right + 12 * STBI__VP8_BPS, top_right, 4);
+        for (n = 0; n < 16; ++n) {
+            stbi_uc* dst = y_dst + (n & 3) * 4 + (n >> 2) * 4 * STBI__VP8_BPS;
+            stbi__vp8_pred4(mb->imodes[n], dst);
+            stbi__vp8_transform(d, d->nz_code[n], coeffs + n * 16, dst);
+        }
+    } else {
+        stbi__vp8_pred_block(stbi__vp8_edge_mode(mb_x, mb_y, mb->imodes[0]), y_dst, 16, 4);
+        for (n = 0; n < 16; n += 2)
+            stbi__vp8_transform2(d, d->nz_code + n, coeffs + n * 16, y_dst + (n & 3) * 4 + (n >> 2) * 4 * STBI__VP8_BPS);
+    }
+
+    {
+        int uvmode = stbi__vp8_edge_mode(mb_x, mb_y, mb->uvmode);
+        stbi__vp8_pred_block(uvmode, u_dst, 8, 3);
+        stbi__vp8_pred_block(uvmode, v_dst, 8, 3);
+        stbi__vp8_transform2(d, d->nz_code + 16, coeffs + 16 * 16, u_dst);
+        stbi__vp8_transform2(d, d->nz_code + 18, coeffs + 18 * 16, u_dst + 4 * STBI__VP8_BPS);
+        stbi__vp8_transform2(d, d->nz_code + 20, coeffs + 20 * 16, v_dst);
+        stbi__vp8_transform2(d, d->nz_code + 22, coeffs + 22 * 16, v_dst + 4 * STBI__VP8_BPS);
+    }
+
+    // keep the unfiltered bottom rows as the next macroblock row's top context
+    if (mb_y < d->mb_h - 1) {
+        memcpy(top, y_dst + 15 * STBI__VP8_BPS, 16);
+        memcpy(top + 16, u_dst + 7 * STBI__VP8_BPS, 8);
+        memcpy(top + 24, v_dst + 7 * STBI__VP8_BPS, 8);
+    }
+
+    for (j = 0; j < 16; ++j)
+        memcpy(d->y + (mb_y * 16 + j) * d->y_stride + mb_x * 16, y_dst + j * STBI__VP8_BPS, 16);
+    for (j = 0; j < 8; ++j) {
+        memcpy(d->u + (mb_y * 8 + j) * d->uv_stride + mb_x * 8, u_dst + j * STBI__VP8_BPS, 8);
+        memcpy(d->v + (mb_y * 8 + j) * d->uv_stride + mb_x * 8, v_dst + j * STBI__VP8_BPS, 8);
+    }
+}
+
+#undef STBI__VP8_AVG3
+#undef STBI__VP8_AVG2
+#undef STBI__VP8_DST
+
+//
+//  loop filter
+//
+
+static int stbi__vp8_sclip1(int v) { return v < -128 ? -128 : v > 127 ? 127 : v; }  // [-1020, 1020] -> [-128, 127]
+static int stbi__vp8_sclip2(int v) { return v < -16 ? -16 : v > 15 ? 15 : v; }      // [-112, 112] -> [-16, 15]
+static int stbi__vp8_abs(int v) { return v < 0 ? -v : v; }
+
+// 4 pixels in, 2 pixels out
+static void stbi__vp8_filter2(stbi_uc* p, int step)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    const int a = 3 * (q0 - p0) + stbi__vp8_sclip1(p1 - q1);
+    const int a1 = stbi__vp8_sclip2((a + 4) >> 3);
+    const int a2 = stbi__vp8_sclip2((a + 3) >> 3);
+    p[-step] = stbi__vp8_clip_pixel(p0 + a2);
+    p[0] = stbi__vp8_clip_pixel(q0 - a1);
+}
+
+// 4 pixels in, 4 pixels out
+static void stbi__vp8_filter4(stbi_uc* p, int step)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    const int a = 3 * (q0 - p0);
+    const int a1 = stbi__vp8_sclip2((a + 4) >> 3);
+    const int a2 = stbi__vp8_sclip2((a + 3) >> 3);
+    const int a3 = (a1 + 1) >> 1;
+    p[-2 * step] = stbi__vp8_clip_pixel(p1 + a3);
+    p[-step] = stbi__vp8_clip_pixel(p0 + a2);
+    p[0] = stbi__vp8_clip_pixel(q0 - a1);
+    p[step] = stbi__vp8_clip_pixel(q1 - a3);
+}
+
+// 6 pixels in, 6 pixels out
+static void stbi__vp8_filter6(stbi_uc* p, int step)
+{
+    const int p2 = p[-3 * step], p1 = p[-2 * step], p0 = p[-step];
+    const int q0 = p[0], q1 = p[step], q2 = p[2 * step];
+    const int a = stbi__vp8_sclip1(3 * (q0 - p0) + stbi__vp8_sclip1(p1 - q1));
+    const int a1 = (27 * a + 63) >> 7;
+    const int a2 = (18 * a + 63) >> 7;
+    const int a3 = (9 * a + 63) >> 7;
+    p[-3 * step] = stbi__vp8_clip_pixel(p2 + a3);
+    p[-2 * step] = stbi__vp8_clip_pixel(p1 + a2);
+    p[-step] = stbi__vp8_clip_pixel(p0 + a1);
+    p[0] = stbi__vp8_clip_pixel(q0 - a1);
+    p[step] = stbi__vp8_clip_pixel(q1 - a2);
+    p[2 * step] = stbi__vp8_clip_pixel(q2 - a3);
+}
+
+static int stbi__vp8_hev(const stbi_uc* p, int step, int thresh)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    return stbi__vp8_abs(p1 - p0) > thresh || stbi__vp8_abs(q1 - q0) > thresh;
+}
+
+static int stbi__vp8_needs_filter(const stbi_uc* p, int step, int t)
+{
+    const int p1 = p[-2 * step], p0 = p[-step], q0 = p[0], q1 = p[step];
+    return 4 * stbi__vp8_abs(p0 - q0) + stbi__vp8_abs(p1 - q1) <= t;
+}
+
+static int stbi__vp8_needs_filter2(const stbi_uc* p, int step, int t, int it)
+{
+    const int p3 = p[-4 * step], p2 = p[-3 * step], p1 = p[-2 * step], p0 = p[-step];
+    const int q0 = p[0], q1 = p[step], q2 = p[2 * step], q3 = p[3 * step];
+    if (4 * stbi__vp8_abs(p0 - q0) + stbi__vp8_abs(p1 - q1) > t) return 0;
+    return stbi__vp8_abs(p3 - p2) <= it && stbi__vp8_abs(p2 - p1) <= it && stbi__vp8_abs(p1 - p0) <= it
+        && stbi__vp8_abs(q3 - q2) <= it && stbi__vp8_abs(q2 - q1) <= it && stbi__vp8_abs(q1 - q0) <= it;
+}
+
+// Filters 'size' pixels along an edge. hstride steps across the edge, vstride along it.
+static void stbi__vp8_simple_filter(stbi_uc* p, int hstride, int vstride, int thresh)
+{
+    const int thresh2 = 2 * thresh + 1;
+    int i;
+    for (i = 0; i < 16; ++i, p += vstride)
+        if (stbi__vp8_needs_filter(p, hstride, thresh2))
+            stbi__vp8_filter2(p, hstride);
+}
+
+static void stbi__vp8_normal_filter(stbi_uc* p, int hstride, int vstride, int size, int thresh, int ithresh, int hev_thresh, int mb_edge)
+{
+    const int thresh2 = 2 * thresh + 1;
+    while (size-- > 0) {
+        if (stbi__vp8_needs_filter2(p, hstride, thresh2, ithresh)) {
+            if (stbi__vp8_hev(p, hstride, hev_thresh))
+                stbi__vp8_filter2(p, hstride);
+            else if (mb_edge)
+                stbi__vp8_filter6(p, hstride);
+            else
+                stbi__vp8_filter4(p, hstride);
+        }
+        p += vstride;
+    }
+}
+
+#ifdef STBI_SSE2
+// Normal loop filter across one edge of 16 pixels at once. x[0..7] hold p3, p2, p1, p0,
+// q0, q1, q2, q3, one pixel of the edge per byte. Bit-exact with stbi__vp8_normal_filter:
+// the saturating 8-bit sums clamp exactly where the scalar code clips.
+static void stbi__vp8_normal_filter_sse2(__m128i* x, int thresh, int ithresh, int hev_thresh, int mb_edge)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    __m128i p2 = x[1], p1 = x[2], p0 = x[3], q0 = x[4], q1 = x[5], q2 = x[6];
+    __m128i t, m, not_hev, a, a1, a2, a3;
+
+#define STBI__VP8_ABSDIFF(a, b) _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a))
+    // arithmetic shift of signed bytes
+#define STBI__VP8_SRA8(v, n) _mm_packs_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(zero, v), 8 + (n)), _mm_srai_epi16(_mm_unpackhi_epi8(zero, v), 8 + (n)))
+
+    t = _mm_max_epu8(STBI__VP8_ABSDIFF(p1, p0), STBI__VP8_ABSDIFF(q1, q0));
+    not_hev = _mm_cmpeq_epi8(_mm_subs_epu8(t, _mm_set1_epi8((char)hev_thresh)), zero);
+    m = _mm_max_epu8(t, _mm_max_epu8(STBI__VP8_ABSDIFF(x[0], p2), STBI__VP8_ABSDIFF(p2, p1)));
+    m = _mm_max_epu8(m, _mm_max_epu8(STBI__VP8_ABSDIFF(x[7], q2), STBI__VP8_ABSDIFF(q2, q1)));
+    m = _mm_cmpeq_epi8(_mm_subs_epu8(m, _mm_set1_epi8((char)ithresh)), zero);
+    // 4 * |p0 - q0| + |p1 - q1| <= 2 * thresh + 1  <=>  2 * |p0 - q0| + |p1 - q1| / 2 <= thresh
+    t = STBI__VP8_ABSDIFF(p0, q0);
+    t = _mm_adds_epu8(_mm_adds_epu8(t, t), _mm_srli_epi16(_mm_and_si128(STBI__VP8_ABSDIFF(p1, q1), _mm_set1_epi8((char)0xfe)), 1));
+    m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_subs_epu8(t, _mm_set1_epi8((char)thresh)), zero));
+
+    p2 = _mm_xor_si128(p2, sign);
+    p1 = _mm_xor_si128(p1, sign);
+    p0 = _mm_xor_si128(p0, sign);
+    q0 = _mm_xor_si128(q0, sign);
+    q1 = _mm_xor_si128(q1, sign);
+    q2 = _mm_xor_si128(q2, sign);
+
+    // 3 * (q0 - p0) + (p1 - q1); the outer term only applies to high edge variance pixels
+    // on inner edges
+    t = _mm_subs_epi8(p1, q1);
+    if (!mb_edge) t = _mm_andnot_si128(not_hev, t);
+    a = _mm_subs_epi8(q0, p0);
+    t = _mm_adds_epi8(t, a);
+    t = _mm_adds_epi8(t, a);
+    t = _mm_adds_epi8(t, a);
+    t = _mm_and_si128(t, m);
+
+    if (!mb_edge) {
+        // stbi__vp8_filter2 where hev, stbi__vp8_filter4 elsewhere
+        a1 = STBI__VP8_SRA8(_mm_adds_epi8(t, _mm_set1_epi8(4)), 3);
+        a2 = STBI__VP8_SRA8(_mm_adds_epi8(t, _mm_set1_epi8(3)), 3);
+        q0 = _mm_subs_epi8(q0, a1);
+        p0 = _mm_adds_epi8(p0, a2);
+        a3 = _mm_and_si128(STBI__VP8_SRA8(_mm_add_epi8(a1, _mm_set1_epi8(1)), 1), not_hev);
+        p1 = _mm_adds_epi8(p1, a3);
+        q1 = _mm_subs_epi8(q1, a3);
+    } else {
+        // stbi__vp8_filter2 where hev
+        a = _mm_andnot_si128(not_hev, t);
+        a1 = STBI__VP8_SRA8(_mm_adds_epi8(a, _mm_set1_epi8(4)), 3);
+        a2 = STBI__VP8_SRA8(_mm_adds_epi8(a, _mm_set1_epi8(3)), 3);
+        q0 = _mm_subs_epi8(q0, a1);
+        p0 = _mm_adds_epi8(p0, a2);
+        // stbi__vp8_filter6 elsewhere: taps of 27, 18 and 9 / 128
+        {
+            const __m128i k63 = _mm_set1_epi16(63);
+            __m128i lo, hi;
+            a = _mm_and_si128(not_hev, t);
+            lo = _mm_srai_epi16(_mm_unpacklo_epi8(zero, a), 8);
+            hi = _mm_srai_epi16(_mm_unpackhi_epi8(zero, a), 8);
+            a1 = _mm_packs_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, _mm_set1_epi16(27)), k63), 7),
+                                 _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, _mm_set1_epi16(27)), k63), 7));
+            a2 = _mm_packs_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, _mm_set1_epi16(18)), k63), 7),
+                                 _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, _mm_set1_epi16(18)), k63), 7));
+            a3 = _mm_packs_epi16(_mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, _mm_set1_epi16(9)), k63), 7),
+                                 _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, _mm_set1_epi16(9)), k63), 7));
+        }
+        p2 = _mm_adds_epi8(p2, a3);
+        q2 = _mm_subs_epi8(q2, a3);
+        p1 = _mm_adds_epi8(p1, a2);
+        q1 = _mm_subs_epi8(q1, a2);
+        p0 = _mm_adds_epi8(p0, a1);
+        q0 = _mm_subs_epi8(q0, a1);
+    }
+
+    x[1] = _mm_xor_si128(p2, sign);
+    x[2] = _mm_xor_si128(p1, sign);
+    x[3] = _mm_xor_si128(p0, sign);
+    x[4] = _mm_xor_si128(q0, sign);
+    x[5] = _mm_xor_si128(q1, sign);
+    x[6] = _mm_xor_si128(q2, sign);
+#undef STBI__VP8_ABSDIFF
+#undef STBI__VP8_SRA8
+}
+
+// Filters the edge in front of 8 pixels at a and 8 pixels at b. A vertical edge spans
+// 8 rows from each; its 8 columns around the edge are transposed into registers and back.
+static void stbi__vp8_filter_edge_sse2(stbi_uc* a, stbi_uc* b, int stride, int vertical_edge, int thresh, int ithresh, int hev_thresh, int mb_edge)
+{
+    __m128i x[8], t[8];
+    int i;
+    if (!vertical_edge) {
+        for (i = 0; i < 8; ++i)
+            x[i] = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(a + (i - 4) * stride)), _mm_loadl_epi64((const __m128i*)(b + (i - 4) * stride)));
+        stbi__vp8_normal_filter_sse2(x, thresh, ithresh, hev_thresh, mb_edge);
+        for (i = 1; i < 7; ++i) {
+            _mm_storel_epi64((__m128i*)(a + (i - 4) * stride), x[i]);
+            _mm_storel_epi64((__m128i*)(b + (i - 4) * stride), _mm_unpackhi_epi64(x[i], x[i]));
+        }
+        return;
+    }
+
+    // 16 rows of 8 bytes -> 8 columns of 16 bytes
+    for (i = 0; i < 8; ++i) {
+        const stbi_uc* r = (i < 4 ? a + 2 * i * stride : b + 2 * (i - 4) * stride) - 4;
+        t[i] = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)r), _mm_loadl_epi64((const __m128i*)(r + stride)));
+    }
+    for (i = 0; i < 4; ++i) {
+        x[2 * i] = _mm_unpacklo_epi16(t[2 * i], t[2 * i + 1]);
+        x[2 * i + 1] = _mm_unpackhi_epi16(t[2 * i], t[2 * i + 1]);
+    }
+    // x[0], x[2], x[4], x[6]: columns 0..3 of rows 0-3, 4-7, 8-11, 12-15; odd ones columns 4..7
+    for (i = 0; i < 2; ++i) {
+        t[4 * i + 0] = _mm_unpacklo_epi32(x[i], x[i + 2]);
+        t[4 * i + 1] = _mm_unpackhi_epi32(x[i], x[i + 2]);
+        t[4 * i + 2] = _mm_unpacklo_epi32(x[i + 4], x[i + 6]);
+        t[4 * i + 3] = _mm_unpackhi_epi32(x[i + 4], x[i + 6]);
+    }
+    // t[0], t[1]: columns 0-1 and 2-3 of rows 0-7, t[2], t[3] the same for rows 8-15; t[4..7] columns 4-7
+    for (i = 0; i < 2; ++i) {
+        x[4 * i + 0] = _mm_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+        x[4 * i + 1] = _mm_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+        x[4 * i + 2] = _mm_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+        x[4 * i + 3] = _mm_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+    }
+
+    stbi__vp8_normal_filter_sse2(x, thresh, ithresh, hev_thresh, mb_edge);
+
+    // and back: 8 columns of 16 bytes -> 16 rows of 8 bytes
+    for (i = 0; i < 4; ++i) {
+        t[2 * i] = _mm_unpacklo_epi8(x[2 * i], x[2 * i + 1]);
+        t[2 * i + 1] = _mm_unpackhi_epi8(x[2 * i], x[2 * i + 1]);
+    }
+    // t[0], t[2], t[4], t[6]: column pairs 0-1 .. 6-7 of rows 0-7; odd ones rows 8-15
+    for (i = 0; i < 2; ++i) {
+        x[4 * i + 0] = _mm_unpacklo_epi16(t[i], t[i + 2]);
+        x[4 * i + 1] = _mm_unpackhi_epi16(t[i], t[i + 2]);
+        x[4 * i + 2] = _mm_unpacklo_epi16(t[i + 4], t[i + 6]);
+        x[4 * i + 3] = _mm_unpackhi_epi16(t[i + 4], t[i + 6]);
+    }
+    // x[4 * i + 0], x[4 * i + 1]: columns 0-3 of rows 0-3 and 4-7 (+8 rows for i == 1); +2: columns 4-7
+    for (i = 0; i < 4; ++i) {
+        __m128i lo = _mm_unpacklo_epi32(x[(i >> 1) * 4 + (i & 1)], x[(i >> 1) * 4 + (i & 1) + 2]);
+        __m128i hi = _mm_unpackhi_epi32(x[(i >> 1) * 4 + (i & 1)], x[(i >> 1) * 4 + (i & 1) + 2]);
+        stbi_uc* r = (i < 2 ? a + 4 * i * stride : b + 4 * (i - 2) * stride) - 4;
+        _mm_storel_epi64((__m128i*)r, lo);
+        _mm_storel_epi64((__m128i*)(r + stride), _mm_unpackhi_epi64(lo, lo));
+        _mm_storel_epi64((__m128i*)(r + 2 * stride), hi);
+        _mm_storel_epi64((__m128i*)(r + 3 * stride), _mm_unpackhi_epi64(hi, hi));
+    }
+}
+#endif // STBI_SSE2
+
+// Normal filter across one edge: 16 luma pixels from a (b == NULL), or 8 u pixels from a
+// and 8 v pixels from b.
+static void stbi__vp8_filter_edge(const stbi__vp8* d, stbi_uc* a, stbi_uc* b, int stride, int vertical_edge, int thresh, int ithresh, int hev_thresh, int mb_edge)
+{
+    const int hstride = vertical_edge ? 1 : stride, vstride = vertical_edge ? stride : 1;
+#ifdef STBI_SSE2
+    if (d->use_sse2) {
+        stbi__vp8_filter_edge_sse2(a, b ? b : a + 8 * vstride, stride, vertical_edge, thresh, ithresh, hev_thresh, mb_edge);
+        return;
+    }
+#else
+    STBI_NOTUSED(d);
+#endif
+    if (!b) {
+        stbi__vp8_normal_filter(a, hstride, vstride, 16, thresh, ithresh, hev_thresh, mb_edge);
+    } else {
+        stbi__vp8_normal_filter(a, hstride, vstride, 8, thresh, ithresh, hev_thresh, mb_edge);
+        stbi__vp8_normal_filter(b, hstride, vstride, 8, thresh, ithresh, hev_thresh, mb_edge);
+    }
+}
+
+static void stbi__vp8_filter_mb(stbi__vp8* d, int mb_x, int mb_y)
+{
+    const stbi__vp8_finfo* f = &d->finfo[mb_x];
+    const int ys = d->y_stride, uvs = d->uv_stride;
+    stbi_uc* y_dst = d->y + mb_y * 16 * ys + mb_x * 16;
+    int limit = f->limit, k;
+
+    if (limit == 0) return;
+    if (d->filter_type == 1) {
+        if (mb_x > 0) stbi__vp8_simple_filter(y_dst, 1, ys, limit + 4);
+        if (f->inner)
+            for (k = 4; k < 16; k += 4) stbi__vp8_simple_filter(y_dst + k, 1, ys, limit);
+        if (mb_y > 0) stbi__vp8_simple_filter(y_dst, ys, 1, limit + 4);
+        if (f->inner)
+            for (k = 4; k < 16; k += 4) stbi__vp8_simple_filter(y_dst + k * ys, ys, 1, limit);
+    } else {
+        stbi_uc* u_dst = d->u + mb_y * 8 * uvs + mb_x * 8;
+        stbi_uc* v_dst = d->v + mb_y * 8 * uvs + mb_x * 8;
+        const int il = f->ilevel, hev = f->hev_thresh;
+        if (mb_x > 0) {
+            stbi__vp8_filter_edge(d, y_dst, NULL, ys, 1, limit + 4, il, hev, 1);
+            stbi__vp8_filter_edge(d, u_dst, v_dst, uvs, 1, limit + 4, il, hev, 1);
+        }
+        if (f->inner) {
+            for (k = 4; k < 16; k += 4) stbi__vp8_filter_edge(d, y_dst + k, NULL, ys, 1, limit, il, hev, 0);
+            stbi__vp8_filter_edge(d, u_dst + 4, v_dst + 4, uvs, 1, limit, il, hev, 0);
+        }
+        if (mb_y > 0) {
+            stbi__vp8_filter_edge(d, y_dst, NULL, ys, 0, limit + 4, il, hev, 1);
+            stbi__vp8_filter_edge(d, u_dst, v_dst, uvs, 0, limit + 4, il, hev, 1);
+        }
+        if (f->inner) {
+            for (k = 4; k < 16; k += 4) stbi__vp8_filter_edge(d, y_dst + k * ys, NULL, ys, 0, limit, il, hev, 0);
+            stbi__vp8_filter_edge(d, u_dst + 4 * uvs, v_dst + 4 * uvs, uvs, 0, limit, il, hev, 0);
+        }
+    }
+}
+
+//
+//  YUV 4:2:0 -> RGB, with libwebp's "fancy" upsampling: every output pixel blends the
+//  four nearest chroma samples 9:3:3:1
+//
+
+static stbi_uc stbi__webp_clip8(int v)
+{
+    return (stbi_uc)((v & ~16383) == 0 ? v >> 6 : v < 0 ? 0 : 255);
+}
+
+static void stbi__webp_yuv_to_rgb(stbi_uc* out, int y, int u, int v)
+{
+    const int yy = (y * 19077) >> 8;
+    out[0] = stbi__webp_clip8(yy + ((v * 26149) >> 8) - 14234);
+    out[1] = stbi__webp_clip8(yy - ((u * 6419) >> 8) - ((v * 13320) >> 8) + 8708);
+    out[2] = stbi__webp_clip8(yy + ((u * 33050) >> 8) - 17685);
+}
+
+// Upsamples one chroma row for an output row of 'len' pixels. 'near' is the chroma row
+// closer to the output row, 'far' the other one of the pair bracketing it.
+static void stbi__webp_upsample_row(stbi_uc* out, const stbi_uc* near, const stbi_uc* far, int len)
+{
+    int x, last_pair = (len - 1) >> 1;
+    out[0] = (stbi_uc)((3 * near[0] + far[0] + 2) >> 2);
+    for (x = 1; x <= last_pair; ++x) {
+        const int sum = near[x - 1] + near[x] + far[x - 1] + far[x] + 8;
+        out[2 * x - 1] = (stbi_uc)((((sum + 2 * (near[x] + far[x - 1])) >> 3) + near[x - 1]) >> 1);
+        out[2 * x] = (stbi_uc)((((sum + 2 * (near[x - 1] + far[x])) >> 3) + near[x]) >> 1);
+    }
+    if (!(len & 1))
+        out[len - 1] = (stbi_uc)((3 * near[last_pair] + far[last_pair] + 2) >> 2);
+}
+
+static void stbi__webp_yuv_row_to_rgba(const stbi__vp8* d, stbi_uc* out, const stbi_uc* y, const stbi_uc* u, const stbi_uc* v, int len)
+{
+    int x = 0;
+#ifdef STBI_SSE2
+    if (d->use_sse2) {
+        // 8 pixels at a time; the multiplies by 19077/256 etc. are high multiplies of the
+        // samples shifted up by 8, and the unsigned saturating adds reproduce the clipping
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i k19077 = _mm_set1_epi16(19077), k26149 = _mm_set1_epi16(26149);
+        const __m128i k6419 = _mm_set1_epi16(6419), k13320 = _mm_set1_epi16(13320);
+        const __m128i k33050 = _mm_set1_epi16((short)33050);
+        const __m128i k14234 = _mm_set1_epi16(14234), k8708 = _mm_set1_epi16(8708), k17685 = _mm_set1_epi16(17685);
+        const __m128i alpha = _mm_set1_epi8((char)255);
+        for (; x + 8 <= len; x += 8, out += 32) {
+            __m128i Y = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, _mm_loadl_epi64((const __m128i*)(y + x))), k19077);
+            __m128i U = _mm_unpacklo_epi8(zero, _mm_loadl_epi64((const __m128i*)(u + x)));
+            __m128i V = _mm_unpacklo_epi8(zero, _mm_loadl_epi64((const __m128i*)(v + x)));
+            __m128i R = _mm_subs_epu16(_mm_adds_epu16(Y, _mm_mulhi_epu16(V, k26149)), k14234);
+            __m128i G = _mm_subs_epu16(_mm_adds_epu16(Y, k8708), _mm_add_epi16(_mm_mulhi_epu16(U, k6419), _mm_mulhi_epu16(V, k13320)));
+            __m128i B = _mm_subs_epu16(_mm_adds_epu16(Y, _mm_mulhi_epu16(U, k33050)), k17685);
+            __m128i rg, ba;
+            R = _mm_packus_epi16(_mm_srli_epi16(R, 6), zero);
+            G = _mm_packus_epi16(_mm_srli_epi16(G, 6), zero);
+            B = _mm_packus_epi16(_mm_srli_epi16(B, 6), zero);
+            rg = _mm_unpacklo_epi8(R, G);
+            ba = _mm_unpacklo_epi8(B, alpha);
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(rg, ba));
+            _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(rg, ba));
+        }
+    }
+#else
+    STBI_NOTUSED(d);
+#endif
+    for (; x < len; ++x, out += 4) {
+        stbi__webp_yuv_to_rgb(out, y[x], u[x], v[x]);
+        out[3] = 255;
+    }
+}
+
+static int stbi__vp8_emit_rgba(stbi__vp8* d, stbi_uc* out)
+{
+    const int w = d->width, h = d->height, uv_h = (h + 1) >> 1;
+    stbi_uc* urow = (stbi_uc*)stbi__malloc_mad2(w, 2, 0);
+    stbi_uc* vrow = urow + w;
+    int r;
+    if (!urow) return stbi__err("outofmem", "Out of memory");
+    for (r = 0; r < h; ++r) {
+        // rows 2k-1 and 2k sit between chroma rows k-1 and k; the edges repeat the outer chroma row
+        const int near = r >> 1;
+        const int far = (r & 1) ? (near + 1 < uv_h ? near + 1 : near) : (near > 0 ? near - 1 : 0);
+        stbi__webp_upsample_row(urow, d->u + near * d->uv_stride, d->u + far * d->uv_stride, w);
+        stbi__webp_upsample_row(vrow, d->v + near * d->uv_stride, d->v + far * d->uv_stride, w);
+        stbi__webp_yuv_row_to_rgba(d, out + (size_t)r * w * 4, d->y + r * d->y_stride, urow, vrow, w);
+    }
+    stbi__free(urow);
+    return 1;
+}
+
+static int stbi__vp8_decode(const stbi_uc* data, int len, stbi_uc* out, int w, int h)
+{
+    stbi__vp8* d = (stbi__vp8*)stbi__malloc(sizeof(stbi__vp8));
+    stbi__vp8_mb mb;
+    stbi_uc* planes = NULL;
+    stbi_uc* context = NULL;
+    int mb_x, mb_y, ok = 0;
+
+    if (!d) return stbi__err("outofmem", "Out of memory");
+    memset(d, 0, sizeof(*d));
+#ifdef STBI_SSE2
+    d->use_sse2 = stbi__sse2_available();
+#endif
+    if (!stbi__vp8_parse_header(d, data, len)) goto done;
+    if (d->width != w || d->height != h) {
+        stbi__err("bad dimensions", "Corrupt WebP");
+        goto done;
+    }
+
+    d->y_stride = d->mb_w * 16;
+    d->uv_stride = d->mb_w * 8;
+    planes = (stbi_uc*)stbi__malloc_mad3(d->mb_w * 16, d->mb_h * 16, 3, 0);
+    context = (stbi_uc*)stbi__malloc_mad2(d->mb_w, 4 + 9 + 32 + (int)sizeof(stbi__vp8_finfo), 0);
+    if (!planes || !context) {
+        stbi__err("outofmem", "Out of memory");
+        goto done;
+    }
+    // 4:2:0 planes; 3 bytes per luma pixel is more than enough for all three
+    d->y = planes;
+    d->u = d->y + d->y_stride * d->mb_h * 16;
+    d->v = d->u + d->uv_stride * d->mb_h * 8;
+    d->finfo = (stbi__vp8_finfo*)context;
+    d->intra_t = context + sizeof(stbi__vp8_finfo) * d->mb_w;
+    d->nz_t = d->intra_t + 4 * d->mb_w;
+    d->top = d->nz_t + 9 * d->mb_w;
+    memset(d->intra_t, STBI__VP8_DC_PRED, 4 * d->mb_w);
+    memset(d->nz_t, 0, 9 * d->mb_w);
+
+    for (mb_y = 0; mb_y < d->mb_h; ++mb_y) {
+        stbi__vp8_bool* tokens = &d->parts[mb_y & (d->num_parts - 1)];
+        memset(d->intra_l, STBI__VP8_DC_PRED, sizeof(d->intra_l));
+        memset(d->nz_l, 0, sizeof(d->nz_l));
+        for (mb_x = 0; mb_x < d->mb_w; ++mb_x) {
+            int has_coeffs = 0;
+            stbi__vp8_parse_modes(d, mb_x, &mb);
+            if (!mb.skip) {
+                has_coeffs = stbi__vp8_parse_residuals(d, mb_x, &mb, tokens);
+            } else {
+                stbi_uc* tnz = d->nz_t + 9 * mb_x;
+                memset(tnz, 0, 8);
+                memset(d->nz_l, 0, 8);
+                if (!mb.is_i4x4) tnz[8] = d->nz_l[8] = 0;
+                memset(d->nz_code, 0, sizeof(d->nz_code));
+            }
+            d->finfo[mb_x] = d->fstrengths[mb.segment][mb.is_i4x4];
+            d->finfo[mb_x].inner |= has_coeffs;
+            stbi__vp8_reconstruct(d, mb_x, mb_y, &mb);
+            if (tokens->eof) {
+                stbi__err("truncated", "Corrupt WebP");
+                goto done;
+            }
+        }
+        if (d->br.eof) {
+            stbi__err("truncated", "Corrupt WebP");
+            goto done;
+        }
+        if (d->filter_type)
+            for (mb_x = 0; mb_x < d->mb_w; ++mb_x)
+                stbi__vp8_filter_mb(d, mb_x, mb_y);
+    }
+    ok = stbi__vp8_emit_rgba(d, out);
+
+done:
+    stbi__free(planes);
+    stbi__free(context);
+    stbi__free(d);
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  VP8L (lossless) decoding
+//
+
+#define STBI__VP8L_FAST_BITS  9
+#define STBI__VP8L_NUM_LITERALS  256
+#define STBI__VP8L_NUM_LENGTHS   24
+#define STBI__VP8L_NUM_DISTANCES 40
+#define STBI__VP8L_MAX_CACHE_BITS 11
+
+enum { STBI__VP8L_GREEN, STBI__VP8L_RED, STBI__VP8L_BLUE, STBI__VP8L_ALPHA, STBI__VP8L_DIST };
+enum { STBI__VP8L_PREDICTOR, STBI__VP8L_CROSS_COLOR, STBI__VP8L_SUBTRACT_GREEN, STBI__VP8L_COLOR_INDEXING };
+
+static const stbi_uc stbi__vp8l_code_length_order[19] = { 17, 18, 0, 1, 2, 3, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+// distance codes 1..120 -> (y << 4) | (8 - x) offsets of the nearest pixels
+static const stbi_uc stbi__vp8l_code_to_plane[120] =
+{
+    0x18, 0x07, 0x17, 0x19, 0x28, 0x06, 0x27, 0x29, 0x16, 0x1a, 0x26, 0x2a,
+    0x38, 0x05, 0x37, 0x39, 0x15, 0x1b, 0x36, 0x3a, 0x25, 0x2b, 0x48, 0x04,
+    0x47, 0x49, 0x14, 0x1c, 0x35, 0x3b, 0x46, 0x4a, 0x24, 0x2c, 0x58, 0x45,
+    0x4b, 0x34, 0x3c, 0x03, 0x57, 0x59, 0x13, 0x1d, 0x56, 0x5a, 0x23, 0x2d,
+    0x44, 0x4c, 0x55, 0x5b, 0x33, 0x3d, 0x68, 0x02, 0x67, 0x69, 0x12, 0x1e,
+    0x66, 0x6a, 0x22, 0x2e, 0x54, 0x5c, 0x43, 0x4d, 0x65, 0x6b, 0x32, 0x3e,
+    0x78, 0x01, 0x77, 0x79, 0x53, 0x5d, 0x11, 0x1f, 0x64, 0x6c, 0x42, 0x4e,
+    0x76, 0x7a, 0x21, 0x2f, 0x75, 0x7b, 0x31, 0x3f, 0x63, 0x6d, 0x52, 0x5e,
+    0x00, 0x74, 0x7c, 0x41, 0x4f, 0x10, 0x20, 0x62, 0x6e, 0x30, 0x73, 0x7d,
+    0x51, 0x5f, 0x40, 0x72, 0x7e, 0x61, 0x6f, 0x50, 0x71, 0x7f, 0x60, 0x70
+};
+
+// LSB-first bit reader; reading past the end yields zero bits and counts as overrun
+typedef struct
+{
+    const stbi_uc* buf;
+    const stbi_uc* buf_end;
+    stbi__uint32 val;
+    int nbits;
+    int overrun;
+} stbi__vp8l_bits;
+
+static void stbi__vp8l_refill(stbi__vp8l_bits* br)
+{
+    while (br->nbits <= 24) {
+        stbi__uint32 byte = 0;
+        if (br->buf < br->buf_end)
+            byte = *br->buf++;
+        else
+            ++br->overrun;
+        br->val |= byte << br->nbits;
+        br->nbits += 8;
+    }
+}
+
+// n <= 24
+static int stbi__vp8l_get(stbi__vp8l_bits* br, int n)
+{
+    int v;
+    if (br->nbits < n) stbi__vp8l_refill(br);
+    v = (int)(br->val & ((1u << n) - 1));
+    br->val >>= n;
+    br->nbits -= n;
+    return v;
+}
+
+static int stbi__vp8l_eos(const stbi__vp8l_bits* br)
+{
+    return br->overrun * 8 > br->nbits;
+}
+
+// canonical prefix code, decoded like stbi__zhuffman; alphabets go up to 280 + 2048 symbols
+typedef struct
+{
+    stbi__uint16 fast[1 << STBI__VP8L_FAST_BITS]; // (length << 12) | symbol, 0 for longer codes
+    stbi__uint16 firstcode[16];
+    int maxcode[17];
+    stbi__uint16 firstsymbol[16];
+    stbi__uint16* value;
+    int single; // the symbol of a code with only one symbol, which takes no bits; -1 otherwise
+} stbi__vp8l_huffman;
+
+typedef struct
+{
+    stbi__vp8l_huffman codes[5];
+} stbi__vp8l_group;
+
+static int stbi__vp8l_build_huffman(stbi__vp8l_huffman* z, const stbi_uc* sizelist, int num, stbi__uint16* value)
+{
+    int i, k = 0, used = 0, last = 0;
+    int code, next_code[16], sizes[16];
+
+    memset(sizes, 0, sizeof(sizes));
+    memset(z->fast, 0, sizeof(z->fast));
+    z->value = value;
+    z->single = -1;
+    for (i = 0; i < num; ++i) {
+        ++sizes[sizelist[i]];
+        if (sizelist[i]) {
+            ++used;
+            last = i;
+        }
+    }
+    if (used == 0) return stbi__err("bad codelengths", "Corrupt WebP");
+    if (used == 1) {
+        z->single = last;
+        return 1;
+    }
+    sizes[0] = 0;
+    code = 0;
+    for (i = 1; i < 16; ++i) {
+        next_code[i] = code;
+        z->firstcode[i] = (stbi__uint16)code;
+        z->firstsymbol[i] = (stbi__uint16)k;
+        code = (code + sizes[i]);
+        if (sizes[i])
+            if (code - 1 >= (1 << i)) return stbi__err("bad codelengths", "Corrupt WebP");
+        z->maxcode[i] = code << (16 - i); // preshift for inner loop
+        code <<= 1;
+        k += sizes[i];
+    }
+    // unlike deflate, incomplete codes are invalid
+    if (code != (1 << 16)) return stbi__err("bad codelengths", "Corrupt WebP");
+    z->maxcode[16] = 0x10000; // sentinel
+    for (i = 0; i < num; ++i) {
+        int s = sizelist[i];
+        if (s) {
+            int c = next_code[s] - z->firstcode[s] + z->firstsymbol[s];
+            value[c] = (stbi__uint16)i;
+            if (s <= STBI__VP8L_FAST_BITS) {
+                int j = stbi__bit_reverse(next_code[s], s);
+                while (j < (1 << STBI__VP8L_FAST_BITS)) {
+                    z->fast[j] = (stbi__uint16)((s << 12) | i);
+                    j += (1 << s);
+                }
+            }
+            ++next_code[s];
+        }
+    }
+    return 1;
+}
+
+static int stbi__vp8l_decode(stbi__vp8l_bits* br, const stbi__vp8l_huffman* z)
+{
+    int b, s, k;
+    if (z->single >= 0) return z->single;
+    if (br->nbits < 16) stbi__vp8l_refill(br);
+    b = z->fast[br->val & ((1 << STBI__VP8L_FAST_BITS) - 1)];
+    if (b) {
+        s = b >> 12;
+        br->val >>= s;
+        br->nbits -= s;
+        return b & 4095;
+    }
+    // not resolved by fast table, so compute it the slow way
+    k = stbi__bit_reverse((int)(br->val & 0xffff), 16);
+    for (s = STBI__VP8L_FAST_BITS + 1; k >= z->maxcode[s]; ++s)
+        ;
+    b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
+    br->val >>= s;
+    br->nbits -= s;
+    return z->value[b];
+}
+
+static int stbi__vp8l_read_code(stbi__vp8l_bits* br, int alphabet_size, stbi_uc* lengths, stbi__vp8l_huffman* z, stbi__uint16* value)
+{
+    memset(lengths, 0, alphabet_size);
+    if (stbi__vp8l_get(br, 1)) {
+        // simple code: one or two symbols listed explicitly
+        int num = stbi__vp8l_get(br, 1) + 1;
+        int sym = stbi__vp8l_get(br, stbi__vp8l_get(br, 1) ? 8 : 1);
+        if (sym >= alphabet_size) return stbi__err("bad codelengths", "Corrupt WebP");
+        lengths[sym] = 1;
+        if (num == 2) {
+            sym = stbi__vp8l_get(br, 8);
+            if (sym >= alphabet_size) return stbi__err("bad codelengths", "Corrupt WebP");
+            lengths[sym] = 1;
+        }
+    } else {
+        // code lengths are themselves prefix coded, like deflate's dynamic blocks
+        static const stbi_uc extra_bits[3] = { 2, 3, 7 };
+        static const stbi_uc repeat_base[3] = { 3, 3, 11 };
+        stbi__vp8l_huffman lencode;
+        stbi__uint16 lencode_value[19];
+        stbi_uc lencode_lengths[19];
+        int i, num_codes = stbi__vp8l_get(br, 4) + 4, max_symbol, symbol = 0, prev = 8;
+
+        memset(lencode_lengths, 0, sizeof(lencode_lengths));
+        for (i = 0; i < num_codes; ++i)
+            lencode_lengths[stbi__vp8l_code_length_order[i]] = (stbi_uc)stbi__vp8l_get(br, 3);
+        if (!stbi__vp8l_build_huffman(&lencode, lencode_lengths, 19, lencode_value)) return 0;
+        if (stbi__vp8l_get(br, 1)) {
+            max_symbol = 2 + stbi__vp8l_get(br, 2 + 2 * stbi__vp8l_get(br, 3));
+            if (max_symbol > alphabet_size) return stbi__err("bad codelengths", "Corrupt WebP");
+        } else {
+            max_symbol = alphabet_size;
+        }
+        while (symbol < alphabet_size && max_symbol-- > 0) {
+            int c = stbi__vp8l_decode(br, &lencode);
+            if (c < 16) {
+                lengths[symbol++] = (stbi_uc)c;
+                if (c) prev = c;
+            } else {
+                int repeat = stbi__vp8l_get(br, extra_bits[c - 16]) + repeat_base[c - 16];
+                if (symbol + repeat > alphabet_size) return stbi__err("bad codelengths", "Corrupt WebP");
+                memset(lengths + symbol, c == 16 ? prev : 0, repeat);
+                symbol += repeat;
+            }
+        }
+    }
+    if (stbi__vp8l_eos(br)) return stbi__err("truncated", "Corrupt WebP");
+    return stbi__vp8l_build_huffman(z, lengths, alphabet_size, value);
+}
+
+typedef struct
+{
+    int type;
+    int bits;
+    int xsize;              // width of the image the inverse transform produces
+    stbi__uint32* data;     // predictor modes, color multipliers or the palette
+} stbi__vp8l_transform;
+
+// entropy coding parameters of one image stream
+typedef struct
+{
+    int huffman_bits;           // 0 when a single group codes the whole image
+    int huffman_xsize;
+    stbi__uint32* huffman_image; // group index per tile
+    stbi__vp8l_group* groups;
+    stbi__uint16* values;       // symbol arrays of all codes
+    int cache_bits;
+    stbi__uint32* cache;
+} stbi__vp8l_codes;
+
+typedef struct
+{
+    stbi__vp8l_bits br;
+    stbi__vp8l_transform transforms[4];
+    int num_transforms;
+} stbi__vp8l;
+
+static int stbi__vp8l_subsample(int size, int bits)
+{
+    return (size + (1 << bits) - 1) >> bits;
+}
+
+static stbi__uint32* stbi__vp8l_decode_image(stbi__vp8l* d, int xsize, int ysize, int level0);
+
+static int stbi__vp8l_read_codes(stbi__vp8l* d, stbi__vp8l_codes* c, int xsize, int ysize, int level0)
+{
+    int alphabet[5], total = 0, num_groups = 1, num_used = 1, i, j, ok = 1;
+    int* mapping = NULL;
+    stbi_uc* lengths;
+
+    if (level0 && stbi__vp8l_get(&d->br, 1)) {
+        // meta prefix codes: an image whose green and red give the code group of each tile
+        int bits = stbi__vp8l_get(&d->br, 3) + 2;
+        int hx = stbi__vp8l_subsample(xsize, bits), hy = stbi__vp8l_subsample(ysize, bits), n = hx * hy;
+        stbi__uint32* himg = stbi__vp8l_decode_image(d, hx, hy, 0);
+        if (!himg) return 0;
+        c->huffman_bits = bits;
+        c->huffman_xsize = hx;
+        c->huffman_image = himg;
+        for (i = 0; i < n; ++i) {
+            himg[i] = (himg[i] >> 8) & 0xffff;
+            if ((int)himg[i] >= num_groups) num_groups = himg[i] + 1;
+        }
+        // only groups that some tile refers to are kept; the rest is parsed into a scratch group
+        mapping = (int*)stbi__malloc_mad2(num_groups, sizeof(int), 0);
+        if (!mapping) return stbi__err("outofmem", "Out of memory");
+        memset(mapping, 0xff, num_groups * sizeof(int));
+        num_used = 0;
+        for (i = 0; i < n; ++i) {
+            if (mapping[himg[i]] < 0) mapping[himg[i]] = num_used++;
+            himg[i] = mapping[himg[i]];
+        }
+    }
+
+    alphabet[STBI__VP8L_GREEN] = STBI__VP8L_NUM_LITERALS + STBI__VP8L_NUM_LENGTHS + (c->cache_bits ? 1 << c->cache_bits : 0);
+    alphabet[STBI__VP8L_RED] = alphabet[STBI__VP8L_BLUE] = alphabet[STBI__VP8L_ALPHA] = STBI__VP8L_NUM_LITERALS;
+    alphabet[STBI__VP8L_DIST] = STBI__VP8L_NUM_DISTANCES;
+    for (j = 0; j < 5; ++j) total += alphabet[j];
+
+    c->groups = (stbi__vp8l_group*)stbi__malloc_mad2(num_used + 1, sizeof(stbi__vp8l_group), 0);
+    c->values = (stbi__uint16*)stbi__malloc_mad3(num_used + 1, total, sizeof(stbi__uint16), 0);
+    lengths = (stbi_uc*)stbi__malloc(alphabet[STBI__VP8L_GREEN]);
+    if (!c->groups || !c->values || !lengths) {
+        ok = stbi__err("outofmem", "Out of memory");
+    } else {
+        for (i = 0; i < num_groups && ok; ++i) {
+            int g = mapping ? (mapping[i] < 0 ? num_used : mapping[i]) : 0;
+            stbi__uint16* value = c->values + (size_t)g * total;
+            for (j = 0; j < 5 && ok; ++j) {
+                ok = stbi__vp8l_read_code(&d->br, alphabet[j], lengths, &c->groups[g].codes[j], value);
+                value += alphabet[j];
+            }
+        }
+    }
+    stbi__free(lengths);
+    stbi__free(mapping);
+    return ok;
+}
+
+static const stbi__vp8l_group* stbi__vp8l_group_at(const stbi__vp8l_codes* c, int x, int y)
+{
+    if (c->huffman_bits == 0) return c->groups;
+    return c->groups + c->huffman_image[(y >> c->huffman_bits) * c->huffman_xsize + (x >> c->huffman_bits)];
+}
+
+static int stbi__vp8l_copy_value(stbi__vp8l_bits* br, int sym)
+{
+    int extra;
+    if (sym < 4) return sym + 1;
+    extra = (sym - 2) >> 1;
+    return ((2 + (sym & 1)) << extra) + stbi__vp8l_get(br, extra) + 1;
+}
+
+// small distance codes stand for nearby (x, y) offsets, mostly in the row above
+static int stbi__vp8l_plane_distance(int xsize, int code)
+{
+    int c, dist;
+    if (code > 120) return code - 120;
+    c = stbi__vp8l_code_to_plane[code - 1];
+    dist = (c >> 4) * xsize + 8 - (c & 15);
+    return dist >= 1 ? dist : 1;
+}
+
+static void stbi__vp8l_cache_insert(const stbi__vp8l_codes* c, stbi__uint32 argb)
+{
+    c->cache[(0x1e35a7bdu * argb) >> (32 - c->cache_bits)] = argb;
+}
+
+static int stbi__vp8l_decode_pixels(stbi__vp8l* d, const stbi__vp8l_codes* c, stbi__uint32* data, int width, int height)
+{
+    stbi__vp8l_bits* br = &d->br;
+    stbi__uint32* src = data;
+    stbi__uint32* end = data + (size_t)width * height;
+    stbi__uint32* last_cached = data;
+    const int mask = c->huffman_bits ? (1 << c->huffman_bits) - 1 : ~0;
+    const int len_limit = STBI__VP8L_NUM_LITERALS + STBI__VP8L_NUM_LENGTHS;
+    const int cache_limit = len_limit + (c->cache_bits ? 1 << c->cache_bits : 0);
+    const stbi__vp8l_group* g = c->groups;
+    int col = 0, row = 0;
+
+    while (src < end) {
+        int code;
+        if ((col & mask) == 0) g = stbi__vp8l_group_at(c, col, row);
+        code = stbi__vp8l_decode(br, &g->codes[STBI__VP8L_GREEN]);
+        if (code < STBI__VP8L_NUM_LITERALS) {
+            int red = stbi__vp8l_decode(br, &g->codes[STBI__VP8L_RED]);
+            int blue = stbi__vp8l_decode(br, &g->codes[STBI__VP8L_BLUE]);
+            int alpha = stbi__vp8l_decode(br, &g->codes[STBI__VP8L_ALPHA]);
+            *src++ = ((stbi__uint32)alpha << 24) | (red << 16) | (code << 8) | blue;
+        } else if (code < len_limit) {
+            // backward reference
+            int length = stbi__vp8l_copy_value(br, code - len_limit + STBI__VP8L_NUM_LENGTHS);
+            int dist = stbi__vp8l_plane_distance(width, stbi__vp8l_copy_value(br, stbi__vp8l_decode(br, &g->codes[STBI__VP8L_DIST])));
+            int i;
+            if (src - data < dist || end - src < length) return stbi__err("bad distance", "Corrupt WebP");
+            for (i = 0; i < length; ++i) src[i] = src[i - dist];
+            src += length;
+            col += length;
+            while (col >= width) {
+                col -= width;
+                ++row;
+                if (stbi__vp8l_eos(br)) return stbi__err("truncated", "Corrupt WebP");
+            }
+            if (src < end && (col & mask)) g = stbi__vp8l_group_at(c, col, row);
+            continue;
+        } else if (code < cache_limit) {
+            while (last_cached < src) stbi__vp8l_cache_insert(c, *last_cached++);
+            *src++ = c->cache[code - len_limit];
+        } else {
+            return stbi__err("bad code", "Corrupt WebP");
+        }
+        if (++col >= width) {
+            col = 0;
+            ++row;
+            if (stbi__vp8l_eos(br)) return stbi__err("truncated", "Corrupt WebP");
+        }
+    }
+    if (stbi__vp8l_eos(br)) return stbi__err("truncated", "Corrupt WebP");
+    return 1;
+}
+
+static int stbi__vp8l_read_transform(stbi__vp8l* d, int* xsize, int ysize)
+{
+    stbi__vp8l_bits* br = &d->br;
+    stbi__vp8l_transform* t = &d->transforms[d->num_transforms];
+    int type = stbi__vp8l_get(br, 2), i;
+
+    // each transform may appear once, so there are at most four
+    for (i = 0; i < d->num_transforms; ++i)
+        if (d->transforms[i].type == type) return stbi__err("bad transform", "Corrupt WebP");
+    ++d->num_transforms;
+    t->type = type;
+    t->xsize = *xsize;
+    t->bits = 0;
+    t->data = NULL;
+    switch (type) {
+        case STBI__VP8L_PREDICTOR:
+        case STBI__VP8L_CROSS_COLOR:
+            t->bits = stbi__vp8l_get(br, 3) + 2;
+            t->data = stbi__vp8l_decode_image(d, stbi__vp8l_subsample(t->xsize, t->bits), stbi__vp8l_subsample(ysize, t->bits), 0);
+            return t->data != NULL;
+        case STBI__VP8L_COLOR_INDEXING: {
+            // small palettes pack 2, 4 or 8 indices into one pixel's green
+            int n = stbi__vp8l_get(br, 8) + 1;
+            int bits = n > 16 ? 0 : n > 4 ? 1 : n > 2 ? 2 : 3;
+            int size = 1 << (8 >> bits);
+            stbi__uint32* palette = stbi__vp8l_decode_image(d, n, 1, 0);
+            if (!palette) return 0;
+            t->data = (stbi__uint32*)stbi__malloc_mad2(size, 4, 0);
+            if (!t->data) {
+                stbi__free(palette);
+                return stbi__err("outofmem", "Out of memory");
+            }
+            // palette entries are coded as per-channel deltas; unused entries are transparent black
+            memset(t->data, 0, size * 4);
+            t->data[0] = palette[0];
+            for (i = 1; i < n; ++i)
+                t->data[i] = (((palette[i] & 0xff00ff00u) + (t->data[i - 1] & 0xff00ff00u)) & 0xff00ff00u)
+                           | (((palette[i] & 0x00ff00ffu) + (t->data[i - 1] & 0x00ff00ffu)) & 0x00ff00ffu);
+            stbi__free(palette);
+            t->bits = bits;
+            *xsize = stbi__vp8l_subsample(*xsize, bits);
+            return 1;
+        }
+        default: // STBI__VP8L_SUBTRACT_GREEN has no data
+            return 1;
+    }
+}
+
+// Decodes an entropy-coded image. Only the main image (level0) carries transforms and
+// meta prefix codes; the returned buffer is big enough for it after all inverse transforms.
+static stbi__uint32* stbi__vp8l_decode_image(stbi__vp8l* d, int xsize, int ysize, int level0)
+{
+    stbi__vp8l_codes c;
+    stbi__uint32* data = NULL;
+    int width = xsize, ok = 0;
+
+    memset(&c, 0, sizeof(c));
+    if (level0)
+        while (stbi__vp8l_get(&d->br, 1))
+            if (!stbi__vp8l_read_transform(d, &width, ysize)) return NULL;
+    if (stbi__vp8l_get(&d->br, 1)) {
+        c.cache_bits = stbi__vp8l_get(&d->br, 4);
+        if (c.cache_bits < 1 || c.cache_bits > STBI__VP8L_MAX_CACHE_BITS) return (stbi__uint32*)stbi__errpuc("bad color cache", "Corrupt WebP");
+    }
+    if (stbi__vp8l_read_codes(d, &c, width, ysize, level0)) {
+        data = (stbi__uint32*)stbi__malloc_mad3(xsize, ysize, 4, 0);
+        if (c.cache_bits) c.cache = (stbi__uint32*)stbi__malloc_mad2(1 << c.cache_bits, 4, 0);
+        if (!data || (c.cache_bits && !c.cache)) {
+            stbi__err("outofmem", "Out of memory");
+        } else {
+            if (c.cache) memset(c.cache, 0, (size_t)4 << c.cache_bits);
+            ok = stbi__vp8l_decode_pixels(d, &c, data, width, ysize);
+        }
+    }
+    stbi__free(c.huffman_image);
+    stbi__free(c.groups);
+    stbi__free(c.values);
+    stbi__free(c.cache);
+    if (!ok) {
+        stbi__free(data);
+        return NULL;
+    }
+    return data;
+}
+
+//
+//  inverse transforms
+//
+
+static stbi__uint32 stbi__vp8l_add_pixels(stbi__uint32 a, stbi__uint32 b)
+{
+    return (((a & 0xff00ff00u) + (b & 0xff00ff00u)) & 0xff00ff00u) | (((a & 0x00ff00ffu) + (b & 0x00ff00ffu)) & 0x00ff00ffu);
+}
+
+static stbi__uint32 stbi__vp8l_average2(stbi__uint32 a, stbi__uint32 b)
+{
+    return (((a ^ b) & 0xfefefefeu) >> 1) + (a & b);
+}
+
+static int stbi__vp8l_clip255(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static stbi__uint32 stbi__vp8l_select(stbi__uint32 T, stbi__uint32 L, stbi__uint32 TL)
+{
+    // whichever of T and L is closer to the gradient estimate L + T - TL
+    int pl_minus_pt = 0, shift;
+    for (shift = 0; shift < 32; shift += 8) {
+        int t = (T >> shift) & 255, l = (L >> shift) & 255, tl = (TL >> shift) & 255;
+        pl_minus_pt += abs(l - tl) - abs(t - tl);
+    }
+    return pl_minus_pt <= 0 ? T : L;
+}
+
+static stbi__uint32 stbi__vp8l_clamp_add_sub_full(stbi__uint32 a, stbi__uint32 b, stbi__uint32 c)
+{
+    stbi__uint32 out = 0;
+    int shift;
+    for (shift = 0; shift < 32; shift += 8)
+        out |= (stbi__uint32)stbi__vp8l_clip255((int)((a >> shift) & 255) + (int)((b >> shift) & 255) - (int)((c >> shift) & 255)) << shift;
+    return out;
+}
+
+static stbi__uint32 stbi__vp8l_clamp_add_sub_half(stbi__uint32 avg, stbi__uint32 c)
+{
+    stbi__uint32 out = 0;
+    int shift;
+    for (shift = 0; shift < 32; shift += 8) {
+        int a = (avg >> shift) & 255, b = (c >> shift) & 255;
+        out |= (stbi__uint32)stbi__vp8l_clip255(a + (a - b) / 2) << shift;
+    }
+    return out;
+}
+
+// Adds the prediction of one mode to row[x..end-1]; top is the row above, whose element
+// past the end is the first pixel of the current row.
+static void stbi__vp8l_predict_run(int mode, stbi__uint32* row, const stbi__uint32* top, int x, int end)
+{
+#define STBI__VP8L_RUN(pred) for (; x < end; ++x) row[x] = stbi__vp8l_add_pixels(row[x], pred)
+    switch (mode) {
+        case 1: STBI__VP8L_RUN(row[x - 1]); break;
+        case 2: STBI__VP8L_RUN(top[x]); break;
+        case 3: STBI__VP8L_RUN(top[x + 1]); break;
+        case 4: STBI__VP8L_RUN(top[x - 1]); break;
+        case 5: STBI__VP8L_RUN(stbi__vp8l_average2(stbi__vp8l_average2(row[x - 1], top[x + 1]), top[x])); break;
+        case 6: STBI__VP8L_RUN(stbi__vp8l_average2(row[x - 1], top[x - 1])); break;
+        case 7: STBI__VP8L_RUN(stbi__vp8l_average2(row[x - 1], top[x])); break;
+        case 8: STBI__VP8L_RUN(stbi__vp8l_average2(top[x - 1], top[x])); break;
+        case 9: STBI__VP8L_RUN(stbi__vp8l_average2(top[x], top[x + 1])); break;
+        case 10: STBI__VP8L_RUN(stbi__vp8l_average2(stbi__vp8l_average2(row[x - 1], top[x - 1]), stbi__vp8l_average2(top[x], top[x + 1]))); break;
+        case 11: STBI__VP8L_RUN(stbi__vp8l_select(top[x], row[x - 1], top[x - 1])); break;
+        case 12: STBI__VP8L_RUN(stbi__vp8l_clamp_add_sub_full(row[x - 1], top[x], top[x - 1])); break;
+        case 13: STBI__VP8L_RUN(stbi__vp8l_clamp_add_sub_half(stbi__vp8l_average2(row[x - 1], top[x]), top[x - 1])); break;
+        default: STBI__VP8L_RUN(0xff000000u); break; // 0, and the undefined 14 and 15
+    }
+#undef STBI__VP8L_RUN
+}
+
+static void stbi__vp8l_inverse_transform(const stbi__vp8l_transform* t, stbi__uint32* data, int ysize)
+{
+    const int w = t->xsize;
+    const int tiles_per_row = stbi__vp8l_subsample(w, t->bits);
+    int x, y;
+    switch (t->type) {
+        case STBI__VP8L_PREDICTOR:
+            data[0] = stbi__vp8l_add_pixels(data[0], 0xff000000u);
+            for (x = 1; x < w; ++x) data[x] = stbi__vp8l_add_pixels(data[x], data[x - 1]);
+            for (y = 1; y < ysize; ++y) {
+                stbi__uint32* row = data + (size_t)y * w;
+                const stbi__uint32* modes = t->data + (y >> t->bits) * tiles_per_row;
+                row[0] = stbi__vp8l_add_pixels(row[0], row[-w]);
+                // one mode per tile
+                for (x = 1; x < w;) {
+                    int end = ((x >> t->bits) + 1) << t->bits;
+                    if (end > w) end = w;
+                    stbi__vp8l_predict_run((modes[x >> t->bits] >> 8) & 15, row, row - w, x, end);
+                    x = end;
                 }
-                else {
-                    stbi__skip(s, len);
-                    break;
+            }
+            break;
+        case STBI__VP8L_CROSS_COLOR:
+            for (y = 0; y < ysize; ++y) {
+                stbi__uint32* row = data + (size_t)y * w;
+                const stbi__uint32* m = t->data + (y >> t->bits) * tiles_per_row;
+                for (x = 0; x < w; ++x) {
+                    const stbi__uint32 code = m[x >> t->bits];
+                    const stbi__uint32 argb = row[x];
+                    const int green = (signed char)(argb >> 8);
+                    int red = (argb >> 16) & 255, blue = argb & 255;
+                    red += ((signed char)code * green) >> 5;
+                    red &= 255;
+                    blue += ((signed char)(code >> 8) * green) >> 5;
+                    blue += ((signed char)(code >> 16) * (signed char)red) >> 5;
+                    row[x] = (argb & 0xff00ff00u) | ((stbi__uint32)red << 16) | (blue & 255);
                 }
             }
-            while ((len = stbi__get8(s)) != 0) {
-                stbi__skip(s, len);
+            break;
+        case STBI__VP8L_SUBTRACT_GREEN:
+            for (x = 0; x < w * ysize; ++x) {
+                const stbi__uint32 green = (data[x] >> 8) & 255;
+                data[x] = (data[x] & 0xff00ff00u) | (((data[x] & 0x00ff00ffu) + ((green << 16) | green)) & 0x00ff00ffu);
+            }
+            break;
+        default: { // STBI__VP8L_COLOR_INDEXING
+            // expands in place from the end: the packed rows are never longer than the output rows
+            const int packed_w = stbi__vp8l_subsample(w, t->bits);
+            const int bits_per_index = 8 >> t->bits;
+            const int index_mask = (1 << bits_per_index) - 1;
+            const int x_mask = (1 << t->bits) - 1;
+            for (y = ysize - 1; y >= 0; --y) {
+                const stbi__uint32* in = data + (size_t)y * packed_w;
+                stbi__uint32* out = data + (size_t)y * w;
+                for (x = w - 1; x >= 0; --x)
+                    out[x] = t->data[((in[x >> t->bits] >> 8) >> ((x & x_mask) * bits_per_index)) & index_mask];
             }
             break;
-        }
-
-        case 0x3B: // gif stream termination code
-            return (stbi_uc*)s; // using '1' causes warning on some compilers
-
-        default:
-            return stbi__errpuc("unknown code", "Corrupt GIF");
         }
     }
 }
 
-static void* stbi__load_gif_main_outofmem(stbi__gif* g, stbi_uc* out, int** delays)
+static stbi__uint32* stbi__vp8l_decode_argb(const stbi_uc* data, int len, int w, int h)
 {
-    STBI_FREE(g->out);
-    STBI_FREE(g->history);
-    STBI_FREE(g->background);
+    stbi__vp8l d;
+    stbi__uint32* argb;
+    int i;
 
-    if (out) STBI_FREE(out);
-    if (delays && *delays) STBI_FREE(*delays);
-    return stbi__errpuc("outofmem", "Out of memory");
+    memset(&d, 0, sizeof(d));
+    d.br.buf = data;
+    d.br.buf_end = data + len;
+    argb = stbi__vp8l_decode_image(&d, w, h, 1);
+    if (argb)
+        for (i = d.num_transforms - 1; i >= 0; --i)
+            stbi__vp8l_inverse_transform(&d.transforms[i], argb, h);
+    for (i = 0; i < d.num_transforms; ++i)
+        stbi__free(d.transforms[i].data);
+    return argb;
+}
+
+static int stbi__vp8l_decode_rgba(const stbi_uc* data, int len, stbi_uc* out, int w, int h)
+{
+    stbi__uint32* argb;
+    size_t i, n = (size_t)w * h;
+    // the 5-byte header was validated by stbi__webp_parse
+    argb = stbi__vp8l_decode_argb(data + 5, len - 5, w, h);
+    if (!argb) return 0;
+    for (i = 0; i < n; ++i) {
+        const stbi__uint32 p = argb[i];
+        out[4 * i + 0] = (stbi_uc)(p >> 16);
+        out[4 * i + 1] = (stbi_uc)(p >> 8);
+        out[4 * i + 2] = (stbi_uc)p;
+        out[4 * i + 3] = (stbi_uc)(p >> 24);
+    }
+    stbi__free(argb);
+    return 1;
 }
 
-static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
-{
-    if (stbi__gif_test(s)) {
-        int layers = 0;
-        stbi_uc* u = 0;
-        stbi_uc* out = 0;
-        stbi_uc* two_back = 0;
-        stbi__gif g;
-        int stride;
-        int out_size = 0;
-        int delays_size = 0;
+// ALPH chunk of a lossy image: raw or VP8L-compressed (in the green channel), optionally
+// with a spatial prediction filter
+static int stbi__webp_decode_alpha(const stbi_uc* data, int len, stbi_uc* out, int w, int h)
+{
+    stbi_uc* plane;
+    size_t i, n = (size_t)w * h;
+    int method, filter, x, y;
+
+    if (len < 1) return stbi__err("bad alpha", "Corrupt WebP");
+    method = data[0] & 3;
+    filter = (data[0] >> 2) & 3;
+    if (method > 1 || (data[0] >> 4) > 1) return stbi__err("bad alpha", "Corrupt WebP");
+    plane = (stbi_uc*)stbi__malloc(n);
+    if (!plane) return stbi__err("outofmem", "Out of memory");
+    if (method == 0) {
+        if ((size_t)(len - 1) < n) {
+            stbi__free(plane);
+            return stbi__err("truncated", "Corrupt WebP");
+        }
+        memcpy(plane, data + 1, n);
+    } else {
+        stbi__uint32* argb = stbi__vp8l_decode_argb(data + 1, len - 1, w, h);
+        if (!argb) {
+            stbi__free(plane);
+            return 0;
+        }
+        for (i = 0; i < n; ++i) plane[i] = (stbi_uc)(argb[i] >> 8);
+        stbi__free(argb);
+    }
+
+    // undo the filter in place; the first row always predicts horizontally
+    if (filter) {
+        for (y = 0; y < h; ++y) {
+            stbi_uc* row = plane + (size_t)y * w;
+            const stbi_uc* prev = row - w;
+            if (y == 0 || filter == 1) {
+                int pred = y == 0 ? 0 : prev[0];
+                for (x = 0; x < w; ++x) pred = row[x] = (stbi_uc)(row[x] + pred);
+            } else if (filter == 2) {
+                for (x = 0; x < w; ++x) row[x] = (stbi_uc)(row[x] + prev[x]);
+            } else {
+                int left = prev[0];
+                for (x = 0; x < w; ++x) {
+                    // x == 0 predicts from the pixel above, like the other filters
+                    int grad = x == 0 ? prev[0] : left + prev[x] - prev[x - 1];
+                    left = row[x] = (stbi_uc)(row[x] + (grad < 0 ? 0 : grad > 255 ? 255 : grad));
+                }
+            }
+        }
+    }
+    for (i = 0; i < n; ++i) out[4 * i + 3] = plane[i];
+    stbi__free(plane);
+    return 1;
+}
 
-        STBI_NOTUSED(out_size);
-        STBI_NOTUSED(delays_size);
+//////////////////////////////////////////////////////////////////////////////
+//
+//  RIFF container
+//
 
-        memset(&g, 0, sizeof(g));
-        if (delays) {
-            *delays = 0;
-        }
+#define STBI__WEBP_TAG(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
-        do {
-            u = stbi__gif_load_next(s, &g, comp, req_comp, two_back);
-            if (u == (stbi_uc*)s) u = 0;  // end of animated gif marker
+static int stbi__webp_test(stbi__context* s)
+{
+    int r = stbi__get32be(s) == STBI__WEBP_TAG('R', 'I', 'F', 'F');
+    stbi__get32le(s);
+    r = r && stbi__get32be(s) == STBI__WEBP_TAG('W', 'E', 'B', 'P');
+    stbi__rewind(s);
+    return r;
+}
 
-            if (u) {
-                *x = g.w;
-                *y = g.h;
-                ++layers;
-                stride = g.w * g.h * 4;
+static void stbi__webp_cleanup(stbi__webp* p)
+{
+    stbi__free(p->data);
+    stbi__free(p->alpha);
+    p->data = p->alpha = NULL;
+}
 
-                if (out) {
-                    void* tmp = (stbi_uc*)STBI_REALLOC_SIZED(out, out_size, layers * stride);
-                    if (!tmp)
-                        return stbi__load_gif_main_outofmem(&g, out, delays);
-                    else {
-                        out = (stbi_uc*)tmp;
-                        out_size = layers * stride;
-                    }
+static int stbi__webp_parse_chunks(stbi__context* s, stbi__webp* p, int header_only)
+{
+    int canvas_w = 0, canvas_h = 0, extended = 0;
+    if (stbi__get32be(s) != STBI__WEBP_TAG('R', 'I', 'F', 'F')) return stbi__err("not WebP", "Corrupt WebP");
+    stbi__get32le(s); // file size
+    if (stbi__get32be(s) != STBI__WEBP_TAG('W', 'E', 'B', 'P')) return stbi__err("not WebP", "Corrupt WebP");
 
-                    if (delays) {
-                        int* new_delays = (int*)STBI_REALLOC_SIZED(*delays, delays_size, sizeof(int) * layers);
-                        if (!new_delays)
-                            return stbi__load_gif_main_outofmem(&g, out, delays);
-                        *delays = new_delays;
-                        delays_size = layers * sizeof(int);
-                    }
-                }
-                else {
-                    out = (stbi_uc*)stbi__malloc(layers * stride);
-                    if (!out)
-                        return stbi__load_gif_main_outofmem(&g, out, delays);
-                    out_size = layers * stride;
-                    if (delays) {
-                        *delays = (int*)stbi__malloc(layers * sizeof(int));
-                        if (!*delays)
-                            return stbi__load_gif_main_outofmem(&g, out, delays);
-                        delays_size = layers * sizeof(int);
-                    }
-                }
-                memcpy(out + ((layers - 1) * stride), u, stride);
-                if (layers >= 2) {
-                    two_back = out - 2 * stride;
+    for (;;) {
+        stbi__uint32 tag, size;
+        if (stbi__at_eof(s)) return stbi__err("no image data", "Corrupt WebP");
+        tag = stbi__get32be(s);
+        size = stbi__get32le(s);
+        if (size > (1u << 30)) return stbi__err("bad chunk size", "Corrupt WebP");
+        switch (tag) {
+            case STBI__WEBP_TAG('V', 'P', '8', 'X'): {
+                int flags;
+                if (size < 10) return stbi__err("bad VP8X", "Corrupt WebP");
+                flags = stbi__get8(s);
+                if (flags & 0x02) return stbi__err("animated WebP", "WebP animations are not supported");
+                p->has_alpha |= (flags & 0x10) != 0;
+                stbi__skip(s, 3);
+                canvas_w = stbi__get16le(s);
+                canvas_w += (stbi__get8(s) << 16) + 1;
+                canvas_h = stbi__get16le(s);
+                canvas_h += (stbi__get8(s) << 16) + 1;
+                extended = 1;
+                stbi__skip(s, (int)(size - 10 + (size & 1)));
+                break;
+            }
+
+            case STBI__WEBP_TAG('A', 'L', 'P', 'H'):
+                p->has_alpha = 1;
+                if (!p->alpha && !header_only) {
+                    p->alpha = (stbi_uc*)stbi__malloc(size ? size : 1);
+                    if (!p->alpha) return stbi__err("outofmem", "Out of memory");
+                    p->alpha_len = (int)size;
+                    if (!stbi__getn(s, p->alpha, (int)size)) return stbi__err("truncated", "Corrupt WebP");
+                    stbi__skip(s, (int)(size & 1));
+                } else {
+                    stbi__skip(s, (int)(size + (size & 1)));
                 }
+                break;
 
-                if (delays) {
-                    (*delays)[layers - 1U] = g.delay;
+            case STBI__WEBP_TAG('V', 'P', '8', ' '):
+            case STBI__WEBP_TAG('V', 'P', '8', 'L'): {
+                stbi_uc header[10];
+                const stbi_uc* hdr = header;
+                p->lossless = tag == STBI__WEBP_TAG('V', 'P', '8', 'L');
+                if (size < (stbi__uint32)(p->lossless ? 5 : 10)) return stbi__err("truncated", "Corrupt WebP");
+                if (header_only) {
+                    if (!stbi__getn(s, header, p->lossless ? 5 : 10)) return stbi__err("truncated", "Corrupt WebP");
+                } else {
+                    p->data = (stbi_uc*)stbi__malloc(size);
+                    p->len = (int)size;
+                    if (!p->data) return stbi__err("outofmem", "Out of memory");
+                    if (!stbi__getn(s, p->data, (int)size)) return stbi__err("truncated", "Corrupt WebP");
+                    hdr = p->data;
+                }
+                if (p->lossless) {
+                    stbi__uint32 bits = hdr[1] | (hdr[2] << 8) | (hdr[3] << 16) | ((stbi__uint32)hdr[4] << 24);
+                    if (hdr[0] != 0x2f || (bits >> 29) != 0) return stbi__err("bad VP8L header", "Corrupt WebP");
+                    p->w = (bits & 0x3fff) + 1;
+                    p->h = ((bits >> 14) & 0x3fff) + 1;
+                    if (!extended) p->has_alpha |= (bits >> 28) & 1;
+                } else {
+                    if (hdr[3] != 0x9d || hdr[4] != 0x01 || hdr[5] != 0x2a) return stbi__err("bad VP8 header", "Corrupt WebP");
+                    p->w = (hdr[6] | (hdr[7] << 8)) & 0x3fff;
+                    p->h = (hdr[8] | (hdr[9] << 8)) & 0x3fff;
+                    if (p->w == 0 || p->h == 0) return stbi__err("0-pixel image", "Corrupt WebP");
                 }
+                if (extended && (canvas_w != p->w || canvas_h != p->h)) return stbi__err("bad dimensions", "Corrupt WebP");
+                if (p->w > STBI_MAX_DIMENSIONS || p->h > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
+                return 1;
             }
-        } while (u != 0);
-
-        // free temp buffer;
-        STBI_FREE(g.out);
-        STBI_FREE(g.history);
-        STBI_FREE(g.background);
 
-        // do the final conversion after loading everything;
-        if (req_comp && req_comp != 4)
-            out = stbi__convert_format(out, 4, req_comp, layers * g.w, g.h);
+            case STBI__WEBP_TAG('A', 'N', 'I', 'M'):
+            case STBI__WEBP_TAG('A', 'N', 'M', 'F'):
+                return stbi__err("animated WebP", "WebP animations are not supported");
 
-        *z = layers;
-        return out;
-    }
-    else {
-        return stbi__errpuc("not GIF", "Image was not as a gif type.");
+            default:
+                // ICCP, EXIF, XMP and unknown chunks
+                stbi__skip(s, (int)(size + (size & 1)));
+                break;
+        }
     }
 }
 
-static void* stbi__gif_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+// Walks the chunks up to the image data and reads the dimensions. With header_only, only
+// the first bytes of the image chunk are read.
+static int stbi__webp_parse(stbi__context* s, stbi__webp* p, int header_only)
 {
-    stbi_uc* u = 0;
-    stbi__gif g;
-    memset(&g, 0, sizeof(g));
-    STBI_NOTUSED(ri);
+    memset(p, 0, sizeof(*p));
+    if (stbi__webp_parse_chunks(s, p, header_only)) return 1;
+    stbi__webp_cleanup(p);
+    return 0;
+}
 
-    u = stbi__gif_load_next(s, &g, comp, req_comp, 0);
-    if (u == (stbi_uc*)s) u = 0;  // end of animated gif marker
-    if (u) {
-        *x = g.w;
-        *y = g.h;
+static void* stbi__webp_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+{
+    stbi__webp p;
+    stbi_uc* out;
+    int ok, n;
+    STBI_NOTUSED(ri);
 
-        // moved conversion to after successful load so that the same
-        // can be done for multiple frames.
-        if (req_comp && req_comp != 4)
-            u = stbi__convert_format(u, 4, req_comp, g.w, g.h);
+    if (!stbi__webp_parse(s, &p, 0)) return NULL;
+    out = (stbi_uc*)stbi__malloc_mad3(p.w, p.h, 4, 0);
+    if (!out) {
+        stbi__webp_cleanup(&p);
+        return stbi__errpuc("outofmem", "Out of memory");
     }
-    else if (g.out) {
-        // if there was an error and we allocated an image buffer, free it!
-        STBI_FREE(g.out);
+    if (p.lossless) {
+        ok = stbi__vp8l_decode_rgba(p.data, p.len, out, p.w, p.h);
+    } else {
+        ok = stbi__vp8_decode(p.data, p.len, out, p.w, p.h);
+        if (ok && p.alpha) ok = stbi__webp_decode_alpha(p.alpha, p.alpha_len, out, p.w, p.h);
+    }
+    stbi__webp_cleanup(&p);
+    if (!ok) {
+        stbi__free(out);
+        return NULL;
     }
 
-    // free buffers needed for multiple frame loading;
-    STBI_FREE(g.history);
-    STBI_FREE(g.background);
-
-    return u;
+    n = p.has_alpha ? 4 : 3;
+    *x = p.w;
+    *y = p.h;
+    if (comp) *comp = n;
+    if (!req_comp) req_comp = n;
+    if (req_comp != 4) out = stbi__convert_format(out, 4, req_comp, p.w, p.h);
+    return out;
 }
 
-static int stbi__gif_info(stbi__context* s, int* x, int* y, int* comp)
+static int stbi__webp_info(stbi__context* s, int* x, int* y, int* comp)
 {
-    return stbi__gif_info_raw(s, x, y, comp);
+    stbi__webp p;
+    if (!stbi__webp_parse(s, &p, 1)) {
+        stbi__rewind(s);
+        return 0;
+    }
+    if (x) *x = p.w;
+    if (y) *y = p.h;
+    if (comp) *comp = p.has_alpha ? 4 : 3;
+    return 1;
 }
-#endif
+
+#endif // STBI_NO_WEBP
 
 // *************************************************************************************************
 // Radiance RGBE HDR loader
@@ -7266,6 +12584,176 @@ static void stbi__hdr_convert(float* output, stbi_uc* input, int req_comp)
     }
 }
 
+// the SIMD conversions below take a scanline as planes of width bytes each of R, G, B
+// and E. they build 2^(e-128) from its bits and scale the mantissas by 2^-8 first, which
+// gives exactly the products stbi__hdr_convert gets from ldexp; groups of 16 pixels
+// holding an exponent whose factor would be denormal are left to stbi__hdr_convert
+#ifdef STBI_SSE2
+static int stbi__hdr_convert_planes_sse2(float* output, stbi_uc const* planes, int width, int req_comp)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one8 = _mm_set1_epi8(1);
+    const __m128i one32 = _mm_set1_epi32(1);
+    const __m128 mantissa_scale = _mm_set1_ps(1.0f / 256.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+    const __m128 opaque = _mm_set1_ps(1.0f);
+    int i, p, k, c;
+    for (i = 0; i + 16 <= width; i += 16) {
+        __m128i ch[4][4];
+        __m128i e8 = _mm_loadu_si128((const __m128i*)(planes + 3 * width + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(e8, one8))) {
+            for (p = i; p < i + 16; ++p) {
+                stbi_uc rgbe[4];
+                rgbe[0] = planes[p]; rgbe[1] = planes[width + p]; rgbe[2] = planes[2 * width + p]; rgbe[3] = planes[3 * width + p];
+                stbi__hdr_convert(output + p * req_comp, rgbe, req_comp);
+            }
+            continue;
+        }
+        // widen each plane to four vectors of four 32-bit values
+        for (c = 0; c < 4; ++c) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(planes + c * width + i));
+            __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+            ch[c][0] = _mm_unpacklo_epi16(lo, zero);
+            ch[c][1] = _mm_unpackhi_epi16(lo, zero);
+            ch[c][2] = _mm_unpacklo_epi16(hi, zero);
+            ch[c][3] = _mm_unpackhi_epi16(hi, zero);
+        }
+        for (k = 0; k < 4; ++k) {
+            float* out = output + (i + k * 4) * req_comp;
+            __m128i e = ch[3][k];
+            // 2^(e-128), or 0 for e == 0
+            __m128 factor = _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(e, one32), 23), _mm_cmpgt_epi32(e, zero)));
+            if (req_comp <= 2) {
+                __m128i sum = _mm_add_epi32(_mm_add_epi32(ch[0][k], ch[1][k]), ch[2][k]);
+                __m128 y = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), mantissa_scale), factor), three);
+                if (req_comp == 1) {
+                    _mm_storeu_ps(out, y);
+                }
+                else {
+                    _mm_storeu_ps(out, _mm_unpacklo_ps(y, opaque));
+                    _mm_storeu_ps(out + 4, _mm_unpackhi_ps(y, opaque));
+                }
+            }
+            else {
+                __m128 r = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(ch[0][k]), mantissa_scale), factor);
+                __m128 g = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(ch[1][k]), mantissa_scale), factor);
+                __m128 b = _mm_mul_ps(_mm_mul_ps(_mm_cvtepi32_ps(ch[2][k]), mantissa_scale), factor);
+                __m128 a = opaque;
+                _MM_TRANSPOSE4_PS(r, g, b, a);
+                if (req_comp == 4) {
+                    _mm_storeu_ps(out, r);
+                    _mm_storeu_ps(out + 4, g);
+                    _mm_storeu_ps(out + 8, b);
+                    _mm_storeu_ps(out + 12, a);
+                }
+                else {
+                    // each store's fourth float is overwritten by the next pixel; the last
+                    // pixel is stored as three so nothing lands past the group
+                    _mm_storeu_ps(out, r);
+                    _mm_storeu_ps(out + 3, g);
+                    _mm_storeu_ps(out + 6, b);
+                    _mm_storel_pi((__m64*)(out + 9), a);
+                    _mm_store_ss(out + 11, _mm_movehl_ps(a, a));
+                }
+            }
+        }
+    }
+    return i;
+}
+#endif
+
+#ifdef STBI_NEON
+// 3 and 4 channels only: there is no exact vector divide for luminance on 32-bit ARM, whose
+// NEON also flushes denormals, so groups with any exponent below 24 stay scalar here
+static int stbi__hdr_convert_planes_neon(float* output, stbi_uc const* planes, int width, int req_comp)
+{
+    const float32x4_t mantissa_scale = vdupq_n_f32(1.0f / 256.0f);
+    int i, p, k;
+    if (req_comp < 3) return 0;
+    for (i = 0; i + 16 <= width; i += 16) {
+        uint8x16_t r8 = vld1q_u8(planes + i);
+        uint8x16_t g8 = vld1q_u8(planes + width + i);
+        uint8x16_t b8 = vld1q_u8(planes + 2 * width + i);
+        uint8x16_t e8 = vld1q_u8(planes + 3 * width + i);
+        uint64x2_t small = vreinterpretq_u64_u8(vandq_u8(vcltq_u8(e8, vdupq_n_u8(24)), vcgtq_u8(e8, vdupq_n_u8(0))));
+        uint16x8_t r16[2], g16[2], b16[2], e16[2];
+        if (vgetq_lane_u64(small, 0) | vgetq_lane_u64(small, 1)) {
+            for (p = i; p < i + 16; ++p) {
+                stbi_uc rgbe[4];
+                rgbe[0] = planes[p]; rgbe[1] = planes[width + p]; rgbe[2] = planes[2 * width + p]; rgbe[3] = planes[3 * width + p];
+                stbi__hdr_convert(output + p * req_comp, rgbe, req_comp);
+            }
+            continue;
+        }
+        r16[0] = vmovl_u8(vget_low_u8(r8)); r16[1] = vmovl_u8(vget_high_u8(r8));
+        g16[0] = vmovl_u8(vget_low_u8(g8)); g16[1] = vmovl_u8(vget_high_u8(g8));
+        b16[0] = vmovl_u8(vget_low_u8(b8)); b16[1] = vmovl_u8(vget_high_u8(b8));
+        e16[0] = vmovl_u8(vget_low_u8(e8)); e16[1] = vmovl_u8(vget_high_u8(e8));
+        for (k = 0; k < 4; ++k) {
+            float* out = output + (i + k * 4) * req_comp;
+            uint32x4_t e = (k & 1) ? vmovl_u16(vget_high_u16(e16[k >> 1])) : vmovl_u16(vget_low_u16(e16[k >> 1]));
+            uint32x4_t r = (k & 1) ? vmovl_u16(vget_high_u16(r16[k >> 1])) : vmovl_u16(vget_low_u16(r16[k >> 1]));
+            uint32x4_t g = (k & 1) ? vmovl_u16(vget_high_u16(g16[k >> 1])) : vmovl_u16(vget_low_u16(g16[k >> 1]));
+            uint32x4_t b = (k & 1) ? vmovl_u16(vget_high_u16(b16[k >> 1])) : vmovl_u16(vget_low_u16(b16[k >> 1]));
+            float32x4_t factor = vreinterpretq_f32_u32(vandq_u32(vshlq_n_u32(vsubq_u32(e, vdupq_n_u32(1)), 23), vcgtq_u32(e, vdupq_n_u32(0))));
+            float32x4_t rf = vmulq_f32(vmulq_f32(vcvtq_f32_u32(r), mantissa_scale), factor);
+            float32x4_t gf = vmulq_f32(vmulq_f32(vcvtq_f32_u32(g), mantissa_scale), factor);
+            float32x4_t bf = vmulq_f32(vmulq_f32(vcvtq_f32_u32(b), mantissa_scale), factor);
+            if (req_comp == 4) {
+                float32x4x4_t v4;
+                v4.val[0] = rf; v4.val[1] = gf; v4.val[2] = bf; v4.val[3] = vdupq_n_f32(1.0f);
+                vst4q_f32(out, v4);
+            }
+            else {
+                float32x4x3_t v3;
+                v3.val[0] = rf; v3.val[1] = gf; v3.val[2] = bf;
+                vst3q_f32(out, v3);
+            }
+        }
+    }
+    return i;
+}
+#endif
+
+static void stbi__hdr_convert_planes(float* output, stbi_uc const* planes, int width, int req_comp)
+{
+    int i = 0;
+#ifdef STBI_SSE2
+    if (stbi__sse2_available())
+        i = stbi__hdr_convert_planes_sse2(output, planes, width, req_comp);
+#endif
+#ifdef STBI_NEON
+    i = stbi__hdr_convert_planes_neon(output, planes, width, req_comp);
+#endif
+    for (; i < width; ++i) {
+        stbi_uc rgbe[4];
+        rgbe[0] = planes[i];
+        rgbe[1] = planes[width + i];
+        rgbe[2] = planes[2 * width + i];
+        rgbe[3] = planes[3 * width + i];
+        stbi__hdr_convert(output + i * req_comp, rgbe, req_comp);
+    }
+}
+
+// n bytes as a run of stbi__get8 would read them, zeros past the end included, but copied
+// out of the buffer in blocks
+static void stbi__hdr_getn(stbi__context* s, stbi_uc* buffer, int n)
+{
+    while (n > 0) {
+        int available = (int)(s->img_buffer_end - s->img_buffer);
+        if (available == 0) {
+            *buffer++ = stbi__get8(s);
+            --n;
+            continue;
+        }
+        if (available > n) available = n;
+        memcpy(buffer, s->img_buffer, available);
+        s->img_buffer += available;
+        buffer += available;
+        n -= available;
+    }
+}
+
 static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
 {
     char buffer[STBI__HDR_BUFLEN];
@@ -7276,7 +12764,7 @@ static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int re
     float* hdr_data;
     int len;
     unsigned char count, value;
-    int i, j, k, c1, c2, z;
+    int i, j, k, c1, c2;
     const char* headerToken;
     STBI_NOTUSED(ri);
 
@@ -7354,21 +12842,24 @@ static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int re
                 stbi__hdr_convert(hdr_data, rgbe, req_comp);
                 i = 1;
                 j = 0;
-                STBI_FREE(scanline);
+                stbi__free(scanline);
                 goto main_decode_loop; // yes, this makes no sense
             }
             len <<= 8;
             len |= stbi__get8(s);
-            if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
+            if (len != width) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
             if (scanline == NULL) {
                 scanline = (stbi_uc*)stbi__malloc_mad2(width, 4, 0);
                 if (!scanline) {
-                    STBI_FREE(hdr_data);
+                    stbi__free(hdr_data);
                     return stbi__errpf("outofmem", "Out of memory");
                 }
             }
 
+            // each channel is decoded into its own plane, so runs and dumps are block fills
+            // and copies, and the planes feed the SIMD conversion directly
             for (k = 0; k < 4; ++k) {
+                stbi_uc* plane = scanline + k * width;
                 int nleft;
                 i = 0;
                 while ((nleft = width - i) > 0) {
@@ -7377,23 +12868,21 @@ static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int re
                         // Run
                         value = stbi__get8(s);
                         count -= 128;
-                        if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                        for (z = 0; z < count; ++z)
-                            scanline[i++ * 4 + k] = value;
+                        if ((count == 0) || (count > nleft)) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                        memset(plane + i, value, count);
                     }
                     else {
                         // Dump
-                        if ((count == 0) || (count > nleft)) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-                        for (z = 0; z < count; ++z)
-                            scanline[i++ * 4 + k] = stbi__get8(s);
+                        if ((count == 0) || (count > nleft)) { stbi__free(hdr_data); stbi__free(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
+                        stbi__hdr_getn(s, plane + i, count);
                     }
+                    i += count;
                 }
             }
-            for (i = 0; i < width; ++i)
-                stbi__hdr_convert(hdr_data + (j * width + i) * req_comp, scanline + i * 4, req_comp);
+            stbi__hdr_convert_planes(hdr_data + (size_t)j * width * req_comp, scanline, width, req_comp);
         }
         if (scanline)
-            STBI_FREE(scanline);
+            stbi__free(scanline);
     }
 
     return hdr_data;
@@ -7638,7 +13127,7 @@ static void* stbi__pnm_load(stbi__context* s, int* x, int* y, int* comp, int req
     out = (stbi_uc*)stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
     if (!out) return stbi__errpuc("outofmem", "Out of memory");
     if (!stbi__getn(s, out, s->img_n * s->img_x * s->img_y * (ri->bits_per_channel / 8))) {
-        STBI_FREE(out);
+        stbi__free(out);
         return stbi__errpuc("bad PNM", "PNM file truncated");
     }
 
@@ -7769,6 +13258,10 @@ static int stbi__info_main(stbi__context* s, int* x, int* y, int* comp)
     if (stbi__pic_info(s, x, y, comp))  return 1;
 #endif
 
+#ifndef STBI_NO_WEBP
+    if (stbi__webp_info(s, x, y, comp))  return 1;
+#endif
+
 #ifndef STBI_NO_PNM
     if (stbi__pnm_info(s, x, y, comp))  return 1;
 #endif
@@ -7843,6 +13336,162 @@ STBIDEF int stbi_is_16_bit_from_file(FILE* f)
     fseek(f, pos, SEEK_SET);
     return r;
 }
+
+enum
+{
+    STBI__FORMAT_unknown,
+    STBI__FORMAT_jpeg,
+    STBI__FORMAT_png,
+    STBI__FORMAT_gif,
+    STBI__FORMAT_bmp,
+    STBI__FORMAT_psd,
+    STBI__FORMAT_pic,
+    STBI__FORMAT_webp,
+    STBI__FORMAT_pnm,
+    STBI__FORMAT_hdr
+};
+
+// identify the format from the signature at the start of the buffer, without consuming
+// anything. TGA has no signature, so it's left to stbi__info_main like anything unknown
+static int stbi__sniff_format(stbi__context* s)
+{
+    stbi_uc const* b = s->img_buffer;
+    int n = (int)(s->img_buffer_end - s->img_buffer);
+    if (n >= 3 && b[0] == 0xff && b[1] == 0xd8 && b[2] == 0xff)       return STBI__FORMAT_jpeg;
+    if (n >= 8 && memcmp(b, "\x89PNG\r\n\x1a\n", 8) == 0)                return STBI__FORMAT_png;
+    if (n >= 4 && memcmp(b, "GIF8", 4) == 0)                           return STBI__FORMAT_gif;
+    if (n >= 2 && b[0] == 'B' && b[1] == 'M')                          return STBI__FORMAT_bmp;
+    if (n >= 4 && memcmp(b, "8BPS", 4) == 0)                           return STBI__FORMAT_psd;
+    if (n >= 4 && memcmp(b, "\x53\x80\xf6\x34", 4) == 0)               return STBI__FORMAT_pic;
+    if (n >= 12 && memcmp(b, "RIFF", 4) == 0 && memcmp(b + 8, "WEBP", 4) == 0) return STBI__FORMAT_webp;
+    if (n >= 2 && b[0] == 'P' && (b[1] == '5' || b[1] == '6'))         return STBI__FORMAT_pnm;
+    if (n >= 2 && b[0] == '#' && b[1] == '?')                          return STBI__FORMAT_hdr;
+    return STBI__FORMAT_unknown;
+}
+
+// same answers as stbi__info_main, stbi__is_16_main and stbi__hdr_test, but reading the
+// header once: signatures don't overlap, so the sniffed format is the only one whose info
+// routine can succeed. a damaged file the sniffed routine rejects gets the full probe
+static int stbi__info_sniffed(stbi__context* s, stbi_info_result* r)
+{
+    int ok = 0;
+    switch (stbi__sniff_format(s)) {
+#ifndef STBI_NO_JPEG
+    case STBI__FORMAT_jpeg:
+        ok = stbi__jpeg_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_PNG
+    case STBI__FORMAT_png:
+    {
+        stbi__png p;
+        p.s = s;
+        ok = stbi__png_info_raw(&p, &r->x, &r->y, &r->channels);
+        r->is_16_bit = ok && p.depth == 16;
+        break;
+    }
+#endif
+#ifndef STBI_NO_GIF
+    case STBI__FORMAT_gif:
+        ok = stbi__gif_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_BMP
+    case STBI__FORMAT_bmp:
+        ok = stbi__bmp_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_PSD
+    case STBI__FORMAT_psd:
+        // the depth is read first: the info routine may leave the first buffer behind
+        r->is_16_bit = stbi__psd_is16(s);
+        stbi__rewind(s);
+        ok = stbi__psd_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_PIC
+    case STBI__FORMAT_pic:
+        ok = stbi__pic_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_WEBP
+    case STBI__FORMAT_webp:
+        ok = stbi__webp_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+#ifndef STBI_NO_PNM
+    case STBI__FORMAT_pnm:
+    {
+        int bits = stbi__pnm_info(s, &r->x, &r->y, &r->channels);
+        ok = bits != 0;
+        r->is_16_bit = bits == 16;
+        break;
+    }
+#endif
+#ifndef STBI_NO_HDR
+    case STBI__FORMAT_hdr:
+        r->is_hdr = stbi__hdr_test(s);
+        ok = stbi__hdr_info(s, &r->x, &r->y, &r->channels);
+        break;
+#endif
+    default:
+        break;
+    }
+    if (!ok) {
+        stbi__rewind(s);
+        ok = stbi__info_main(s, &r->x, &r->y, &r->channels);
+    }
+    return ok;
+}
+
+typedef struct
+{
+    char const* const* filenames;
+    stbi_info_result* results;
+    int count;
+} stbi__info_batch;
+
+// files per parallel task; opening a file costs far more than handing out a task
+#define STBI__INFO_BATCH_FILES 64
+
+static void stbi__info_batch_task(void* task_data, int index)
+{
+    stbi__info_batch* batch = (stbi__info_batch*)task_data;
+    int i = index * STBI__INFO_BATCH_FILES;
+    int end = i + STBI__INFO_BATCH_FILES < batch->count ? i + STBI__INFO_BATCH_FILES : batch->count;
+    for (; i < end; ++i) {
+        stbi_info_result* r = &batch->results[i];
+        stbi__context s;
+        FILE* f = stbi__fopen(batch->filenames[i], "rb");
+        memset(r, 0, sizeof(*r));
+        if (!f) {
+            stbi__err("can't fopen", "Unable to open file");
+            continue;
+        }
+        stbi__start_file(&s, f);
+        r->ok = stbi__info_sniffed(&s, r);
+        fclose(f);
+    }
+}
+
+STBIDEF int stbi_info_many(char const* const* filenames, int count, stbi_info_result* results)
+{
+    stbi__info_batch batch;
+    int i, task_count, ok_count = 0;
+    if (count <= 0) return 0;
+    batch.filenames = filenames;
+    batch.results = results;
+    batch.count = count;
+    task_count = (count + STBI__INFO_BATCH_FILES - 1) / STBI__INFO_BATCH_FILES;
+    if (stbi__parallel_for && task_count > 1)
+        stbi__parallel_for(stbi__parallel_for_user, task_count, stbi__info_batch_task, &batch);
+    else
+        for (i = 0; i < task_count; ++i)
+            stbi__info_batch_task(&batch, i);
+    for (i = 0; i < count; ++i)
+        ok_count += results[i].ok;
+    return ok_count;
+}
 #endif // !STBI_NO_STDIO
 
 STBIDEF int stbi_info_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp)
@@ -1,63 +1,89 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "GLExtensions.h"
 #include "Shader.h"
+#include "ShaderCompiler.h"
+#include "ShaderHotReloader.h"
+#include "ShaderVariants.h"
+#include "UniformRingBuffer.h"
+#include "GLObjects.h"
+#include "GLStateCache.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "TextureManifest.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "std_image.h"
 #include <iostream>
+#include <vector>
+#include <string>
 
 const unsigned WINDOW_HEIGHT = 600;
 const unsigned WINDOW_WIDTH = 800;
+const unsigned VARIANT_VERTEX_COLOR = 1u << 0;
+const unsigned OBJECT_BLOCK_BINDING = 0;
 bool lineMode = false;
 bool stopper = false;
+bool vertexColorMode = false;
+bool vertexColorStopper = false;
+
+struct ObjectBlock {
+	Std140Mat4 model;
+};
 
 void windowSizeAdjustCallback(GLFWwindow* window, int width, int height) {
 	glViewport(0, 0, width, height);
 }
 
-void mapInputToGlfwState(GLFWwindow* window) {
+void mapInputToGlfwState(GLFWwindow* window, GLStateCache& glState) {
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
 		glfwSetWindowShouldClose(window, true);
 	}
 
 	if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS) {
 		if (lineMode && !stopper) {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			glState.polygonMode(GL_FILL);
 			lineMode = false;
 			stopper = true;
 		} else if (!lineMode && !stopper) {
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+			glState.polygonMode(GL_LINE);
 			lineMode = true;
 			stopper = true;
 		}
 	} else if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_RELEASE) {
 		stopper = false;
 	}
-}
-
-int main() {
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL) {
-		std::cout << "GLFWwindow object creation failed" << std::endl;
-		glfwTerminate();
-		return -1;
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) {
+		if (!vertexColorStopper) {
+			vertexColorMode = !vertexColorMode;
+			vertexColorStopper = true;
+		}
+	} else if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE) {
+		vertexColorStopper = false;
 	}
-	glfwMakeContextCurrent(window);
+}
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		std::cout << "GLAD setup failed" << std::endl;
-		glfwTerminate();
-		return -1;
+// Every GL object lives in this scope, so their destructors run while the context still exists
+void renderLoop(GLFWwindow* window) {
+	GLStateCache glState;
+
+	// Decoding and compilation run while the buffers below are set up
+	TextureLoader textureLoader(glState);
+	TextureCache textureCache(textureLoader);
+	// Header facts for every texture; only files changed since the last run are opened
+	TextureManifest textureManifest;
+	if (textureManifest.scan("src/textures", "texture_manifest.bin")) {
+		TextureManifestStats manifestStats = textureManifest.stats();
+		std::cout << "Texture manifest: " << manifestStats.textures << " textures, " << manifestStats.headersRead << " headers read in " << manifestStats.scanSeconds * 1000.0 << " ms" << std::endl;
 	}
+	// OpenGL expects the bottom row first; the decoder writes the rows in that order
+	TextureLoadOptions containerOptions;
+	containerOptions.flipVertically = true;
+	TextureHandle containerTexture = textureCache.get("src/textures/container.jpg", containerOptions);
 
-	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
-	glfwSetFramebufferSizeCallback(window, windowSizeAdjustCallback);
-
-	Shader shaderProgram("src/shaders/vertex.txt", "src/shaders/fragment.txt");
+	ShaderCompiler shaderCompiler;
+	ShaderHandle shaderHandle = shaderCompiler.queue("src/shaders/vertex.txt", "src/shaders/fragment.txt");
+	shaderCompiler.submit();
 
 	const float vboData[] = {
 		-0.5f, -0.5f, 0.0f,    1.0f, 0.0f, 0.0f,    0.0f, 0.0f, 
@@ -70,17 +96,15 @@ int main() {
 		3, 2, 1,
 	};
 
-	unsigned vao = 0;
-	glGenVertexArrays(1, &vao);
-	unsigned vbo = 0;
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	VertexArray vao = VertexArray::create();
+	std::vector<Buffer> quadBuffers = Buffer::createMany(2);
+	const Buffer& vbo = quadBuffers[0];
+	const Buffer& ebo = quadBuffers[1];
+	glState.bindBuffer(GL_ARRAY_BUFFER, vbo.id());
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vboData), vboData, GL_STATIC_DRAW);
-	unsigned ebo = 0;
-	glGenBuffers(1, &ebo);
 
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glState.bindVertexArray(vao.id());
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.id());
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(eboData), eboData, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
@@ -89,44 +113,95 @@ int main() {
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(3 * sizeof(float)));
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(6 * sizeof(float)));
 
-	glBindBuffer(GL_ARRAY_BUFFER, NULL);
-	glBindVertexArray(NULL);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, NULL);
-
-	unsigned texture = 0;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	int height = 0, width = 0, channels = 0;
-	unsigned char* imageData = stbi_load("src/textures/container.jpg", &width, &height, &channels, 0);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, imageData);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, NULL);
-	stbi_image_free(imageData);
+	Shader& shaderProgram = shaderHandle.get();
+	const UniformHandle textureSampler = shaderProgram.getUniformHandle("tahmTexture");
+	shaderProgram.use(glState);
+	shaderProgram.setUniform(textureSampler, 0);
+	shaderProgram.bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
+
+	ShaderVariants shaderVariants("src/shaders/vertex.txt", "src/shaders/fragment.txt", { "USE_VERTEX_COLOR" });
+	shaderVariants.bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
 
+	UniformRingBuffer uniformRing(64 * 1024);
+	const ObjectBlock quadBlock = { { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } } };
+
+	ShaderHotReloader shaderReloader;
+	shaderReloader.watch(shaderProgram, "src/shaders/vertex.txt", "src/shaders/fragment.txt");
+	shaderReloader.start(window);
+
+	double statsTime = glfwGetTime();
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
-		mapInputToGlfwState(window);
+		mapInputToGlfwState(window, glState);
+		textureLoader.update();
+		textureCache.update();
+
+		// Uniform values, locations and block bindings do not survive a swapped-in program
+		if (shaderReloader.update()) {
+			shaderProgram.use(glState);
+			shaderProgram.setUniform(shaderProgram.getUniformHandle("tahmTexture"), 0);
+			shaderProgram.bindUniformBlock("ObjectBlock", OBJECT_BLOCK_BINDING);
+		}
 
 		glClearColor(0.3f, 0.5f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 
-		shaderProgram.use();
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glBindVertexArray(vao);
+		uniformRing.beginFrame();
+		UniformAllocation quadUniforms = uniformRing.write(quadBlock);
+		uniformRing.finishWrites();
+		uniformRing.bind(OBJECT_BLOCK_BINDING, quadUniforms);
+
+		Shader& activeShader = vertexColorMode ? shaderVariants.get(VARIANT_VERTEX_COLOR) : shaderProgram;
+		activeShader.use(glState);
+		glState.bindTexture(0, GL_TEXTURE_2D, containerTexture.id());
+		glState.bindVertexArray(vao.id());
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, static_cast<void*>(0));
-		glBindVertexArray(NULL);
-		glUseProgram(NULL);
+		uniformRing.endFrame();
+
+		glState.endFrame();
+		if (glfwGetTime() - statsTime >= 1.0) {
+			GLStateCounters frameCounters = glState.lastFrameCounters();
+			TextureLoaderStats decodeStats = textureLoader.stats();
+			std::string title = "LearnOpenGL | state calls issued " + std::to_string(frameCounters.issued) + ", filtered " + std::to_string(frameCounters.filtered);
+			if (decodeStats.decoded != 0) {
+				title += " | decodes " + std::to_string(decodeStats.decoded) + ", avg " + std::to_string(decodeStats.decodeSeconds * 1000.0 / decodeStats.decoded) + " ms"
+					+ ", heap allocs " + std::to_string(decodeStats.heapAllocations) + ", arena allocs " + std::to_string(decodeStats.arenaAllocations);
+			}
+			glfwSetWindowTitle(window, title.c_str());
+			statsTime = glfwGetTime();
+		}
 
 		glfwSwapBuffers(window);
 	}
+}
+
+int main() {
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+	GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", NULL, NULL);
+	if (window == NULL) {
+		std::cout << "GLFWwindow object creation failed" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		std::cout << "GLAD setup failed" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+	glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+	glfwSetFramebufferSizeCallback(window, windowSizeAdjustCallback);
+
+	renderLoop(window);
 
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &vbo);
-	shaderProgram.kill();
+	reportGLObjectLeaks();
 	glfwTerminate();
 	return 0;
 }
\ No newline at end of file